@@ -0,0 +1,159 @@
+#include <benchmark/benchmark.h>
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCClient.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCSharedMemoryServer.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCStreamServer.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCWebSocketServer.h"
+#include "include/asyncjsonrpc/SharedMemoryClientTransport.h"
+#include "include/asyncjsonrpc/StreamClientTransport.h"
+#include "include/asyncjsonrpc/WebSocketClientTransport.h"
+#include <future>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include <boost/asio/io_context.hpp>
+
+// Calls per second of an AsyncJsonRPCClient, with 1 to 256 calls in flight: each iteration makes depth
+// calls with callbacks, in a burst on the client's strand, and waits for the last one. The server runs
+// on an io_context of its own (the shared-memory server on its channel's thread); the client's
+// io_context has one thread. Over the Unix socket and WebSocket, calls are also auto-batched (maxBatch
+// 64, zero window): batches/s is how many arrays were sent. Batching pays most on WebSocket, where every
+// unbatched call is a message of its own; the stream transports already write and read many frames at
+// once.
+
+using Rpc   = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+using local = boost::asio::local::stream_protocol;
+
+static void AddSumHandler(Rpc& rpc)
+{
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response) {
+            response = request["p0"].asInt() + request["p1"].asInt();
+        },
+        "sum", {{"p0", Json::ValueType::intValue}, {"p1", Json::ValueType::intValue}});
+}
+
+template <typename Transport>
+static void RunCalls(benchmark::State& state, AsyncJsonRPCClient<Transport>& client)
+{
+    const int   depth = static_cast<int>(state.range(0));
+    Json::Value params;
+    params["p0"] = 1;
+    params["p1"] = 2;
+    for (auto _ : state) {
+        std::promise<void> done;
+        int                remaining = depth; // on the client's strand
+        boost::asio::dispatch(client.get_executor(), [&]() {
+            for (int i = 0; i < depth; i++) {
+                client.asyncCall("sum", params, [&](boost::system::error_code ec, Json::Value) {
+                    if (ec) {
+                        state.SkipWithError("call failed");
+                    }
+                    if (--remaining == 0) {
+                        done.set_value();
+                    }
+                });
+            }
+        });
+        done.get_future().wait();
+    }
+    state.SetItemsProcessed(state.iterations() * depth);
+}
+
+static void BM_ClientUnix(benchmark::State& state)
+{
+    const std::string path = "/tmp/asyncjsonrpc_bench_" + std::to_string(getpid()) + ".sock";
+    ::unlink(path.c_str());
+    boost::asio::io_context              serverContext;
+    Rpc                                  rpc(serverContext.get_executor());
+    AsyncJsonRPCStreamServer<Rpc, local> server(rpc, serverContext, local::endpoint(path));
+    AddSumHandler(rpc);
+    server.start();
+    std::thread serverThread([&serverContext]() { serverContext.run(); });
+
+    boost::asio::io_context clientContext;
+    auto                    work = boost::asio::make_work_guard(clientContext);
+    std::thread             clientThread([&clientContext]() { clientContext.run(); });
+    {
+        auto transport = std::make_shared<StreamClientTransport<local>>(clientContext);
+        transport->connect(server.localEndpoint());
+        ClientOptions options;
+        options.maxBatch = static_cast<std::size_t>(state.range(1));
+        AsyncJsonRPCClient<StreamClientTransport<local>> client(transport, options);
+        RunCalls(state, client);
+        state.counters["batches"] =
+            benchmark::Counter(static_cast<double>(client.stats().batches), benchmark::Counter::kIsRate);
+    }
+
+    work.reset();
+    clientThread.join();
+    server.stop();
+    serverThread.join();
+    ::unlink(path.c_str());
+}
+
+static void BM_ClientWebSocket(benchmark::State& state)
+{
+    using tcp = boost::asio::ip::tcp;
+    boost::asio::io_context          serverContext;
+    Rpc                              rpc(serverContext.get_executor());
+    AsyncJsonRPCWebSocketServer<Rpc> server(rpc, serverContext,
+                                            tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    AddSumHandler(rpc);
+    server.start();
+    std::thread serverThread([&serverContext]() { serverContext.run(); });
+
+    boost::asio::io_context clientContext;
+    auto                    work = boost::asio::make_work_guard(clientContext);
+    std::thread             clientThread([&clientContext]() { clientContext.run(); });
+    {
+        auto transport = std::make_shared<WebSocketClientTransport>(clientContext);
+        transport->connect(server.localEndpoint());
+        ClientOptions options;
+        options.maxBatch = static_cast<std::size_t>(state.range(1));
+        AsyncJsonRPCClient<WebSocketClientTransport> client(transport, options);
+        RunCalls(state, client);
+        state.counters["batches"] =
+            benchmark::Counter(static_cast<double>(client.stats().batches), benchmark::Counter::kIsRate);
+    }
+
+    work.reset();
+    clientThread.join();
+    server.stop();
+    serverThread.join();
+}
+
+static void BM_ClientSharedMemory(benchmark::State& state)
+{
+    boost::asio::io_context             serverContext;
+    Rpc                                 rpc(serverContext.get_executor());
+    AsyncJsonRPCSharedMemoryServer<Rpc> server(rpc);
+    AddSumHandler(rpc);
+
+    boost::asio::io_context clientContext;
+    auto                    work = boost::asio::make_work_guard(clientContext);
+    std::thread             clientThread([&clientContext]() { clientContext.run(); });
+    {
+        AsyncJsonRPCClient<SharedMemoryClientTransport> client(
+            std::make_shared<SharedMemoryClientTransport>(clientContext, server.accept()));
+        RunCalls(state, client);
+    }
+
+    work.reset();
+    clientThread.join();
+    server.stop();
+}
+
+BENCHMARK(BM_ClientUnix)
+    ->ArgNames({"depth", "maxBatch"})
+    ->ArgsProduct({{1, 16, 256}, {1, 64}})
+    ->UseRealTime();
+BENCHMARK(BM_ClientWebSocket)
+    ->ArgNames({"depth", "maxBatch"})
+    ->ArgsProduct({{1, 16, 256}, {1, 64}})
+    ->UseRealTime();
+BENCHMARK(BM_ClientSharedMemory)->ArgName("depth")->Arg(1)->Arg(16)->Arg(256)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+
+#include "include/asyncjsonrpc/AsyncJsonRPCCluster.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Throughput of N producers (one per simulated connection) posting to one shared AsyncJsonRPC on an
+// N-thread pool, compared to an AsyncJsonRPCCluster with N shards, for 1 to 64 cores
+
+static const char* const BenchCall =
+    R"({"jsonrpc": "2.0", "method": "bench", "params": {"p1": 5, "p2": "some-session-token"}, "id": 1})";
+
+static const int CallsPerProducer = 5000;
+
+template <typename Rpc>
+static void RegisterHandler(Rpc& rpc)
+{
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response, std::size_t /*connectionId*/) {
+            response = request["p1"].asInt() + static_cast<int>(request["p2"].asString().size());
+        },
+        "bench", {{"p1", Json::ValueType::intValue}, {"p2", Json::ValueType::stringValue}});
+}
+
+template <typename PostFunction>
+static void RunProducers(int producerCount, std::atomic<int>& completed, PostFunction post)
+{
+    completed.store(0);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; p++) {
+        producers.emplace_back([p, &post]() {
+            const std::string call = BenchCall;
+            for (int i = 0; i < CallsPerProducer; i++) {
+                post(call, static_cast<std::size_t>(p));
+            }
+        });
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    while (completed.load() < producerCount * CallsPerProducer) {
+        std::this_thread::yield();
+    }
+}
+
+static void BM_SharedInstance(benchmark::State& state)
+{
+    const int                                                        threads = state.range(0);
+    WorkStealingThreadPool                                           pool(threads);
+    AsyncJsonRPC<WorkStealingThreadPool::executor_type, std::size_t> rpc(pool.get_executor());
+    std::atomic<int>                                                 completed{0};
+
+    RegisterHandler(rpc);
+    rpc.setResponseCallback([&completed](std::string&&) { completed.fetch_add(1); });
+
+    for (auto _ : state) {
+        RunProducers(threads, completed, [&rpc](const std::string& call, std::size_t connectionId) {
+            rpc.asyncPost(call, connectionId);
+        });
+    }
+    state.SetItemsProcessed(state.iterations() * threads * CallsPerProducer);
+    pool.join();
+}
+
+static void BM_Cluster(benchmark::State& state)
+{
+    const int                                 threads = state.range(0);
+    AsyncJsonRPCCluster<std::size_t>::Options options;
+    options.shardCount = threads;
+    options.pinShards  = true;
+    AsyncJsonRPCCluster<std::size_t> cluster(
+        [](const std::size_t& connectionId) { return connectionId; }, options);
+    std::atomic<int> completed{0};
+
+    RegisterHandler(cluster);
+    cluster.setResponseCallback([&completed](std::string&&) { completed.fetch_add(1); });
+
+    for (auto _ : state) {
+        RunProducers(threads, completed, [&cluster](const std::string& call, std::size_t connectionId) {
+            cluster.asyncPost(call, connectionId);
+        });
+    }
+    state.SetItemsProcessed(state.iterations() * threads * CallsPerProducer);
+    cluster.join();
+}
+
+BENCHMARK(BM_SharedInstance)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+BENCHMARK(BM_Cluster)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,343 @@
+#include <benchmark/benchmark.h>
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+// The dispatch pipeline: post() with different call shapes, batch sizes, errors, payloads and
+// instrumentation, and asyncPost() on io_context with 1 to N threads. Besides time, every benchmark
+// reports ops/s, s/op and heap allocations (operator new calls) per op.
+
+static std::atomic<std::uint64_t> AllocationCount{0};
+
+void* operator new(std::size_t size)
+{
+    AllocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// not inlined, so the compiler doesn't see free() called on memory from operator new and warn about it
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+using Rpc = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+
+// one operation is one post()/asyncPost(); allocations include the ones of the handler
+class OpCounter
+{
+    benchmark::State& state;
+    std::uint64_t     allocationsAtStart;
+
+public:
+    explicit OpCounter(benchmark::State& State)
+        : state(State), allocationsAtStart(AllocationCount.load())
+    {
+    }
+
+    void report(std::int64_t opsPerIteration)
+    {
+        const double allocations = static_cast<double>(AllocationCount.load() - allocationsAtStart);
+        const double ops         = static_cast<double>(state.iterations() * opsPerIteration);
+        state.SetItemsProcessed(state.iterations() * opsPerIteration);
+        state.counters["ops/s"]     = benchmark::Counter(ops, benchmark::Counter::kIsRate);
+        state.counters["s/op"]      = benchmark::Counter(ops, benchmark::Counter::kIsRate |
+                                                                  benchmark::Counter::kInvert);
+        state.counters["allocs/op"] = benchmark::Counter(allocations / ops);
+    }
+};
+
+static std::string ParamName(int i) { return "p" + std::to_string(i); }
+
+static std::string MakeCall(const std::string& method, const std::string& params, int id)
+{
+    std::string call = R"({"jsonrpc": "2.0", "method": ")" + method + "\"";
+    if (!params.empty()) {
+        call += R"(, "params": )" + params;
+    }
+    return call + R"(, "id": )" + std::to_string(id) + "}";
+}
+
+static std::string NamedParams(int count)
+{
+    std::string params = "{";
+    for (int i = 0; i < count; i++) {
+        params += (i > 0 ? ", \"" : "\"") + ParamName(i) + "\": " + std::to_string(i);
+    }
+    return params + "}";
+}
+
+static std::string PositionalParams(int count)
+{
+    std::string params = "[";
+    for (int i = 0; i < count; i++) {
+        params += (i > 0 ? ", " : "") + std::to_string(i);
+    }
+    return params + "]";
+}
+
+static void Sum(const Json::Value& request, Json::Value& response)
+{
+    int sum = 0;
+    for (const Json::Value& v : request) {
+        sum += v.asInt();
+    }
+    response = sum;
+}
+
+static void SingleCall(benchmark::State& state, bool byName)
+{
+    const int               paramCount = static_cast<int>(state.range(0));
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+
+    if (byName) {
+        std::map<std::string, Json::ValueType> params;
+        for (int i = 0; i < paramCount; i++) {
+            params[ParamName(i)] = Json::ValueType::intValue;
+        }
+        rpc.addHandler(Sum, "sum", params);
+    } else {
+        rpc.addHandler(Sum, "sum", std::vector<Json::ValueType>(paramCount, Json::ValueType::intValue));
+    }
+    std::size_t responseBytes = 0;
+    rpc.setResponseCallback([&responseBytes](std::string&& res) { responseBytes += res.size(); });
+
+    const std::string call =
+        MakeCall("sum", paramCount == 0 ? "" : (byName ? NamedParams : PositionalParams)(paramCount), 1);
+
+    OpCounter counter(state);
+    for (auto _ : state) {
+        rpc.post(call);
+    }
+    counter.report(1);
+    benchmark::DoNotOptimize(responseBytes);
+}
+
+static void BM_SingleCallByName(benchmark::State& state) { SingleCall(state, true); }
+static void BM_SingleCallByPosition(benchmark::State& state) { SingleCall(state, false); }
+
+BENCHMARK(BM_SingleCallByName)->Arg(0)->Arg(2)->Arg(20);
+BENCHMARK(BM_SingleCallByPosition)->Arg(0)->Arg(2)->Arg(20);
+
+static void BM_Batch(benchmark::State& state)
+{
+    const int               batchSize = static_cast<int>(state.range(0));
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+
+    rpc.addHandler(Sum, "sum", {{"p0", Json::ValueType::intValue}, {"p1", Json::ValueType::intValue}});
+    std::size_t responseBytes = 0;
+    rpc.setResponseCallback([&responseBytes](std::string&& res) { responseBytes += res.size(); });
+
+    std::string call = "[";
+    for (int i = 0; i < batchSize; i++) {
+        call += (i > 0 ? ", " : "") + MakeCall("sum", NamedParams(2), i);
+    }
+    call += "]";
+
+    OpCounter counter(state);
+    for (auto _ : state) {
+        rpc.post(call);
+    }
+    // one op is a whole batch; calls/s tells the per-call rate
+    counter.report(1);
+    state.counters["calls/s"] = benchmark::Counter(static_cast<double>(state.iterations() * batchSize),
+                                                   benchmark::Counter::kIsRate);
+    benchmark::DoNotOptimize(responseBytes);
+}
+
+BENCHMARK(BM_Batch)->Arg(1)->Arg(10)->Arg(100)->Arg(1000);
+
+enum ErrorKind
+{
+    ParseError,
+    UnknownMethod,
+    BadParams,
+    // every other call of a batch fails
+    MixedBatch
+};
+
+static void BM_Errors(benchmark::State& state)
+{
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+
+    rpc.addHandler(Sum, "sum", {{"p0", Json::ValueType::intValue}, {"p1", Json::ValueType::intValue}});
+    std::size_t responseBytes = 0;
+    rpc.setResponseCallback([&responseBytes](std::string&& res) { responseBytes += res.size(); });
+
+    std::string call;
+    switch (static_cast<ErrorKind>(state.range(0))) {
+    case ParseError:
+        state.SetLabel("parse error");
+        call = R"({"jsonrpc": "2.0", "method": "sum", "params": {"p0": 1, "p1": )";
+        break;
+    case UnknownMethod:
+        state.SetLabel("unknown method");
+        call = MakeCall("nosuchmethod", NamedParams(2), 1);
+        break;
+    case BadParams:
+        state.SetLabel("bad params");
+        call = MakeCall("sum", R"({"p0": "one", "p1": 2})", 1);
+        break;
+    case MixedBatch:
+        state.SetLabel("batch of 100, half failing");
+        call = "[";
+        for (int i = 0; i < 100; i++) {
+            call += (i > 0 ? ", " : "") + MakeCall(i % 2 ? "nosuchmethod" : "sum", NamedParams(2), i);
+        }
+        call += "]";
+        break;
+    }
+
+    OpCounter counter(state);
+    for (auto _ : state) {
+        rpc.post(call);
+    }
+    counter.report(1);
+    benchmark::DoNotOptimize(responseBytes);
+}
+
+BENCHMARK(BM_Errors)->DenseRange(ParseError, MixedBatch);
+
+static void BM_Payload(benchmark::State& state)
+{
+    const std::size_t       payloadSize = static_cast<std::size_t>(state.range(0));
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+
+    rpc.addHandler([](const Json::Value& request, Json::Value& response) { response = request["data"]; },
+                   "echo", {{"data", Json::ValueType::stringValue}});
+    std::size_t responseBytes = 0;
+    rpc.setResponseCallback([&responseBytes](std::string&& res) { responseBytes += res.size(); });
+
+    const std::string call = MakeCall("echo", R"({"data": ")" + std::string(payloadSize, 'x') + "\"}", 1);
+
+    OpCounter counter(state);
+    for (auto _ : state) {
+        rpc.post(call);
+    }
+    counter.report(1);
+    state.SetBytesProcessed(state.iterations() * static_cast<std::int64_t>(call.size()));
+    benchmark::DoNotOptimize(responseBytes);
+}
+
+BENCHMARK(BM_Payload)->Arg(1024)->Arg(1024 * 1024);
+
+enum Instrumentation
+{
+    NoInstrumentation,
+    Metrics,
+    CpuTime,
+    CpuTimeSampled,
+    PerfCounterStages
+};
+
+// the cost of the opt-in instrumentation, on the cheapest call
+static void BM_Instrumentation(benchmark::State& state)
+{
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+
+    rpc.addHandler(Sum, "sum", {{"p0", Json::ValueType::intValue}, {"p1", Json::ValueType::intValue}});
+    std::size_t responseBytes = 0;
+    rpc.setResponseCallback([&responseBytes](std::string&& res) { responseBytes += res.size(); });
+
+    CpuTimeAccountingOptions sampled;
+    sampled.sampleInterval = 16;
+    switch (static_cast<Instrumentation>(state.range(0))) {
+    case NoInstrumentation:
+        state.SetLabel("none");
+        break;
+    case Metrics:
+        state.SetLabel("metrics");
+        rpc.enableMetrics();
+        break;
+    case CpuTime:
+        state.SetLabel("cpu time");
+        rpc.enableCpuTimeAccounting();
+        break;
+    case CpuTimeSampled:
+        state.SetLabel("cpu time, 1 in 16 requests");
+        rpc.enableCpuTimeAccounting(sampled);
+        break;
+    case PerfCounterStages:
+        state.SetLabel(rpc.enablePerfCounters() ? "perf counters" : "perf counters (unavailable)");
+        break;
+    }
+    const std::string call = MakeCall("sum", NamedParams(2), 1);
+
+    OpCounter counter(state);
+    for (auto _ : state) {
+        rpc.post(call);
+    }
+    counter.report(1);
+    benchmark::DoNotOptimize(responseBytes);
+}
+
+BENCHMARK(BM_Instrumentation)->DenseRange(NoInstrumentation, PerfCounterStages);
+
+static const int AsyncCallsPerIteration = 10000;
+
+static void BM_AsyncPostIoContext(benchmark::State& state)
+{
+    const int               threadCount = static_cast<int>(state.range(0));
+    boost::asio::io_context executionContext(threadCount);
+    auto                    work = boost::asio::make_work_guard(executionContext);
+    Rpc                     rpc(executionContext.get_executor());
+
+    rpc.addHandler(Sum, "sum", {{"p0", Json::ValueType::intValue}, {"p1", Json::ValueType::intValue}});
+    std::atomic<int> completed{0};
+    rpc.setResponseCallback([&completed](std::string&&) { completed.fetch_add(1); });
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; i++) {
+        threads.emplace_back([&executionContext]() { executionContext.run(); });
+    }
+
+    const std::string call = MakeCall("sum", NamedParams(2), 1);
+
+    OpCounter counter(state);
+    for (auto _ : state) {
+        completed.store(0);
+        for (int i = 0; i < AsyncCallsPerIteration; i++) {
+            rpc.asyncPost(call);
+        }
+        while (completed.load() < AsyncCallsPerIteration) {
+            std::this_thread::yield();
+        }
+    }
+    counter.report(AsyncCallsPerIteration);
+
+    work.reset();
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+// 1, 2, 4, ... up to the number of cpus, and the number of cpus itself
+static void ThreadCounts(benchmark::internal::Benchmark* b)
+{
+    const int cpuCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int threads = 1; threads < cpuCount; threads *= 2) {
+        b->Arg(threads);
+    }
+    b->Arg(cpuCount);
+}
+
+BENCHMARK(BM_AsyncPostIoContext)->Apply(ThreadCounts)->UseRealTime();
+
+BENCHMARK_MAIN();
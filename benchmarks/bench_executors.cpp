@@ -0,0 +1,100 @@
+#include <benchmark/benchmark.h>
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/WorkStealingThreadPool.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+// asyncPost() throughput of the same trivial call on the different executors, with 1 to 64 threads
+
+static const char* const BenchCall =
+    R"({"jsonrpc": "2.0", "method": "bench", "params": {"p1": 5}, "id": 1})";
+
+static const int CallsPerIteration = 10000;
+
+class IoContextRunner
+{
+    boost::asio::io_context                                                  context;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    std::vector<std::thread>                                                 threads;
+
+public:
+    using executor_type = boost::asio::io_context::executor_type;
+
+    explicit IoContextRunner(int threadCount)
+        : context(threadCount), work(boost::asio::make_work_guard(context))
+    {
+        for (int i = 0; i < threadCount; i++) {
+            threads.emplace_back([this]() { context.run(); });
+        }
+    }
+    ~IoContextRunner()
+    {
+        work.reset();
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+    executor_type get_executor() { return context.get_executor(); }
+};
+
+class ThreadPoolRunner
+{
+    boost::asio::thread_pool pool;
+
+public:
+    using executor_type = boost::asio::thread_pool::executor_type;
+
+    explicit ThreadPoolRunner(int threadCount) : pool(threadCount) {}
+    ~ThreadPoolRunner() { pool.join(); }
+    executor_type get_executor() { return pool.get_executor(); }
+};
+
+class WorkStealingRunner
+{
+    WorkStealingThreadPool pool;
+
+public:
+    using executor_type = WorkStealingThreadPool::executor_type;
+
+    explicit WorkStealingRunner(int threadCount) : pool(static_cast<std::size_t>(threadCount)) {}
+    ~WorkStealingRunner() { pool.join(); }
+    executor_type get_executor() { return pool.get_executor(); }
+};
+
+template <typename Runner>
+static void BM_AsyncPost(benchmark::State& state)
+{
+    Runner                                       runner(static_cast<int>(state.range(0)));
+    AsyncJsonRPC<typename Runner::executor_type> rpc(runner.get_executor());
+    std::atomic<int>                             completed{0};
+
+    rpc.addHandler([](const Json::Value& request, Json::Value& response) { response = request["p1"]; },
+                   "bench", {{"p1", Json::ValueType::intValue}});
+    rpc.setResponseCallback([&completed](std::string&&) { completed.fetch_add(1); });
+
+    const std::string call = BenchCall;
+    for (auto _ : state) {
+        completed.store(0);
+        for (int i = 0; i < CallsPerIteration; i++) {
+            rpc.asyncPost(call);
+        }
+        while (completed.load() < CallsPerIteration) {
+            std::this_thread::yield();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * CallsPerIteration);
+}
+
+BENCHMARK_TEMPLATE(BM_AsyncPost, IoContextRunner)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_AsyncPost, ThreadPoolRunner)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_AsyncPost, WorkStealingRunner)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCHttpServer.h"
+#include <string>
+#include <thread>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/string_body.hpp>
+
+// Requests per second over loopback, one keep-alive connection, with 1 to 64 requests pipelined: the
+// client writes them at once, then reads the responses
+
+using Rpc      = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+using tcp      = boost::asio::ip::tcp;
+namespace http = boost::beast::http;
+
+static std::string HttpRequest()
+{
+    const std::string body = R"({"jsonrpc": "2.0", "method": "sum", "params": {"p0": 1, "p1": 2}, "id": 1})";
+    return "POST / HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\nContent-Length: " +
+           std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+static void BM_HttpPipelined(benchmark::State& state)
+{
+    const int depth = static_cast<int>(state.range(0));
+
+    boost::asio::io_context        serverContext;
+    Rpc                            rpc(serverContext.get_executor());
+    AsyncJsonRPCHttpServer<Rpc>    server(rpc, serverContext,
+                                          tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response) {
+            response = request["p0"].asInt() + request["p1"].asInt();
+        },
+        "sum", {{"p0", Json::ValueType::intValue}, {"p1", Json::ValueType::intValue}});
+    server.start();
+    std::thread serverThread([&serverContext]() { serverContext.run(); });
+
+    boost::asio::io_context   clientContext;
+    tcp::socket               socket(clientContext);
+    boost::beast::flat_buffer buffer;
+    socket.connect(server.localEndpoint());
+    socket.set_option(tcp::no_delay(true));
+
+    std::string requests;
+    for (int i = 0; i < depth; i++) {
+        requests += HttpRequest();
+    }
+    http::response<http::string_body> response;
+    for (auto _ : state) {
+        boost::asio::write(socket, boost::asio::buffer(requests));
+        for (int i = 0; i < depth; i++) {
+            response = {};
+            http::read(socket, buffer, response);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * depth);
+
+    const HttpServerStats stats = server.stats();
+    state.counters["requests/write"] =
+        static_cast<double>(stats.requests) / static_cast<double>(std::max<std::uint64_t>(stats.writes, 1));
+
+    socket.close();
+    server.stop();
+    serverThread.join();
+}
+
+BENCHMARK(BM_HttpPipelined)->RangeMultiplier(4)->Range(1, 64)->UseRealTime();
+
+BENCHMARK_MAIN();
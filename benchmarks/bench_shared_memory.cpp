@@ -0,0 +1,50 @@
+#include <benchmark/benchmark.h>
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCSharedMemoryServer.h"
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+
+// Round trips through a shared-memory channel, in one process: 1 to 64 requests are sent before their
+// responses are received, with the default spin-then-futex wait, and with busy polling on both sides
+// (a core each; compare with BM_StreamUnix of asyncjsonrpc_stream_bench)
+
+using Rpc = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+
+static void BM_SharedMemory(benchmark::State& state)
+{
+    const int depth = static_cast<int>(state.range(0));
+
+    SharedMemoryOptions options;
+    options.busyPoll = (state.range(1) != 0);
+    boost::asio::io_context             ioContext;
+    Rpc                                 rpc(ioContext.get_executor());
+    AsyncJsonRPCSharedMemoryServer<Rpc> server(rpc, options);
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response) {
+            response = request["p0"].asInt() + request["p1"].asInt();
+        },
+        "sum", {{"p0", Json::ValueType::intValue}, {"p1", Json::ValueType::intValue}});
+    SharedMemoryClient client(server.accept(), options);
+
+    const std::string request =
+        R"({"jsonrpc": "2.0", "method": "sum", "params": {"p0": 1, "p1": 2}, "id": 1})";
+    for (auto _ : state) {
+        for (int i = 0; i < depth; i++) {
+            client.send(request);
+        }
+        for (int i = 0; i < depth; i++) {
+            client.receive(
+                [](const char* response, std::size_t) { benchmark::DoNotOptimize(response); });
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * depth);
+}
+
+BENCHMARK(BM_SharedMemory)
+    ->ArgNames({"depth", "busy_poll"})
+    ->ArgsProduct({{1, 8, 64}, {0, 1}})
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,101 @@
+#include <benchmark/benchmark.h>
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCStreamServer.h"
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/write.hpp>
+
+// Requests per second over loopback TCP and a Unix socket, one connection, for every framing, with 1 to
+// 256 requests written at once before the responses are read; requests/read is how many the server
+// framed and ran per read() of its socket
+
+using Rpc = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+using tcp = boost::asio::ip::tcp;
+
+template <typename Protocol>
+static void StreamLoopback(benchmark::State& state, const typename Protocol::endpoint& endpoint)
+{
+    const Framing framing = static_cast<Framing>(state.range(0));
+    const int     depth   = static_cast<int>(state.range(1));
+
+    StreamServerOptions options;
+    options.framing = framing;
+    boost::asio::io_context                 serverContext;
+    Rpc                                     rpc(serverContext.get_executor());
+    AsyncJsonRPCStreamServer<Rpc, Protocol> server(
+        rpc, serverContext, endpoint, AsyncJsonRPCStreamServer<Rpc, Protocol>::DefaultContextFactory(),
+        options);
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response) {
+            response = request["p0"].asInt() + request["p1"].asInt();
+        },
+        "sum", {{"p0", Json::ValueType::intValue}, {"p1", Json::ValueType::intValue}});
+    server.start();
+    std::thread serverThread([&serverContext]() { serverContext.run(); });
+
+    boost::asio::io_context   clientContext;
+    typename Protocol::socket socket(clientContext);
+    socket.connect(server.localEndpoint());
+
+    const std::string request =
+        R"({"jsonrpc": "2.0", "method": "sum", "params": {"p0": 1, "p1": 2}, "id": 1})";
+    std::string requests;
+    for (int i = 0; i < depth; i++) {
+        StreamFramer::Encode(framing, request.data(), request.size(), requests);
+    }
+    StreamFramer framer(framing, 1024 * 1024);
+    std::string  buffer;
+    char         chunk[64 * 1024];
+    for (auto _ : state) {
+        boost::asio::write(socket, boost::asio::buffer(requests));
+        int responses = 0;
+        while (responses < depth) {
+            buffer.append(chunk, socket.read_some(boost::asio::buffer(chunk)));
+            buffer.erase(0, framer.consume(buffer.data(), buffer.size(),
+                                           [&](const char*, std::size_t) { responses++; }));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * depth);
+    state.SetLabel(FramingName(framing));
+
+    const StreamServerStats stats = server.stats();
+    state.counters["requests/read"] =
+        static_cast<double>(stats.requests) /
+        static_cast<double>(std::max<std::uint64_t>(stats.reads, 1));
+
+    socket.close();
+    server.stop();
+    serverThread.join();
+}
+
+static void BM_StreamTcp(benchmark::State& state)
+{
+    StreamLoopback<tcp>(state, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+}
+
+static void BM_StreamUnix(benchmark::State& state)
+{
+    const std::string path = "/tmp/asyncjsonrpc_bench_" + std::to_string(getpid()) + ".sock";
+    ::unlink(path.c_str());
+    using local = boost::asio::local::stream_protocol;
+    StreamLoopback<local>(state, local::endpoint(path));
+    ::unlink(path.c_str());
+}
+
+static void FramingsAndDepths(benchmark::internal::Benchmark* benchmark)
+{
+    for (Framing framing : {Framing::Ndjson, Framing::LengthPrefix, Framing::Netstring}) {
+        for (int depth : {1, 16, 256}) {
+            benchmark->Args({static_cast<int>(framing), depth});
+        }
+    }
+}
+
+BENCHMARK(BM_StreamTcp)->Apply(FramingsAndDepths)->UseRealTime();
+BENCHMARK(BM_StreamUnix)->Apply(FramingsAndDepths)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,205 @@
+#include <benchmark/benchmark.h>
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCUringServer.h"
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+// Requests per second from 100 up to 10000 concurrent loopback connections, with one request in flight
+// on each: the io_uring server against its asio/epoll fallback (AsyncJsonRPCStreamServer). The server
+// runs in a child process, so that each side has its own file descriptors; the client writes a request
+// to every connection, then reads every response, with blocking system calls (the same for both).
+// requests/submit is how many requests the io_uring server ran per io_uring_enter().
+
+using Rpc = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+
+struct ServerProcess
+{
+    pid_t            pid        = -1;
+    int              toServer   = -1; // closed to stop the server, which then sends its stats
+    int              fromServer = -1;
+    unsigned short   port       = 0;
+    bool             usesUring  = false;
+    UringServerStats stats{};
+
+    explicit ServerProcess(bool forceFallback)
+    {
+        int toChild[2];
+        int toParent[2];
+        if (::pipe(toChild) != 0 || ::pipe(toParent) != 0) {
+            return;
+        }
+        pid = ::fork();
+        if (pid == 0) {
+            ::close(toChild[1]);
+            ::close(toParent[0]);
+            Serve(forceFallback, toChild[0], toParent[1]);
+            ::_exit(0);
+        }
+        ::close(toChild[0]);
+        ::close(toParent[1]);
+        toServer   = toChild[1];
+        fromServer = toParent[0];
+        char ready[3];
+        if (::read(fromServer, ready, sizeof(ready)) == sizeof(ready)) {
+            port      = static_cast<unsigned short>((static_cast<unsigned char>(ready[0]) << 8) |
+                                               static_cast<unsigned char>(ready[1]));
+            usesUring = ready[2] != 0;
+        }
+    }
+
+    ~ServerProcess() { finish(); }
+
+    // stops the server, and reads its stats
+    void finish()
+    {
+        if (pid <= 0) {
+            return;
+        }
+        ::close(toServer);
+        ssize_t ignored = ::read(fromServer, &stats, sizeof(stats));
+        (void)ignored;
+        ::close(fromServer);
+        ::waitpid(pid, nullptr, 0);
+        pid = -1;
+    }
+
+private:
+    static void Serve(bool forceFallback, int control, int parent)
+    {
+        RaiseFileLimit();
+        UringServerOptions options;
+        options.forceFallback = forceFallback;
+        options.queueDepth    = 16384;
+        options.bufferCount   = 4096;
+        options.bufferSize    = 4096;
+        boost::asio::io_context      ioContext;
+        Rpc                          rpc(ioContext.get_executor());
+        AsyncJsonRPCUringServer<Rpc> server(
+            rpc, ioContext, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+            AsyncJsonRPCUringServer<Rpc>::DefaultContextFactory(), options);
+        rpc.addHandler(
+            [](const Json::Value& request, Json::Value& response) {
+                response = request["p0"].asInt() + request["p1"].asInt();
+            },
+            "sum", {{"p0", Json::ValueType::intValue}, {"p1", Json::ValueType::intValue}});
+        server.start();
+        auto        work = boost::asio::make_work_guard(ioContext);
+        std::thread thread([&ioContext]() { ioContext.run(); });
+
+        const unsigned short port     = server.localEndpoint().port();
+        const char           ready[3] = {static_cast<char>(port >> 8), static_cast<char>(port & 0xff),
+                                         static_cast<char>(server.usesUring())};
+        ssize_t ignored = ::write(parent, ready, sizeof(ready));
+        char    byte;
+        ignored = ::read(control, &byte, 1);
+
+        server.stop();
+        work.reset();
+        ioContext.stop();
+        thread.join();
+        const UringServerStats stats = server.stats();
+        ignored                      = ::write(parent, &stats, sizeof(stats));
+        (void)ignored;
+    }
+
+public:
+    static rlim_t RaiseFileLimit()
+    {
+        rlimit limit;
+        ::getrlimit(RLIMIT_NOFILE, &limit);
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+        return limit.rlim_cur;
+    }
+};
+
+static void BM_Loopback(benchmark::State& state)
+{
+    const int  connections = static_cast<int>(state.range(0));
+    const bool uring       = state.range(1) != 0;
+    if (ServerProcess::RaiseFileLimit() < static_cast<rlim_t>(connections + 64)) {
+        state.SkipWithError("the file descriptor limit is too low");
+        return;
+    }
+
+    ServerProcess server(!uring);
+    if (uring && !server.usesUring) {
+        state.SkipWithError("io_uring is unavailable");
+        return;
+    }
+
+    sockaddr_in address     = {};
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons(server.port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::vector<int> sockets;
+    for (int c = 0; c < connections; c++) {
+        const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            state.SkipWithError("connect failed");
+            break;
+        }
+        const int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        // closed with a reset: no TIME_WAIT to exhaust the ephemeral ports with
+        const linger reset = {1, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        sockets.push_back(fd);
+    }
+
+    const std::string request =
+        R"({"jsonrpc": "2.0", "method": "sum", "params": {"p0": 1, "p1": 2}, "id": 1})"
+        "\n";
+    char response[4096];
+    for (auto _ : state) {
+        if (sockets.size() < static_cast<std::size_t>(connections)) {
+            break;
+        }
+        for (int fd : sockets) {
+            if (::write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size())) {
+                state.SkipWithError("write failed");
+            }
+        }
+        for (int fd : sockets) {
+            // a response is a line
+            ssize_t size;
+            do {
+                size = ::read(fd, response, sizeof(response));
+            } while (size > 0 && response[size - 1] != '\n');
+            if (size <= 0) {
+                state.SkipWithError("read failed");
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * connections);
+    state.SetLabel(uring ? "io_uring" : "asio");
+
+    for (int fd : sockets) {
+        ::close(fd);
+    }
+    server.finish();
+    if (uring) {
+        state.counters["requests/submit"] =
+            static_cast<double>(server.stats.requests) /
+            static_cast<double>(std::max<std::uint64_t>(server.stats.submits, 1));
+    }
+}
+
+BENCHMARK(BM_Loopback)
+    ->ArgNames({"connections", "uring"})
+    ->ArgsProduct({{100, 1000, 10000}, {1, 0}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
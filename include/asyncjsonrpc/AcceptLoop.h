@@ -0,0 +1,121 @@
+#ifndef ACCEPTLOOP_H
+#define ACCEPTLOOP_H
+
+#include <atomic>
+#include <boost/asio/basic_socket_acceptor.hpp>
+#include <boost/asio/basic_waitable_timer.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+// The accepts of the servers: connections are accepted one after the other, each on a strand of its
+// own, and handed to the handler. A failed accept (out of file descriptors...) would most likely fail
+// again at once, in a busy loop: the next one waits for retryDelay instead. The acceptor and the retry
+// timer are on a strand of the loop, with the accepts and stop(): stop() can be called from any thread,
+// while any number of threads run the io_context.
+template <typename Protocol>
+class AcceptLoop
+{
+public:
+    using Endpoint = typename Protocol::endpoint;
+    using Socket   = typename Protocol::socket;
+    using Handler  = std::function<void(Socket&& socket)>; // on the loop's strand
+
+private:
+    using Strand = boost::asio::strand<boost::asio::io_context::executor_type>;
+    using Clock  = std::chrono::steady_clock;
+    using Timer  = boost::asio::basic_waitable_timer<Clock, boost::asio::wait_traits<Clock>, Strand>;
+
+    boost::asio::io_context&                             ioContext;
+    boost::asio::basic_socket_acceptor<Protocol, Strand> acceptor;
+    Timer                                                retry;
+    const std::chrono::milliseconds                      retryDelay;
+    Handler                                              handler;
+    std::atomic<std::uint64_t>                           errors{0};
+
+    void accept();
+    void onAccept(boost::system::error_code ec, Socket&& socket);
+
+public:
+    AcceptLoop(boost::asio::io_context& ioContextRef, const Endpoint& endpoint,
+               std::chrono::milliseconds RetryDelay);
+
+    AcceptLoop(const AcceptLoop&) = delete;
+    AcceptLoop& operator=(const AcceptLoop&) = delete;
+
+    Endpoint localEndpoint() const { return acceptor.local_endpoint(); }
+
+    // for a server that accepts on the socket itself (AsyncJsonRPCUringServer, with io_uring), and
+    // counts its failures with countError(); start() and stop() are then not used
+    typename Protocol::acceptor::native_handle_type nativeHandle() { return acceptor.native_handle(); }
+    void countError() { errors.fetch_add(1, std::memory_order_relaxed); }
+
+    void start(Handler Handler);
+
+    // stops accepting; a retry that waits is cancelled
+    void stop();
+
+    // each followed by retryDelay without accepting
+    std::uint64_t acceptErrors() const { return errors.load(std::memory_order_relaxed); }
+};
+
+template <typename Protocol>
+AcceptLoop<Protocol>::AcceptLoop(boost::asio::io_context& ioContextRef, const Endpoint& endpoint,
+                                 std::chrono::milliseconds RetryDelay)
+    : ioContext(ioContextRef), acceptor(boost::asio::make_strand(ioContextRef), endpoint),
+      retry(acceptor.get_executor()), retryDelay(RetryDelay)
+{
+}
+
+template <typename Protocol>
+void AcceptLoop<Protocol>::start(Handler Handler)
+{
+    handler = std::move(Handler);
+    boost::asio::dispatch(acceptor.get_executor(), [this]() { accept(); });
+}
+
+template <typename Protocol>
+void AcceptLoop<Protocol>::stop()
+{
+    boost::asio::post(acceptor.get_executor(), [this]() {
+        boost::system::error_code ignored;
+        acceptor.close(ignored);
+        retry.cancel();
+    });
+}
+
+template <typename Protocol>
+void AcceptLoop<Protocol>::accept()
+{
+    // the accepted socket is on the executor given here, the completion on the acceptor's
+    acceptor.async_accept(boost::asio::make_strand(ioContext),
+                          [this](boost::system::error_code ec, auto socket) {
+                              onAccept(ec, Socket(std::move(socket)));
+                          });
+}
+
+template <typename Protocol>
+void AcceptLoop<Protocol>::onAccept(boost::system::error_code ec, Socket&& socket)
+{
+    if (ec == boost::asio::error::operation_aborted || !acceptor.is_open()) {
+        return;
+    }
+    if (ec) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+        retry.expires_after(retryDelay);
+        retry.async_wait([this](boost::system::error_code waitEc) {
+            if (!waitEc && acceptor.is_open()) {
+                accept();
+            }
+        });
+        return;
+    }
+    handler(std::move(socket));
+    accept();
+}
+
+#endif // ACCEPTLOOP_H
@@ -2,30 +2,186 @@
 #define ASYNCJSONRPC_H
 
 #include "AsyncJsonRPCMethod.h"
+#include "CpuTimeAccounting.h"
+#include "Interceptors.h"
 #include "JsonErrorCode.h"
+#include "KeyedStrand.h"
+#include "PerfCounters.h"
+#include "Probes.h"
+#include "RecyclingAllocator.h"
+#include "RpcMetrics.h"
+#include "SlowRequestLog.h"
+#include "SubmissionBatcher.h"
+#include "TrafficCapture.h"
+#include <chrono>
 #include <functional>
 #include <jsoncpp/json/json.h>
+#include <memory>
 #include <stdexcept>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 
-template <typename Executor, typename... HandlerContext>
-class AsyncJsonRPC
+// the implementation of AsyncJsonRPC; InterceptorChain is an Interceptors<...>, empty by default
+template <typename Executor, typename InterceptorChain, typename... HandlerContext>
+class BasicAsyncJsonRPC
 {
     boost::container::flat_map<std::string, AsyncJsonRPCMethod<HandlerContext...>> methods;
 
+    InterceptorChain interceptorChain;
+
+    // contexts are moved along the call path, unless interceptors need them after the call
+    template <typename T>
+    using ForwardedContext = typename std::conditional<InterceptorChain::Empty, T&&, const T&>::type;
+
+    template <typename T>
+    static ForwardedContext<T> ForwardContext(typename std::remove_reference<T>::type& value)
+    {
+        return static_cast<ForwardedContext<T>>(value);
+    }
+
     std::function<void(std::string&&)> responseCallback = [](std::string&&) {};
 
     Executor executor;
 
+    KeyedStrand<Executor> orderedQueues;
+
+    std::unique_ptr<RpcMetrics> metrics;
+
+    std::unique_ptr<SlowRequestLog> slowRequests;
+
+    std::unique_ptr<CpuTimeAccounting>                     cpuTime;
+    std::function<std::uint64_t(const HandlerContext&...)> cpuTimeKeyFunction;
+
+    std::unique_ptr<PerfCounters> perfCounters;
+
+    std::unique_ptr<TrafficCaptureWriter>                  captureWriter;
+    std::function<std::uint64_t(const HandlerContext&...)> captureKeyFunction;
+
+    using Clock = std::chrono::steady_clock;
+
+    static std::uint64_t ToNanoseconds(Clock::duration duration)
+    {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+
+    static std::uint64_t NanosecondsSince(Clock::time_point start)
+    {
+        return ToNanoseconds(Clock::now() - start);
+    }
+
+    // what happened to a single call; only filled in (and the clock only read) when metrics, the
+    // slow-request log, cpu time accounting or perf counters are on
+    struct CallTrace
+    {
+        const std::string* methodName = nullptr; // null until the call is matched to a method
+        int                errorCode  = 0;
+        Clock::time_point  start;
+        Clock::time_point  invokeStart; // stays at the epoch if the handler is never reached
+        Clock::time_point  end;
+        bool               measureCpu  = false;
+        std::uint64_t      invokeCpuNs = 0;
+        PerfStageRecorder* perf        = nullptr;
+
+        std::uint64_t validateNs() const;
+        std::uint64_t invokeNs() const;
+    };
+
+    // what happened to a whole request (a single call or a batch)
+    struct RequestTrace
+    {
+        Clock::time_point start;
+        std::uint64_t     parseNs     = 0;
+        std::uint64_t     serializeNs = 0;
+        std::size_t       batchSize   = 0;
+        int               errorCode   = 0; // errors answered for the request as a whole
+
+        // summed over the calls
+        std::uint64_t validateNs = 0;
+        std::uint64_t invokeNs   = 0;
+
+        // thread cpu time, when this request is sampled for cpu time accounting
+        bool          measureCpu     = false;
+        std::uint64_t parseCpuNs     = 0;
+        std::uint64_t invokeCpuNs    = 0;
+        std::uint64_t serializeCpuNs = 0;
+
+        // the perf counters of the thread, when they're on (and it has any)
+        PerfStageRecorder* perf = nullptr;
+
+        // the slowest call, as offsets of its "method" and "params" in the request text
+        std::uint64_t  slowestCallNs = 0;
+        std::ptrdiff_t methodStart   = 0;
+        std::ptrdiff_t methodLimit   = 0;
+        std::ptrdiff_t paramsStart   = 0;
+        std::ptrdiff_t paramsLimit   = 0;
+
+        void addCall(const CallTrace& callTrace, const Json::Value& call);
+    };
+
+    static PerfStageRecorder* PerfOf(const CallTrace* trace) { return trace ? trace->perf : nullptr; }
+
     void basicRpcCallValidation(const Json::Value& root);
 
-    Json::Value getResultForSingleRpcCall(const Json::Value& root, HandlerContext... handlerContext);
+    Json::Value getResultForSingleRpcCall(const Json::Value& root, CallTrace* trace,
+                                          HandlerContext... handlerContext);
+
+    void invokeMethod(const AsyncJsonRPCMethod<HandlerContext...>& methodObj,
+                      const std::string& methodName, const Json::Value& params,
+                      const Json::Value& requestId, Json::Value& result, CallTrace* trace,
+                      HandlerContext... handlerContext);
 
     Json::Value getResponseForSingleRpcCall(const Json::Value& root, const Json::Value& requestId,
+                                            RequestTrace*      requestTrace,
                                             HandlerContext... handlerContext);
 
+    std::string serializeResponse(Json::Value& response, RequestTrace* trace,
+                                  const HandlerContext&... handlerContext);
+
+    std::string getResponseForRequest(const char* jsonCall, std::size_t size, RequestTrace* trace,
+                                      HandlerContext... handlerContext);
+
+    // post(); queuedAt is when asyncPost() queued the call, if the slow-request log is on. jsonString
+    // is the request as a std::string, when it was posted as one (the interceptors need one)
+    void process(const char* jsonCall, std::size_t size, const std::string* jsonString,
+                 Clock::time_point queuedAt, HandlerContext... handlerContext);
+
+    void logIfSlow(const char* jsonCall, std::size_t size, Clock::time_point queuedAt,
+                   const RequestTrace& trace);
+
+    Clock::time_point queueTimestamp() const
+    {
+        return slowRequests ? Clock::now() : Clock::time_point();
+    }
+
+    // a call and its context, moved (not copied) into the task that the executor runs
+    struct PostTask
+    {
+        BasicAsyncJsonRPC*            rpc;
+        std::string                   jsonCall;
+        std::tuple<HandlerContext...> handlerContext;
+        Clock::time_point             queuedAt;
+
+        void operator()() { invoke(std::index_sequence_for<HandlerContext...>()); }
+
+        template <std::size_t... I>
+        void invoke(std::index_sequence<I...>)
+        {
+            rpc->process(jsonCall.data(), jsonCall.size(), &jsonCall, queuedAt,
+                         std::move(std::get<I>(handlerContext))...);
+        }
+    };
+
+    std::unique_ptr<SubmissionBatcher<Executor, PostTask>> submissionBatcher;
+
 public:
-    AsyncJsonRPC(const Executor& executorRef) : executor(executorRef) {}
+    BasicAsyncJsonRPC(const Executor& executorRef, InterceptorChain Interceptors = InterceptorChain())
+        : interceptorChain(std::move(Interceptors)), executor(executorRef), orderedQueues(executorRef)
+    {
+    }
+
+    InterceptorChain& interceptors() { return interceptorChain; }
 
     template <typename Handler>
     void addHandler(Handler handler, const std::string& methodName,
@@ -64,14 +220,92 @@ public:
     static inline Json::Value PutResultInResponseContext(Json::Value&&      result,
                                                          const Json::Value& requestId);
 
+    // the contexts of a call, for code that stores them (the transports, ...)
+    using HandlerContextTuple = std::tuple<HandlerContext...>;
+
     void setResponseCallback(std::function<void(std::string&&)> callback);
 
     void post(const std::string& jsonCall, HandlerContext... handlerContext);
-    void asyncPost(const std::string& jsonCall, HandlerContext... handlerContext);
+
+    // the request is parsed where it is, without a copy into a std::string (with interceptors, it's
+    // copied for their onReceive()); it must stay valid until post() returns
+    void post(const char* jsonCall, std::size_t size, HandlerContext... handlerContext);
+    void asyncPost(std::string jsonCall, HandlerContext... handlerContext);
+
+    // like asyncPost, but runs the call inline if the caller is already running on the executor
+    void asyncDispatch(std::string jsonCall, HandlerContext... handlerContext);
+
+    // calls posted with equal ordering keys run in FIFO order; different keys run in parallel
+    template <typename Key>
+    void asyncPostOrdered(const Key& orderingKey, std::string jsonCall,
+                          HandlerContext... handlerContext);
+
+    std::size_t activeOrderingKeyCount();
+
+    // opt-in: asyncPost() stages calls and runs many of them per executor task; not thread-safe, call
+    // it before posting
+    void
+    enableSubmissionBatching(const SubmissionBatchingOptions& options = SubmissionBatchingOptions());
+
+    SubmissionBatchingStats submissionBatchingStats() const;
+
+    // opt-in: per-method call and error counts, stage latencies and request/response sizes; not
+    // thread-safe, call it before posting. With registerStatsMethod, the "rpc.stats" method returns
+    // metricsSnapshot().toJsonValue()
+    void enableMetrics(bool registerStatsMethod = false);
+
+    bool metricsEnabled() const;
+
+    // merges the data of all threads; an empty snapshot if metrics aren't enabled
+    RpcMetricsSnapshot metricsSnapshot() const;
+
+    // opt-in: requests slower than options.threshold, end to end, are kept with the time spent in
+    // the executor's queue, parsing, validating, in the handler and serializing (see SlowRequestLog.h);
+    // not thread-safe, call it before posting. With registerDumpMethod, the "rpc.slowRequests"
+    // method returns the log as json
+    void enableSlowRequestLog(const SlowRequestLogOptions& options = SlowRequestLogOptions(),
+                              bool                         registerDumpMethod = false);
+
+    // null if the slow-request log isn't enabled
+    SlowRequestLog* slowRequestLog() const;
+
+    // maps the context of a request to a 64-bit key (the tenant, the user, ...)
+    using ContextKeyFunction = std::function<std::uint64_t(const HandlerContext&...)>;
+
+    // opt-in: the thread cpu time of handlers, per method, and of whole requests (parse, handlers and
+    // serialize), per context key; see CpuTimeAccounting.h. Without a key function, keys are 0. Not
+    // thread-safe, call it before posting
+    void enableCpuTimeAccounting(const CpuTimeAccountingOptions& options = CpuTimeAccountingOptions(),
+                                 ContextKeyFunction              keyFunction = ContextKeyFunction());
+
+    // an empty snapshot if cpu time accounting isn't enabled
+    CpuTimeSnapshot cpuTimeSnapshot() const;
+
+    // opt-in: cycles, instructions, cache and branch misses of the parse, lookup, validate, invoke and
+    // serialize stages, counted per thread with perf_event_open (see PerfCounters.h). Returns false,
+    // and stays off, if no counter can be opened on the calling thread. Not thread-safe, call it
+    // before posting
+    bool enablePerfCounters();
+
+    // an empty snapshot if perf counters aren't enabled
+    PerfCountersSnapshot perfCountersSnapshot() const;
+
+    // opt-in: post() appends every request, with its context key and arrival time, to a capture file
+    // that TrafficCaptureReader can replay (see TrafficCapture.h). Without a key function, keys are 0.
+    // Not thread-safe, call it before posting
+    void enableCapture(const std::string& fileName,
+                       ContextKeyFunction keyFunction = ContextKeyFunction());
+
+    // flushes and closes the capture file; can be called while calls are running
+    void stopCapture();
+
+    // why the capture file failed (it's closed at the first failed write); empty if it hasn't
+    std::string captureError() const;
 };
 
-template <typename ExecutionContext, typename... HandlerContext>
-Json::Value AsyncJsonRPC<ExecutionContext, HandlerContext...>::PutResultInResponseContext(
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+Json::Value
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::PutResultInResponseContext(
     Json::Value&& result, const Json::Value& requestId)
 {
     Json::Value response;
@@ -82,15 +316,16 @@ Json::Value AsyncJsonRPC<ExecutionContext, HandlerContext...>::PutResultInRespon
     return response;
 }
 
-template <typename ExecutionContext, typename... HandlerContext>
-void AsyncJsonRPC<ExecutionContext, HandlerContext...>::setResponseCallback(
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::setResponseCallback(
     std::function<void(std::string&&)> callback)
 {
     responseCallback = callback;
 }
 
-template <typename ExecutionContext, typename... HandlerContext>
-void AsyncJsonRPC<ExecutionContext, HandlerContext...>::basicRpcCallValidation(const Json::Value& root)
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::basicRpcCallValidation(
+    const Json::Value& root)
 {
     if (!root.isMember("method")) {
         throw JsonErrorCode::make_InvalidRequest();
@@ -114,20 +349,72 @@ void AsyncJsonRPC<ExecutionContext, HandlerContext...>::basicRpcCallValidation(c
     }
 }
 
-template <typename ExecutionContext, typename... HandlerContext>
-Json::Value AsyncJsonRPC<ExecutionContext, HandlerContext...>::getResultForSingleRpcCall(
-    const Json::Value& root, HandlerContext... handlerContext)
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+std::uint64_t
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::CallTrace::validateNs() const
+{
+    const Clock::time_point validateEnd = (invokeStart == Clock::time_point() ? end : invokeStart);
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(validateEnd - start).count());
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+std::uint64_t
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::CallTrace::invokeNs() const
+{
+    if (invokeStart == Clock::time_point()) {
+        return 0;
+    }
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - invokeStart).count());
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::RequestTrace::addCall(
+    const CallTrace& callTrace, const Json::Value& call)
+{
+    validateNs += callTrace.validateNs();
+    invokeNs += callTrace.invokeNs();
+    invokeCpuNs += callTrace.invokeCpuNs;
+
+    // offsets are set by the parser, so this costs no copy; the text is only cut out if the request
+    // turns out to be slow
+    const std::uint64_t callNs = ToNanoseconds(callTrace.end - callTrace.start);
+    if (callNs >= slowestCallNs) {
+        slowestCallNs = callNs;
+        methodStart   = call["method"].getOffsetStart();
+        methodLimit   = call["method"].getOffsetLimit();
+        paramsStart   = call["params"].getOffsetStart();
+        paramsLimit   = call["params"].getOffsetLimit();
+    }
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+Json::Value
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::getResultForSingleRpcCall(
+    const Json::Value& root, CallTrace* trace, HandlerContext... handlerContext)
 {
     const std::string& methodName = root["method"].asString();
 
-    auto methodIt = methods.find(methodName);
+    PerfStageScope lookup(PerfOf(trace), PerfStage::Lookup);
+    auto           methodIt = methods.find(methodName);
+    lookup.end();
     if (methodIt == methods.cend()) {
         throw JsonErrorCode::make_MethodNotFound(root["id"]);
     }
 
+    if (ASYNCJSONRPC_PROBE_ENABLED(method_resolved)) {
+        ASYNCJSONRPC_PROBE2(method_resolved, methodName.c_str(), ProbeRequestId(root["id"]).c_str());
+    }
+
     const AsyncJsonRPCMethod<HandlerContext...>& methodObj = methodIt->second;
+    if (trace) {
+        // the key in the method table, so it outlives the call
+        trace->methodName = &methodIt->first;
+    }
 
     // if number of params is > 0, make sure there is a params object
+    PerfStageScope validation(PerfOf(trace), PerfStage::Validate);
     if (!root.isMember("params") && methodObj.parameterCount() > 0) {
         throw JsonErrorCode::make_InvalidParams(root["id"]);
     }
@@ -136,40 +423,124 @@ Json::Value AsyncJsonRPC<ExecutionContext, HandlerContext...>::getResultForSingl
     if (methodObj.parameterCount() > 0) {
         const Json::Value& paramsObj = root["params"];
         methodObj.verifyParameterTypes(paramsObj, root["id"]);
-        methodObj.invoke(paramsObj, result, std::forward<HandlerContext>(handlerContext)...);
+        validation.end();
+        invokeMethod(methodObj, methodIt->first, paramsObj, root["id"], result, trace,
+                     std::forward<HandlerContext>(handlerContext)...);
     } else {
-        methodObj.invoke(Json::Value(), result, std::forward<HandlerContext>(handlerContext)...);
+        validation.end();
+        invokeMethod(methodObj, methodIt->first, Json::Value(), root["id"], result, trace,
+                     std::forward<HandlerContext>(handlerContext)...);
     }
 
     return result;
 }
 
-template <typename ExecutionContext, typename... HandlerContext>
-Json::Value AsyncJsonRPC<ExecutionContext, HandlerContext...>::getResponseForSingleRpcCall(
-    const Json::Value& root, const Json::Value& requestId, HandlerContext... handlerContext)
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::invokeMethod(
+    const AsyncJsonRPCMethod<HandlerContext...>& methodObj, const std::string& methodName,
+    const Json::Value& params, const Json::Value& requestId, Json::Value& result, CallTrace* trace,
+    HandlerContext... handlerContext)
+{
+    interceptorChain.forEach([&](auto& interceptor) {
+        interceptor.beforeInvoke(methodName, params, handlerContext...);
+    });
+    if (trace) {
+        trace->invokeStart = Clock::now();
+    }
+    if (ASYNCJSONRPC_PROBE_ENABLED(handler_start)) {
+        ASYNCJSONRPC_PROBE2(handler_start, methodName.c_str(), ProbeRequestId(requestId).c_str());
+    }
+    std::uint64_t* invokeCpuNs = (trace && trace->measureCpu ? &trace->invokeCpuNs : nullptr);
+    if (InterceptorChain::Empty) {
+        {
+            ThreadCpuTimer cpuTimer(invokeCpuNs);
+            PerfStageScope invocation(PerfOf(trace), PerfStage::Invoke);
+            methodObj.invoke(params, result, std::forward<HandlerContext>(handlerContext)...);
+        }
+        if (ASYNCJSONRPC_PROBE_ENABLED(handler_end)) {
+            ASYNCJSONRPC_PROBE2(handler_end, methodName.c_str(), ProbeRequestId(requestId).c_str());
+        }
+        return;
+    }
+
+    try {
+        ThreadCpuTimer cpuTimer(invokeCpuNs);
+        PerfStageScope invocation(PerfOf(trace), PerfStage::Invoke);
+        methodObj.invoke(params, result, ForwardContext<HandlerContext>(handlerContext)...);
+    } catch (std::exception& ex) {
+        interceptorChain.forEach([&](auto& interceptor) {
+            interceptor.afterInvoke(methodName, result, &ex, handlerContext...);
+        });
+        throw;
+    }
+    if (ASYNCJSONRPC_PROBE_ENABLED(handler_end)) {
+        ASYNCJSONRPC_PROBE2(handler_end, methodName.c_str(), ProbeRequestId(requestId).c_str());
+    }
+    interceptorChain.forEach([&](auto& interceptor) {
+        interceptor.afterInvoke(methodName, result, nullptr, handlerContext...);
+    });
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+Json::Value
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::getResponseForSingleRpcCall(
+    const Json::Value& root, const Json::Value& requestId, RequestTrace* requestTrace,
+    HandlerContext... handlerContext)
 {
+    CallTrace  callTrace;
+    CallTrace* trace = nullptr;
+    if (requestTrace) {
+        trace             = &callTrace;
+        trace->start      = Clock::now();
+        trace->measureCpu = requestTrace->measureCpu;
+        trace->perf       = requestTrace->perf;
+    }
+
+    Json::Value response;
     try {
         // validate basic properties (for example, that "id" exists)
-        basicRpcCallValidation(root);
+        {
+            PerfStageScope validation(PerfOf(trace), PerfStage::Validate);
+            basicRpcCallValidation(root);
+        }
 
         // single request
         Json::Value result =
-            getResultForSingleRpcCall(root, std::forward<HandlerContext>(handlerContext)...);
+            getResultForSingleRpcCall(root, trace, std::forward<HandlerContext>(handlerContext)...);
 
         // create the response string
-        return PutResultInResponseContext(std::move(result), requestId);
+        response = PutResultInResponseContext(std::move(result), requestId);
     } catch (JsonErrorCode& ex) {
         // create response from json error
         ex.setRequestId(root["id"]);
-        return ex.toJsonRpcResponse();
+        callTrace.errorCode = ex.getCode();
+        response            = ex.toJsonRpcResponse();
+        ProbeErrorEmitted(ex.getCode(), &root);
     } catch (std::exception& ex) {
         // create response from error
-        return JsonErrorCode::make_InternalError(root["id"]).toJsonRpcResponse();
+        JsonErrorCode error = JsonErrorCode::make_InternalError(root["id"]);
+        callTrace.errorCode = error.getCode();
+        response            = error.toJsonRpcResponse();
+        ProbeErrorEmitted(error.getCode(), &root);
     }
+
+    if (trace) {
+        trace->end = Clock::now();
+        if (metrics) {
+            metrics->recordCall(trace->methodName, trace->errorCode, trace->validateNs(),
+                                trace->invokeNs());
+        }
+        if (trace->measureCpu && trace->methodName) {
+            cpuTime->recordCall(*trace->methodName, trace->invokeCpuNs);
+        }
+        requestTrace->addCall(callTrace, root);
+    }
+    return response;
 }
 
-template <typename ExecutionContext, typename... HandlerContext>
-void AsyncJsonRPC<ExecutionContext, HandlerContext...>::removeHandler(const std::string& methodName)
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::removeHandler(
+    const std::string& methodName)
 {
     if (methods.find(methodName) == methods.end()) {
         throw std::runtime_error("Method " + methodName + " does not exist");
@@ -177,44 +548,190 @@ void AsyncJsonRPC<ExecutionContext, HandlerContext...>::removeHandler(const std:
     methods.erase(methodName);
 }
 
-template <typename ExecutionContext, typename... HandlerContext>
-bool AsyncJsonRPC<ExecutionContext, HandlerContext...>::handlerExists(
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+bool BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::handlerExists(
     const std::string& methodName) const
 {
     return methods.find(methodName) != methods.end();
 }
 
-template <typename ExecutionContext, typename... HandlerContext>
-std::size_t AsyncJsonRPC<ExecutionContext, HandlerContext...>::handlerCount() const
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+std::size_t
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::handlerCount() const
 {
     return methods.size();
 }
 
-template <typename ExecutionContext, typename... HandlerContext>
-void AsyncJsonRPC<ExecutionContext, HandlerContext...>::post(const std::string& jsonCall,
-                                                             HandlerContext... handlerContext)
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::post(
+    const std::string& jsonCall, HandlerContext... handlerContext)
+{
+    process(jsonCall.data(), jsonCall.size(), &jsonCall, Clock::time_point(),
+            std::forward<HandlerContext>(handlerContext)...);
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::post(
+    const char* jsonCall, std::size_t size, HandlerContext... handlerContext)
+{
+    process(jsonCall, size, nullptr, Clock::time_point(),
+            std::forward<HandlerContext>(handlerContext)...);
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::process(
+    const char* jsonCall, std::size_t size, const std::string* jsonString, Clock::time_point queuedAt,
+    HandlerContext... handlerContext)
+{
+    ASYNCJSONRPC_PROBE2(request_received, jsonCall, size);
+
+    RequestTrace requestTrace;
+    requestTrace.measureCpu = (cpuTime && cpuTime->sampleNext());
+    requestTrace.perf       = (perfCounters ? perfCounters->beginRequest() : nullptr);
+
+    const bool    tracing = (metrics || slowRequests || requestTrace.measureCpu || requestTrace.perf);
+    RequestTrace* trace   = (tracing ? &requestTrace : nullptr);
+    if (slowRequests) {
+        requestTrace.start = Clock::now();
+    }
+    // before the context is moved into the call
+    const std::uint64_t cpuTimeKey =
+        (requestTrace.measureCpu && cpuTimeKeyFunction ? cpuTimeKeyFunction(handlerContext...) : 0);
+
+    if (captureWriter) {
+        captureWriter->append(jsonCall, size,
+                              captureKeyFunction ? captureKeyFunction(handlerContext...) : 0,
+                              TrafficCaptureWriter::Now());
+    }
+
+    if (!InterceptorChain::Empty) {
+        const std::string  copy    = (jsonString ? std::string() : std::string(jsonCall, size));
+        const std::string& request = (jsonString ? *jsonString : copy);
+        interceptorChain.forEach(
+            [&](auto& interceptor) { interceptor.onReceive(request, handlerContext...); });
+    }
+
+    std::string response = getResponseForRequest(jsonCall, size, trace,
+                                                  ForwardContext<HandlerContext>(handlerContext)...);
+
+    if (metrics) {
+        metrics->recordRequest(trace->parseNs, trace->serializeNs, trace->batchSize, size,
+                               response.size(), trace->errorCode);
+    }
+    if (slowRequests) {
+        logIfSlow(jsonCall, size, queuedAt, requestTrace);
+    }
+    if (requestTrace.perf) {
+        perfCounters->endRequest(requestTrace.perf);
+    }
+    if (requestTrace.measureCpu) {
+        cpuTime->recordRequest(cpuTimeKey, requestTrace.parseCpuNs, requestTrace.invokeCpuNs,
+                               requestTrace.serializeCpuNs);
+    }
+    interceptorChain.forEach(
+        [&](auto& interceptor) { interceptor.onSend(response, handlerContext...); });
+    ASYNCJSONRPC_PROBE2(response_emitted, response.size(), size);
+    responseCallback(std::move(response));
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::logIfSlow(
+    const char* jsonCall, std::size_t size, Clock::time_point queuedAt, const RequestTrace& trace)
+{
+    const std::uint64_t queueWaitNs =
+        (queuedAt == Clock::time_point() ? 0 : ToNanoseconds(trace.start - queuedAt));
+    const std::uint64_t totalNs = queueWaitNs + NanosecondsSince(trace.start);
+    if (!slowRequests->isSlow(totalNs)) {
+        return;
+    }
+
+    const std::size_t maxParamsSize = slowRequests->logOptions().maxParamsSize;
+    slowRequests->record([&](SlowRequestRecord& record) {
+        // the method is a json string: without its quotes (escapes are kept as they are)
+        std::ptrdiff_t methodStart = trace.methodStart;
+        std::ptrdiff_t methodLimit = trace.methodLimit;
+        if (methodLimit - methodStart >= 2 && jsonCall[methodStart] == '"') {
+            methodStart++;
+            methodLimit--;
+        }
+        record.method.assign(jsonCall + methodStart, methodLimit - methodStart);
+        record.paramsTruncated = SlowRequestLog::AssignTruncated(
+            record.params, jsonCall + trace.paramsStart, trace.paramsLimit - trace.paramsStart,
+            maxParamsSize);
+        record.timestampNs  = TrafficCaptureWriter::Now();
+        record.requestBytes = size;
+        record.batchSize    = trace.batchSize;
+        record.errorCode    = trace.errorCode;
+        record.totalNs      = totalNs;
+        record.queueWaitNs  = queueWaitNs;
+        record.parseNs      = trace.parseNs;
+        record.validateNs   = trace.validateNs;
+        record.invokeNs     = trace.invokeNs;
+        record.serializeNs  = trace.serializeNs;
+    });
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+std::string
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::serializeResponse(
+    Json::Value& response, RequestTrace* trace, const HandlerContext&... handlerContext)
+{
+    interceptorChain.forEach(
+        [&](auto& interceptor) { interceptor.beforeSerialize(response, handlerContext...); });
+
+    if (!trace) {
+        return JsonErrorCode::JsonValueToString(response);
+    }
+    ThreadCpuTimer          cpuTimer(trace->measureCpu ? &trace->serializeCpuNs : nullptr);
+    PerfStageScope          serialization(trace->perf, PerfStage::Serialize);
+    const Clock::time_point start       = Clock::now();
+    std::string             responseStr = JsonErrorCode::JsonValueToString(response);
+    trace->serializeNs                  = NanosecondsSince(start);
+    return responseStr;
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+std::string
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::getResponseForRequest(
+    const char* jsonCall, std::size_t size, RequestTrace* trace, HandlerContext... handlerContext)
 {
     try {
 
+        Clock::time_point parseStart;
+        if (trace) {
+            parseStart = Clock::now();
+        }
         Json::Reader reader;
         Json::Value  root_;
-        bool         success = reader.parse(jsonCall, root_, false);
+        bool         success;
+        {
+            ThreadCpuTimer cpuTimer(trace && trace->measureCpu ? &trace->parseCpuNs : nullptr);
+            PerfStageScope parsing(trace ? trace->perf : nullptr, PerfStage::Parse);
+            success = reader.parse(jsonCall, jsonCall + size, root_, false);
+        }
+        if (trace) {
+            trace->parseNs = NanosecondsSince(parseStart);
+        }
         if (!success) {
-            responseCallback(JsonErrorCode::make_ParseError().toJsonRpcResponseStr());
-            return;
+            throw JsonErrorCode::make_ParseError();
         }
         const Json::Value& root = root_;
 
+        interceptorChain.forEach(
+            [&](auto& interceptor) { interceptor.afterParse(root, handlerContext...); });
+
         // requests can either be batch requests (array type) or single requests, in an object
         if (root.type() == Json::ValueType::arrayValue) {
             // batch request
             for (unsigned i = 0; i < root.size(); i++) {
                 // inside the array there should be objects, this protects from infinite recursion
                 if (root[i].type() != Json::ValueType::objectValue) {
-                    responseCallback(JsonErrorCode::make_ParseError().toJsonRpcResponseStr());
-                    return;
+                    throw JsonErrorCode::make_ParseError();
                 }
             }
+            if (trace) {
+                trace->batchSize = root.size();
+            }
             // prepare the responses and put them in an array
             Json::Value arrayResponse = Json::Value(Json::arrayValue);
             for (unsigned i = 0; i < root.size(); i++) {
@@ -222,12 +739,12 @@ void AsyncJsonRPC<ExecutionContext, HandlerContext...>::post(const std::string&
                 const Json::Value& idVal = (root[i].isMember("id") ? root[i]["id"] : Json::Value());
 
                 // process every single request, and add it to the response array
-                Json::Value response = getResponseForSingleRpcCall(
-                    root[i], idVal, std::forward<HandlerContext>(handlerContext)...);
+                // the context is copied, not forwarded, because every element of the batch needs it
+                Json::Value response =
+                    getResponseForSingleRpcCall(root[i], idVal, trace, handlerContext...);
                 arrayResponse.append(response);
             }
-            std::string arrayResponseStr = JsonErrorCode::JsonValueToString(arrayResponse);
-            responseCallback(std::move(arrayResponseStr));
+            return serializeResponse(arrayResponse, trace, handlerContext...);
 
         } else if (root.type() == Json::ValueType::objectValue) {
             // validate basic properties (for example, that "id" exists)
@@ -235,32 +752,234 @@ void AsyncJsonRPC<ExecutionContext, HandlerContext...>::post(const std::string&
 
             // single request
             Json::Value response = getResponseForSingleRpcCall(
-                root, root["id"], std::forward<HandlerContext>(handlerContext)...);
+                root, root["id"], trace, ForwardContext<HandlerContext>(handlerContext)...);
 
             // the result as string
-            responseCallback(JsonErrorCode::JsonValueToString(response));
+            return serializeResponse(response, trace, handlerContext...);
 
         } else {
-            responseCallback(JsonErrorCode::make_ParseError().toJsonRpcResponseStr());
-            return;
+            throw JsonErrorCode::make_ParseError();
         }
 
     } catch (JsonErrorCode& ex) {
-        responseCallback(ex.toJsonRpcResponseStr());
-        return;
+        if (trace) {
+            trace->errorCode = ex.getCode();
+        }
+        ProbeErrorEmitted(ex.getCode(), nullptr);
+        Json::Value response = ex.toJsonRpcResponse();
+        return serializeResponse(response, trace, handlerContext...);
     } catch (std::exception& ex) {
-        responseCallback(JsonErrorCode::make_InternalError().toJsonRpcResponseStr());
-        return;
+        JsonErrorCode error = JsonErrorCode::make_InternalError();
+        if (trace) {
+            trace->errorCode = error.getCode();
+        }
+        ProbeErrorEmitted(error.getCode(), nullptr);
+        Json::Value response = error.toJsonRpcResponse();
+        return serializeResponse(response, trace, handlerContext...);
+    }
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::asyncPost(
+    std::string jsonCall, HandlerContext... handlerContext)
+{
+    // the call and handlerContext are deliberately passed by value; they're moved into the task, whose
+    // memory comes from the recycling pool, so posting doesn't allocate in steady state
+    PostTask task{this, std::move(jsonCall), std::make_tuple(std::move(handlerContext)...),
+                  queueTimestamp()};
+    if (submissionBatcher) {
+        submissionBatcher->submit(std::move(task));
+    } else {
+        executor.post(std::move(task), RecyclingAllocator<char>());
+    }
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::asyncDispatch(
+    std::string jsonCall, HandlerContext... handlerContext)
+{
+    executor.dispatch(
+        PostTask{this, std::move(jsonCall), std::make_tuple(std::move(handlerContext)...),
+                 queueTimestamp()},
+        RecyclingAllocator<char>());
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+template <typename Key>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::asyncPostOrdered(
+    const Key& orderingKey, std::string jsonCall, HandlerContext... handlerContext)
+{
+    // keys with colliding hashes share a queue, which costs parallelism but never breaks ordering
+    const std::uint64_t key = std::hash<Key>()(orderingKey);
+    orderedQueues.post(key, PostTask{this, std::move(jsonCall),
+                                     std::make_tuple(std::move(handlerContext)...), queueTimestamp()});
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+std::size_t
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::activeOrderingKeyCount()
+{
+    return orderedQueues.activeKeyCount();
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::enableSubmissionBatching(
+    const SubmissionBatchingOptions& options)
+{
+    submissionBatcher.reset(new SubmissionBatcher<ExecutionContext, PostTask>(executor, options));
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+SubmissionBatchingStats
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::submissionBatchingStats() const
+{
+    if (!submissionBatcher) {
+        return SubmissionBatchingStats();
+    }
+    return submissionBatcher->stats();
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::enableMetrics(
+    bool registerStatsMethod)
+{
+    if (metrics) {
+        throw std::runtime_error("Metrics are already enabled");
+    }
+    if (registerStatsMethod) {
+        addHandler(
+            [this](const Json::Value&, Json::Value& response, HandlerContext...) {
+                response = metricsSnapshot().toJsonValue();
+            },
+            "rpc.stats");
+    }
+    metrics.reset(new RpcMetrics);
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+bool BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::metricsEnabled() const
+{
+    return metrics != nullptr;
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+RpcMetricsSnapshot
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::metricsSnapshot() const
+{
+    if (!metrics) {
+        return RpcMetricsSnapshot();
+    }
+    return metrics->snapshot();
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::enableSlowRequestLog(
+    const SlowRequestLogOptions& options, bool registerDumpMethod)
+{
+    if (slowRequests) {
+        throw std::runtime_error("The slow request log is already enabled");
+    }
+    if (registerDumpMethod) {
+        addHandler(
+            [this](const Json::Value&, Json::Value& response, HandlerContext...) {
+                response = slowRequests->toJsonValue();
+            },
+            "rpc.slowRequests");
+    }
+    slowRequests.reset(new SlowRequestLog(options));
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+SlowRequestLog*
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::slowRequestLog() const
+{
+    return slowRequests.get();
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::enableCpuTimeAccounting(
+    const CpuTimeAccountingOptions& options, ContextKeyFunction keyFunction)
+{
+    if (cpuTime) {
+        throw std::runtime_error("Cpu time accounting is already enabled");
+    }
+    cpuTime.reset(new CpuTimeAccounting(options));
+    cpuTimeKeyFunction = std::move(keyFunction);
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+CpuTimeSnapshot
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::cpuTimeSnapshot() const
+{
+    if (!cpuTime) {
+        return CpuTimeSnapshot();
+    }
+    return cpuTime->snapshot();
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+bool BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::enablePerfCounters()
+{
+    if (perfCounters) {
+        throw std::runtime_error("Perf counters are already enabled");
+    }
+    if (!PerfCounters::Supported()) {
+        return false;
     }
+    perfCounters.reset(new PerfCounters);
+    return true;
 }
 
-template <typename ExecutionContext, typename... HandlerContext>
-void AsyncJsonRPC<ExecutionContext, HandlerContext...>::asyncPost(const std::string& jsonCall,
-                                                                  HandlerContext... handlerContext)
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+PerfCountersSnapshot
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::perfCountersSnapshot() const
 {
-    // handlerContext here is deliberately passed by value; it's forwarded later
-    executor.post([this, jsonCall, handlerContext...]() { this->post(jsonCall, handlerContext...); },
-                  std::allocator<char>());
+    if (!perfCounters) {
+        return PerfCountersSnapshot();
+    }
+    return perfCounters->snapshot();
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::enableCapture(
+    const std::string& fileName, ContextKeyFunction keyFunction)
+{
+    captureWriter.reset(new TrafficCaptureWriter(fileName));
+    captureKeyFunction = std::move(keyFunction);
 }
 
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+void BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::stopCapture()
+{
+    if (captureWriter) {
+        captureWriter->close();
+    }
+}
+
+template <typename ExecutionContext, typename InterceptorChain, typename... HandlerContext>
+std::string
+BasicAsyncJsonRPC<ExecutionContext, InterceptorChain, HandlerContext...>::captureError() const
+{
+    return captureWriter ? captureWriter->error() : std::string();
+}
+
+// AsyncJsonRPC<Executor, Context...> runs handlers taking (request, response, Context...) on Executor.
+// With an interceptor chain as the first context type, AsyncJsonRPC<Executor, Interceptors<A, B>,
+// Context...>, the interceptors' hooks are called around every request and call.
+template <typename Executor, typename... HandlerContext>
+class AsyncJsonRPC : public BasicAsyncJsonRPC<Executor, Interceptors<>, HandlerContext...>
+{
+public:
+    using BasicAsyncJsonRPC<Executor, Interceptors<>, HandlerContext...>::BasicAsyncJsonRPC;
+};
+
+template <typename Executor, typename... Interceptor, typename... HandlerContext>
+class AsyncJsonRPC<Executor, Interceptors<Interceptor...>, HandlerContext...>
+    : public BasicAsyncJsonRPC<Executor, Interceptors<Interceptor...>, HandlerContext...>
+{
+public:
+    using BasicAsyncJsonRPC<Executor, Interceptors<Interceptor...>,
+                            HandlerContext...>::BasicAsyncJsonRPC;
+};
+
 #endif // ASYNCJSONRPC_H
@@ -0,0 +1,500 @@
+#ifndef ASYNCJSONRPCCLIENT_H
+#define ASYNCJSONRPCCLIENT_H
+
+#include "JsonErrorCode.h"
+#include <atomic>
+#include <chrono>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/system/error_code.hpp>
+#include <cstdint>
+#include <functional>
+#include <jsoncpp/json/json.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// the codes of json-rpc error responses, as error_codes: ec.value() is the "code" of the error
+class JsonRpcErrorCategory : public boost::system::error_category
+{
+public:
+    const char* name() const noexcept override { return "json-rpc"; }
+
+    std::string message(int code) const override
+    {
+        switch (code) {
+        case -32700:
+            return "Parse error";
+        case -32600:
+            return "Invalid Request";
+        case -32601:
+            return "Method not found";
+        case -32602:
+            return "Invalid params";
+        case -32603:
+            return "Internal error";
+        default:
+            return (code >= -32099 && code <= -32000) ? "Server error" : "Application error";
+        }
+    }
+};
+
+inline const boost::system::error_category& JsonRpcCategory()
+{
+    static const JsonRpcErrorCategory category;
+    return category;
+}
+
+inline boost::system::error_code MakeJsonRpcError(int code)
+{
+    return boost::system::error_code(code, JsonRpcCategory());
+}
+
+struct ClientOptions
+{
+    // calls in flight at once, rounded up to a power of two; calls beyond it fail with no_buffer_space
+    std::size_t maxPending = 1024;
+
+    // Auto-batching: calls made within batchWindow of the first one, up to maxBatch of them, are sent
+    // as one batch array. With a zero window, the calls made before the strand runs something else are
+    // batched. maxBatch 1 sends every call on its own.
+    std::size_t               maxBatch = 1;
+    std::chrono::microseconds batchWindow{0};
+};
+
+struct ClientStats
+{
+    std::uint64_t calls;         // sent
+    std::uint64_t completed;     // with a response, or failed
+    std::uint64_t errors;        // error responses
+    std::uint64_t unmatched;     // responses with an id of no call in flight (failed before), or malformed
+    std::uint64_t batches;       // batch arrays sent by auto-batching
+    std::uint64_t notifications; // received (messages with a method and no id)
+};
+
+// A type-erased completion handler, invoked once, through its associated executor
+class ClientCompletion
+{
+    struct Base
+    {
+        virtual ~Base() = default;
+        virtual void complete(boost::system::error_code ec, Json::Value result) = 0;
+    };
+
+    template <typename Handler>
+    struct Holder : Base
+    {
+        Handler handler;
+
+        template <typename HandlerRef>
+        explicit Holder(HandlerRef&& handlerRef) : handler(std::forward<HandlerRef>(handlerRef))
+        {
+        }
+
+        void complete(boost::system::error_code ec, Json::Value result) override
+        {
+            auto executor = boost::asio::get_associated_executor(handler);
+            boost::asio::dispatch(executor, [handler = std::move(handler), ec,
+                                             result = std::move(result)]() mutable {
+                handler(ec, std::move(result));
+            });
+        }
+    };
+
+    std::unique_ptr<Base> holder;
+
+public:
+    ClientCompletion() = default;
+
+    template <typename Handler>
+    explicit ClientCompletion(Handler&& handler)
+        : holder(new Holder<typename std::decay<Handler>::type>(std::forward<Handler>(handler)))
+    {
+    }
+
+    explicit operator bool() const { return holder != nullptr; }
+
+    void operator()(boost::system::error_code ec, Json::Value result)
+    {
+        std::unique_ptr<Base> completing = std::move(holder);
+        completing->complete(ec, std::move(result));
+    }
+};
+
+// Pipelined json-rpc client, for the servers of this library, over any of the client transports
+// (StreamClientTransport, HttpClientTransport, WebSocketClientTransport, SharedMemoryClientTransport).
+// Calls complete with (error_code, Json::Value), through an asio completion token: a callback,
+// boost::asio::use_future, or a boost::asio::yield_context. An error response completes with its code in
+// JsonRpcCategory() and the error object ("code", "message", "data") as the value; a transport error
+// fails every call in flight with it.
+//
+// The id of a call is the index of its slot in a preallocated table, with the slot's generation in the
+// high bits: a response finds its call with a mask and a compare, and a response for a slot that was
+// reused since (its call was failed) is dropped. Any number of calls can be in flight on the connection,
+// up to options.maxPending; their requests are written together when they're made together. Responses
+// are parsed with the same jsoncpp Reader as the server's requests, and may come in any order, or as
+// batch arrays.
+//
+// With options.maxBatch above 1, calls are sent as batch arrays, which the server parses and runs in
+// one post(); its batch response is split into the completions of the calls.
+//
+// Notifications pushed by the server (see Subscriptions.h) go to the notification handler.
+//
+// The table and the transport live on the transport's strand; asyncCall() can be called from any
+// thread.
+template <typename Transport>
+class AsyncJsonRPCClient
+{
+public:
+    using executor_type       = typename Transport::executor_type;
+    using NotificationHandler =
+        std::function<void(const std::string& method, const Json::Value& params)>;
+
+private:
+    struct Slot
+    {
+        std::uint32_t    generation = 0;
+        bool             busy       = false;
+        ClientCompletion completion;
+    };
+
+    struct Core : std::enable_shared_from_this<Core>
+    {
+        std::shared_ptr<Transport> transport;
+        const ClientOptions        options;
+        std::vector<Slot>          slots;
+        std::vector<std::uint32_t> freeSlots;
+        unsigned                   slotBits = 0;
+        std::uint32_t              generationMask;
+        bool                       closed = false;
+        std::string                batch; // "[" and the requests of the batch being made
+        std::size_t                batched     = 0;
+        std::uint64_t              batchNumber = 0; // of the batch being made
+        boost::asio::steady_timer  batchTimer;
+        NotificationHandler        onNotification;
+        std::atomic<std::uint64_t> calls{0};
+        std::atomic<std::uint64_t> completed{0};
+        std::atomic<std::uint64_t> errors{0};
+        std::atomic<std::uint64_t> unmatched{0};
+        std::atomic<std::uint64_t> batches{0};
+        std::atomic<std::uint64_t> notifications{0};
+
+        Core(std::shared_ptr<Transport> transportRef, const ClientOptions& Options)
+            : transport(std::move(transportRef)), options(Options), batchTimer(transport->get_executor())
+        {
+        }
+
+        void start(const std::string& method, const Json::Value& params, ClientCompletion completion);
+        void addToBatch(const std::string& request);
+        void sendBatch();
+        void onMessage(const char* data, std::size_t size);
+        void onResponse(const Json::Value& response);
+        void onClose(boost::system::error_code ec);
+    };
+
+    std::shared_ptr<Core> core;
+
+    static std::string Request(const std::string& method, const Json::Value& params, std::uint32_t id);
+
+public:
+    // the transport is connected, and not started
+    explicit AsyncJsonRPCClient(std::shared_ptr<Transport> transport,
+                                const ClientOptions&       Options = ClientOptions());
+
+    AsyncJsonRPCClient(const AsyncJsonRPCClient&) = delete;
+    AsyncJsonRPCClient& operator=(const AsyncJsonRPCClient&) = delete;
+
+    // closes the transport: the calls in flight fail with operation_aborted
+    ~AsyncJsonRPCClient() { close(); }
+
+    executor_type get_executor() const { return core->transport->get_executor(); }
+
+    // params are an object, an array, or null (none); token is called with (error_code, Json::Value)
+    template <typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, Json::Value))
+    asyncCall(std::string method, Json::Value params, CompletionToken&& token);
+
+    // run on the strand, for every notification received from then on: set it before the call that
+    // makes the server send them (a subscribe)
+    void setNotificationHandler(NotificationHandler handler);
+
+    void close();
+
+    ClientStats stats() const;
+};
+
+template <typename Transport>
+AsyncJsonRPCClient<Transport>::AsyncJsonRPCClient(std::shared_ptr<Transport> transport,
+                                                  const ClientOptions&       Options)
+    : core(std::make_shared<Core>(std::move(transport), Options))
+{
+    std::size_t capacity = 1;
+    while (capacity < Options.maxPending) {
+        capacity *= 2;
+        core->slotBits++;
+    }
+    // ids stay positive 32-bit integers
+    core->generationMask = (std::uint32_t(1) << (31 - core->slotBits)) - 1;
+    core->slots.resize(capacity);
+    core->freeSlots.reserve(capacity);
+    for (std::size_t slot = capacity; slot > 0; slot--) {
+        core->freeSlots.push_back(static_cast<std::uint32_t>(slot - 1));
+    }
+
+    std::weak_ptr<Core> weak = core;
+    boost::asio::dispatch(core->transport->get_executor(), [weak]() {
+        std::shared_ptr<Core> started = weak.lock();
+        if (!started) {
+            return;
+        }
+        started->transport->start(
+            [weak](const char* data, std::size_t size) {
+                if (std::shared_ptr<Core> core = weak.lock()) {
+                    core->onMessage(data, size);
+                }
+            },
+            [weak](boost::system::error_code ec) {
+                if (std::shared_ptr<Core> core = weak.lock()) {
+                    core->onClose(ec);
+                }
+            });
+    });
+}
+
+template <typename Transport>
+std::string AsyncJsonRPCClient<Transport>::Request(const std::string& method, const Json::Value& params,
+                                                   std::uint32_t id)
+{
+    std::string request = R"({"jsonrpc":"2.0","method":)";
+    request += Json::valueToQuotedString(method.c_str());
+    if (!params.isNull()) {
+        request += R"(,"params":)";
+        request += JsonErrorCode::JsonValueToString(params);
+        request.pop_back(); // the FastWriter's "\n"
+    }
+    request += R"(,"id":)";
+    request += std::to_string(id);
+    request += '}';
+    return request;
+}
+
+template <typename Transport>
+template <typename CompletionToken>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, Json::Value))
+AsyncJsonRPCClient<Transport>::asyncCall(std::string method, Json::Value params, CompletionToken&& token)
+{
+    std::shared_ptr<Core> started = core;
+    auto initiation = [started](auto&& handler, std::string method, Json::Value params) {
+        ClientCompletion completion(std::forward<decltype(handler)>(handler));
+        boost::asio::dispatch(started->transport->get_executor(),
+                              [started, method = std::move(method), params = std::move(params),
+                               completion = std::move(completion)]() mutable {
+                                  started->start(method, params, std::move(completion));
+                              });
+    };
+    return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, Json::Value)>(
+        initiation, token, std::move(method), std::move(params));
+}
+
+template <typename Transport>
+void AsyncJsonRPCClient<Transport>::Core::start(const std::string& method, const Json::Value& params,
+                                                ClientCompletion completion)
+{
+    if (closed || freeSlots.empty()) {
+        // not from within asyncCall()
+        const boost::system::error_code ec =
+            closed ? boost::system::error_code(boost::asio::error::not_connected)
+                   : boost::system::error_code(boost::asio::error::no_buffer_space);
+        boost::asio::post(transport->get_executor(),
+                          [completion = std::move(completion), ec]() mutable { completion(ec, {}); });
+        completed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const std::uint32_t slot = freeSlots.back();
+    freeSlots.pop_back();
+    Slot& entry      = slots[slot];
+    entry.busy       = true;
+    entry.generation = (entry.generation + 1) & generationMask;
+    entry.completion = std::move(completion);
+    calls.fetch_add(1, std::memory_order_relaxed);
+    const std::string request = Request(method, params, (entry.generation << slotBits) | slot);
+    if (options.maxBatch > 1) {
+        addToBatch(request);
+    } else {
+        transport->send(request);
+    }
+}
+
+template <typename Transport>
+void AsyncJsonRPCClient<Transport>::Core::addToBatch(const std::string& request)
+{
+    batch += (batched == 0 ? '[' : ',');
+    batch += request;
+    if (++batched >= options.maxBatch) {
+        sendBatch();
+        return;
+    }
+    if (batched > 1) {
+        return;
+    }
+    // the first call of a batch: it is sent when the window ends, unless it fills up before
+    auto                self   = this->shared_from_this();
+    const std::uint64_t number = batchNumber;
+    if (options.batchWindow.count() == 0) {
+        boost::asio::post(transport->get_executor(), [self, number]() {
+            if (self->batchNumber == number) {
+                self->sendBatch();
+            }
+        });
+    } else {
+        batchTimer.expires_after(options.batchWindow);
+        batchTimer.async_wait([self, number](boost::system::error_code ec) {
+            if (!ec && self->batchNumber == number) {
+                self->sendBatch();
+            }
+        });
+    }
+}
+
+template <typename Transport>
+void AsyncJsonRPCClient<Transport>::Core::sendBatch()
+{
+    if (batched == 0 || closed) {
+        return;
+    }
+    batchNumber++;
+    if (batched == 1) {
+        // not worth an array
+        transport->send(batch.substr(1));
+    } else {
+        batch += ']';
+        transport->send(batch);
+        batches.fetch_add(1, std::memory_order_relaxed);
+    }
+    batch.clear();
+    batched = 0;
+}
+
+template <typename Transport>
+void AsyncJsonRPCClient<Transport>::Core::onMessage(const char* data, std::size_t size)
+{
+    Json::Reader reader;
+    Json::Value  message;
+    if (!reader.parse(data, data + size, message, false)) {
+        unmatched.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (message.isArray()) {
+        // a batch response, or responses coalesced by the server
+        for (const Json::Value& response : message) {
+            onResponse(response);
+        }
+    } else {
+        onResponse(message);
+    }
+}
+
+template <typename Transport>
+void AsyncJsonRPCClient<Transport>::Core::onResponse(const Json::Value& response)
+{
+    // isMember() and operator[] throw on other values, out of the transport's read handler
+    if (!response.isObject()) {
+        unmatched.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (response.isMember("method") && !response.isMember("id")) {
+        notifications.fetch_add(1, std::memory_order_relaxed);
+        if (onNotification) {
+            onNotification(response["method"].asString(), response["params"]);
+        }
+        return;
+    }
+    const Json::Value& id = response["id"];
+    if (!id.isUInt()) {
+        unmatched.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const std::uint32_t value = id.asUInt();
+    const std::uint32_t slot  = value & ((std::uint32_t(1) << slotBits) - 1);
+    if (slot >= slots.size() || !slots[slot].busy || slots[slot].generation != (value >> slotBits)) {
+        unmatched.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Slot& entry = slots[slot];
+    entry.busy  = false;
+    freeSlots.push_back(slot);
+    completed.fetch_add(1, std::memory_order_relaxed);
+    ClientCompletion completion = std::move(entry.completion);
+    if (response.isMember("error")) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+        const Json::Value& error = response["error"];
+        const Json::Value  code  = (error.isObject() ? error["code"] : Json::Value());
+        completion(MakeJsonRpcError(code.isInt() ? code.asInt() : -32603), error);
+    } else {
+        completion(boost::system::error_code(), response["result"]);
+    }
+}
+
+template <typename Transport>
+void AsyncJsonRPCClient<Transport>::Core::onClose(boost::system::error_code ec)
+{
+    if (closed) {
+        return;
+    }
+    closed = true;
+    batch.clear();
+    batched = 0;
+    batchNumber++;
+    batchTimer.cancel();
+    for (std::uint32_t slot = 0; slot < slots.size(); slot++) {
+        Slot& entry = slots[slot];
+        if (entry.busy) {
+            entry.busy = false;
+            freeSlots.push_back(slot);
+            completed.fetch_add(1, std::memory_order_relaxed);
+            ClientCompletion completion = std::move(entry.completion);
+            completion(ec, {});
+        }
+    }
+}
+
+template <typename Transport>
+void AsyncJsonRPCClient<Transport>::setNotificationHandler(NotificationHandler handler)
+{
+    std::shared_ptr<Core> setting = core;
+    boost::asio::dispatch(core->transport->get_executor(),
+                          [setting, handler = std::move(handler)]() mutable {
+                              setting->onNotification = std::move(handler);
+                          });
+}
+
+template <typename Transport>
+void AsyncJsonRPCClient<Transport>::close()
+{
+    std::shared_ptr<Core> closing = core;
+    boost::asio::dispatch(core->transport->get_executor(), [closing]() {
+        closing->transport->close();
+        closing->onClose(boost::asio::error::operation_aborted);
+    });
+}
+
+template <typename Transport>
+ClientStats AsyncJsonRPCClient<Transport>::stats() const
+{
+    ClientStats result;
+    result.calls         = core->calls.load(std::memory_order_relaxed);
+    result.completed     = core->completed.load(std::memory_order_relaxed);
+    result.errors        = core->errors.load(std::memory_order_relaxed);
+    result.unmatched     = core->unmatched.load(std::memory_order_relaxed);
+    result.batches       = core->batches.load(std::memory_order_relaxed);
+    result.notifications = core->notifications.load(std::memory_order_relaxed);
+    return result;
+}
+
+#endif // ASYNCJSONRPCCLIENT_H
@@ -0,0 +1,645 @@
+#ifndef ASYNCJSONRPCCLIENTPOOL_H
+#define ASYNCJSONRPCCLIENTPOOL_H
+
+#include "AsyncJsonRPCClient.h"
+#include "RpcMetrics.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+enum class PoolBalancing
+{
+    // the endpoint with the fewest calls in flight; ties go to the lower latency EWMA
+    LeastOutstanding,
+    // the better of two endpoints picked at random, compared the same way: no scan of every endpoint,
+    // unless one of the two can't be called
+    PowerOfTwoChoices
+};
+
+// of asyncHedgedCall()
+struct HedgingOptions
+{
+    // a hedged call not answered after this long is sent again, to another endpoint; 0: after the
+    // quantile below of the latencies of the first attempts of hedged calls
+    std::chrono::microseconds delay{0};
+    double                    quantile = 0.95;
+
+    // latencies needed before the quantile is used (no hedges until then); it's of the last window to
+    // 2 * window of them
+    std::size_t minSamples = 100;
+    std::size_t window     = 10000;
+
+    // hedges sent are at most this fraction of the hedged calls (0.05: 5% more calls), and at most
+    // maxBurst of them in a row
+    double maxExtraLoad = 0.05;
+    double maxBurst     = 10;
+};
+
+struct PoolOptions
+{
+    PoolBalancing balancing = PoolBalancing::LeastOutstanding;
+
+    // of the client of every endpoint
+    ClientOptions client;
+
+    // weight of a new latency in the EWMA of its endpoint
+    double ewmaAlpha = 0.2;
+
+    // a transport error (the connection is lost, or can't be made) takes the endpoint out of the
+    // balancing for this long; then it's connected again by the next call that picks it
+    std::chrono::milliseconds retryAfter{1000};
+
+    // calls made on every endpoint by warmup(), once it's connected, to seed the latency EWMAs
+    std::size_t warmupCalls = 0;
+    std::string warmupMethod;
+    Json::Value warmupParams;
+
+    HedgingOptions hedging;
+};
+
+struct PoolEndpointStats
+{
+    std::uint64_t calls;         // sent to the endpoint
+    std::uint64_t failures;      // completed with a transport error
+    std::uint64_t connects;      // connections made
+    std::uint64_t outstanding;   // calls in flight
+    double        latencyEwmaUs; // of the calls answered; 0 before the first
+    bool          healthy;       // connected, and not failed since
+};
+
+struct PoolHedgingStats
+{
+    std::uint64_t calls;   // made with asyncHedgedCall()
+    std::uint64_t hedges;  // second attempts sent
+    std::uint64_t wins;    // calls answered by their second attempt
+    std::uint64_t delayUs; // after which a hedge is sent; 0 while not known
+};
+
+// A client for several servers of the same service (say, one process per core on the host): every
+// call goes to one endpoint, picked by options.balancing among the healthy ones, and completes as an
+// AsyncJsonRPCClient call does. An endpoint is a connector, a function that returns a connected
+// transport (and throws if it can't), so the pool works with any of the client transports. Each
+// endpoint has one connection, made by warmup() or by its first call; a transport error on it marks the
+// endpoint down for options.retryAfter, and the next call that picks it after that connects again (in
+// the calling thread). The latency of every answered call, error responses included, goes into an EWMA
+// of its endpoint. With no endpoint to call, calls fail with host_unreachable.
+//
+// asyncHedgedCall() is for idempotent calls (reads): when the first attempt isn't answered within the
+// hedge delay (options.hedging), the same call is sent to another endpoint, and the first of the two
+// responses completes it; the other one is dropped when it arrives (the server does the work anyway,
+// hence the budget of hedges). Each attempt is a call of its own client, matched to its response by id.
+// A transport error completes a hedged call only if no other attempt of it is in flight. A hedge only
+// goes to an endpoint that's already connected (by warmup(), or an earlier call): it's sent from the
+// strand of the first attempt's transport, where a connector would stall every call of that transport.
+//
+// asyncCall() can be called from any thread; the pool must outlive it, not the calls it made.
+template <typename Transport>
+class AsyncJsonRPCClientPool
+{
+public:
+    using Client    = AsyncJsonRPCClient<Transport>;
+    // may block: it's called in the thread of the call that connects its endpoint, never for a hedge
+    using Connector = std::function<std::shared_ptr<Transport>()>;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // shared with the completions of its calls
+    struct Endpoint
+    {
+        const Connector                 connector;
+        const ClientOptions             clientOptions;
+        const double                    ewmaAlpha;
+        const std::chrono::milliseconds retryAfter;
+        std::mutex                      mutex; // guards client
+        std::shared_ptr<Client>         client;
+        std::atomic<bool>               healthy{false};
+        std::atomic<Clock::rep>         downUntil{0};
+        std::atomic<std::uint64_t>      outstanding{0};
+        std::atomic<std::uint64_t>      latencyEwmaNs{0};
+        std::atomic<std::uint64_t>      calls{0};
+        std::atomic<std::uint64_t>      failures{0};
+        std::atomic<std::uint64_t>      connects{0};
+
+        Endpoint(Connector connectorRef, const PoolOptions& options)
+            : connector(std::move(connectorRef)), clientOptions(options.client),
+              ewmaAlpha(options.ewmaAlpha), retryAfter(options.retryAfter)
+        {
+        }
+
+        bool callable(Clock::rep now) const
+        {
+            return healthy.load(std::memory_order_relaxed) ||
+                   downUntil.load(std::memory_order_relaxed) <= now;
+        }
+
+        void retryLater()
+        {
+            downUntil.store((Clock::now() + retryAfter).time_since_epoch().count(),
+                            std::memory_order_relaxed);
+        }
+
+        std::shared_ptr<Client> connect();
+        std::shared_ptr<Client> connected(); // without connecting: nullptr if it isn't
+        void                    markDown(const std::weak_ptr<Client>& failed);
+        void                    complete(const std::weak_ptr<Client>& caller, Clock::time_point start,
+                                         boost::system::error_code ec);
+    };
+
+    // shared with the hedged calls, whose hedges are sent after asyncHedgedCall() returned
+    struct Core
+    {
+        const PoolOptions                      options;
+        std::vector<std::shared_ptr<Endpoint>> endpoints;
+        std::mutex                             hedgingMutex; // guards the 3 below
+        LatencyHistogram                       latencies;    // of first attempts, in ns
+        LatencyHistogram                       previousLatencies;
+        double                                 hedgeCredits = 0;
+        std::atomic<std::uint64_t>             hedgeDelayNs{0};
+        std::atomic<std::uint64_t>             hedgedCalls{0};
+        std::atomic<std::uint64_t>             hedges{0};
+        std::atomic<std::uint64_t>             hedgeWins{0};
+
+        explicit Core(const PoolOptions& Options);
+
+        // the endpoint for a call (not excluded), and its client; nullptr if none can be called.
+        // connectedOnly: among the endpoints already connected, so that no connector is called
+        std::shared_ptr<Endpoint> pick(std::shared_ptr<Client>& client, const Endpoint* excluded = nullptr,
+                                       bool connectedOnly = false);
+
+        void recordLatency(Clock::duration latency);
+        void earnHedge();
+        bool spendHedge();
+        void refundHedge();
+    };
+
+    // one asyncHedgedCall(): the first answer completes it
+    struct Hedged : std::enable_shared_from_this<Hedged>
+    {
+        const std::shared_ptr<Core>     core;
+        const std::shared_ptr<Endpoint> first;
+        const std::string               method;
+        const Json::Value               params;
+        const Clock::time_point         start;
+        ClientCompletion                completion;
+        boost::asio::steady_timer       timer; // on the strand of the first attempt's transport
+        std::atomic<bool>               done{false};
+        std::atomic<int>                inFlight{1};
+
+        template <typename Executor>
+        Hedged(std::shared_ptr<Core> coreRef, std::shared_ptr<Endpoint> firstRef, std::string methodRef,
+               Json::Value paramsRef, ClientCompletion completionRef, const Executor& executor)
+            : core(std::move(coreRef)), first(std::move(firstRef)), method(std::move(methodRef)),
+              params(std::move(paramsRef)), start(Clock::now()), completion(std::move(completionRef)),
+              timer(executor)
+        {
+        }
+
+        void arm(std::chrono::nanoseconds delay);
+        void hedge();
+        void finish(bool isHedge, boost::system::error_code ec, Json::Value result);
+    };
+
+    std::shared_ptr<Core> core;
+
+    static bool Better(const Endpoint& a, const Endpoint& b);
+
+    template <typename Handler>
+    static void Call(const std::shared_ptr<Endpoint>& endpoint, const std::shared_ptr<Client>& client,
+                     std::string method, Json::Value params, Handler&& handler);
+
+    template <typename Handler>
+    static void Unreachable(Handler&& handler);
+
+public:
+    explicit AsyncJsonRPCClientPool(std::vector<Connector> connectors,
+                                    const PoolOptions&     Options = PoolOptions());
+
+    AsyncJsonRPCClientPool(const AsyncJsonRPCClientPool&) = delete;
+    AsyncJsonRPCClientPool& operator=(const AsyncJsonRPCClientPool&) = delete;
+
+    // connects every endpoint, and makes options.warmupCalls calls on each; blocks until they complete
+    // (the transports' io_context must be running in another thread)
+    void warmup();
+
+    // as AsyncJsonRPCClient::asyncCall()
+    template <typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, Json::Value))
+    asyncCall(std::string method, Json::Value params, CompletionToken&& token);
+
+    // as asyncCall(), hedged; only for calls that can be made twice
+    template <typename CompletionToken>
+    BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, Json::Value))
+    asyncHedgedCall(std::string method, Json::Value params, CompletionToken&& token);
+
+    // in the order of the connectors
+    std::vector<PoolEndpointStats> stats() const;
+
+    PoolHedgingStats hedgingStats() const;
+};
+
+template <typename Transport>
+std::shared_ptr<typename AsyncJsonRPCClientPool<Transport>::Client>
+AsyncJsonRPCClientPool<Transport>::Endpoint::connect()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (client) {
+        return client;
+    }
+    try {
+        client = std::make_shared<Client>(connector(), clientOptions);
+    } catch (const std::exception&) {
+        retryLater();
+        return nullptr;
+    }
+    connects.fetch_add(1, std::memory_order_relaxed);
+    healthy.store(true, std::memory_order_relaxed);
+    return client;
+}
+
+template <typename Transport>
+std::shared_ptr<typename AsyncJsonRPCClientPool<Transport>::Client>
+AsyncJsonRPCClientPool<Transport>::Endpoint::connected()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return client;
+}
+
+template <typename Transport>
+void AsyncJsonRPCClientPool<Transport>::Endpoint::markDown(const std::weak_ptr<Client>& failed)
+{
+    std::shared_ptr<Client> closing;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // a late failure of a connection that was replaced since doesn't take the new one down
+        if (!client || client != failed.lock()) {
+            return;
+        }
+        closing = std::move(client);
+        healthy.store(false, std::memory_order_relaxed);
+        retryLater();
+    }
+}
+
+template <typename Transport>
+void AsyncJsonRPCClientPool<Transport>::Endpoint::complete(const std::weak_ptr<Client>& caller,
+                                                           Clock::time_point            start,
+                                                           boost::system::error_code    ec)
+{
+    outstanding.fetch_sub(1, std::memory_order_relaxed);
+    if (ec && ec.category() != JsonRpcCategory()) {
+        // no_buffer_space is the client's table being full, not the connection failing
+        if (ec != boost::asio::error::no_buffer_space) {
+            failures.fetch_add(1, std::memory_order_relaxed);
+            markDown(caller);
+        }
+        return;
+    }
+    const double sample = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    std::uint64_t ewma = latencyEwmaNs.load(std::memory_order_relaxed);
+    std::uint64_t next;
+    do {
+        next = ewma == 0 ? static_cast<std::uint64_t>(sample)
+                         : static_cast<std::uint64_t>(static_cast<double>(ewma) +
+                                                      ewmaAlpha * (sample - static_cast<double>(ewma)));
+    } while (!latencyEwmaNs.compare_exchange_weak(ewma, std::max<std::uint64_t>(next, 1),
+                                                  std::memory_order_relaxed));
+}
+
+template <typename Transport>
+AsyncJsonRPCClientPool<Transport>::Core::Core(const PoolOptions& Options) : options(Options)
+{
+    if (options.hedging.delay.count() > 0) {
+        hedgeDelayNs = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(options.hedging.delay).count());
+    }
+}
+
+template <typename Transport>
+AsyncJsonRPCClientPool<Transport>::AsyncJsonRPCClientPool(std::vector<Connector> connectors,
+                                                          const PoolOptions&     Options)
+    : core(std::make_shared<Core>(Options))
+{
+    if (connectors.empty()) {
+        throw std::runtime_error("AsyncJsonRPCClientPool: no endpoints");
+    }
+    for (Connector& connector : connectors) {
+        core->endpoints.push_back(std::make_shared<Endpoint>(std::move(connector), core->options));
+    }
+}
+
+template <typename Transport>
+bool AsyncJsonRPCClientPool<Transport>::Better(const Endpoint& a, const Endpoint& b)
+{
+    const std::uint64_t aOutstanding = a.outstanding.load(std::memory_order_relaxed);
+    const std::uint64_t bOutstanding = b.outstanding.load(std::memory_order_relaxed);
+    if (aOutstanding != bOutstanding) {
+        return aOutstanding < bOutstanding;
+    }
+    return a.latencyEwmaNs.load(std::memory_order_relaxed) <
+           b.latencyEwmaNs.load(std::memory_order_relaxed);
+}
+
+template <typename Transport>
+std::shared_ptr<typename AsyncJsonRPCClientPool<Transport>::Endpoint>
+AsyncJsonRPCClientPool<Transport>::Core::pick(std::shared_ptr<Client>& client, const Endpoint* excluded,
+                                              bool connectedOnly)
+{
+    const Clock::rep now      = Clock::now().time_since_epoch().count();
+    auto             eligible = [excluded, now, connectedOnly](const Endpoint& endpoint) {
+        return &endpoint != excluded && endpoint.callable(now) &&
+               (!connectedOnly || endpoint.healthy.load(std::memory_order_relaxed));
+    };
+    auto clientOf = [connectedOnly](Endpoint& endpoint) {
+        return connectedOnly ? endpoint.connected() : endpoint.connect();
+    };
+
+    // two endpoints sampled at random; the scan below only if one of them can't be called (or connected)
+    const std::size_t count = endpoints.size();
+    if (options.balancing == PoolBalancing::PowerOfTwoChoices && count > 2) {
+        thread_local std::minstd_rand random(std::random_device{}());
+
+        const std::size_t                first = random() % count;
+        const std::size_t                other = (first + 1 + random() % (count - 1)) % count; // not first
+        const std::shared_ptr<Endpoint>& a     = endpoints[first];
+        const std::shared_ptr<Endpoint>& b     = endpoints[other];
+        if (eligible(*a) && eligible(*b)) {
+            const std::shared_ptr<Endpoint>& chosen = Better(*b, *a) ? b : a;
+            client                                  = clientOf(*chosen);
+            if (client) {
+                return chosen;
+            }
+        }
+    }
+    // the best of the endpoints that can be called; one that can't be connected is down from then on
+    // (or no longer connected), and the next best is tried
+    for (std::size_t attempt = 0; attempt < count; attempt++) {
+        const std::shared_ptr<Endpoint>* best = nullptr;
+        for (const std::shared_ptr<Endpoint>& endpoint : endpoints) {
+            if (eligible(*endpoint) && (!best || Better(*endpoint, **best))) {
+                best = &endpoint;
+            }
+        }
+        if (!best) {
+            return nullptr;
+        }
+        client = clientOf(**best);
+        if (client) {
+            return *best;
+        }
+    }
+    return nullptr;
+}
+
+template <typename Transport>
+template <typename Handler>
+void AsyncJsonRPCClientPool<Transport>::Call(const std::shared_ptr<Endpoint>& endpoint,
+                                             const std::shared_ptr<Client>& client, std::string method,
+                                             Json::Value params, Handler&& handler)
+{
+    endpoint->outstanding.fetch_add(1, std::memory_order_relaxed);
+    endpoint->calls.fetch_add(1, std::memory_order_relaxed);
+    auto executor   = boost::asio::get_associated_executor(handler);
+    auto completion = [endpoint, caller = std::weak_ptr<Client>(client), start = Clock::now(),
+                       handler = std::forward<Handler>(handler)](boost::system::error_code ec,
+                                                                 Json::Value result) mutable {
+        endpoint->complete(caller, start, ec);
+        handler(ec, std::move(result));
+    };
+    client->asyncCall(std::move(method), std::move(params),
+                      boost::asio::bind_executor(executor, std::move(completion)));
+}
+
+template <typename Transport>
+template <typename Handler>
+void AsyncJsonRPCClientPool<Transport>::Unreachable(Handler&& handler)
+{
+    auto executor = boost::asio::get_associated_executor(handler);
+    boost::asio::post(executor, [handler = std::forward<Handler>(handler)]() mutable {
+        handler(boost::asio::error::host_unreachable, Json::Value());
+    });
+}
+
+template <typename Transport>
+template <typename CompletionToken>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, Json::Value))
+AsyncJsonRPCClientPool<Transport>::asyncCall(std::string method, Json::Value params,
+                                             CompletionToken&& token)
+{
+    auto initiation = [this](auto&& handler, std::string method, Json::Value params) {
+        std::shared_ptr<Client>   client;
+        std::shared_ptr<Endpoint> endpoint = core->pick(client);
+        if (!endpoint) {
+            Unreachable(std::forward<decltype(handler)>(handler));
+            return;
+        }
+        Call(endpoint, client, std::move(method), std::move(params),
+             std::forward<decltype(handler)>(handler));
+    };
+    return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, Json::Value)>(
+        initiation, token, std::move(method), std::move(params));
+}
+
+template <typename Transport>
+template <typename CompletionToken>
+BOOST_ASIO_INITFN_RESULT_TYPE(CompletionToken, void(boost::system::error_code, Json::Value))
+AsyncJsonRPCClientPool<Transport>::asyncHedgedCall(std::string method, Json::Value params,
+                                                   CompletionToken&& token)
+{
+    auto initiation = [this](auto&& handler, std::string method, Json::Value params) {
+        std::shared_ptr<Client>   client;
+        std::shared_ptr<Endpoint> endpoint = core->pick(client);
+        if (!endpoint) {
+            Unreachable(std::forward<decltype(handler)>(handler));
+            return;
+        }
+        core->hedgedCalls.fetch_add(1, std::memory_order_relaxed);
+        core->earnHedge();
+        ClientCompletion completion(std::forward<decltype(handler)>(handler));
+        auto hedged = std::make_shared<Hedged>(core, endpoint, method, params, std::move(completion),
+                                               client->get_executor());
+        Call(endpoint, client, std::move(method), std::move(params),
+             [hedged](boost::system::error_code ec, Json::Value result) {
+                 hedged->finish(false, ec, std::move(result));
+             });
+        const std::uint64_t delay = core->hedgeDelayNs.load(std::memory_order_relaxed);
+        if (delay > 0) {
+            hedged->arm(std::chrono::nanoseconds(delay));
+        }
+    };
+    return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, Json::Value)>(
+        initiation, token, std::move(method), std::move(params));
+}
+
+template <typename Transport>
+void AsyncJsonRPCClientPool<Transport>::Hedged::arm(std::chrono::nanoseconds delay)
+{
+    auto self = this->shared_from_this();
+    boost::asio::dispatch(timer.get_executor(), [self, delay]() {
+        if (self->done.load(std::memory_order_relaxed)) {
+            return;
+        }
+        self->timer.expires_at(self->start + delay);
+        self->timer.async_wait([self](boost::system::error_code ec) {
+            if (!ec) {
+                self->hedge();
+            }
+        });
+    });
+}
+
+template <typename Transport>
+void AsyncJsonRPCClientPool<Transport>::Hedged::hedge()
+{
+    if (done.load(std::memory_order_relaxed) || !core->spendHedge()) {
+        return;
+    }
+    std::shared_ptr<Client>   client;
+    std::shared_ptr<Endpoint> endpoint = core->pick(client, first.get(), true);
+    if (!endpoint) {
+        core->refundHedge();
+        return;
+    }
+    core->hedges.fetch_add(1, std::memory_order_relaxed);
+    inFlight.fetch_add(1, std::memory_order_relaxed);
+    auto self = this->shared_from_this();
+    Call(endpoint, client, method, params, [self](boost::system::error_code ec, Json::Value result) {
+        self->finish(true, ec, std::move(result));
+    });
+}
+
+template <typename Transport>
+void AsyncJsonRPCClientPool<Transport>::Hedged::finish(bool isHedge, boost::system::error_code ec,
+                                                       Json::Value result)
+{
+    const bool answered = !ec || ec.category() == JsonRpcCategory();
+    if (answered && !isHedge) {
+        core->recordLatency(Clock::now() - start);
+    }
+    // a transport error waits for the other attempt, if one is in flight
+    if (!answered && inFlight.fetch_sub(1, std::memory_order_acq_rel) > 1) {
+        return;
+    }
+    if (done.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    if (isHedge) {
+        core->hedgeWins.fetch_add(1, std::memory_order_relaxed);
+    }
+    auto self = this->shared_from_this();
+    boost::asio::dispatch(timer.get_executor(), [self]() { self->timer.cancel(); });
+    completion(ec, std::move(result));
+}
+
+template <typename Transport>
+void AsyncJsonRPCClientPool<Transport>::Core::recordLatency(Clock::duration latency)
+{
+    if (options.hedging.delay.count() > 0) {
+        return;
+    }
+    const std::uint64_t         ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    std::lock_guard<std::mutex> lock(hedgingMutex);
+    latencies.record(ns);
+    if (latencies.count() >= options.hedging.window) {
+        previousLatencies = latencies;
+        latencies         = LatencyHistogram();
+    }
+    // the quantile is a scan of the buckets: not redone for every latency
+    const std::uint64_t known = latencies.count() + previousLatencies.count();
+    if (known >= options.hedging.minSamples && known % 16 == 0) {
+        LatencyHistogram recent = previousLatencies;
+        recent.merge(latencies);
+        hedgeDelayNs.store(std::max<std::uint64_t>(recent.percentile(options.hedging.quantile), 1),
+                           std::memory_order_relaxed);
+    }
+}
+
+template <typename Transport>
+void AsyncJsonRPCClientPool<Transport>::Core::earnHedge()
+{
+    std::lock_guard<std::mutex> lock(hedgingMutex);
+    hedgeCredits = std::min(hedgeCredits + options.hedging.maxExtraLoad, options.hedging.maxBurst);
+}
+
+template <typename Transport>
+bool AsyncJsonRPCClientPool<Transport>::Core::spendHedge()
+{
+    std::lock_guard<std::mutex> lock(hedgingMutex);
+    if (hedgeCredits < 1) {
+        return false;
+    }
+    hedgeCredits -= 1;
+    return true;
+}
+
+template <typename Transport>
+void AsyncJsonRPCClientPool<Transport>::Core::refundHedge()
+{
+    std::lock_guard<std::mutex> lock(hedgingMutex);
+    hedgeCredits += 1;
+}
+
+template <typename Transport>
+void AsyncJsonRPCClientPool<Transport>::warmup()
+{
+    std::vector<std::future<Json::Value>> calls;
+    const PoolOptions& options = core->options;
+    for (const auto& endpoint : core->endpoints) {
+        std::shared_ptr<Client> client = endpoint->connect();
+        for (std::size_t n = 0; client && n < options.warmupCalls; n++) {
+            std::promise<Json::Value> promise;
+            calls.push_back(promise.get_future());
+            Call(endpoint, client, options.warmupMethod, options.warmupParams,
+                 [promise = std::move(promise)](boost::system::error_code, Json::Value) mutable {
+                     promise.set_value(Json::Value());
+                 });
+        }
+    }
+    for (auto& call : calls) {
+        call.wait();
+    }
+}
+
+template <typename Transport>
+std::vector<PoolEndpointStats> AsyncJsonRPCClientPool<Transport>::stats() const
+{
+    std::vector<PoolEndpointStats> result;
+    for (const auto& endpoint : core->endpoints) {
+        PoolEndpointStats stats;
+        stats.calls         = endpoint->calls.load(std::memory_order_relaxed);
+        stats.failures      = endpoint->failures.load(std::memory_order_relaxed);
+        stats.connects      = endpoint->connects.load(std::memory_order_relaxed);
+        stats.outstanding   = endpoint->outstanding.load(std::memory_order_relaxed);
+        stats.latencyEwmaUs =
+            static_cast<double>(endpoint->latencyEwmaNs.load(std::memory_order_relaxed)) / 1000;
+        stats.healthy       = endpoint->healthy.load(std::memory_order_relaxed);
+        result.push_back(stats);
+    }
+    return result;
+}
+
+template <typename Transport>
+PoolHedgingStats AsyncJsonRPCClientPool<Transport>::hedgingStats() const
+{
+    PoolHedgingStats stats;
+    stats.calls   = core->hedgedCalls.load(std::memory_order_relaxed);
+    stats.hedges  = core->hedges.load(std::memory_order_relaxed);
+    stats.wins    = core->hedgeWins.load(std::memory_order_relaxed);
+    stats.delayUs = core->hedgeDelayNs.load(std::memory_order_relaxed) / 1000;
+    return stats;
+}
+
+#endif // ASYNCJSONRPCCLIENTPOOL_H
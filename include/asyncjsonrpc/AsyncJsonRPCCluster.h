@@ -0,0 +1,239 @@
+#ifndef ASYNCJSONRPCCLUSTER_H
+#define ASYNCJSONRPCCLUSTER_H
+
+#include "AsyncJsonRPC.h"
+#include "WorkStealingThreadPool.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// Shared-nothing dispatcher: N independent AsyncJsonRPC replicas ("shards"), each with its own thread,
+// method table and stats. Every call is routed to a shard by a key computed from its context, so all
+// calls with the same key run on the same thread, in order, and never touch another shard's memory.
+// Destroying the cluster stops the shards after the calls they're running; the calls still queued are
+// dropped, so join() first to complete them.
+template <typename... HandlerContext>
+class AsyncJsonRPCCluster
+{
+public:
+    using ShardExecutor    = WorkStealingThreadPool::executor_type;
+    using ShardRpc         = AsyncJsonRPC<ShardExecutor, HandlerContext...>;
+    using ShardKeyFunction = std::function<std::size_t(const HandlerContext&...)>;
+    using IdleStrategy     = WorkStealingThreadPool::IdleStrategy;
+
+    struct Options
+    {
+        std::size_t  shardCount   = std::max(1u, std::thread::hardware_concurrency());
+        bool         pinShards    = false; // pin shard i's thread to cpu (i % cpu count); linux only
+        IdleStrategy idleStrategy = IdleStrategy::SpinThenPark;
+    };
+
+    struct ShardStats
+    {
+        std::uint64_t posted;
+        std::uint64_t completed;
+    };
+
+private:
+    // posted is written by the posting threads and completed by the shard's thread: each has a cache
+    // line of its own (every shard lives in its own allocation, too)
+    struct Shard
+    {
+        WorkStealingThreadPool                 pool;
+        ShardRpc                               rpc;
+        alignas(64) std::atomic<std::uint64_t> posted{0};
+        alignas(64) std::atomic<std::uint64_t> completed{0};
+
+        explicit Shard(const WorkStealingThreadPool::Options& poolOptions)
+            : pool(poolOptions), rpc(pool.get_executor())
+        {
+        }
+
+        // rpc is destroyed before pool: its thread must be stopped first, or it would go on running
+        // the queued calls on a destroyed rpc
+        ~Shard() { pool.stop(); }
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    ShardKeyFunction                    shardKeyFunction;
+    std::function<void(std::string&&)>  responseCallback = [](std::string&&) {};
+    std::atomic<bool>                   frozen{false};
+
+    void throwIfFrozen(const std::string& what) const;
+
+public:
+    AsyncJsonRPCCluster(ShardKeyFunction ShardKey, const Options& options);
+    explicit AsyncJsonRPCCluster(ShardKeyFunction ShardKey);
+
+    // handlers are registered on every shard; the method tables are frozen by the first call
+    template <typename Handler>
+    void addHandler(Handler handler, const std::string& methodName,
+                    const std::map<std::string, Json::ValueType>& MethodParamsTypes)
+    {
+        throwIfFrozen("addHandler");
+        for (auto& shard : shards) {
+            shard->rpc.addHandler(handler, methodName, MethodParamsTypes);
+        }
+    }
+
+    template <typename Handler>
+    void addHandler(Handler handler, const std::string& methodName,
+                    const std::vector<Json::ValueType>& MethodParamsTypes = {})
+    {
+        throwIfFrozen("addHandler");
+        for (auto& shard : shards) {
+            shard->rpc.addHandler(handler, methodName, MethodParamsTypes);
+        }
+    }
+
+    void removeHandler(const std::string& methodName);
+
+    bool handlerExists(const std::string& methodName) const;
+
+    std::size_t handlerCount() const;
+
+    std::size_t shardCount() const;
+
+    // the callback is called from the shard threads, concurrently
+    void setResponseCallback(std::function<void(std::string&&)> callback);
+
+    std::size_t shardFor(const HandlerContext&... handlerContext) const;
+
+    void asyncPost(const std::string& jsonCall, HandlerContext... handlerContext);
+
+    std::vector<ShardStats> shardStats() const;
+
+    // blocks until all shards are idle, then stops their threads
+    void join();
+};
+
+template <typename... HandlerContext>
+AsyncJsonRPCCluster<HandlerContext...>::AsyncJsonRPCCluster(ShardKeyFunction ShardKey,
+                                                             const Options&   options)
+    : shardKeyFunction(std::move(ShardKey))
+{
+    if (options.shardCount == 0) {
+        throw std::invalid_argument("AsyncJsonRPCCluster needs at least one shard");
+    }
+    const unsigned cpuCount = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t i = 0; i < options.shardCount; i++) {
+        WorkStealingThreadPool::Options poolOptions;
+        poolOptions.threadCount  = 1;
+        poolOptions.idleStrategy = options.idleStrategy;
+        shards.emplace_back(new Shard(poolOptions));
+#ifdef __linux__
+        if (options.pinShards) {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(i % cpuCount, &cpuSet);
+            shards.back()->pool.get_executor().post(
+                [cpuSet]() { pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet); },
+                std::allocator<char>());
+        }
+#else
+        (void)cpuCount;
+#endif
+    }
+    setResponseCallback(responseCallback);
+}
+
+template <typename... HandlerContext>
+AsyncJsonRPCCluster<HandlerContext...>::AsyncJsonRPCCluster(ShardKeyFunction ShardKey)
+    : AsyncJsonRPCCluster(std::move(ShardKey), Options())
+{
+}
+
+template <typename... HandlerContext>
+void AsyncJsonRPCCluster<HandlerContext...>::throwIfFrozen(const std::string& what) const
+{
+    if (frozen.load()) {
+        throw std::runtime_error(what + " called after the cluster started handling calls");
+    }
+}
+
+template <typename... HandlerContext>
+void AsyncJsonRPCCluster<HandlerContext...>::removeHandler(const std::string& methodName)
+{
+    throwIfFrozen("removeHandler");
+    for (auto& shard : shards) {
+        shard->rpc.removeHandler(methodName);
+    }
+}
+
+template <typename... HandlerContext>
+bool AsyncJsonRPCCluster<HandlerContext...>::handlerExists(const std::string& methodName) const
+{
+    return shards.front()->rpc.handlerExists(methodName);
+}
+
+template <typename... HandlerContext>
+std::size_t AsyncJsonRPCCluster<HandlerContext...>::handlerCount() const
+{
+    return shards.front()->rpc.handlerCount();
+}
+
+template <typename... HandlerContext>
+std::size_t AsyncJsonRPCCluster<HandlerContext...>::shardCount() const
+{
+    return shards.size();
+}
+
+template <typename... HandlerContext>
+void AsyncJsonRPCCluster<HandlerContext...>::setResponseCallback(
+    std::function<void(std::string&&)> callback)
+{
+    throwIfFrozen("setResponseCallback");
+    responseCallback = std::move(callback);
+    for (auto& shard : shards) {
+        Shard* shardPtr = shard.get();
+        // each shard gets its own copy of the callback, so calling it touches no shared state
+        shard->rpc.setResponseCallback(
+            [shardPtr, callback = responseCallback](std::string&& response) {
+                callback(std::move(response));
+                shardPtr->completed.fetch_add(1, std::memory_order_relaxed);
+            });
+    }
+}
+
+template <typename... HandlerContext>
+std::size_t
+AsyncJsonRPCCluster<HandlerContext...>::shardFor(const HandlerContext&... handlerContext) const
+{
+    return shardKeyFunction(handlerContext...) % shards.size();
+}
+
+template <typename... HandlerContext>
+void AsyncJsonRPCCluster<HandlerContext...>::asyncPost(const std::string& jsonCall,
+                                                       HandlerContext... handlerContext)
+{
+    if (!frozen.load(std::memory_order_relaxed)) {
+        frozen.store(true);
+    }
+    Shard& shard = *shards[shardFor(handlerContext...)];
+    shard.posted.fetch_add(1, std::memory_order_relaxed);
+    shard.rpc.asyncPost(jsonCall, std::move(handlerContext)...);
+}
+
+template <typename... HandlerContext>
+std::vector<typename AsyncJsonRPCCluster<HandlerContext...>::ShardStats>
+AsyncJsonRPCCluster<HandlerContext...>::shardStats() const
+{
+    std::vector<ShardStats> result;
+    result.reserve(shards.size());
+    for (const auto& shard : shards) {
+        result.push_back(ShardStats{shard->posted.load(), shard->completed.load()});
+    }
+    return result;
+}
+
+template <typename... HandlerContext>
+void AsyncJsonRPCCluster<HandlerContext...>::join()
+{
+    for (auto& shard : shards) {
+        shard->pool.join();
+    }
+}
+
+#endif // ASYNCJSONRPCCLUSTER_H
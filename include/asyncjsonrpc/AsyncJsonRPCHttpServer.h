@@ -0,0 +1,421 @@
+#ifndef ASYNCJSONRPCHTTPSERVER_H
+#define ASYNCJSONRPCHTTPSERVER_H
+
+#include "AcceptLoop.h"
+#include "ResponseRouter.h"
+#include <atomic>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http/error.hpp>
+#include <boost/beast/http/parser.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/status.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <boost/optional.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct HttpServerOptions
+{
+    // requests to other targets are answered with 404; empty accepts every target
+    std::string target = "/";
+
+    // larger bodies are answered with 413, and the connection is closed
+    std::size_t maxBodySize = 1024 * 1024;
+
+    // requests of a connection whose responses aren't written yet; reading pauses beyond this
+    std::size_t maxPipelineDepth = 16;
+
+    // responses written together, with one gather write (two buffers each: header and body)
+    std::size_t maxResponsesPerWrite = 32;
+
+    // after a failed accept (out of file descriptors...), the wait before accepting again
+    std::chrono::milliseconds acceptRetryDelay{100};
+
+    // the responses of the rpc's calls that don't come through a server (asyncPost(), ...); dropped if
+    // empty. See ResponseRouter.h
+    ResponseRouter::Fallback responseFallback;
+};
+
+struct HttpServerStats
+{
+    std::uint64_t accepted;     // connections
+    std::uint64_t acceptErrors; // failed accepts, each followed by acceptRetryDelay without accepting
+    std::uint64_t requests;     // posted to the rpc
+    std::uint64_t writes;       // gather writes; fewer than requests when pipelined responses coalesce
+};
+
+// HTTP/1.1 front end for an AsyncJsonRPC: json-rpc requests are POSTed to options.target, on keep-alive
+// connections. Requests a client pipelines are read ahead, run in order, and their responses are written
+// in order, as many per write as are ready. Bodies are read into the parser's string and posted from
+// there; the contexts of the calls are made once per connection, by the context factory.
+//
+// Every connection runs on a strand of the io_context, and calls post() on it: with several threads
+// running the io_context, connections are served in parallel. The server installs a ResponseRouter on
+// the rpc (its response callback is replaced; the responses of other calls go to
+// options.responseFallback), and must outlive the io_context's run().
+template <typename Rpc>
+class AsyncJsonRPCHttpServer
+{
+public:
+    using ContextTuple   = typename Rpc::HandlerContextTuple;
+    using ContextFactory = std::function<ContextTuple(const boost::asio::ip::tcp::endpoint& remote)>;
+
+private:
+    class Connection;
+
+    Rpc&                             rpc;
+    const HttpServerOptions          options;
+    ContextFactory                   contextFactory;
+    AcceptLoop<boost::asio::ip::tcp> acceptLoop;
+
+    std::atomic<std::uint64_t> accepted{0};
+    std::atomic<std::uint64_t> requests{0};
+    std::atomic<std::uint64_t> writes{0};
+
+    void onAccept(boost::asio::ip::tcp::socket&& socket);
+
+public:
+    // contexts are value-initialized if no factory is given
+    static ContextFactory DefaultContextFactory()
+    {
+        return [](const boost::asio::ip::tcp::endpoint&) { return ContextTuple(); };
+    }
+
+    AsyncJsonRPCHttpServer(Rpc& rpcRef, boost::asio::io_context& ioContextRef,
+                           const boost::asio::ip::tcp::endpoint& endpoint,
+                           ContextFactory                        Factory = DefaultContextFactory(),
+                           const HttpServerOptions&              Options = HttpServerOptions());
+
+    AsyncJsonRPCHttpServer(const AsyncJsonRPCHttpServer&) = delete;
+    AsyncJsonRPCHttpServer& operator=(const AsyncJsonRPCHttpServer&) = delete;
+
+    // with port 0 in the constructor, the port that was picked
+    boost::asio::ip::tcp::endpoint localEndpoint() const { return acceptLoop.localEndpoint(); }
+
+    void start();
+
+    // stops accepting; open connections are served until the clients close them
+    void stop();
+
+    HttpServerStats stats() const;
+};
+
+template <typename Rpc>
+class AsyncJsonRPCHttpServer<Rpc>::Connection : public std::enable_shared_from_this<Connection>
+{
+    using Parser = boost::beast::http::request_parser<boost::beast::http::string_body>;
+
+    struct Response
+    {
+        std::string header;
+        std::string body;
+    };
+
+    AsyncJsonRPCHttpServer&                server;
+    ContextTuple                           context;
+    boost::beast::flat_buffer              buffer;
+    boost::optional<Parser>                parser;
+    std::deque<Response>                   queued;
+    std::vector<Response>                  writing;
+    std::vector<boost::asio::const_buffer> writeBuffers;
+    bool                                   partial = false; // the parser holds part of a request
+    bool                                   reading = false;
+    bool                                   closing = false; // once the queued responses are written
+    bool                                   closed  = false;
+
+    std::size_t pending() const { return queued.size() + writing.size(); }
+    bool        canRead() const
+    {
+        return !reading && !closing && pending() < server.options.maxPipelineDepth;
+    }
+
+    void newParser();
+    void read();
+    void onRead(boost::system::error_code ec);
+    void onError(boost::system::error_code ec);
+    void handleRequest();
+    void handleBuffered();
+    void enqueue(boost::beast::http::status status, std::string&& body, unsigned version,
+                 bool keepAlive);
+    void flush();
+    void close();
+    void drain();
+
+public:
+    boost::asio::ip::tcp::socket socket;
+
+    // the socket is on a strand of its own
+    Connection(AsyncJsonRPCHttpServer& Server, boost::asio::ip::tcp::socket&& Socket)
+        : server(Server), socket(std::move(Socket))
+    {
+    }
+
+    void start(ContextTuple Context)
+    {
+        context = std::move(Context);
+        read();
+    }
+};
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::Connection::newParser()
+{
+    parser.emplace();
+    parser->body_limit(server.options.maxBodySize);
+    parser->eager(true);
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::Connection::read()
+{
+    if (!partial) {
+        newParser();
+    }
+    reading = true;
+    auto self = this->shared_from_this();
+    boost::beast::http::async_read(socket, buffer, *parser,
+                                   [self](boost::system::error_code ec, std::size_t) {
+                                       self->onRead(ec);
+                                   });
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::Connection::onRead(boost::system::error_code ec)
+{
+    reading = false;
+    partial = false;
+    if (ec) {
+        onError(ec);
+        return;
+    }
+    handleRequest();
+    handleBuffered();
+    flush();
+    if (canRead()) {
+        read();
+    }
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::Connection::onError(boost::system::error_code ec)
+{
+    namespace http = boost::beast::http;
+
+    const bool closedByClient = (ec == http::error::end_of_stream || ec == http::error::partial_message);
+    // other http errors mean the request couldn't be parsed
+    const auto& httpErrors = http::make_error_code(http::error::bad_target).category();
+    if (ec == http::error::body_limit) {
+        enqueue(http::status::payload_too_large, "body too large", 11, false);
+    } else if (!closedByClient && ec.category() == httpErrors) {
+        enqueue(http::status::bad_request, "malformed request", 11, false);
+    } else {
+        // the client closed the connection, or it broke: answer what was read, then close
+        closing = true;
+    }
+    flush();
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::Connection::handleRequest()
+{
+    namespace http = boost::beast::http;
+
+    const http::request<http::string_body>& request   = parser->get();
+    const bool                              keepAlive = request.keep_alive();
+    if (!server.options.target.empty() && request.target() != server.options.target) {
+        enqueue(http::status::not_found, "no such target", request.version(), keepAlive);
+    } else if (request.method() != http::verb::post) {
+        enqueue(http::status::method_not_allowed, "json-rpc requests are POSTed", request.version(),
+                keepAlive);
+    } else {
+        std::string response;
+        ResponseRouter::Post(server.rpc, request.body(), context, response);
+        server.requests.fetch_add(1, std::memory_order_relaxed);
+        enqueue(http::status::ok, std::move(response), request.version(), keepAlive);
+    }
+}
+
+// the requests a client pipelines usually arrive with one read: they're parsed straight from the read
+// buffer and run one after the other, and their responses go out together, with the next flush()
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::Connection::handleBuffered()
+{
+    while (!closing && pending() < server.options.maxPipelineDepth && buffer.size() > 0) {
+        if (!partial) {
+            newParser();
+        }
+        boost::system::error_code ec;
+        buffer.consume(parser->put(buffer.data(), ec));
+        if (ec == boost::beast::http::error::need_more || (!ec && !parser->is_done())) {
+            // the rest comes with the next read
+            partial = true;
+            return;
+        }
+        partial = false;
+        if (ec) {
+            onError(ec);
+            return;
+        }
+        handleRequest();
+    }
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::Connection::enqueue(boost::beast::http::status status,
+                                                      std::string&& body, unsigned version,
+                                                      bool keepAlive)
+{
+    const auto reason = boost::beast::http::obsolete_reason(status);
+
+    Response response;
+    response.body = std::move(body);
+    response.header.reserve(128);
+    response.header += (version == 10 ? "HTTP/1.0 " : "HTTP/1.1 ");
+    response.header += std::to_string(static_cast<unsigned>(status));
+    response.header += ' ';
+    response.header.append(reason.data(), reason.size());
+    response.header += (status == boost::beast::http::status::ok ? "\r\nContent-Type: application/json"
+                                                                  : "\r\nContent-Type: text/plain");
+    response.header += "\r\nContent-Length: ";
+    response.header += std::to_string(response.body.size());
+    if (!keepAlive) {
+        response.header += "\r\nConnection: close";
+        closing = true;
+    } else if (version == 10) {
+        response.header += "\r\nConnection: keep-alive";
+    }
+    response.header += "\r\n\r\n";
+    queued.push_back(std::move(response));
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::Connection::flush()
+{
+    if (!writing.empty()) {
+        return;
+    }
+    if (queued.empty()) {
+        if (closing && !reading) {
+            close();
+        }
+        return;
+    }
+
+    while (!queued.empty() && writing.size() < server.options.maxResponsesPerWrite) {
+        writing.push_back(std::move(queued.front()));
+        queued.pop_front();
+    }
+    writeBuffers.clear();
+    for (const Response& response : writing) {
+        writeBuffers.push_back(boost::asio::buffer(response.header));
+        writeBuffers.push_back(boost::asio::buffer(response.body));
+    }
+    server.writes.fetch_add(1, std::memory_order_relaxed);
+
+    auto self = this->shared_from_this();
+    boost::asio::async_write(socket, writeBuffers, [self](boost::system::error_code ec, std::size_t) {
+        if (ec) {
+            self->close();
+            return;
+        }
+        self->writing.clear();
+        if (!self->reading) {
+            // requests left in the buffer when the pipeline was full
+            self->handleBuffered();
+        }
+        self->flush();
+        if (self->canRead()) {
+            self->read();
+        }
+    });
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::Connection::close()
+{
+    if (closed) {
+        return;
+    }
+    closed = true;
+    // closing a socket with unread data resets the connection, and the client could lose the last
+    // responses: stop sending, and discard what the client still sends until it closes
+    boost::system::error_code ignored;
+    socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ignored);
+    drain();
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::Connection::drain()
+{
+    buffer.consume(buffer.size());
+    auto self = this->shared_from_this();
+    socket.async_read_some(buffer.prepare(4096), [self](boost::system::error_code ec, std::size_t) {
+        if (ec) {
+            boost::system::error_code ignored;
+            self->socket.close(ignored);
+            return;
+        }
+        self->drain();
+    });
+}
+
+template <typename Rpc>
+AsyncJsonRPCHttpServer<Rpc>::AsyncJsonRPCHttpServer(Rpc& rpcRef, boost::asio::io_context& ioContextRef,
+                                                    const boost::asio::ip::tcp::endpoint& endpoint,
+                                                    ContextFactory                        Factory,
+                                                    const HttpServerOptions&              Options)
+    : rpc(rpcRef), options(Options), contextFactory(std::move(Factory)),
+      acceptLoop(ioContextRef, endpoint, Options.acceptRetryDelay)
+{
+    ResponseRouter::Install(rpc, options.responseFallback);
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::start()
+{
+    acceptLoop.start([this](boost::asio::ip::tcp::socket&& socket) { onAccept(std::move(socket)); });
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::stop()
+{
+    acceptLoop.stop();
+}
+
+template <typename Rpc>
+void AsyncJsonRPCHttpServer<Rpc>::onAccept(boost::asio::ip::tcp::socket&& socket)
+{
+    accepted.fetch_add(1, std::memory_order_relaxed);
+    boost::system::error_code ignored;
+    socket.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+    const boost::asio::ip::tcp::endpoint remote     = socket.remote_endpoint(ignored);
+    auto                                 connection = std::make_shared<Connection>(*this, std::move(socket));
+    ContextTuple                         context    = contextFactory(remote);
+    // the connection's handlers run on its strand, the accept handler doesn't
+    boost::asio::dispatch(connection->socket.get_executor(), [connection, context]() mutable {
+        connection->start(std::move(context));
+    });
+}
+
+template <typename Rpc>
+HttpServerStats AsyncJsonRPCHttpServer<Rpc>::stats() const
+{
+    HttpServerStats result;
+    result.accepted     = accepted.load(std::memory_order_relaxed);
+    result.acceptErrors = acceptLoop.acceptErrors();
+    result.requests     = requests.load(std::memory_order_relaxed);
+    result.writes       = writes.load(std::memory_order_relaxed);
+    return result;
+}
+
+#endif // ASYNCJSONRPCHTTPSERVER_H
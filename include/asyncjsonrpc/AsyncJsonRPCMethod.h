@@ -105,7 +105,7 @@ void AsyncJsonRPCMethod<ContextParams...>::verifyParameterTypes(const Json::Valu
             throw JsonErrorCode::make_InvalidParams(requestId);
         }
         for (int i = 0; i < static_cast<int>(parameters.size()); i++) {
-            if (parameters[i] != methodParameters_byPos[i]) {
+            if (parameters[i].type() != methodParameters_byPos[i]) {
                 throw JsonErrorCode::make_InvalidParams(requestId);
             }
         }
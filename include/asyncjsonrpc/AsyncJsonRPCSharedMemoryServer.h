@@ -0,0 +1,191 @@
+#ifndef ASYNCJSONRPCSHAREDMEMORYSERVER_H
+#define ASYNCJSONRPCSHAREDMEMORYSERVER_H
+
+#include "JsonErrorCode.h"
+#include "ResponseRouter.h"
+#include "SharedMemoryChannel.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SharedMemoryServerStats
+{
+    std::uint64_t channels; // accepted
+    std::uint64_t requests; // posted to the rpc
+};
+
+// Shared-memory front end for an AsyncJsonRPC, for clients on the same host: every client gets a
+// SharedMemoryChannel (a pair of SPSC rings in a memfd) and a thread that serves it. Requests are
+// posted straight from the mapped memory, without a copy; responses are copied into the response ring.
+// There is no socket, and no system call while both sides keep up with each other (or busy-poll).
+//
+// The thread of a channel runs its calls with post(), with the contexts given to accept(); it stops when
+// either side closes the channel. The death of the client's process isn't detected: the thread and the
+// mapping of a channel it abandoned live until stop(). As with the other transports, the rpc's response
+// callback is replaced by a ResponseRouter.
+template <typename Rpc>
+class AsyncJsonRPCSharedMemoryServer
+{
+public:
+    using ContextTuple = typename Rpc::HandlerContextTuple;
+
+private:
+    struct Served
+    {
+        std::shared_ptr<SharedMemoryChannel> channel;
+        std::shared_ptr<std::atomic<bool>>   done;
+        std::thread                          thread;
+    };
+
+    Rpc&                      rpc;
+    const SharedMemoryOptions options;
+    std::mutex                mutex;
+    std::vector<Served>       served;
+
+    std::atomic<std::uint64_t> channels{0};
+    std::atomic<std::uint64_t> requests{0};
+
+    void serve(SharedMemoryChannel& channel, const ContextTuple& context);
+
+    static std::string InternalErrors(const std::string& response);
+
+public:
+    explicit AsyncJsonRPCSharedMemoryServer(Rpc&                       rpcRef,
+                                            const SharedMemoryOptions& Options = SharedMemoryOptions())
+        : rpc(rpcRef), options(Options)
+    {
+        ResponseRouter::Install(rpc, options.responseFallback);
+    }
+
+    AsyncJsonRPCSharedMemoryServer(const AsyncJsonRPCSharedMemoryServer&) = delete;
+    AsyncJsonRPCSharedMemoryServer& operator=(const AsyncJsonRPCSharedMemoryServer&) = delete;
+
+    ~AsyncJsonRPCSharedMemoryServer() { stop(); }
+
+    // a new channel, served with these contexts; its fd() is for the client's process (in this one, give
+    // the channel to a SharedMemoryClient)
+    std::shared_ptr<SharedMemoryChannel> accept(ContextTuple context = ContextTuple());
+
+    // closes every channel, and waits for their threads
+    void stop();
+
+    SharedMemoryServerStats stats() const;
+};
+
+template <typename Rpc>
+void AsyncJsonRPCSharedMemoryServer<Rpc>::serve(SharedMemoryChannel& channel,
+                                                const ContextTuple&  context)
+{
+    SharedMemoryRing&                 requestRing  = channel.requests();
+    SharedMemoryRing&                 responseRing = channel.responses();
+    const std::atomic<std::uint32_t>& closed       = channel.closedFlag();
+
+    std::string response;
+    while (!channel.closed() && requestRing.waitForMessage(closed, options)) {
+        requestRing.consume(
+            [&](const char* request, std::size_t size) {
+                ResponseRouter::Post(rpc, request, size, context, response);
+                requests.fetch_add(1, std::memory_order_relaxed);
+                if (response.empty()) {
+                    return;
+                }
+                if (response.size() > responseRing.maxMessageSize()) {
+                    response = InternalErrors(response);
+                }
+                if (response.size() > responseRing.maxMessageSize()) {
+                    // not even the errors fit: the client fails its calls when the channel closes
+                    channel.close();
+                    response.clear();
+                    return;
+                }
+                while (!responseRing.tryPush(response.data(), response.size())) {
+                    if (!responseRing.waitForRoom(response.size(), closed, options)) {
+                        break;
+                    }
+                }
+                response.clear();
+            },
+            // the request ring is freed as the calls are run, for the client to push more
+            64);
+        if (requestRing.corrupted()) {
+            channel.close();
+        }
+    }
+}
+
+// in place of a response too large for the ring: an InternalError with its id (for a batch, one for each
+// response), for the client to match with its call
+template <typename Rpc>
+std::string AsyncJsonRPCSharedMemoryServer<Rpc>::InternalErrors(const std::string& response)
+{
+    Json::Value  value;
+    Json::Reader reader;
+    reader.parse(response, value);
+    if (!value.isArray()) {
+        const Json::Value id = (value.isObject() ? value["id"] : Json::Value());
+        return JsonErrorCode::make_InternalError(id).toJsonRpcResponseStr();
+    }
+    Json::Value errors(Json::arrayValue);
+    for (const Json::Value& each : value) {
+        const Json::Value id = (each.isObject() ? each["id"] : Json::Value());
+        errors.append(JsonErrorCode::make_InternalError(id).toJsonRpcResponse());
+    }
+    Json::FastWriter writer;
+    return writer.write(errors);
+}
+
+template <typename Rpc>
+std::shared_ptr<SharedMemoryChannel> AsyncJsonRPCSharedMemoryServer<Rpc>::accept(ContextTuple context)
+{
+    std::shared_ptr<SharedMemoryChannel> channel = SharedMemoryChannel::Create(options.ringCapacity);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // the threads of channels that were closed since
+    for (auto it = served.begin(); it != served.end();) {
+        if (it->done->load()) {
+            it->thread.join();
+            it = served.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    Served entry;
+    entry.channel = channel;
+    entry.done    = std::make_shared<std::atomic<bool>>(false);
+    entry.thread  = std::thread([this, channel, context, done = entry.done]() {
+        serve(*channel, context);
+        done->store(true);
+    });
+    served.push_back(std::move(entry));
+    channels.fetch_add(1, std::memory_order_relaxed);
+    return channel;
+}
+
+template <typename Rpc>
+void AsyncJsonRPCSharedMemoryServer<Rpc>::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Served& entry : served) {
+        entry.channel->close();
+    }
+    for (Served& entry : served) {
+        entry.thread.join();
+    }
+    served.clear();
+}
+
+template <typename Rpc>
+SharedMemoryServerStats AsyncJsonRPCSharedMemoryServer<Rpc>::stats() const
+{
+    SharedMemoryServerStats result;
+    result.channels = channels.load(std::memory_order_relaxed);
+    result.requests = requests.load(std::memory_order_relaxed);
+    return result;
+}
+
+#endif // ASYNCJSONRPCSHAREDMEMORYSERVER_H
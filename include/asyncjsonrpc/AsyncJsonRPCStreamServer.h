@@ -0,0 +1,430 @@
+#ifndef ASYNCJSONRPCSTREAMSERVER_H
+#define ASYNCJSONRPCSTREAMSERVER_H
+
+#include "AcceptLoop.h"
+#include "ResponseRouter.h"
+#include "StreamFraming.h"
+#include "Subscriptions.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct StreamServerOptions
+{
+    Framing framing = Framing::Ndjson;
+
+    // bytes asked for by every read: a client that sends many small requests gets them framed and run
+    // many per read
+    std::size_t readBufferSize = 64 * 1024;
+
+    // larger frames close the connection; the read buffer grows up to this to hold one
+    std::size_t maxFrameSize = 1024 * 1024;
+
+    // framed responses waiting for the socket, per connection; reading pauses beyond this. Notifications
+    // that would queue beyond it are dropped.
+    std::size_t maxPendingBytes = 1024 * 1024;
+
+    // after a failed accept (out of file descriptors...), the wait before accepting again
+    std::chrono::milliseconds acceptRetryDelay{100};
+
+    // the responses of the rpc's calls that don't come through a server (asyncPost(), ...)
+    ResponseRouter::Fallback responseFallback;
+};
+
+struct StreamServerStats
+{
+    std::uint64_t accepted;     // connections
+    std::uint64_t acceptErrors; // failed accepts, each followed by acceptRetryDelay without accepting
+    std::uint64_t requests;     // frames posted to the rpc
+    std::uint64_t reads;        // completed reads; fewer than requests when they are read together
+    std::uint64_t writes;       // every write sends all the responses framed since the previous one
+    std::uint64_t notified;     // notifications written
+    std::uint64_t dropped;      // notifications dropped: the connection was too far behind
+};
+
+// json-rpc over a raw byte stream, for service-to-service traffic without the overhead of HTTP:
+// Protocol is boost::asio::ip::tcp or boost::asio::local::stream_protocol (Unix domain sockets).
+// Messages are delimited by options.framing, in both directions.
+//
+// Every read asks for up to options.readBufferSize bytes; the frames in them are found by a
+// StreamFramer, and posted one after the other, from the read buffer (they aren't copied). Their
+// framed responses are appended to one string, sent with a single write; the responses framed while it
+// is in progress go with the next one. As in AsyncJsonRPCHttpServer, every connection runs on a strand,
+// the contexts of the calls are made once per connection, the rpc's response callback is replaced by a
+// ResponseRouter, and the server must outlive the io_context's run(). A Unix socket's path must not
+// exist before the server is constructed.
+//
+// The connections are NotificationSinks (see Subscriptions.h): a notification pushed to one is written
+// with the next write, from its shared buffer (only its framing is copied), after the responses.
+template <typename Rpc, typename Protocol = boost::asio::ip::tcp>
+class AsyncJsonRPCStreamServer
+{
+public:
+    using ContextTuple   = typename Rpc::HandlerContextTuple;
+    using Endpoint       = typename Protocol::endpoint;
+    using ContextFactory = std::function<ContextTuple(const Endpoint& remote)>;
+
+private:
+    class Connection;
+
+    Rpc&                      rpc;
+    const StreamServerOptions options;
+    ContextFactory            contextFactory;
+    AcceptLoop<Protocol>      acceptLoop;
+
+    std::atomic<std::uint64_t> accepted{0};
+    std::atomic<std::uint64_t> requests{0};
+    std::atomic<std::uint64_t> reads{0};
+    std::atomic<std::uint64_t> writes{0};
+    std::atomic<std::uint64_t> notified{0};
+    std::atomic<std::uint64_t> dropped{0};
+
+    static void SetSocketOptions(boost::asio::ip::tcp::socket& socket)
+    {
+        boost::system::error_code ignored;
+        socket.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+    }
+    template <typename Socket>
+    static void SetSocketOptions(Socket&)
+    {
+    }
+
+    void onAccept(typename Protocol::socket&& socket);
+
+public:
+    // contexts are value-initialized if no factory is given
+    static ContextFactory DefaultContextFactory()
+    {
+        return [](const Endpoint&) { return ContextTuple(); };
+    }
+
+    AsyncJsonRPCStreamServer(Rpc& rpcRef, boost::asio::io_context& ioContextRef,
+                             const Endpoint&            endpoint,
+                             ContextFactory             Factory = DefaultContextFactory(),
+                             const StreamServerOptions& Options = StreamServerOptions());
+
+    AsyncJsonRPCStreamServer(const AsyncJsonRPCStreamServer&) = delete;
+    AsyncJsonRPCStreamServer& operator=(const AsyncJsonRPCStreamServer&) = delete;
+
+    // with port 0 in the constructor, the port that was picked
+    Endpoint localEndpoint() const { return acceptLoop.localEndpoint(); }
+
+    void start();
+
+    // stops accepting; open connections are served until the clients close them
+    void stop();
+
+    StreamServerStats stats() const;
+};
+
+template <typename Rpc, typename Protocol>
+class AsyncJsonRPCStreamServer<Rpc, Protocol>::Connection
+    : public std::enable_shared_from_this<Connection>
+{
+    AsyncJsonRPCStreamServer&              server;
+    ContextTuple                           context;
+    StreamFramer                           framer;
+    std::vector<char>                      buffer;
+    std::size_t                            begin = 0; // buffer[begin, end) is read, and not framed yet
+    std::size_t                            end   = 0;
+    std::string                            response;
+    std::string                            pending; // framed responses, for the next write
+    std::string                            writing;
+    std::vector<SharedMessage>             notifications; // for the next write, after pending
+    std::size_t                            notificationBytes = 0;
+    std::vector<SharedMessage>             writingNotifications;
+    std::string                            prefixes; // the framing of writingNotifications
+    std::vector<std::size_t>               prefixEnds;
+    std::vector<boost::asio::const_buffer> buffers;
+    std::shared_ptr<NotificationSink>      sink;
+    bool                                   reading = false;
+    bool                                   closing = false; // once the pending responses are written
+    bool                                   closed  = false;
+
+    bool canRead() const
+    {
+        return !reading && !closing && pending.size() < server.options.maxPendingBytes;
+    }
+
+    // without the "\n" that ends the library's messages
+    static std::size_t MessageSize(const std::string& message)
+    {
+        return !message.empty() && message.back() == '\n' ? message.size() - 1 : message.size();
+    }
+
+    void read();
+    void onRead(boost::system::error_code ec, std::size_t size);
+    void handleBuffered();
+    void flush();
+    void close();
+    void drain();
+
+public:
+    typename Protocol::socket socket;
+
+    // the socket is on a strand of its own
+    Connection(AsyncJsonRPCStreamServer& Server, typename Protocol::socket&& Socket)
+        : server(Server), framer(Server.options.framing, Server.options.maxFrameSize),
+          buffer(Server.options.readBufferSize), socket(std::move(Socket))
+    {
+    }
+
+    void start(ContextTuple Context)
+    {
+        context = std::move(Context);
+        sink    = std::make_shared<ConnectionSink<Connection, typename Protocol::socket::executor_type>>(
+            this->shared_from_this(), socket.get_executor());
+        read();
+    }
+
+    // on the strand
+    void notify(const SharedMessage& message);
+};
+
+template <typename Rpc, typename Protocol>
+void AsyncJsonRPCStreamServer<Rpc, Protocol>::Connection::read()
+{
+    if (end == buffer.size()) {
+        if (begin > 0) {
+            // the beginning of a frame, at the end of the buffer: moved to the front
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        } else {
+            // a frame larger than the buffer; the framer fails before it grows beyond maxFrameSize
+            buffer.resize(std::max(buffer.size() * 2, server.options.readBufferSize));
+        }
+    }
+    reading   = true;
+    auto self = this->shared_from_this();
+    socket.async_read_some(boost::asio::buffer(buffer.data() + end, buffer.size() - end),
+                           [self](boost::system::error_code ec, std::size_t size) {
+                               self->onRead(ec, size);
+                           });
+}
+
+template <typename Rpc, typename Protocol>
+void AsyncJsonRPCStreamServer<Rpc, Protocol>::Connection::onRead(boost::system::error_code ec,
+                                                                 std::size_t               size)
+{
+    reading = false;
+    if (ec) {
+        // the client closed the connection, or it broke: answer what was read, then close
+        closing = true;
+        flush();
+        return;
+    }
+    end += size;
+    server.reads.fetch_add(1, std::memory_order_relaxed);
+    handleBuffered();
+    flush();
+    if (canRead()) {
+        read();
+    }
+}
+
+template <typename Rpc, typename Protocol>
+void AsyncJsonRPCStreamServer<Rpc, Protocol>::Connection::handleBuffered()
+{
+    NotificationSink::Scope subscribing(sink);
+    const std::size_t       consumed =
+        framer.consume(buffer.data() + begin, end - begin, [this](const char* frame, std::size_t size) {
+            ResponseRouter::Post(server.rpc, frame, size, context, response);
+            server.requests.fetch_add(1, std::memory_order_relaxed);
+            if (!response.empty()) {
+                // notifications have no response
+                StreamFramer::Encode(server.options.framing, response.data(), response.size(), pending);
+                response.clear();
+            }
+        });
+    begin += consumed;
+    if (begin == end) {
+        begin = 0;
+        end   = 0;
+        if (buffer.size() > server.options.readBufferSize) {
+            // it was grown for a large frame
+            buffer.resize(server.options.readBufferSize);
+            buffer.shrink_to_fit();
+        }
+    }
+    if (framer.failed()) {
+        // the next frame can't be found: answer the frames before it, then close
+        closing = true;
+    }
+}
+
+template <typename Rpc, typename Protocol>
+void AsyncJsonRPCStreamServer<Rpc, Protocol>::Connection::notify(const SharedMessage& message)
+{
+    if (closing || closed) {
+        return;
+    }
+    if (pending.size() + notificationBytes + message->size() > server.options.maxPendingBytes) {
+        server.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    notifications.push_back(message);
+    notificationBytes += message->size();
+    flush();
+}
+
+template <typename Rpc, typename Protocol>
+void AsyncJsonRPCStreamServer<Rpc, Protocol>::Connection::flush()
+{
+    if (!writing.empty() || !writingNotifications.empty()) {
+        return;
+    }
+    if (pending.empty() && notifications.empty()) {
+        if (closing && !reading) {
+            close();
+        }
+        return;
+    }
+
+    // the strings trade buffers: after the first few writes, neither allocates
+    writing.swap(pending);
+    writingNotifications.swap(notifications);
+    notificationBytes = 0;
+    server.writes.fetch_add(1, std::memory_order_relaxed);
+
+    auto self      = this->shared_from_this();
+    auto onWritten = [self](boost::system::error_code ec, std::size_t) {
+        if (ec) {
+            self->close();
+            return;
+        }
+        self->writing.clear();
+        self->writingNotifications.clear();
+        self->flush();
+        if (self->canRead()) {
+            self->read();
+        }
+    };
+    if (writingNotifications.empty()) {
+        boost::asio::async_write(socket, boost::asio::buffer(writing), onWritten);
+        return;
+    }
+
+    // gathered: the responses, then every notification between its framing
+    const Framing framing = server.options.framing;
+    prefixes.clear();
+    prefixEnds.clear();
+    for (const SharedMessage& notification : writingNotifications) {
+        StreamFramer::EncodePrefix(framing, MessageSize(*notification), prefixes);
+        prefixEnds.push_back(prefixes.size());
+    }
+    const char*       suffix     = StreamFramer::Suffix(framing);
+    const std::size_t suffixSize = std::strlen(suffix);
+    buffers.clear();
+    if (!writing.empty()) {
+        buffers.push_back(boost::asio::buffer(writing));
+    }
+    std::size_t prefixBegin = 0;
+    for (std::size_t n = 0; n < writingNotifications.size(); n++) {
+        const std::string& notification = *writingNotifications[n];
+        if (prefixEnds[n] > prefixBegin) {
+            buffers.push_back(boost::asio::buffer(&prefixes[prefixBegin], prefixEnds[n] - prefixBegin));
+        }
+        buffers.push_back(boost::asio::buffer(notification.data(), MessageSize(notification)));
+        if (suffixSize > 0) {
+            buffers.push_back(boost::asio::buffer(suffix, suffixSize));
+        }
+        prefixBegin = prefixEnds[n];
+    }
+    server.notified.fetch_add(writingNotifications.size(), std::memory_order_relaxed);
+    boost::asio::async_write(socket, buffers, onWritten);
+}
+
+template <typename Rpc, typename Protocol>
+void AsyncJsonRPCStreamServer<Rpc, Protocol>::Connection::close()
+{
+    if (closed) {
+        return;
+    }
+    closed = true;
+    // as in AsyncJsonRPCHttpServer: closing with unread data would reset the connection
+    boost::system::error_code ignored;
+    socket.shutdown(Protocol::socket::shutdown_send, ignored);
+    drain();
+}
+
+template <typename Rpc, typename Protocol>
+void AsyncJsonRPCStreamServer<Rpc, Protocol>::Connection::drain()
+{
+    auto self = this->shared_from_this();
+    socket.async_read_some(boost::asio::buffer(buffer),
+                           [self](boost::system::error_code ec, std::size_t) {
+                               if (ec) {
+                                   boost::system::error_code ignored;
+                                   self->socket.close(ignored);
+                                   return;
+                               }
+                               self->drain();
+                           });
+}
+
+template <typename Rpc, typename Protocol>
+AsyncJsonRPCStreamServer<Rpc, Protocol>::AsyncJsonRPCStreamServer(
+    Rpc& rpcRef, boost::asio::io_context& ioContextRef, const Endpoint& endpoint, ContextFactory Factory,
+    const StreamServerOptions& Options)
+    : rpc(rpcRef), options(Options), contextFactory(std::move(Factory)),
+      acceptLoop(ioContextRef, endpoint, Options.acceptRetryDelay)
+{
+    ResponseRouter::Install(rpc, options.responseFallback);
+}
+
+template <typename Rpc, typename Protocol>
+void AsyncJsonRPCStreamServer<Rpc, Protocol>::start()
+{
+    acceptLoop.start([this](typename Protocol::socket&& socket) { onAccept(std::move(socket)); });
+}
+
+template <typename Rpc, typename Protocol>
+void AsyncJsonRPCStreamServer<Rpc, Protocol>::stop()
+{
+    acceptLoop.stop();
+}
+
+template <typename Rpc, typename Protocol>
+void AsyncJsonRPCStreamServer<Rpc, Protocol>::onAccept(typename Protocol::socket&& socket)
+{
+    accepted.fetch_add(1, std::memory_order_relaxed);
+    SetSocketOptions(socket);
+    boost::system::error_code ignored;
+    const Endpoint            remote     = socket.remote_endpoint(ignored);
+    auto                      connection = std::make_shared<Connection>(*this, std::move(socket));
+    ContextTuple              context    = contextFactory(remote);
+    // the connection's handlers run on its strand, the accept handler doesn't
+    boost::asio::dispatch(connection->socket.get_executor(), [connection, context]() mutable {
+        connection->start(std::move(context));
+    });
+}
+
+template <typename Rpc, typename Protocol>
+StreamServerStats AsyncJsonRPCStreamServer<Rpc, Protocol>::stats() const
+{
+    StreamServerStats result;
+    result.accepted     = accepted.load(std::memory_order_relaxed);
+    result.acceptErrors = acceptLoop.acceptErrors();
+    result.requests     = requests.load(std::memory_order_relaxed);
+    result.reads        = reads.load(std::memory_order_relaxed);
+    result.writes       = writes.load(std::memory_order_relaxed);
+    result.notified     = notified.load(std::memory_order_relaxed);
+    result.dropped      = dropped.load(std::memory_order_relaxed);
+    return result;
+}
+
+#endif // ASYNCJSONRPCSTREAMSERVER_H
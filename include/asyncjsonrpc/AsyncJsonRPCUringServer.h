@@ -0,0 +1,576 @@
+#ifndef ASYNCJSONRPCURINGSERVER_H
+#define ASYNCJSONRPCURINGSERVER_H
+
+#include "AcceptLoop.h"
+#include "AsyncJsonRPCStreamServer.h"
+#include "IoUring.h"
+#include "ResponseRouter.h"
+#include "StreamFraming.h"
+#include <atomic>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct UringServerOptions
+{
+    // the framing, and the limits of frames and of responses waiting to be sent, per connection
+    // (readBufferSize is only used by the fallback)
+    StreamServerOptions stream;
+
+    // entries of the submission queue, a power of two; the completion queue has four times as many
+    unsigned queueDepth = 4096;
+
+    // the buffers shared by the receives of all the connections (at most 65535), and their size; a
+    // connection holds none while it has nothing to read
+    unsigned    bufferCount = 1024;
+    std::size_t bufferSize  = 16 * 1024;
+
+    // serve with AsyncJsonRPCStreamServer even where io_uring is available, to compare them
+    bool forceFallback = false;
+};
+
+struct UringServerStats
+{
+    std::uint64_t accepted;     // connections
+    std::uint64_t acceptErrors; // failed accepts, each followed by stream.acceptRetryDelay without accepting
+    std::uint64_t requests;     // frames posted to the rpc
+    std::uint64_t reads;        // receive completions with data
+    std::uint64_t writes;       // sends; every one has all the responses framed since the previous one
+    std::uint64_t submits;      // io_uring_enter() calls, for all the reads and writes of the connections
+};
+
+// json-rpc over TCP with io_uring (Linux 6.1 or later), framed as with AsyncJsonRPCStreamServer. A
+// thread of the server owns the ring: it accepts with a multishot accept (rearmed after
+// stream.acceptRetryDelay, with a timeout on the ring, when it fails), and every connection has a
+// multishot receive into buffers provided to the kernel, so reading a connection again takes no system
+// call. Every turn of the thread submits what it queued (sends, receives to rearm) and waits for the
+// next completions with a single io_uring_enter(), then runs the frames of all the completed receives,
+// from the provided buffers (copied only when a frame is split between two of them). As in the other
+// transports, frames are posted one after the other with the contexts made for the connection, their
+// responses framed into one string per send, and the rpc's response callback is replaced by a
+// ResponseRouter.
+//
+// Where io_uring can't be set up (an older kernel, or disabled), the server is an
+// AsyncJsonRPCStreamServer on the io_context instead: usesUring() tells which. The ring is enabled by
+// the thread that submits to it; if that fails, start() falls back too, on the same endpoint. stop()
+// closes the open connections too, and waits for the thread (the fallback only stops accepting, as
+// AsyncJsonRPCStreamServer::stop()).
+template <typename Rpc>
+class AsyncJsonRPCUringServer
+{
+public:
+    using ContextTuple   = typename Rpc::HandlerContextTuple;
+    using Endpoint       = boost::asio::ip::tcp::endpoint;
+    using ContextFactory = std::function<ContextTuple(const Endpoint& remote)>;
+    using Fallback       = AsyncJsonRPCStreamServer<Rpc, boost::asio::ip::tcp>;
+
+private:
+    // what a completion is for, in the high byte of its user data; the low bits are the connection's
+    enum Operation : std::uint64_t
+    {
+        Accept = 1,
+        AcceptRetry, // the timeout after a failed accept
+        Wake,
+        Receive,
+        Send,
+        CancelReceive,
+        CancelAll
+    };
+
+    struct Connection
+    {
+        int          fd;
+        ContextTuple context;
+        StreamFramer framer;
+        std::string  partial; // the beginning of a frame, received with the end of a previous buffer
+        std::string  response;
+        std::string  pending; // framed responses, for the next send
+        std::string  writing;
+        std::size_t  written    = 0;
+        unsigned     inflight   = 0; // requests of the ring that will complete
+        bool         receiving  = false;
+        bool         cancelling = false;
+        bool         sending    = false;
+        bool         closing    = false; // no more frames are run
+        bool         readDone   = false; // not received from again
+        bool         writeDone  = false; // shut down for writing
+
+        Connection(int Fd, ContextTuple Context, const StreamServerOptions& options)
+            : fd(Fd), context(std::move(Context)), framer(options.framing, options.maxFrameSize)
+        {
+        }
+    };
+
+    Rpc&                     rpc;
+    boost::asio::io_context& ioContext;
+    const UringServerOptions options;
+    ContextFactory           contextFactory;
+
+    std::unique_ptr<IoUring>                          ring;
+    std::unique_ptr<IoUringProvidedBuffers>           buffers;
+    std::unique_ptr<AcceptLoop<boost::asio::ip::tcp>> acceptLoop; // its socket, accepted on by the ring
+    std::unique_ptr<Fallback>                         fallback;
+
+    // of the ring's thread
+    std::vector<std::unique_ptr<Connection>> connections;
+    std::vector<std::uint32_t>               freeSlots;
+    std::vector<std::uint32_t>               toReceive; // connections whose receive is to be rearmed
+    std::size_t                              inflight = 0;
+
+    int               wakeFd    = -1;
+    std::uint64_t     wakeValue = 0;
+    std::atomic<bool> stopping{false};
+    std::thread       thread;
+
+    std::atomic<std::uint64_t> accepted{0};
+    std::atomic<std::uint64_t> requests{0};
+    std::atomic<std::uint64_t> reads{0};
+    std::atomic<std::uint64_t> writes{0};
+    std::atomic<std::uint64_t> submits{0};
+
+    static std::uint64_t UserData(Operation operation, std::uint32_t slot)
+    {
+        return (static_cast<std::uint64_t>(operation) << 56) | slot;
+    }
+
+    bool canReceive(const Connection& connection) const
+    {
+        // while closing, receives go on, and what they get is dropped, until the client closes
+        return !connection.receiving && !connection.readDone &&
+               (connection.closing || connection.pending.size() < options.stream.maxPendingBytes);
+    }
+
+    void run();
+    void fallBack();
+    void complete(const IoUringCompletion& completion);
+    void onAccept(int fd);
+    void onReceive(std::uint32_t slot, const IoUringCompletion& completion);
+    void onSend(std::uint32_t slot, int result);
+    void handleReceived(Connection& connection, const char* data, std::size_t size);
+    void flush(std::uint32_t slot);
+    void release(std::uint32_t slot);
+    void shutdown();
+
+public:
+    static ContextFactory DefaultContextFactory()
+    {
+        return [](const Endpoint&) { return ContextTuple(); };
+    }
+
+    // ioContext is only used by the fallback
+    AsyncJsonRPCUringServer(Rpc& rpcRef, boost::asio::io_context& ioContext, const Endpoint& endpoint,
+                            ContextFactory            Factory = DefaultContextFactory(),
+                            const UringServerOptions& Options = UringServerOptions());
+
+    AsyncJsonRPCUringServer(const AsyncJsonRPCUringServer&) = delete;
+    AsyncJsonRPCUringServer& operator=(const AsyncJsonRPCUringServer&) = delete;
+
+    ~AsyncJsonRPCUringServer() { stop(); }
+
+    // final once start() returned
+    bool usesUring() const { return ring != nullptr; }
+
+    Endpoint localEndpoint() const
+    {
+        return fallback ? fallback->localEndpoint() : acceptLoop->localEndpoint();
+    }
+
+    void start();
+
+    void stop();
+
+    UringServerStats stats() const;
+};
+
+template <typename Rpc>
+AsyncJsonRPCUringServer<Rpc>::AsyncJsonRPCUringServer(Rpc& rpcRef, boost::asio::io_context& ioContextRef,
+                                                      const Endpoint& endpoint, ContextFactory Factory,
+                                                      const UringServerOptions& Options)
+    : rpc(rpcRef), ioContext(ioContextRef), options(Options), contextFactory(std::move(Factory))
+{
+    if (!options.forceFallback) {
+        ring = IoUring::Create(options.queueDepth);
+    }
+    if (ring) {
+        wakeFd = ::eventfd(0, EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            ring.reset();
+        }
+    }
+    if (!ring) {
+        fallback.reset(new Fallback(rpc, ioContext, endpoint, contextFactory, options.stream));
+        return;
+    }
+    acceptLoop.reset(
+        new AcceptLoop<boost::asio::ip::tcp>(ioContext, endpoint, options.stream.acceptRetryDelay));
+    buffers.reset(new IoUringProvidedBuffers(*ring, 0, options.bufferCount, options.bufferSize));
+    ResponseRouter::Install(rpc, options.stream.responseFallback);
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::start()
+{
+    if (!fallback) {
+        std::promise<bool> enabled;
+        std::future<bool>  result = enabled.get_future();
+        thread = std::thread([this, enabled = std::move(enabled)]() mutable {
+            const bool ok = ring->enable();
+            enabled.set_value(ok);
+            if (ok) {
+                run();
+            }
+        });
+        if (result.get()) {
+            return;
+        }
+        thread.join();
+        fallBack();
+    }
+    fallback->start();
+}
+
+// the ring was set up, but can't be enabled: what was made for it is released, and the endpoint it
+// would have accepted on is served by the fallback
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::fallBack()
+{
+    const Endpoint endpoint = acceptLoop->localEndpoint();
+    acceptLoop.reset();
+    buffers.reset();
+    ring.reset();
+    ::close(wakeFd);
+    wakeFd = -1;
+    fallback.reset(new Fallback(rpc, ioContext, endpoint, contextFactory, options.stream));
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::stop()
+{
+    if (fallback) {
+        fallback->stop();
+        return;
+    }
+    if (!thread.joinable()) {
+        return;
+    }
+    stopping.store(true);
+    const std::uint64_t one = 1;
+    ssize_t             ignored = ::write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+    thread.join();
+    ::close(wakeFd);
+    wakeFd = -1;
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::run()
+{
+    ring->prepareAccept(acceptLoop->nativeHandle(), UserData(Accept, 0));
+    ring->prepareRead(wakeFd, &wakeValue, sizeof(wakeValue), UserData(Wake, 0));
+    inflight += 2;
+
+    while (!stopping.load()) {
+        ring->submitAndWait(1);
+        submits.fetch_add(1, std::memory_order_relaxed);
+        ring->forEachCompletion([this](const IoUringCompletion& completion) { complete(completion); });
+        // the buffers of all the receives handled, given back at once
+        buffers->publish();
+        for (std::uint32_t slot : toReceive) {
+            Connection* connection = connections[slot].get();
+            if (connection && canReceive(*connection)) {
+                ring->prepareReceive(connection->fd, 0, UserData(Receive, slot));
+                connection->receiving = true;
+                connection->inflight++;
+                inflight++;
+            }
+        }
+        toReceive.clear();
+    }
+    shutdown();
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::complete(const IoUringCompletion& completion)
+{
+    if (completion.userData == IoUring::Internal) {
+        // buffers the kernel refused: fewer are left
+        return;
+    }
+    const Operation     operation = static_cast<Operation>(completion.userData >> 56);
+    const std::uint32_t slot      = static_cast<std::uint32_t>(completion.userData);
+    if (!completion.more) {
+        inflight--;
+    }
+
+    switch (operation) {
+    case Accept:
+        if (completion.result >= 0) {
+            onAccept(completion.result);
+        } else if (completion.result != -ECANCELED) {
+            acceptLoop->countError();
+        }
+        if (!completion.more && !stopping.load()) {
+            if (completion.result < 0) {
+                // accepting again at once would most likely fail again (EMFILE...), in a busy loop
+                ring->prepareTimeout(options.stream.acceptRetryDelay, UserData(AcceptRetry, 0));
+            } else {
+                ring->prepareAccept(acceptLoop->nativeHandle(), UserData(Accept, 0));
+            }
+            inflight++;
+        }
+        break;
+    case AcceptRetry:
+        if (!stopping.load()) {
+            ring->prepareAccept(acceptLoop->nativeHandle(), UserData(Accept, 0));
+            inflight++;
+        }
+        break;
+    case Wake:
+        // stopping is checked by the loop
+        break;
+    case Receive:
+        onReceive(slot, completion);
+        break;
+    case Send:
+        onSend(slot, completion.result);
+        break;
+    case CancelReceive:
+        connections[slot]->cancelling = false;
+        connections[slot]->inflight--;
+        release(slot);
+        break;
+    case CancelAll:
+        break;
+    }
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::onAccept(int fd)
+{
+    accepted.fetch_add(1, std::memory_order_relaxed);
+    const int noDelay = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    Endpoint  remote;
+    socklen_t size = static_cast<socklen_t>(remote.capacity());
+    if (::getpeername(fd, remote.data(), &size) == 0) {
+        remote.resize(size);
+    }
+
+    std::uint32_t slot;
+    if (freeSlots.empty()) {
+        slot = static_cast<std::uint32_t>(connections.size());
+        connections.emplace_back();
+    } else {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    connections[slot].reset(new Connection(fd, contextFactory(remote), options.stream));
+    toReceive.push_back(slot);
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::onReceive(std::uint32_t slot, const IoUringCompletion& completion)
+{
+    Connection& connection = *connections[slot];
+    if (!completion.more) {
+        connection.receiving = false;
+        connection.inflight--;
+    }
+
+    if (completion.result > 0) {
+        reads.fetch_add(1, std::memory_order_relaxed);
+        if (!connection.closing) {
+            handleReceived(connection, buffers->buffer(completion.bufferId),
+                           static_cast<std::size_t>(completion.result));
+        }
+        buffers->recycle(completion.bufferId);
+    } else if (completion.result != -ENOBUFS && completion.result != -ECANCELED) {
+        // the client closed the connection, or it broke: answer what was read, then close
+        connection.closing  = true;
+        connection.readDone = true;
+    }
+
+    if (connection.receiving && !connection.cancelling && !canReceive(connection) &&
+        !connection.closing) {
+        // too many responses wait for the client to read them: receiving stops until they're sent
+        ring->prepareCancel(UserData(Receive, slot), UserData(CancelReceive, slot));
+        connection.cancelling = true;
+        connection.inflight++;
+        inflight++;
+    }
+    if (canReceive(connection)) {
+        // rearmed once the buffers are given back (a receive that found none ended with ENOBUFS)
+        toReceive.push_back(slot);
+    }
+    flush(slot);
+    release(slot);
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::handleReceived(Connection& connection, const char* data,
+                                                  std::size_t size)
+{
+    auto onFrame = [this, &connection](const char* frame, std::size_t frameSize) {
+        ResponseRouter::Post(rpc, frame, frameSize, connection.context, connection.response);
+        requests.fetch_add(1, std::memory_order_relaxed);
+        if (!connection.response.empty()) {
+            StreamFramer::Encode(options.stream.framing, connection.response.data(),
+                                 connection.response.size(), connection.pending);
+            connection.response.clear();
+        }
+    };
+
+    if (connection.partial.empty()) {
+        // the frames are run from the provided buffer, and the rest is kept
+        const std::size_t consumed = connection.framer.consume(data, size, onFrame);
+        connection.partial.assign(data + consumed, size - consumed);
+    } else {
+        connection.partial.append(data, size);
+        const std::size_t consumed =
+            connection.framer.consume(connection.partial.data(), connection.partial.size(), onFrame);
+        connection.partial.erase(0, consumed);
+    }
+    if (connection.framer.failed()) {
+        // the next frame can't be found: answer the frames before it, then close
+        connection.closing = true;
+        connection.partial.clear();
+    }
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::flush(std::uint32_t slot)
+{
+    Connection& connection = *connections[slot];
+    if (connection.sending || connection.writeDone) {
+        return;
+    }
+    if (connection.pending.empty()) {
+        if (connection.closing) {
+            // as in AsyncJsonRPCStreamServer: the connection is closed once the client closes it too
+            ::shutdown(connection.fd, SHUT_WR);
+            connection.writeDone = true;
+        }
+        return;
+    }
+
+    connection.writing.swap(connection.pending);
+    connection.written = 0;
+    connection.sending = true;
+    connection.inflight++;
+    inflight++;
+    writes.fetch_add(1, std::memory_order_relaxed);
+    ring->prepareSend(connection.fd, connection.writing.data(), connection.writing.size(),
+                      UserData(Send, slot));
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::onSend(std::uint32_t slot, int result)
+{
+    Connection& connection = *connections[slot];
+    connection.inflight--;
+    if (result <= 0) {
+        // the client is gone: nothing more is sent, or received
+        connection.sending   = false;
+        connection.closing   = true;
+        connection.readDone  = true;
+        connection.writeDone = true;
+        connection.pending.clear();
+        if (connection.receiving && !connection.cancelling) {
+            ring->prepareCancel(UserData(Receive, slot), UserData(CancelReceive, slot));
+            connection.cancelling = true;
+            connection.inflight++;
+            inflight++;
+        }
+        release(slot);
+        return;
+    }
+
+    connection.written += static_cast<std::size_t>(result);
+    if (connection.written < connection.writing.size()) {
+        // a short send: the rest
+        connection.inflight++;
+        inflight++;
+        ring->prepareSend(connection.fd, connection.writing.data() + connection.written,
+                          connection.writing.size() - connection.written, UserData(Send, slot));
+        return;
+    }
+    connection.writing.clear();
+    connection.sending = false;
+    flush(slot);
+    if (canReceive(connection)) {
+        toReceive.push_back(slot);
+    }
+    release(slot);
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::release(std::uint32_t slot)
+{
+    Connection& connection = *connections[slot];
+    if (connection.inflight > 0 || !connection.readDone || !connection.writeDone) {
+        return;
+    }
+    ::close(connection.fd);
+    connections[slot].reset();
+    freeSlots.push_back(slot);
+}
+
+template <typename Rpc>
+void AsyncJsonRPCUringServer<Rpc>::shutdown()
+{
+    // everything still armed is cancelled; the buffers and strings of the connections must outlive it
+    ring->prepareCancelAll(UserData(CancelAll, 0));
+    inflight++;
+    while (inflight > 0) {
+        ring->submitAndWait(1);
+        ring->forEachCompletion([this](const IoUringCompletion& completion) {
+            if (completion.userData != IoUring::Internal && !completion.more) {
+                inflight--;
+            }
+        });
+    }
+    for (std::unique_ptr<Connection>& connection : connections) {
+        if (connection) {
+            ::close(connection->fd);
+        }
+    }
+    connections.clear();
+    freeSlots.clear();
+}
+
+template <typename Rpc>
+UringServerStats AsyncJsonRPCUringServer<Rpc>::stats() const
+{
+    UringServerStats result;
+    if (fallback) {
+        const StreamServerStats stream = fallback->stats();
+        result.accepted                = stream.accepted;
+        result.acceptErrors            = stream.acceptErrors;
+        result.requests                = stream.requests;
+        result.reads                   = stream.reads;
+        result.writes                  = stream.writes;
+        result.submits                 = 0;
+        return result;
+    }
+    result.accepted     = accepted.load(std::memory_order_relaxed);
+    result.acceptErrors = acceptLoop->acceptErrors();
+    result.requests     = requests.load(std::memory_order_relaxed);
+    result.reads        = reads.load(std::memory_order_relaxed);
+    result.writes       = writes.load(std::memory_order_relaxed);
+    result.submits      = submits.load(std::memory_order_relaxed);
+    return result;
+}
+
+#endif // ASYNCJSONRPCURINGSERVER_H
@@ -0,0 +1,401 @@
+#ifndef ASYNCJSONRPCWEBSOCKETSERVER_H
+#define ASYNCJSONRPCWEBSOCKETSERVER_H
+
+#include "AcceptLoop.h"
+#include "ResponseRouter.h"
+#include "Subscriptions.h"
+#include <atomic>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <boost/beast/http/write.hpp>
+#include <boost/beast/websocket/rfc6455.hpp>
+#include <boost/beast/websocket/stream.hpp>
+#include <boost/optional.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct WebSocketServerOptions
+{
+    // upgrades to other targets are refused with 404; empty accepts every target
+    std::string target;
+
+    // larger messages close the connection
+    std::size_t maxMessageSize = 1024 * 1024;
+
+    // responses waiting for the socket, per connection; reading pauses beyond this. Notifications
+    // waiting beyond it are dropped.
+    std::size_t maxQueuedResponses = 1024;
+
+    // While a write is in progress, responses queue up; with coalesceResponses, the queued ones go out
+    // as one json array (a batch response: clients match responses by id), up to maxCoalesced per
+    // frame. Off by default, since clients that sent single calls must accept arrays.
+    bool        coalesceResponses = false;
+    std::size_t maxCoalesced      = 64;
+
+    // after a failed accept (out of file descriptors...), the wait before accepting again
+    std::chrono::milliseconds acceptRetryDelay{100};
+
+    // the responses of the rpc's calls that don't come through a server (asyncPost(), ...)
+    ResponseRouter::Fallback responseFallback;
+};
+
+struct WebSocketServerStats
+{
+    std::uint64_t accepted;     // upgraded connections
+    std::uint64_t acceptErrors; // failed accepts, each followed by acceptRetryDelay without accepting
+    std::uint64_t messages;     // posted to the rpc
+    std::uint64_t frames;       // written; fewer than messages when responses are coalesced
+    std::uint64_t notified;     // notifications written
+    std::uint64_t dropped;      // notifications dropped: the connection was too far behind
+};
+
+// WebSocket front end for an AsyncJsonRPC: every text message is a json-rpc request, and its response
+// is sent back on the same connection. The contexts of the calls are made once per connection, from
+// the upgrade request (cookies, tokens, ...), by the context factory. As in AsyncJsonRPCHttpServer,
+// calls run on the connection's strand, responses are routed back through a ResponseRouter (the rpc's
+// response callback is replaced), and the server must outlive the io_context's run().
+//
+// The connections are NotificationSinks (see Subscriptions.h): every notification pushed to one is a
+// frame of its own, written from its shared buffer once the queued responses are.
+template <typename Rpc>
+class AsyncJsonRPCWebSocketServer
+{
+public:
+    using ContextTuple   = typename Rpc::HandlerContextTuple;
+    using UpgradeRequest = boost::beast::http::request<boost::beast::http::string_body>;
+    using ContextFactory = std::function<ContextTuple(const UpgradeRequest&                upgrade,
+                                                      const boost::asio::ip::tcp::endpoint& remote)>;
+
+private:
+    class Connection;
+
+    Rpc&                             rpc;
+    const WebSocketServerOptions     options;
+    ContextFactory                   contextFactory;
+    AcceptLoop<boost::asio::ip::tcp> acceptLoop;
+
+    std::atomic<std::uint64_t> accepted{0};
+    std::atomic<std::uint64_t> messages{0};
+    std::atomic<std::uint64_t> frames{0};
+    std::atomic<std::uint64_t> notified{0};
+    std::atomic<std::uint64_t> dropped{0};
+
+    void onAccept(boost::asio::ip::tcp::socket&& socket);
+
+public:
+    // contexts are value-initialized if no factory is given
+    static ContextFactory DefaultContextFactory()
+    {
+        return [](const UpgradeRequest&, const boost::asio::ip::tcp::endpoint&) {
+            return ContextTuple();
+        };
+    }
+
+    AsyncJsonRPCWebSocketServer(Rpc& rpcRef, boost::asio::io_context& ioContextRef,
+                                const boost::asio::ip::tcp::endpoint& endpoint,
+                                ContextFactory                        Factory = DefaultContextFactory(),
+                                const WebSocketServerOptions& Options = WebSocketServerOptions());
+
+    AsyncJsonRPCWebSocketServer(const AsyncJsonRPCWebSocketServer&) = delete;
+    AsyncJsonRPCWebSocketServer& operator=(const AsyncJsonRPCWebSocketServer&) = delete;
+
+    // with port 0 in the constructor, the port that was picked
+    boost::asio::ip::tcp::endpoint localEndpoint() const { return acceptLoop.localEndpoint(); }
+
+    void start();
+
+    // stops accepting; open connections are served until the clients close them
+    void stop();
+
+    WebSocketServerStats stats() const;
+};
+
+template <typename Rpc>
+class AsyncJsonRPCWebSocketServer<Rpc>::Connection : public std::enable_shared_from_this<Connection>
+{
+    using MessageBuffer =
+        boost::asio::dynamic_string_buffer<char, std::char_traits<char>, std::allocator<char>>;
+
+    AsyncJsonRPCWebSocketServer&                                  server;
+    boost::beast::websocket::stream<boost::asio::ip::tcp::socket> ws;
+    ContextTuple                                                  context;
+    boost::beast::flat_buffer                                     upgradeBuffer;
+    UpgradeRequest                                                upgrade;
+    std::string                                                   message; // read straight into
+    boost::optional<MessageBuffer>                                messageBuffer;
+    std::deque<std::string>                                       queued;
+    std::string                                                   writing;
+    std::deque<SharedMessage>                                     notifications;
+    SharedMessage                                                 writingNotification;
+    std::shared_ptr<NotificationSink>                             sink;
+    bool                                                          reading = false;
+    bool                                                          closed  = false;
+
+    void onUpgradeRequest(boost::system::error_code ec);
+    void refuse(boost::beast::http::status status);
+    void read();
+    void onRead(boost::system::error_code ec);
+    void flush();
+    void writeNotification();
+    void onWritten(boost::system::error_code ec);
+
+public:
+    // the socket is on a strand of its own
+    Connection(AsyncJsonRPCWebSocketServer& Server, boost::asio::ip::tcp::socket&& Socket)
+        : server(Server), ws(std::move(Socket))
+    {
+    }
+
+    boost::asio::ip::tcp::socket& socket() { return ws.next_layer(); }
+
+    void start();
+
+    // on the strand
+    void notify(const SharedMessage& message);
+};
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::Connection::start()
+{
+    auto self = this->shared_from_this();
+    boost::beast::http::async_read(socket(), upgradeBuffer, upgrade,
+                                   [self](boost::system::error_code ec, std::size_t) {
+                                       self->onUpgradeRequest(ec);
+                                   });
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::Connection::onUpgradeRequest(boost::system::error_code ec)
+{
+    namespace http = boost::beast::http;
+    if (ec) {
+        return;
+    }
+    if (!boost::beast::websocket::is_upgrade(upgrade)) {
+        refuse(http::status::upgrade_required);
+        return;
+    }
+    if (!server.options.target.empty() && upgrade.target() != server.options.target) {
+        refuse(http::status::not_found);
+        return;
+    }
+
+    boost::system::error_code      ignored;
+    boost::asio::ip::tcp::endpoint remote = socket().remote_endpoint(ignored);
+    context                               = server.contextFactory(upgrade, remote);
+    ws.read_message_max(server.options.maxMessageSize);
+    ws.text(true);
+
+    auto self = this->shared_from_this();
+    ws.async_accept(upgrade, [self](boost::system::error_code ec) {
+        if (ec) {
+            return;
+        }
+        self->server.accepted.fetch_add(1, std::memory_order_relaxed);
+        using Sink = ConnectionSink<Connection, typename decltype(self->ws)::executor_type>;
+        self->sink = std::make_shared<Sink>(self, self->ws.get_executor());
+        self->read();
+    });
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::Connection::refuse(boost::beast::http::status status)
+{
+    namespace http = boost::beast::http;
+
+    auto response = std::make_shared<http::response<http::string_body>>(status, upgrade.version());
+    response->set(http::field::content_type, "text/plain");
+    response->set(http::field::connection, "close");
+    response->body() = (status == http::status::not_found ? "no such target" : "websocket only");
+    response->prepare_payload();
+
+    auto self = this->shared_from_this();
+    http::async_write(socket(), *response, [self, response](boost::system::error_code, std::size_t) {
+        boost::system::error_code ignored;
+        self->socket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, ignored);
+    });
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::Connection::read()
+{
+    reading = true;
+    message.clear();
+    messageBuffer.emplace(message, server.options.maxMessageSize);
+    auto self = this->shared_from_this();
+    ws.async_read(*messageBuffer,
+                  [self](boost::system::error_code ec, std::size_t) { self->onRead(ec); });
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::Connection::onRead(boost::system::error_code ec)
+{
+    reading = false;
+    if (ec) {
+        // closed by the client, or broken: pending writes fail on their own
+        closed = true;
+        return;
+    }
+
+    std::string response;
+    {
+        NotificationSink::Scope subscribing(sink);
+        ResponseRouter::Post(server.rpc, message, context, response);
+    }
+    server.messages.fetch_add(1, std::memory_order_relaxed);
+    queued.push_back(std::move(response));
+    flush();
+
+    if (queued.size() < server.options.maxQueuedResponses) {
+        read();
+    }
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::Connection::flush()
+{
+    if (!writing.empty() || writingNotification || closed) {
+        return;
+    }
+    if (queued.empty()) {
+        if (!notifications.empty()) {
+            writeNotification();
+        }
+        return;
+    }
+
+    if (!server.options.coalesceResponses || queued.size() == 1) {
+        writing = std::move(queued.front());
+        queued.pop_front();
+    } else {
+        // one array of all queued responses; a batch response contributes its elements
+        writing = "[";
+        for (std::size_t n = 0; n < server.options.maxCoalesced && !queued.empty(); n++) {
+            std::string& response = queued.front();
+            while (!response.empty() && (response.back() == '\n' || response.back() == ' ')) {
+                response.pop_back();
+            }
+            std::size_t start = 0;
+            std::size_t limit = response.size();
+            if (!response.empty() && response.front() == '[') {
+                start = 1;
+                limit--;
+            }
+            if (limit > start) {
+                if (writing.size() > 1) {
+                    writing += ',';
+                }
+                writing.append(response, start, limit - start);
+            }
+            queued.pop_front();
+        }
+        writing += ']';
+    }
+    server.frames.fetch_add(1, std::memory_order_relaxed);
+
+    auto self = this->shared_from_this();
+    ws.async_write(boost::asio::buffer(writing), [self](boost::system::error_code ec, std::size_t) {
+        self->writing.clear();
+        self->onWritten(ec);
+    });
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::Connection::writeNotification()
+{
+    writingNotification = std::move(notifications.front());
+    notifications.pop_front();
+    server.frames.fetch_add(1, std::memory_order_relaxed);
+    server.notified.fetch_add(1, std::memory_order_relaxed);
+
+    auto self = this->shared_from_this();
+    ws.async_write(boost::asio::buffer(*writingNotification),
+                   [self](boost::system::error_code ec, std::size_t) {
+                       self->writingNotification.reset();
+                       self->onWritten(ec);
+                   });
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::Connection::onWritten(boost::system::error_code ec)
+{
+    if (ec) {
+        closed = true;
+        return;
+    }
+    flush();
+    if (!reading && queued.size() < server.options.maxQueuedResponses) {
+        read();
+    }
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::Connection::notify(const SharedMessage& message)
+{
+    if (closed) {
+        return;
+    }
+    if (notifications.size() >= server.options.maxQueuedResponses) {
+        server.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    notifications.push_back(message);
+    flush();
+}
+
+template <typename Rpc>
+AsyncJsonRPCWebSocketServer<Rpc>::AsyncJsonRPCWebSocketServer(
+    Rpc& rpcRef, boost::asio::io_context& ioContextRef, const boost::asio::ip::tcp::endpoint& endpoint,
+    ContextFactory Factory, const WebSocketServerOptions& Options)
+    : rpc(rpcRef), options(Options), contextFactory(std::move(Factory)),
+      acceptLoop(ioContextRef, endpoint, Options.acceptRetryDelay)
+{
+    ResponseRouter::Install(rpc, options.responseFallback);
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::start()
+{
+    acceptLoop.start([this](boost::asio::ip::tcp::socket&& socket) { onAccept(std::move(socket)); });
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::stop()
+{
+    acceptLoop.stop();
+}
+
+template <typename Rpc>
+void AsyncJsonRPCWebSocketServer<Rpc>::onAccept(boost::asio::ip::tcp::socket&& socket)
+{
+    boost::system::error_code ignored;
+    socket.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+    auto connection = std::make_shared<Connection>(*this, std::move(socket));
+    // the connection's handlers run on its strand, the accept handler doesn't
+    boost::asio::dispatch(connection->socket().get_executor(), [connection]() { connection->start(); });
+}
+
+template <typename Rpc>
+WebSocketServerStats AsyncJsonRPCWebSocketServer<Rpc>::stats() const
+{
+    WebSocketServerStats result;
+    result.accepted     = accepted.load(std::memory_order_relaxed);
+    result.acceptErrors = acceptLoop.acceptErrors();
+    result.messages     = messages.load(std::memory_order_relaxed);
+    result.frames       = frames.load(std::memory_order_relaxed);
+    result.notified     = notified.load(std::memory_order_relaxed);
+    result.dropped      = dropped.load(std::memory_order_relaxed);
+    return result;
+}
+
+#endif // ASYNCJSONRPCWEBSOCKETSERVER_H
@@ -0,0 +1,218 @@
+#ifndef CPUTIMEACCOUNTING_H
+#define CPUTIMEACCOUNTING_H
+
+#include "PerThreadShards.h"
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <jsoncpp/json/json.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CpuTimeAccountingOptions
+{
+    // every sampleInterval-th request of a thread is measured, and counted sampleInterval times. Reading
+    // the thread's cpu clock is a system call; 1 measures everything, 16 makes the cost negligible
+    std::uint32_t sampleInterval = 1;
+
+    // context keys beyond this many (per thread) are accounted together, under OtherContextKeys
+    std::size_t maxContextKeys = 1024;
+};
+
+// cpu time spent by the calling thread, in ns
+inline std::uint64_t ThreadCpuNow()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000u + static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+// adds the cpu time the calling thread spends during its lifetime to *target; does nothing if null
+class ThreadCpuTimer
+{
+    std::uint64_t* target;
+    std::uint64_t  start;
+
+public:
+    explicit ThreadCpuTimer(std::uint64_t* Target)
+        : target(Target), start(Target ? ThreadCpuNow() : 0)
+    {
+    }
+
+    ~ThreadCpuTimer()
+    {
+        if (target) {
+            *target += ThreadCpuNow() - start;
+        }
+    }
+
+    ThreadCpuTimer(const ThreadCpuTimer&) = delete;
+    ThreadCpuTimer& operator=(const ThreadCpuTimer&) = delete;
+};
+
+struct CpuTime
+{
+    std::uint64_t count = 0;
+    std::uint64_t cpuNs = 0;
+
+    void add(std::uint64_t ns, std::uint64_t times)
+    {
+        count += times;
+        cpuNs += ns * times;
+    }
+
+    void merge(const CpuTime& other)
+    {
+        count += other.count;
+        cpuNs += other.cpuNs;
+    }
+
+    Json::Value toJsonValue() const;
+};
+
+struct CpuTimeSnapshot
+{
+    static constexpr std::uint64_t OtherContextKeys = std::numeric_limits<std::uint64_t>::max();
+
+    // handler cpu time, per method
+    std::map<std::string, CpuTime> methods;
+
+    // parse, handler and serialize cpu time of whole requests, per context key (the tenant, ...)
+    std::map<std::uint64_t, CpuTime> contextKeys;
+
+    // the library's own stages, per request
+    CpuTime parse;
+    CpuTime serialize;
+
+    void merge(const CpuTimeSnapshot& other);
+
+    Json::Value toJsonValue() const;
+};
+
+// Adds up CpuTimeSnapshot data in a shard per thread: recording locks the thread's own shard only.
+class CpuTimeAccounting
+{
+    struct Shard
+    {
+        std::mutex      mutex;
+        CpuTimeSnapshot data;
+        std::uint32_t   untilSample = 0; // requests to skip before the next sample; owner thread only
+    };
+
+    const CpuTimeAccountingOptions options;
+    PerThreadShards<Shard>         shards;
+
+public:
+    explicit CpuTimeAccounting(const CpuTimeAccountingOptions& Options = CpuTimeAccountingOptions())
+        : options(Options)
+    {
+        if (options.sampleInterval == 0) {
+            throw std::runtime_error("The cpu time sample interval must be at least 1");
+        }
+    }
+
+    CpuTimeAccounting(const CpuTimeAccounting&) = delete;
+    CpuTimeAccounting& operator=(const CpuTimeAccounting&) = delete;
+
+    // whether the calling thread measures its next request
+    inline bool sampleNext();
+
+    inline void recordCall(const std::string& methodName, std::uint64_t invokeCpuNs);
+
+    inline void recordRequest(std::uint64_t contextKey, std::uint64_t parseCpuNs,
+                              std::uint64_t invokeCpuNs, std::uint64_t serializeCpuNs);
+
+    inline CpuTimeSnapshot snapshot() const;
+};
+
+inline Json::Value CpuTime::toJsonValue() const
+{
+    Json::Value value;
+    value["count"] = Json::UInt64(count);
+    value["cpuNs"] = Json::UInt64(cpuNs);
+    return value;
+}
+
+inline void CpuTimeSnapshot::merge(const CpuTimeSnapshot& other)
+{
+    for (const auto& p : other.methods) {
+        methods[p.first].merge(p.second);
+    }
+    for (const auto& p : other.contextKeys) {
+        contextKeys[p.first].merge(p.second);
+    }
+    parse.merge(other.parse);
+    serialize.merge(other.serialize);
+}
+
+inline Json::Value CpuTimeSnapshot::toJsonValue() const
+{
+    Json::Value value;
+    value["parse"]     = parse.toJsonValue();
+    value["serialize"] = serialize.toJsonValue();
+    value["methods"]   = Json::Value(Json::objectValue);
+    for (const auto& p : methods) {
+        value["methods"][p.first] = p.second.toJsonValue();
+    }
+    // json keys are strings; "other" for OtherContextKeys
+    value["contextKeys"] = Json::Value(Json::objectValue);
+    for (const auto& p : contextKeys) {
+        const std::string key = (p.first == OtherContextKeys ? "other" : std::to_string(p.first));
+        value["contextKeys"][key] = p.second.toJsonValue();
+    }
+    return value;
+}
+
+bool CpuTimeAccounting::sampleNext()
+{
+    Shard& shard = shards.local();
+    if (shard.untilSample > 0) {
+        shard.untilSample--;
+        return false;
+    }
+    shard.untilSample = options.sampleInterval - 1;
+    return true;
+}
+
+void CpuTimeAccounting::recordCall(const std::string& methodName, std::uint64_t invokeCpuNs)
+{
+    Shard&                      shard = shards.local();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.data.methods[methodName].add(invokeCpuNs, options.sampleInterval);
+}
+
+void CpuTimeAccounting::recordRequest(std::uint64_t contextKey, std::uint64_t parseCpuNs,
+                                      std::uint64_t invokeCpuNs, std::uint64_t serializeCpuNs)
+{
+    Shard&                      shard = shards.local();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.data.parse.add(parseCpuNs, options.sampleInterval);
+    shard.data.serialize.add(serializeCpuNs, options.sampleInterval);
+
+    auto it = shard.data.contextKeys.find(contextKey);
+    if (it == shard.data.contextKeys.end()) {
+        if (shard.data.contextKeys.size() >= options.maxContextKeys) {
+            contextKey = CpuTimeSnapshot::OtherContextKeys;
+        }
+        it = shard.data.contextKeys.emplace(contextKey, CpuTime()).first;
+    }
+    it->second.add(parseCpuNs + invokeCpuNs + serializeCpuNs, options.sampleInterval);
+}
+
+CpuTimeSnapshot CpuTimeAccounting::snapshot() const
+{
+    CpuTimeSnapshot result;
+    for (const auto& shard : shards.all()) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        result.merge(shard->data);
+    }
+    return result;
+}
+
+#endif // CPUTIMEACCOUNTING_H
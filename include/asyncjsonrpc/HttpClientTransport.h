@@ -0,0 +1,162 @@
+#ifndef HTTPCLIENTTRANSPORT_H
+#define HTTPCLIENTTRANSPORT_H
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http/parser.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/status.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <boost/optional.hpp>
+#include <boost/system/error_code.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct HttpClientOptions
+{
+    // the Host header of the requests
+    std::string host = "localhost";
+
+    // as the server's
+    std::string target = "/";
+
+    // larger response bodies close the connection
+    std::size_t maxBodySize = 1024 * 1024;
+};
+
+// The connection of an AsyncJsonRPCClient to an AsyncJsonRPCHttpServer: every request is POSTed on one
+// keep-alive connection, pipelined, and the requests sent while a write is in progress are written
+// together with the next write. The server answers in order; the body of every response is a message.
+// A response other than 200 OK closes the connection with protocol_error (the calls in flight fail).
+// Used on its strand, as StreamClientTransport.
+class HttpClientTransport : public std::enable_shared_from_this<HttpClientTransport>
+{
+public:
+    using executor_type = boost::asio::strand<boost::asio::io_context::executor_type>;
+    using OnMessage     = std::function<void(const char* data, std::size_t size)>;
+    using OnClose       = std::function<void(boost::system::error_code ec)>;
+
+private:
+    using Parser = boost::beast::http::response_parser<boost::beast::http::string_body>;
+
+    const HttpClientOptions      options;
+    const std::string            header; // of every request, up to the Content-Length's value
+    executor_type                strand;
+    boost::asio::ip::tcp::socket socket;
+    boost::beast::flat_buffer    buffer;
+    boost::optional<Parser>      parser;
+    std::string                  pending;
+    std::string                  writing;
+    OnMessage                    onMessage;
+    OnClose                      onClose;
+    bool                         closed = false;
+
+    void read();
+    void flush();
+    void fail(boost::system::error_code ec);
+
+public:
+    explicit HttpClientTransport(boost::asio::io_context& ioContext,
+                                 const HttpClientOptions& Options = HttpClientOptions())
+        : options(Options), header("POST " + Options.target + " HTTP/1.1\r\nHost: " + Options.host +
+                                   "\r\nContent-Type: application/json\r\nContent-Length: "),
+          strand(boost::asio::make_strand(ioContext)), socket(strand)
+    {
+    }
+
+    // blocks; throws boost::system::system_error
+    void connect(const boost::asio::ip::tcp::endpoint& endpoint)
+    {
+        socket.connect(endpoint);
+        socket.set_option(boost::asio::ip::tcp::no_delay(true));
+    }
+
+    executor_type get_executor() const { return strand; }
+
+    void start(OnMessage onMessageRef, OnClose onCloseRef)
+    {
+        onMessage = std::move(onMessageRef);
+        onClose   = std::move(onCloseRef);
+        read();
+    }
+
+    void send(const std::string& message)
+    {
+        pending += header;
+        pending += std::to_string(message.size());
+        pending += "\r\n\r\n";
+        pending += message;
+        flush();
+    }
+
+    void close()
+    {
+        closed    = true;
+        onMessage = nullptr;
+        onClose   = nullptr;
+        boost::system::error_code ignored;
+        socket.close(ignored);
+    }
+};
+
+inline void HttpClientTransport::read()
+{
+    parser.emplace();
+    parser->body_limit(options.maxBodySize);
+    auto self = shared_from_this();
+    boost::beast::http::async_read(
+        socket, buffer, *parser, [self](boost::system::error_code ec, std::size_t) {
+            if (ec) {
+                self->fail(ec);
+                return;
+            }
+            if (self->parser->get().result() != boost::beast::http::status::ok) {
+                self->fail(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+                return;
+            }
+            const std::string& body = self->parser->get().body();
+            if (self->onMessage) {
+                self->onMessage(body.data(), body.size());
+            }
+            if (!self->closed) {
+                self->read();
+            }
+        });
+}
+
+inline void HttpClientTransport::flush()
+{
+    if (!writing.empty() || pending.empty() || closed) {
+        return;
+    }
+    writing.swap(pending);
+    auto self = shared_from_this();
+    boost::asio::async_write(socket, boost::asio::buffer(writing),
+                             [self](boost::system::error_code ec, std::size_t) {
+                                 self->writing.clear();
+                                 if (ec) {
+                                     self->fail(ec);
+                                     return;
+                                 }
+                                 self->flush();
+                             });
+}
+
+inline void HttpClientTransport::fail(boost::system::error_code ec)
+{
+    if (closed) {
+        return;
+    }
+    OnClose closing = std::move(onClose);
+    close();
+    if (closing) {
+        closing(ec);
+    }
+}
+
+#endif // HTTPCLIENTTRANSPORT_H
@@ -0,0 +1,103 @@
+#ifndef INTERCEPTORS_H
+#define INTERCEPTORS_H
+
+#include <exception>
+#include <jsoncpp/json/json.h>
+#include <string>
+#include <tuple>
+#include <utility>
+
+// Base for interceptors, with a no-op for every hook. Derive from it and hide the hooks you need with
+// functions of the same name; they're called statically, so nothing has to be virtual and hooks that
+// aren't hidden cost nothing.
+struct RpcInterceptor
+{
+    // the raw request, before anything else
+    template <typename... Ctx>
+    void onReceive(const std::string& /*jsonCall*/, const Ctx&... /*handlerContext*/)
+    {
+    }
+
+    // the parsed request; an array for batches
+    template <typename... Ctx>
+    void afterParse(const Json::Value& /*root*/, const Ctx&... /*handlerContext*/)
+    {
+    }
+
+    // once per call, after its method is found and its parameters are validated. Throw a JsonErrorCode
+    // to reject the call; the context can be modified before the handler gets it
+    template <typename... Ctx>
+    void beforeInvoke(const std::string& /*methodName*/, const Json::Value& /*params*/,
+                      Ctx&... /*handlerContext*/)
+    {
+    }
+
+    // after every handler that was called; error is the exception it threw, or null
+    template <typename... Ctx>
+    void afterInvoke(const std::string& /*methodName*/, const Json::Value& /*result*/,
+                     const std::exception* /*error*/, const Ctx&... /*handlerContext*/)
+    {
+    }
+
+    // the whole response (an array for batches, an error object if the request was rejected)
+    template <typename... Ctx>
+    void beforeSerialize(Json::Value& /*response*/, const Ctx&... /*handlerContext*/)
+    {
+    }
+
+    // the serialized response, right before it's passed to the response callback
+    template <typename... Ctx>
+    void onSend(std::string& /*response*/, const Ctx&... /*handlerContext*/)
+    {
+    }
+};
+
+// A chain of interceptors, composed at compile time. Use it as the first context type of AsyncJsonRPC:
+// AsyncJsonRPC<Executor, Interceptors<Auth, Audit>, Context...>. Every hook runs on the interceptors in
+// the order they're listed.
+template <typename... Interceptor>
+class Interceptors
+{
+    std::tuple<Interceptor...> chain;
+
+    template <typename F, std::size_t... I>
+    void forEach(F&& f, std::index_sequence<I...>)
+    {
+        // braced initialization guarantees left-to-right evaluation
+        int expander[] = {0, (f(std::get<I>(chain)), 0)...};
+        (void)expander;
+    }
+
+public:
+    static const bool Empty = sizeof...(Interceptor) == 0;
+
+    Interceptors() = default;
+    explicit Interceptors(Interceptor... interceptor) : chain(std::move(interceptor)...) {}
+
+    template <typename T>
+    T& get()
+    {
+        return std::get<T>(chain);
+    }
+
+    // calls f(interceptor) for every interceptor, in order
+    template <typename F>
+    void forEach(F&& f)
+    {
+        forEach(std::forward<F>(f), std::index_sequence_for<Interceptor...>());
+    }
+};
+
+template <>
+class Interceptors<>
+{
+public:
+    static const bool Empty = true;
+
+    template <typename F>
+    void forEach(F&&)
+    {
+    }
+};
+
+#endif // INTERCEPTORS_H
@@ -0,0 +1,403 @@
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// A minimal io_uring, on the raw system calls (without liburing): one submission queue filled by
+// prepare*() and handed to the kernel by a single submitAndWait(), and the completions read from the
+// shared completion queue. Only what AsyncJsonRPCUringServer needs: multishot accept and receive into
+// provided buffers, send, read, timeouts, and cancellation.
+//
+// The ring is set up for a single issuer with deferred task work (a kernel from 6.1), so completions are
+// only posted when the thread that enable()d it waits for them: there are no interrupts of that thread
+// while it runs handlers. Create() returns null where io_uring can't be used (another system, an older
+// kernel, or io_uring disabled by the sysctl or a seccomp filter); callers fall back to something else.
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_SETUP_DEFER_TASKRUN) && defined(IORING_RECV_MULTISHOT)
+#define ASYNCJSONRPC_HAS_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifdef ASYNCJSONRPC_HAS_IO_URING
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+struct IoUringCompletion
+{
+    std::uint64_t userData;
+    int           result;   // as returned by the system call, or -errno
+    bool          more;     // a multishot request that is still armed
+    int           bufferId; // the provided buffer that received the data, or -1
+};
+
+class IoUring
+{
+#ifdef ASYNCJSONRPC_HAS_IO_URING
+    int           ringFd = -1;
+    void*         rings  = nullptr; // the submission and completion queues, mapped together
+    std::size_t   ringsSize;
+    io_uring_sqe* sqes = nullptr;
+    std::size_t   sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned  sqMask;
+    unsigned  sqEntries;
+    unsigned  queuedTail;    // prepared entries, some not submitted yet
+    unsigned  submittedTail; // handed to the kernel
+
+    unsigned*     cqHead;
+    unsigned*     cqTail;
+    unsigned      cqMask;
+    io_uring_cqe* cqes;
+
+    __kernel_timespec timeout; // of prepareTimeout(), read by the kernel when it's submitted
+
+    IoUring() = default;
+
+    int           enter(unsigned toSubmit, unsigned waitFor, unsigned flags);
+    io_uring_sqe* nextEntry();
+#endif
+
+public:
+    static const std::uint64_t Internal = 0;
+
+    // entries of the submission queue, a power of two; the completion queue has four times as many
+    static std::unique_ptr<IoUring> Create(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // from the thread that submits and reaps from now on; false if the kernel refused
+    bool enable();
+
+    // queued until the next submitAndWait() (or until the queue is full)
+    void prepareAccept(int fd, std::uint64_t userData);                              // multishot
+    void prepareReceive(int fd, unsigned short bufferGroup, std::uint64_t userData); // multishot
+    void prepareSend(int fd, const char* data, std::size_t size, std::uint64_t userData);
+    void prepareRead(int fd, void* data, std::size_t size, std::uint64_t userData);
+    void prepareCancel(std::uint64_t target, std::uint64_t userData);
+    void prepareCancelAll(std::uint64_t userData);
+    // completes with -ETIME after duration; one per submitAndWait()
+    void prepareTimeout(std::chrono::nanoseconds duration, std::uint64_t userData);
+    // buffers for the receives of a group, ids from firstId; its completion is only posted if it fails,
+    // with the user data Internal
+    void prepareProvideBuffers(char* data, std::size_t bufferSize, unsigned count, unsigned short group,
+                               unsigned short firstId);
+
+    // submits the queued entries, and waits until there are waitFor completions; with one system call
+    void submitAndWait(unsigned waitFor);
+
+    // onCompletion(const IoUringCompletion&) for every completion posted; returns how many there were
+    template <typename OnCompletion>
+    std::size_t forEachCompletion(OnCompletion&& onCompletion);
+};
+
+// Buffers provided to the kernel for the receives of a buffer group: a receive takes one when data
+// arrives (so idle connections hold none), and its completion says which. recycle() gives them back;
+// publish() queues them to the ring, a request per run of consecutive ids, submitted with the next
+// submitAndWait().
+class IoUringProvidedBuffers
+{
+    IoUring&                    ring;
+    const unsigned short        group;
+    const std::size_t           bufferSize;
+    std::unique_ptr<char[]>     buffers;
+    std::vector<unsigned short> recycled;
+
+public:
+    // count is at most 65535
+    IoUringProvidedBuffers(IoUring& Ring, unsigned short Group, unsigned Count, std::size_t BufferSize);
+
+    IoUringProvidedBuffers(const IoUringProvidedBuffers&) = delete;
+    IoUringProvidedBuffers& operator=(const IoUringProvidedBuffers&) = delete;
+
+    char* buffer(int id) const { return buffers.get() + static_cast<std::size_t>(id) * bufferSize; }
+
+    void recycle(int id) { recycled.push_back(static_cast<unsigned short>(id)); }
+
+    void publish();
+};
+
+#ifdef ASYNCJSONRPC_HAS_IO_URING
+
+inline std::unique_ptr<IoUring> IoUring::Create(unsigned entries)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER |
+                   IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+    params.cq_entries = entries * 4;
+
+    const int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+        return nullptr;
+    }
+    std::unique_ptr<IoUring> ring(new IoUring());
+    ring->ringFd = fd;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+        return nullptr;
+    }
+
+    ring->ringsSize =
+        std::max<std::size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                              params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    void* rings = ::mmap(nullptr, ring->ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                         IORING_OFF_SQ_RING);
+    if (rings == MAP_FAILED) {
+        return nullptr;
+    }
+    ring->rings    = rings;
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                        IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return nullptr;
+    }
+    ring->sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* base          = static_cast<char*>(rings);
+    ring->sqHead        = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    ring->sqTail        = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    ring->sqMask        = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    ring->sqEntries     = params.sq_entries;
+    ring->queuedTail    = *ring->sqTail;
+    ring->submittedTail = ring->queuedTail;
+    // entry i of the queue is always sqes[i]
+    unsigned* array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        array[i] = i;
+    }
+
+    ring->cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    ring->cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    ring->cqes   = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+    return ring;
+}
+
+inline IoUring::~IoUring()
+{
+    if (sqes) {
+        ::munmap(sqes, sqesSize);
+    }
+    if (rings) {
+        ::munmap(rings, ringsSize);
+    }
+    if (ringFd >= 0) {
+        ::close(ringFd);
+    }
+}
+
+inline bool IoUring::enable()
+{
+    return ::syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) == 0;
+}
+
+inline int IoUring::enter(unsigned toSubmit, unsigned waitFor, unsigned flags)
+{
+    int result;
+    do {
+        result = static_cast<int>(
+            ::syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, flags, nullptr, 0));
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+inline io_uring_sqe* IoUring::nextEntry()
+{
+    if (queuedTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == sqEntries) {
+        // full: what's queued is submitted now, without waiting for completions
+        __atomic_store_n(sqTail, queuedTail, __ATOMIC_RELEASE);
+        enter(queuedTail - submittedTail, 0, 0);
+        submittedTail = queuedTail;
+    }
+    io_uring_sqe* sqe = &sqes[queuedTail & sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    queuedTail++;
+    return sqe;
+}
+
+inline void IoUring::prepareAccept(int fd, std::uint64_t userData)
+{
+    io_uring_sqe* sqe = nextEntry();
+    sqe->opcode       = IORING_OP_ACCEPT;
+    sqe->fd           = fd;
+    sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data    = userData;
+}
+
+inline void IoUring::prepareReceive(int fd, unsigned short bufferGroup, std::uint64_t userData)
+{
+    io_uring_sqe* sqe = nextEntry();
+    sqe->opcode       = IORING_OP_RECV;
+    sqe->fd           = fd;
+    sqe->ioprio       = IORING_RECV_MULTISHOT;
+    sqe->flags        = IOSQE_BUFFER_SELECT;
+    sqe->buf_group    = bufferGroup;
+    sqe->user_data    = userData;
+}
+
+inline void IoUring::prepareSend(int fd, const char* data, std::size_t size, std::uint64_t userData)
+{
+    io_uring_sqe* sqe = nextEntry();
+    sqe->opcode       = IORING_OP_SEND;
+    sqe->fd           = fd;
+    sqe->addr         = reinterpret_cast<std::uint64_t>(data);
+    sqe->len          = static_cast<std::uint32_t>(std::min<std::size_t>(size, 0x7ffff000));
+    sqe->msg_flags    = MSG_NOSIGNAL;
+    sqe->user_data    = userData;
+}
+
+inline void IoUring::prepareRead(int fd, void* data, std::size_t size, std::uint64_t userData)
+{
+    io_uring_sqe* sqe = nextEntry();
+    sqe->opcode       = IORING_OP_READ;
+    sqe->fd           = fd;
+    sqe->addr         = reinterpret_cast<std::uint64_t>(data);
+    sqe->len          = static_cast<std::uint32_t>(size);
+    sqe->off          = static_cast<std::uint64_t>(-1); // the file position: none, for an eventfd
+    sqe->user_data    = userData;
+}
+
+inline void IoUring::prepareCancel(std::uint64_t target, std::uint64_t userData)
+{
+    io_uring_sqe* sqe = nextEntry();
+    sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+    sqe->fd           = -1;
+    sqe->addr         = target;
+    sqe->user_data    = userData;
+}
+
+inline void IoUring::prepareCancelAll(std::uint64_t userData)
+{
+    io_uring_sqe* sqe = nextEntry();
+    sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+    sqe->fd           = -1;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    sqe->user_data    = userData;
+}
+
+inline void IoUring::prepareTimeout(std::chrono::nanoseconds duration, std::uint64_t userData)
+{
+    timeout.tv_sec    = static_cast<long long>(duration.count() / 1000000000);
+    timeout.tv_nsec   = static_cast<long long>(duration.count() % 1000000000);
+    io_uring_sqe* sqe = nextEntry();
+    sqe->opcode       = IORING_OP_TIMEOUT;
+    sqe->fd           = -1;
+    sqe->addr         = reinterpret_cast<std::uint64_t>(&timeout);
+    sqe->len          = 1;
+    sqe->user_data    = userData;
+}
+
+inline void IoUring::prepareProvideBuffers(char* data, std::size_t bufferSize, unsigned count,
+                                           unsigned short group, unsigned short firstId)
+{
+    io_uring_sqe* sqe = nextEntry();
+    sqe->opcode       = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd           = static_cast<int>(count);
+    sqe->addr         = reinterpret_cast<std::uint64_t>(data);
+    sqe->len          = static_cast<std::uint32_t>(bufferSize);
+    sqe->buf_group    = group;
+    sqe->off          = firstId;
+    sqe->flags        = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data    = Internal;
+}
+
+inline void IoUring::submitAndWait(unsigned waitFor)
+{
+    __atomic_store_n(sqTail, queuedTail, __ATOMIC_RELEASE);
+    enter(queuedTail - submittedTail, waitFor, IORING_ENTER_GETEVENTS);
+    submittedTail = queuedTail;
+}
+
+template <typename OnCompletion>
+std::size_t IoUring::forEachCompletion(OnCompletion&& onCompletion)
+{
+    unsigned       head = *cqHead;
+    const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const io_uring_cqe& cqe = cqes[head & cqMask];
+        IoUringCompletion   completion;
+        completion.userData = cqe.user_data;
+        completion.result   = cqe.res;
+        completion.more     = (cqe.flags & IORING_CQE_F_MORE) != 0;
+        completion.bufferId = (cqe.flags & IORING_CQE_F_BUFFER)
+                                  ? static_cast<int>(cqe.flags >> IORING_CQE_BUFFER_SHIFT)
+                                  : -1;
+        onCompletion(completion);
+    }
+    const std::size_t count = static_cast<std::size_t>(tail - *cqHead);
+    __atomic_store_n(cqHead, tail, __ATOMIC_RELEASE);
+    return count;
+}
+
+#else // ASYNCJSONRPC_HAS_IO_URING
+
+inline std::unique_ptr<IoUring> IoUring::Create(unsigned)
+{
+    return nullptr;
+}
+
+// never called: there is no IoUring to call them on
+inline IoUring::~IoUring() {}
+inline bool IoUring::enable() { return false; }
+inline void IoUring::prepareAccept(int, std::uint64_t) {}
+inline void IoUring::prepareReceive(int, unsigned short, std::uint64_t) {}
+inline void IoUring::prepareSend(int, const char*, std::size_t, std::uint64_t) {}
+inline void IoUring::prepareRead(int, void*, std::size_t, std::uint64_t) {}
+inline void IoUring::prepareCancel(std::uint64_t, std::uint64_t) {}
+inline void IoUring::prepareCancelAll(std::uint64_t) {}
+inline void IoUring::prepareTimeout(std::chrono::nanoseconds, std::uint64_t) {}
+inline void IoUring::submitAndWait(unsigned) {}
+template <typename OnCompletion>
+std::size_t IoUring::forEachCompletion(OnCompletion&&)
+{
+    return 0;
+}
+
+inline void IoUring::prepareProvideBuffers(char*, std::size_t, unsigned, unsigned short, unsigned short)
+{
+}
+
+#endif // ASYNCJSONRPC_HAS_IO_URING
+
+inline IoUringProvidedBuffers::IoUringProvidedBuffers(IoUring& Ring, unsigned short Group,
+                                                      unsigned Count, std::size_t BufferSize)
+    : ring(Ring), group(Group), bufferSize(BufferSize), buffers(new char[Count * BufferSize])
+{
+    recycled.reserve(Count);
+    ring.prepareProvideBuffers(buffers.get(), bufferSize, Count, group, 0);
+}
+
+inline void IoUringProvidedBuffers::publish()
+{
+    std::sort(recycled.begin(), recycled.end());
+    std::size_t first = 0;
+    for (std::size_t i = 1; i <= recycled.size(); i++) {
+        if (i == recycled.size() || recycled[i] != recycled[i - 1] + 1) {
+            ring.prepareProvideBuffers(buffer(recycled[first]), bufferSize,
+                                       static_cast<unsigned>(i - first), group, recycled[first]);
+            first = i;
+        }
+    }
+    recycled.clear();
+}
+
+#endif // IOURING_H
@@ -0,0 +1,125 @@
+#ifndef KEYEDSTRAND_H
+#define KEYEDSTRAND_H
+
+#include "RecyclingAllocator.h"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Tasks posted with the same key run one at a time in FIFO order; different keys run in parallel.
+// A key's queue only exists while it has pending tasks, so idle keys cost no memory.
+template <typename Executor>
+class KeyedStrand
+{
+    using TaskQueue = std::deque<std::function<void()>>;
+
+    struct Shard
+    {
+        std::mutex                                   mutex;
+        std::unordered_map<std::uint64_t, TaskQueue> queues;
+    };
+
+    static const std::size_t ShardCount = 64;
+
+    Executor                      executor;
+    std::array<Shard, ShardCount> shards;
+
+    Shard& shardFor(std::uint64_t key) { return shards[key % ShardCount]; }
+
+    void schedule(std::uint64_t key);
+    void runFront(std::uint64_t key);
+    bool popFront(std::uint64_t key);
+
+public:
+    explicit KeyedStrand(const Executor& executorRef) : executor(executorRef) {}
+
+    KeyedStrand(const KeyedStrand&) = delete;
+    KeyedStrand& operator=(const KeyedStrand&) = delete;
+
+    template <typename Function>
+    void post(std::uint64_t key, Function&& function);
+
+    // number of keys that currently have queued or running tasks
+    std::size_t activeKeyCount();
+};
+
+template <typename Executor>
+template <typename Function>
+void KeyedStrand<Executor>::post(std::uint64_t key, Function&& function)
+{
+    bool   wasIdle;
+    Shard& shard = shardFor(key);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        TaskQueue&                  queue = shard.queues[key];
+        wasIdle                           = queue.empty();
+        queue.emplace_back(std::forward<Function>(function));
+    }
+    // only the submission that finds the queue idle schedules it; otherwise a runner is already active
+    if (wasIdle) {
+        schedule(key);
+    }
+}
+
+template <typename Executor>
+void KeyedStrand<Executor>::schedule(std::uint64_t key)
+{
+    executor.post([this, key]() { this->runFront(key); }, RecyclingAllocator<char>());
+}
+
+template <typename Executor>
+void KeyedStrand<Executor>::runFront(std::uint64_t key)
+{
+    std::function<void()> task;
+    {
+        Shard&                      shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // the task stays in the queue (moved-from) while running, so new submissions see it busy
+        task = std::move(shard.queues.at(key).front());
+    }
+
+    try {
+        task();
+    } catch (...) {
+        if (popFront(key)) {
+            schedule(key);
+        }
+        throw;
+    }
+
+    // one task per executor run, so a busy key can't starve the other keys sharing the executor
+    if (popFront(key)) {
+        schedule(key);
+    }
+}
+
+template <typename Executor>
+bool KeyedStrand<Executor>::popFront(std::uint64_t key)
+{
+    Shard&                      shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto                        it = shard.queues.find(key);
+    it->second.pop_front();
+    if (it->second.empty()) {
+        shard.queues.erase(it);
+        return false;
+    }
+    return true;
+}
+
+template <typename Executor>
+std::size_t KeyedStrand<Executor>::activeKeyCount()
+{
+    std::size_t result = 0;
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        result += shard.queues.size();
+    }
+    return result;
+}
+
+#endif // KEYEDSTRAND_H
@@ -0,0 +1,137 @@
+#ifndef PERTHREADSHARDS_H
+#define PERTHREADSHARDS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// One Shard per thread that uses an instance, for counters that many threads record into: a thread
+// only ever touches its own shard, and all() hands every shard to a reader, who merges them.
+//
+// Every thread keeps a map from instance id to its shard of that instance, and the instance the last
+// shard it used, so the steady-state lookup is a compare. The instances know the maps they're in, and
+// erase themselves from them when destroyed; a thread's map goes away when the thread exits.
+template <typename Shard>
+class PerThreadShards
+{
+    // the shards of one thread; its mutex is only contended by the destruction of an instance
+    struct ThreadMap
+    {
+        std::mutex                                mutex;
+        std::unordered_map<std::uint64_t, Shard*> shards;
+    };
+
+    struct LastUsed
+    {
+        std::uint64_t id    = 0;
+        Shard*        shard = nullptr;
+    };
+
+    const std::uint64_t                   id; // never reused, so a stale LastUsed never matches
+    mutable std::mutex                    mutex;
+    std::vector<std::shared_ptr<Shard>>   shards;
+    std::vector<std::weak_ptr<ThreadMap>> threads; // the maps of the threads that have a shard
+
+    static std::uint64_t NextId()
+    {
+        static std::atomic<std::uint64_t> counter{0};
+        return ++counter;
+    }
+
+    static const std::shared_ptr<ThreadMap>& ThisThread()
+    {
+        static thread_local const std::shared_ptr<ThreadMap> map = std::make_shared<ThreadMap>();
+        return map;
+    }
+
+    static LastUsed& LastUsedOnThisThread()
+    {
+        static thread_local LastUsed lastUsed;
+        return lastUsed;
+    }
+
+    template <typename Create>
+    Shard& localSlow(Create create);
+
+public:
+    PerThreadShards() : id(NextId()) {}
+    ~PerThreadShards();
+
+    PerThreadShards(const PerThreadShards&) = delete;
+    PerThreadShards& operator=(const PerThreadShards&) = delete;
+
+    // the calling thread's shard; create() makes it, as a std::shared_ptr<Shard>, on first use
+    template <typename Create>
+    Shard& local(Create create)
+    {
+        LastUsed& lastUsed = LastUsedOnThisThread();
+        if (lastUsed.id == id) {
+            return *lastUsed.shard;
+        }
+        return localSlow(create);
+    }
+
+    Shard& local()
+    {
+        return local([]() { return std::make_shared<Shard>(); });
+    }
+
+    // every shard made so far; they stay valid after the instance is destroyed
+    std::vector<std::shared_ptr<Shard>> all() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return shards;
+    }
+
+    // the instances the calling thread has a shard of
+    static std::size_t CountOnThisThread()
+    {
+        const std::shared_ptr<ThreadMap>& map = ThisThread();
+        std::lock_guard<std::mutex>       lock(map->mutex);
+        return map->shards.size();
+    }
+};
+
+template <typename Shard>
+template <typename Create>
+Shard& PerThreadShards<Shard>::localSlow(Create create)
+{
+    const std::shared_ptr<ThreadMap>& map = ThisThread();
+    Shard*                            shard;
+    {
+        std::lock_guard<std::mutex> lock(map->mutex);
+        const auto                  found = map->shards.find(id);
+        shard                             = found == map->shards.end() ? nullptr : found->second;
+    }
+    if (!shard) {
+        std::shared_ptr<Shard> newShard = create();
+        shard                           = newShard.get();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shards.push_back(std::move(newShard));
+            threads.push_back(map);
+        }
+        std::lock_guard<std::mutex> lock(map->mutex);
+        map->shards.emplace(id, shard);
+    }
+    LastUsed& lastUsed = LastUsedOnThisThread();
+    lastUsed.id        = id;
+    lastUsed.shard     = shard;
+    return *shard;
+}
+
+template <typename Shard>
+PerThreadShards<Shard>::~PerThreadShards()
+{
+    for (const std::weak_ptr<ThreadMap>& thread : threads) {
+        if (std::shared_ptr<ThreadMap> map = thread.lock()) {
+            std::lock_guard<std::mutex> lock(map->mutex);
+            map->shards.erase(id);
+        }
+    }
+}
+
+#endif // PERTHREADSHARDS_H
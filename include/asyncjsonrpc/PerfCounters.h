@@ -0,0 +1,405 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include "PerThreadShards.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <jsoncpp/json/json.h>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Per-thread perf_event_open counters, read at the boundaries of the dispatch stages of post(). Only
+// user-space counts are taken, so the reads themselves (system calls) barely show. Counters that can't
+// be opened (no PMU in a VM, perf_event_paranoid, not Linux) are reported as unavailable; TaskClock is
+// a software counter, usually available where the hardware ones aren't.
+
+enum class PerfCounter
+{
+    Cycles,
+    Instructions,
+    CacheMisses,
+    BranchMisses,
+    TaskClock // ns of cpu time
+};
+
+enum class PerfStage
+{
+    Parse,
+    Lookup, // finding the method
+    Validate,
+    Invoke,
+    Serialize
+};
+
+static const std::size_t PerfCounterCount = 5;
+static const std::size_t PerfStageCount   = 5;
+
+using PerfCounterValues = std::array<std::uint64_t, PerfCounterCount>;
+
+inline const char* PerfCounterName(PerfCounter counter)
+{
+    static const char* const names[PerfCounterCount] = {"cycles", "instructions", "cacheMisses",
+                                                        "branchMisses", "taskClockNs"};
+    return names[static_cast<std::size_t>(counter)];
+}
+
+inline const char* PerfStageName(PerfStage stage)
+{
+    static const char* const names[PerfStageCount] = {"parse", "lookup", "validate", "invoke",
+                                                      "serialize"};
+    return names[static_cast<std::size_t>(stage)];
+}
+
+// the counters of the calling thread, in one group so they're read with one system call
+class PerfCounterGroup
+{
+    int                               leader = -1;
+    std::array<int, PerfCounterCount> fds;
+    std::array<int, PerfCounterCount> positions; // in the group's read format, -1 if unavailable
+    std::size_t                       openCount = 0;
+
+public:
+    PerfCounterGroup();
+    ~PerfCounterGroup();
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    bool available(PerfCounter counter) const
+    {
+        return positions[static_cast<std::size_t>(counter)] >= 0;
+    }
+    bool anyAvailable() const { return openCount > 0; }
+
+    // unavailable counters read 0
+    void read(PerfCounterValues& values) const;
+};
+
+// counts per stage of the request running on a thread; every endStage() adds the counts since the
+// previous mark() or endStage()
+class PerfStageRecorder
+{
+    const PerfCounterGroup& group;
+    PerfCounterValues       last{};
+
+public:
+    std::array<PerfCounterValues, PerfStageCount> stages{};
+    bool                                          inRequest = false;
+
+    explicit PerfStageRecorder(const PerfCounterGroup& Group) : group(Group) {}
+
+    void mark() { group.read(last); }
+
+    void endStage(PerfStage stage)
+    {
+        PerfCounterValues now;
+        group.read(now);
+        PerfCounterValues& counts = stages[static_cast<std::size_t>(stage)];
+        for (std::size_t c = 0; c < PerfCounterCount; c++) {
+            counts[c] += now[c] - last[c];
+        }
+        last = now;
+    }
+};
+
+// attributes the counts of its lifetime, or until end(), to a stage; does nothing without a recorder
+class PerfStageScope
+{
+    PerfStageRecorder* recorder;
+    PerfStage          stage;
+
+public:
+    PerfStageScope(PerfStageRecorder* Recorder, PerfStage Stage) : recorder(Recorder), stage(Stage)
+    {
+        if (recorder) {
+            recorder->mark();
+        }
+    }
+
+    ~PerfStageScope() { end(); }
+
+    PerfStageScope(const PerfStageScope&) = delete;
+    PerfStageScope& operator=(const PerfStageScope&) = delete;
+
+    void end()
+    {
+        if (recorder) {
+            recorder->endStage(stage);
+            recorder = nullptr;
+        }
+    }
+};
+
+struct PerfCountersSnapshot
+{
+    std::array<bool, PerfCounterCount> available{}; // opened on at least one thread
+    std::uint64_t                      requests = 0;
+
+    // totals[stage][counter], over all requests
+    std::array<PerfCounterValues, PerfStageCount> totals{};
+
+    double perRequest(PerfStage stage, PerfCounter counter) const;
+
+    // instructions per cycle in a stage; 0 if either counter is unavailable
+    double ipc(PerfStage stage) const;
+
+    void merge(const PerfCountersSnapshot& other);
+
+    Json::Value toJsonValue() const;
+
+    // a table: one row per stage, with the counts per request and the IPC
+    std::string toString() const;
+};
+
+// The counts of every thread that runs requests, in a shard per thread that also owns the thread's
+// counter group.
+class PerfCounters
+{
+    struct Shard
+    {
+        std::mutex                         mutex;
+        PerfCountersSnapshot               data;
+        std::unique_ptr<PerfCounterGroup>  group;
+        std::unique_ptr<PerfStageRecorder> recorder; // null if no counter could be opened
+    };
+
+    PerThreadShards<Shard> shards;
+
+    // the calling thread's shard, with its counters opened on first use
+    inline Shard& localShard();
+
+public:
+    PerfCounters() = default;
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // whether any counter can be opened on the calling thread
+    static bool Supported();
+
+    // the recorder of the calling thread, reset for a new request; null if the thread has no counters,
+    // or is already in a request (a handler calling post())
+    inline PerfStageRecorder* beginRequest();
+
+    inline void endRequest(PerfStageRecorder* recorder);
+
+    inline PerfCountersSnapshot snapshot() const;
+};
+
+#ifdef __linux__
+
+inline PerfCounterGroup::PerfCounterGroup()
+{
+    static const std::uint32_t types[PerfCounterCount]   = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                          PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                          PERF_TYPE_SOFTWARE};
+    static const std::uint64_t configs[PerfCounterCount] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_SW_TASK_CLOCK};
+
+    fds.fill(-1);
+    positions.fill(-1);
+    for (std::size_t c = 0; c < PerfCounterCount; c++) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = types[c];
+        attr.config         = configs[c];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP;
+        // this thread, any cpu
+        const int fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+        if (fd < 0) {
+            continue;
+        }
+        if (leader < 0) {
+            leader = fd;
+        }
+        fds[c]       = fd;
+        positions[c] = static_cast<int>(openCount++);
+    }
+}
+
+inline PerfCounterGroup::~PerfCounterGroup()
+{
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+inline void PerfCounterGroup::read(PerfCounterValues& values) const
+{
+    // PERF_FORMAT_GROUP: the number of counters, then their values in the order they were opened
+    std::uint64_t buffer[1 + PerfCounterCount] = {};
+    if (leader < 0 || ::read(leader, buffer, sizeof(buffer)) <= 0) {
+        values.fill(0);
+        return;
+    }
+    for (std::size_t c = 0; c < PerfCounterCount; c++) {
+        values[c] = (positions[c] >= 0 ? buffer[1 + positions[c]] : 0);
+    }
+}
+
+#else
+
+inline PerfCounterGroup::PerfCounterGroup()
+{
+    fds.fill(-1);
+    positions.fill(-1);
+}
+
+inline PerfCounterGroup::~PerfCounterGroup() {}
+
+inline void PerfCounterGroup::read(PerfCounterValues& values) const { values.fill(0); }
+
+#endif
+
+inline double PerfCountersSnapshot::perRequest(PerfStage stage, PerfCounter counter) const
+{
+    if (requests == 0) {
+        return 0;
+    }
+    const PerfCounterValues& counts = totals[static_cast<std::size_t>(stage)];
+    return static_cast<double>(counts[static_cast<std::size_t>(counter)]) /
+           static_cast<double>(requests);
+}
+
+inline double PerfCountersSnapshot::ipc(PerfStage stage) const
+{
+    const PerfCounterValues& counts = totals[static_cast<std::size_t>(stage)];
+    const std::uint64_t      cycles = counts[static_cast<std::size_t>(PerfCounter::Cycles)];
+    if (cycles == 0 || !available[static_cast<std::size_t>(PerfCounter::Instructions)]) {
+        return 0;
+    }
+    return static_cast<double>(counts[static_cast<std::size_t>(PerfCounter::Instructions)]) /
+           static_cast<double>(cycles);
+}
+
+inline void PerfCountersSnapshot::merge(const PerfCountersSnapshot& other)
+{
+    for (std::size_t c = 0; c < PerfCounterCount; c++) {
+        available[c] = available[c] || other.available[c];
+    }
+    requests += other.requests;
+    for (std::size_t s = 0; s < PerfStageCount; s++) {
+        for (std::size_t c = 0; c < PerfCounterCount; c++) {
+            totals[s][c] += other.totals[s][c];
+        }
+    }
+}
+
+inline Json::Value PerfCountersSnapshot::toJsonValue() const
+{
+    Json::Value value;
+    value["requests"]  = Json::UInt64(requests);
+    value["available"] = Json::Value(Json::arrayValue);
+    for (std::size_t c = 0; c < PerfCounterCount; c++) {
+        if (available[c]) {
+            value["available"].append(PerfCounterName(static_cast<PerfCounter>(c)));
+        }
+    }
+    for (std::size_t s = 0; s < PerfStageCount; s++) {
+        const PerfStage stage     = static_cast<PerfStage>(s);
+        Json::Value&    stageJson = value["stages"][PerfStageName(stage)];
+        for (std::size_t c = 0; c < PerfCounterCount; c++) {
+            if (available[c]) {
+                stageJson[PerfCounterName(static_cast<PerfCounter>(c))] = Json::UInt64(totals[s][c]);
+            }
+        }
+        stageJson["ipc"] = ipc(stage);
+    }
+    return value;
+}
+
+inline std::string PerfCountersSnapshot::toString() const
+{
+    std::ostringstream out;
+    out << "per request (" << requests << " requests):\n";
+    out << "stage    ";
+    for (std::size_t c = 0; c < PerfCounterCount; c++) {
+        out << " " << PerfCounterName(static_cast<PerfCounter>(c));
+    }
+    out << " ipc\n";
+    for (std::size_t s = 0; s < PerfStageCount; s++) {
+        const PerfStage stage = static_cast<PerfStage>(s);
+        out << PerfStageName(stage);
+        for (std::size_t c = 0; c < PerfCounterCount; c++) {
+            out << " ";
+            if (available[c]) {
+                out << perRequest(stage, static_cast<PerfCounter>(c));
+            } else {
+                out << "n/a";
+            }
+        }
+        out << " " << ipc(stage) << "\n";
+    }
+    return out.str();
+}
+
+PerfCounters::Shard& PerfCounters::localShard()
+{
+    return shards.local([]() {
+        std::shared_ptr<Shard> shard = std::make_shared<Shard>();
+        shard->group.reset(new PerfCounterGroup);
+        if (shard->group->anyAvailable()) {
+            shard->recorder.reset(new PerfStageRecorder(*shard->group));
+        }
+        for (std::size_t c = 0; c < PerfCounterCount; c++) {
+            shard->data.available[c] = shard->group->available(static_cast<PerfCounter>(c));
+        }
+        return shard;
+    });
+}
+
+inline bool PerfCounters::Supported() { return PerfCounterGroup().anyAvailable(); }
+
+PerfStageRecorder* PerfCounters::beginRequest()
+{
+    PerfStageRecorder* recorder = localShard().recorder.get();
+    if (!recorder || recorder->inRequest) {
+        return nullptr;
+    }
+    recorder->inRequest = true;
+    recorder->stages    = {};
+    return recorder;
+}
+
+void PerfCounters::endRequest(PerfStageRecorder* recorder)
+{
+    Shard&                      shard = localShard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.data.requests++;
+    for (std::size_t s = 0; s < PerfStageCount; s++) {
+        for (std::size_t c = 0; c < PerfCounterCount; c++) {
+            shard.data.totals[s][c] += recorder->stages[s][c];
+        }
+    }
+    recorder->inRequest = false;
+}
+
+PerfCountersSnapshot PerfCounters::snapshot() const
+{
+    PerfCountersSnapshot result;
+    for (const auto& shard : shards.all()) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        result.merge(shard->data);
+    }
+    return result;
+}
+
+#endif // PERFCOUNTERS_H
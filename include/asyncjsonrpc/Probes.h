@@ -0,0 +1,97 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+#include <jsoncpp/json/json.h>
+#include <string>
+
+// USDT probes (provider "asyncjsonrpc") in the dispatch pipeline, for bpftrace, perf or systemtap:
+//
+//   request_received  (const char* request, size_t bytes)
+//   method_resolved   (const char* method, const char* id)
+//   handler_start     (const char* method, const char* id)
+//   handler_end       (const char* method, const char* id)  not fired if the handler throws
+//   error_emitted     (int code, const char* method, const char* id)
+//   response_emitted  (size_t responseBytes, size_t requestBytes)
+//
+// ids are rendered as json ("7", "\"abc\"", "null"). Compiled in with ASYNCJSONRPC_USDT (the cmake
+// option of the same name) where sys/sdt.h is installed, and compiled out otherwise. Every probe has
+// a semaphore that the tracer sets while attached, so when nobody is, a probe costs a load and a
+// branch, and its arguments aren't computed.
+//
+//   bpftrace -e 'usdt:./server:asyncjsonrpc:handler_start { @start[tid] = nsecs; }
+//                usdt:./server:asyncjsonrpc:handler_end /@start[tid]/ {
+//                    @us[str(arg0)] = hist((nsecs - @start[tid]) / 1000); delete(@start[tid]); }'
+
+#if defined(ASYNCJSONRPC_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define ASYNCJSONRPC_HAS_USDT 1
+#endif
+#endif
+
+#ifdef ASYNCJSONRPC_HAS_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+// defined in src/Probes.cpp; the names are the ones sys/sdt.h expects
+#define ASYNCJSONRPC_DECLARE_SEMAPHORE(name)                                                            \
+    extern "C" unsigned short asyncjsonrpc_##name##_semaphore __attribute__((section(".probes")))
+
+ASYNCJSONRPC_DECLARE_SEMAPHORE(request_received);
+ASYNCJSONRPC_DECLARE_SEMAPHORE(method_resolved);
+ASYNCJSONRPC_DECLARE_SEMAPHORE(handler_start);
+ASYNCJSONRPC_DECLARE_SEMAPHORE(handler_end);
+ASYNCJSONRPC_DECLARE_SEMAPHORE(error_emitted);
+ASYNCJSONRPC_DECLARE_SEMAPHORE(response_emitted);
+
+#define ASYNCJSONRPC_PROBE_ENABLED(name) __builtin_expect(asyncjsonrpc_##name##_semaphore != 0, 0)
+#define ASYNCJSONRPC_PROBE2(name, a, b) STAP_PROBE2(asyncjsonrpc, name, a, b)
+#define ASYNCJSONRPC_PROBE3(name, a, b, c) STAP_PROBE3(asyncjsonrpc, name, a, b, c)
+
+#else
+
+#define ASYNCJSONRPC_PROBE_ENABLED(name) false
+// the arguments are still type-checked, but never evaluated
+#define ASYNCJSONRPC_PROBE2(name, a, b)                                                                 \
+    do {                                                                                                \
+        static_cast<void>(sizeof(a));                                                                   \
+        static_cast<void>(sizeof(b));                                                                   \
+    } while (0)
+#define ASYNCJSONRPC_PROBE3(name, a, b, c)                                                              \
+    do {                                                                                                \
+        static_cast<void>(sizeof(a));                                                                   \
+        static_cast<void>(sizeof(b));                                                                   \
+        static_cast<void>(sizeof(c));                                                                   \
+    } while (0)
+
+#endif
+
+// a request id as probe argument
+inline std::string ProbeRequestId(const Json::Value& id)
+{
+    if (id.isString()) {
+        return "\"" + id.asString() + "\"";
+    }
+    if (id.isNull()) {
+        return "null";
+    }
+    Json::FastWriter writer;
+    std::string      text = writer.write(id);
+    if (!text.empty() && text.back() == '\n') {
+        text.pop_back();
+    }
+    return text;
+}
+
+// fires error_emitted for an error answered to call (null for errors of the request as a whole)
+inline void ProbeErrorEmitted(int code, const Json::Value* call)
+{
+    if (ASYNCJSONRPC_PROBE_ENABLED(error_emitted)) {
+        const bool        hasMethod = (call && call->isMember("method") && (*call)["method"].isString());
+        const std::string method    = (hasMethod ? (*call)["method"].asString() : std::string());
+        const std::string id        = ProbeRequestId(call ? (*call)["id"] : Json::Value());
+        ASYNCJSONRPC_PROBE3(error_emitted, code, method.c_str(), id.c_str());
+    }
+}
+
+#endif // PROBES_H
@@ -0,0 +1,173 @@
+#ifndef RECYCLINGALLOCATOR_H
+#define RECYCLINGALLOCATOR_H
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+// Per-thread free lists of small blocks, in size classes of 64 bytes up to 1 KiB. Blocks freed on one
+// thread and needed on another (the usual case for tasks posted by one thread and run by another)
+// travel in batches through a shared depot, so in steady state neither side calls the system
+// allocator and the depot lock is taken once per batch, not per block.
+class RecyclingMemoryPool
+{
+public:
+    static const std::size_t Granularity     = 64;
+    static const std::size_t SizeClassCount  = 16;
+    static const std::size_t LocalCacheLimit = 256; // blocks per size class kept by one thread
+    static const std::size_t TransferBatch   = LocalCacheLimit / 2;
+
+    static inline void* allocate(std::size_t size);
+    static inline void  deallocate(void* pointer, std::size_t size);
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct FreeList
+    {
+        FreeBlock*  head  = nullptr;
+        std::size_t count = 0;
+
+        void push(FreeBlock* block)
+        {
+            block->next = head;
+            head        = block;
+            count++;
+        }
+        FreeBlock* pop()
+        {
+            FreeBlock* block = head;
+            head             = block->next;
+            count--;
+            return block;
+        }
+        // moves up to n blocks to the other list
+        void transferTo(FreeList& other, std::size_t n)
+        {
+            while (head && n-- > 0) {
+                other.push(pop());
+            }
+        }
+    };
+
+    struct Depot
+    {
+        std::mutex mutex;
+        FreeList   lists[SizeClassCount];
+    };
+
+    struct LocalCache
+    {
+        FreeList lists[SizeClassCount];
+
+        ~LocalCache()
+        {
+            // a thread going away hands its blocks to the depot for the others
+            Depot&                      d = depot();
+            std::lock_guard<std::mutex> lock(d.mutex);
+            for (std::size_t i = 0; i < SizeClassCount; i++) {
+                lists[i].transferTo(d.lists[i], lists[i].count);
+            }
+        }
+    };
+
+    static Depot& depot()
+    {
+        // never destroyed, so threads exiting during static destruction can still return blocks
+        static Depot* instance = new Depot;
+        return *instance;
+    }
+
+    static LocalCache& localCache()
+    {
+        static thread_local LocalCache cache;
+        return cache;
+    }
+
+    static std::size_t sizeClassOf(std::size_t size) { return (size + Granularity - 1) / Granularity - 1; }
+};
+
+void* RecyclingMemoryPool::allocate(std::size_t size)
+{
+    const std::size_t sizeClass = sizeClassOf(size);
+    if (size == 0 || sizeClass >= SizeClassCount) {
+        return ::operator new(size);
+    }
+
+    FreeList& local = localCache().lists[sizeClass];
+    if (!local.head) {
+        Depot&                      d = depot();
+        std::lock_guard<std::mutex> lock(d.mutex);
+        d.lists[sizeClass].transferTo(local, TransferBatch);
+    }
+    if (!local.head) {
+        return ::operator new((sizeClass + 1) * Granularity);
+    }
+    return local.pop();
+}
+
+void RecyclingMemoryPool::deallocate(void* pointer, std::size_t size)
+{
+    const std::size_t sizeClass = sizeClassOf(size);
+    if (size == 0 || sizeClass >= SizeClassCount) {
+        ::operator delete(pointer);
+        return;
+    }
+
+    FreeList& local = localCache().lists[sizeClass];
+    local.push(static_cast<FreeBlock*>(pointer));
+    if (local.count > LocalCacheLimit) {
+        Depot&                      d = depot();
+        std::lock_guard<std::mutex> lock(d.mutex);
+        local.transferTo(d.lists[sizeClass], TransferBatch);
+    }
+}
+
+// Standard allocator on top of RecyclingMemoryPool. It's stateless; all instances are interchangeable.
+template <typename T>
+class RecyclingAllocator
+{
+public:
+    using value_type = T;
+
+    RecyclingAllocator() noexcept = default;
+
+    template <typename U>
+    RecyclingAllocator(const RecyclingAllocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "Over-aligned types are not supported");
+        return static_cast<T*>(RecyclingMemoryPool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, std::size_t n) noexcept
+    {
+        RecyclingMemoryPool::deallocate(pointer, n * sizeof(T));
+    }
+
+    template <typename U>
+    struct rebind
+    {
+        using other = RecyclingAllocator<U>;
+    };
+};
+
+template <typename T, typename U>
+bool operator==(const RecyclingAllocator<T>&, const RecyclingAllocator<U>&) noexcept
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const RecyclingAllocator<T>&, const RecyclingAllocator<U>&) noexcept
+{
+    return false;
+}
+
+#endif // RECYCLINGALLOCATOR_H
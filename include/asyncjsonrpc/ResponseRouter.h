@@ -0,0 +1,83 @@
+#ifndef RESPONSEROUTER_H
+#define RESPONSEROUTER_H
+
+#include <functional>
+#include <string>
+#include <tuple>
+#include <utility>
+
+// post() hands the response to the response callback before it returns, on the calling thread. The
+// transports use that to get the response of their own post() back without a table of pending calls:
+// for the duration of the call, a thread-local points at the caller's buffer.
+//
+// Responses of calls made outside of Post() (asyncPost(), ...) go to the fallback callback: the servers
+// take it in their options (responseFallback), and install the router when they're constructed. Every
+// server of an rpc installs it again, so give them all the same fallback; setting the rpc's response
+// callback after that takes the responses away from all of them. A handler that calls post() directly,
+// inside a Post(), must use Post() too: otherwise its response is dropped.
+class ResponseRouter
+{
+    static std::string*& Current()
+    {
+        static thread_local std::string* current = nullptr;
+        return current;
+    }
+
+    template <typename Rpc, typename Tuple, std::size_t... I, typename... Call>
+    static void PostWithTuple(Rpc& rpc, const Tuple& context, std::index_sequence<I...>,
+                              const Call&... call)
+    {
+        rpc.post(call..., std::get<I>(context)...);
+    }
+
+    template <typename Rpc, typename... Context, typename... Call>
+    static void Route(Rpc& rpc, const std::tuple<Context...>& context, std::string& response,
+                      const Call&... call)
+    {
+        std::string*& current  = Current();
+        std::string*  previous = current;
+        current                = &response;
+        try {
+            PostWithTuple(rpc, context, std::index_sequence_for<Context...>(), call...);
+        } catch (...) {
+            current = previous;
+            throw;
+        }
+        current = previous;
+    }
+
+public:
+    using Fallback = std::function<void(std::string&&)>;
+
+    // sets rpc's response callback; without a fallback, the responses of other calls are dropped
+    template <typename Rpc>
+    static void Install(Rpc& rpc, Fallback fallback = Fallback())
+    {
+        rpc.setResponseCallback([fallback](std::string&& response) {
+            std::string*& current = Current();
+            if (current) {
+                *current = std::move(response);
+            } else if (fallback) {
+                fallback(std::move(response));
+            }
+        });
+    }
+
+    // post()s jsonCall with the contexts in the tuple, and moves its response into response
+    template <typename Rpc, typename... Context>
+    static void Post(Rpc& rpc, const std::string& jsonCall, const std::tuple<Context...>& context,
+                     std::string& response)
+    {
+        Route(rpc, context, response, jsonCall);
+    }
+
+    // the same, for a request that isn't in a std::string: it's parsed where it is
+    template <typename Rpc, typename... Context>
+    static void Post(Rpc& rpc, const char* jsonCall, std::size_t size,
+                     const std::tuple<Context...>& context, std::string& response)
+    {
+        Route(rpc, context, response, jsonCall, size);
+    }
+};
+
+#endif // RESPONSEROUTER_H
@@ -0,0 +1,397 @@
+#ifndef RPCMETRICS_H
+#define RPCMETRICS_H
+
+#include "PerThreadShards.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <jsoncpp/json/json.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// HDR-style log-linear histogram: values below 2^SubBucketBits are exact, every power of two above
+// is split in 2^SubBucketBits equal sub-buckets, so any recorded value is off by at most 12.5%
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned    SubBucketBits = 3;
+    static constexpr std::size_t BucketCount   = (64 - SubBucketBits + 1) << SubBucketBits;
+
+private:
+    std::array<std::uint64_t, BucketCount> counts{};
+    std::uint64_t                          total = 0;
+    std::uint64_t                          sum   = 0;
+    std::uint64_t                          max   = 0;
+
+public:
+    static std::size_t   bucketIndex(std::uint64_t value);
+    static std::uint64_t bucketUpperBound(std::size_t index);
+
+    void record(std::uint64_t value);
+    void merge(const LatencyHistogram& other);
+
+    std::uint64_t count() const { return total; }
+    std::uint64_t sumOfValues() const { return sum; }
+    std::uint64_t maxValue() const { return max; }
+
+    // upper bound of the bucket holding the q-th quantile (q in [0, 1]), 0 if empty
+    std::uint64_t percentile(double q) const;
+
+    std::uint64_t countAtOrBelow(std::uint64_t value) const;
+};
+
+inline std::size_t LatencyHistogram::bucketIndex(std::uint64_t value)
+{
+    if (value < (1u << SubBucketBits)) {
+        return static_cast<std::size_t>(value);
+    }
+    const unsigned      msb       = 63 - static_cast<unsigned>(__builtin_clzll(value));
+    const unsigned      shift     = msb - SubBucketBits;
+    const std::uint64_t subBucket = (value >> shift) & ((1u << SubBucketBits) - 1);
+    return (static_cast<std::size_t>(shift + 1) << SubBucketBits) + static_cast<std::size_t>(subBucket);
+}
+
+inline std::uint64_t LatencyHistogram::bucketUpperBound(std::size_t index)
+{
+    if (index < (1u << SubBucketBits)) {
+        return index;
+    }
+    const std::size_t   shift     = (index >> SubBucketBits) - 1;
+    const std::uint64_t subBucket = index & ((1u << SubBucketBits) - 1);
+    const std::uint64_t lower     = ((std::uint64_t(1) << SubBucketBits) + subBucket) << shift;
+    return lower + ((std::uint64_t(1) << shift) - 1);
+}
+
+inline void LatencyHistogram::record(std::uint64_t value)
+{
+    counts[bucketIndex(value)]++;
+    total++;
+    sum += value;
+    if (value > max) {
+        max = value;
+    }
+}
+
+inline void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (std::size_t i = 0; i < BucketCount; i++) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+    sum += other.sum;
+    if (other.max > max) {
+        max = other.max;
+    }
+}
+
+inline std::uint64_t LatencyHistogram::percentile(double q) const
+{
+    if (total == 0) {
+        return 0;
+    }
+    const std::uint64_t rank       = static_cast<std::uint64_t>(q * static_cast<double>(total - 1)) + 1;
+    std::uint64_t       cumulative = 0;
+    for (std::size_t i = 0; i < BucketCount; i++) {
+        cumulative += counts[i];
+        if (cumulative >= rank) {
+            return std::min(bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+inline std::uint64_t LatencyHistogram::countAtOrBelow(std::uint64_t value) const
+{
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i < BucketCount && bucketUpperBound(i) <= value; i++) {
+        cumulative += counts[i];
+    }
+    return cumulative;
+}
+
+struct MethodMetrics
+{
+    std::uint64_t                calls = 0;
+    std::map<int, std::uint64_t> errorsByCode;
+    LatencyHistogram             validateNs; // basic checks, method lookup and parameter types
+    LatencyHistogram             invokeNs;   // the handler
+
+    void merge(const MethodMetrics& other);
+};
+
+inline void MethodMetrics::merge(const MethodMetrics& other)
+{
+    calls += other.calls;
+    for (const auto& p : other.errorsByCode) {
+        errorsByCode[p.first] += p.second;
+    }
+    validateNs.merge(other.validateNs);
+    invokeNs.merge(other.invokeNs);
+}
+
+struct RpcMetricsSnapshot
+{
+    std::uint64_t                        requests = 0;
+    std::map<std::string, MethodMetrics> methods;
+    std::map<int, std::uint64_t>         errorsByCode; // every error, including unknown methods
+    LatencyHistogram                     parseNs;
+    LatencyHistogram                     serializeNs;
+    LatencyHistogram                     batchSizes;
+    LatencyHistogram                     requestBytes;
+    LatencyHistogram                     responseBytes;
+
+    void merge(const RpcMetricsSnapshot& other);
+
+    std::string toPrometheusText(const std::string& prefix = "asyncjsonrpc") const;
+    Json::Value toJsonValue() const;
+};
+
+inline void RpcMetricsSnapshot::merge(const RpcMetricsSnapshot& other)
+{
+    requests += other.requests;
+    for (const auto& p : other.methods) {
+        methods[p.first].merge(p.second);
+    }
+    for (const auto& p : other.errorsByCode) {
+        errorsByCode[p.first] += p.second;
+    }
+    parseNs.merge(other.parseNs);
+    serializeNs.merge(other.serializeNs);
+    batchSizes.merge(other.batchSizes);
+    requestBytes.merge(other.requestBytes);
+    responseBytes.merge(other.responseBytes);
+}
+
+namespace RpcMetricsFormat {
+
+inline std::string EscapeLabel(const std::string& value)
+{
+    std::string result;
+    result.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            result += '\\';
+            result += c;
+        } else if (c == '\n') {
+            result += "\\n";
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+inline void WriteHistogram(std::ostream& os, const std::string& name, const std::string& labels,
+                           const LatencyHistogram& histogram, const std::vector<std::uint64_t>& bounds,
+                           double scale)
+{
+    const std::string sep = labels.empty() ? "" : ",";
+    for (std::uint64_t bound : bounds) {
+        os << name << "_bucket{" << labels << sep << "le=\"" << bound * scale << "\"} "
+           << histogram.countAtOrBelow(bound) << "\n";
+    }
+    os << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << histogram.count() << "\n";
+    os << name << "_sum{" << labels << "} " << static_cast<double>(histogram.sumOfValues()) * scale
+       << "\n";
+    os << name << "_count{" << labels << "} " << histogram.count() << "\n";
+}
+
+inline std::vector<std::uint64_t> PowersOf(std::uint64_t base, std::uint64_t first, std::uint64_t last)
+{
+    std::vector<std::uint64_t> result;
+    for (std::uint64_t v = first; v <= last; v *= base) {
+        result.push_back(v);
+    }
+    return result;
+}
+
+inline Json::Value HistogramToJson(const LatencyHistogram& histogram)
+{
+    Json::Value result;
+    result["count"] = Json::UInt64(histogram.count());
+    result["sum"]   = Json::UInt64(histogram.sumOfValues());
+    result["max"]   = Json::UInt64(histogram.maxValue());
+    result["p50"]   = Json::UInt64(histogram.percentile(0.5));
+    result["p90"]   = Json::UInt64(histogram.percentile(0.9));
+    result["p99"]   = Json::UInt64(histogram.percentile(0.99));
+    result["p999"]  = Json::UInt64(histogram.percentile(0.999));
+    return result;
+}
+
+} // namespace RpcMetricsFormat
+
+inline std::string RpcMetricsSnapshot::toPrometheusText(const std::string& prefix) const
+{
+    using namespace RpcMetricsFormat;
+
+    // durations are recorded in nanoseconds and exported in seconds, as prometheus expects
+    const std::vector<std::uint64_t> timeBounds  = PowersOf(4, 1000, 1000000000);
+    const std::vector<std::uint64_t> sizeBounds  = PowersOf(4, 64, 64 * 1024 * 1024);
+    const std::vector<std::uint64_t> batchBounds = PowersOf(2, 1, 4096);
+
+    std::ostringstream os;
+    os << std::setprecision(9);
+
+    os << "# TYPE " << prefix << "_requests_total counter\n";
+    os << prefix << "_requests_total " << requests << "\n";
+
+    os << "# TYPE " << prefix << "_calls_total counter\n";
+    for (const auto& m : methods) {
+        os << prefix << "_calls_total{method=\"" << EscapeLabel(m.first) << "\"} " << m.second.calls
+           << "\n";
+    }
+
+    os << "# TYPE " << prefix << "_errors_total counter\n";
+    for (const auto& e : errorsByCode) {
+        os << prefix << "_errors_total{code=\"" << e.first << "\"} " << e.second << "\n";
+    }
+    os << "# TYPE " << prefix << "_method_errors_total counter\n";
+    for (const auto& m : methods) {
+        for (const auto& e : m.second.errorsByCode) {
+            os << prefix << "_method_errors_total{method=\"" << EscapeLabel(m.first) << "\",code=\""
+               << e.first << "\"} " << e.second << "\n";
+        }
+    }
+
+    const std::string stageName = prefix + "_stage_duration_seconds";
+    os << "# TYPE " << stageName << " histogram\n";
+    WriteHistogram(os, stageName, "stage=\"parse\"", parseNs, timeBounds, 1e-9);
+    WriteHistogram(os, stageName, "stage=\"serialize\"", serializeNs, timeBounds, 1e-9);
+    for (const auto& m : methods) {
+        const std::string method = "method=\"" + EscapeLabel(m.first) + "\"";
+        WriteHistogram(os, stageName, "stage=\"validate\"," + method, m.second.validateNs, timeBounds,
+                       1e-9);
+        WriteHistogram(os, stageName, "stage=\"invoke\"," + method, m.second.invokeNs, timeBounds, 1e-9);
+    }
+
+    os << "# TYPE " << prefix << "_batch_size histogram\n";
+    WriteHistogram(os, prefix + "_batch_size", "", batchSizes, batchBounds, 1);
+    os << "# TYPE " << prefix << "_request_bytes histogram\n";
+    WriteHistogram(os, prefix + "_request_bytes", "", requestBytes, sizeBounds, 1);
+    os << "# TYPE " << prefix << "_response_bytes histogram\n";
+    WriteHistogram(os, prefix + "_response_bytes", "", responseBytes, sizeBounds, 1);
+
+    return os.str();
+}
+
+inline Json::Value RpcMetricsSnapshot::toJsonValue() const
+{
+    using namespace RpcMetricsFormat;
+
+    Json::Value result;
+    result["requests"] = Json::UInt64(requests);
+    Json::Value errors(Json::objectValue);
+    for (const auto& e : errorsByCode) {
+        errors[std::to_string(e.first)] = Json::UInt64(e.second);
+    }
+    result["errors"] = errors;
+
+    Json::Value methodsValue(Json::objectValue);
+    for (const auto& m : methods) {
+        Json::Value methodValue;
+        methodValue["calls"] = Json::UInt64(m.second.calls);
+        Json::Value methodErrors(Json::objectValue);
+        for (const auto& e : m.second.errorsByCode) {
+            methodErrors[std::to_string(e.first)] = Json::UInt64(e.second);
+        }
+        methodValue["errors"]     = methodErrors;
+        methodValue["validateNs"] = HistogramToJson(m.second.validateNs);
+        methodValue["invokeNs"]   = HistogramToJson(m.second.invokeNs);
+        methodsValue[m.first]     = methodValue;
+    }
+    result["methods"] = methodsValue;
+
+    result["parseNs"]       = HistogramToJson(parseNs);
+    result["serializeNs"]   = HistogramToJson(serializeNs);
+    result["batchSizes"]    = HistogramToJson(batchSizes);
+    result["requestBytes"]  = HistogramToJson(requestBytes);
+    result["responseBytes"] = HistogramToJson(responseBytes);
+    return result;
+}
+
+// Collects RpcMetricsSnapshot data from many threads. Every thread records into its own shard (see
+// PerThreadShards.h), whose lock is only ever contended by a concurrent snapshot(); snapshot() merges
+// all shards.
+class RpcMetrics
+{
+    struct Shard
+    {
+        std::mutex         mutex;
+        RpcMetricsSnapshot data;
+    };
+
+    PerThreadShards<Shard> shards;
+
+public:
+    RpcMetrics() = default;
+
+    RpcMetrics(const RpcMetrics&) = delete;
+    RpcMetrics& operator=(const RpcMetrics&) = delete;
+
+    // methodName is null for calls that couldn't be attributed to a registered method
+    inline void recordCall(const std::string* methodName, int errorCode, std::uint64_t validateNs,
+                           std::uint64_t invokeNs);
+
+    inline void recordRequest(std::uint64_t parseNs, std::uint64_t serializeNs, std::size_t batchSize,
+                              std::size_t requestBytes, std::size_t responseBytes, int errorCode);
+
+    inline RpcMetricsSnapshot snapshot() const;
+};
+
+void RpcMetrics::recordCall(const std::string* methodName, int errorCode, std::uint64_t validateNs,
+                            std::uint64_t invokeNs)
+{
+    Shard&                      shard = shards.local();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (errorCode != 0) {
+        shard.data.errorsByCode[errorCode]++;
+    }
+    if (methodName) {
+        MethodMetrics& m = shard.data.methods[*methodName];
+        m.calls++;
+        if (errorCode != 0) {
+            m.errorsByCode[errorCode]++;
+        }
+        m.validateNs.record(validateNs);
+        if (invokeNs > 0) {
+            m.invokeNs.record(invokeNs);
+        }
+    }
+}
+
+void RpcMetrics::recordRequest(std::uint64_t parseNs, std::uint64_t serializeNs, std::size_t batchSize,
+                               std::size_t requestBytes, std::size_t responseBytes, int errorCode)
+{
+    Shard&                      shard = shards.local();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.data.requests++;
+    if (errorCode != 0) {
+        shard.data.errorsByCode[errorCode]++;
+    }
+    shard.data.parseNs.record(parseNs);
+    shard.data.serializeNs.record(serializeNs);
+    if (batchSize > 0) {
+        shard.data.batchSizes.record(batchSize);
+    }
+    shard.data.requestBytes.record(requestBytes);
+    shard.data.responseBytes.record(responseBytes);
+}
+
+RpcMetricsSnapshot RpcMetrics::snapshot() const
+{
+    RpcMetricsSnapshot result;
+    for (const auto& shard : shards.all()) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        result.merge(shard->data);
+    }
+    return result;
+}
+
+#endif // RPCMETRICS_H
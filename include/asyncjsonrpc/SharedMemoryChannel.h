@@ -0,0 +1,518 @@
+#ifndef SHAREDMEMORYCHANNEL_H
+#define SHAREDMEMORYCHANNEL_H
+
+#include "ResponseRouter.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+struct SharedMemoryOptions
+{
+    // bytes of each of the two rings of a channel, a power of two; a message can take up to half of it
+    std::size_t ringCapacity = 1024 * 1024;
+
+    // polls of an empty (or full) ring before sleeping on a futex until the other side wakes it; none
+    // on a single cpu
+    std::uint32_t spinCount = 1000;
+
+    // never sleep: the lowest latency, for a core per waiting thread (on a single cpu, polls yield)
+    bool busyPoll = false;
+
+    // the server's: the responses of the rpc's calls that don't come through a server (asyncPost(), ...)
+    ResponseRouter::Fallback responseFallback;
+};
+
+// Lock-free single-producer single-consumer ring of messages, in memory shared by two processes. A
+// message is a 4-byte length, then its bytes, padded to 8; it's never split at the end of the ring (a
+// marker skips what's left), so the consumer reads every message where it is, in one piece.
+//
+// The positions only grow; each has a futex word next to it, bumped with every move, that the other
+// side sleeps on when the ring is empty (or full). Wakeups are only sent to a side that said it sleeps.
+//
+// The other process can write anything in the ring: the consumer checks every position and length
+// before it reads a message, and stops at the first that's out of bounds (see corrupted()).
+class SharedMemoryRing
+{
+public:
+    struct alignas(64) Header
+    {
+        std::uint64_t capacity;
+
+        alignas(64) std::atomic<std::uint64_t> head; // bytes written, by the producer
+        std::atomic<std::uint32_t> pushed;           // futex word of the consumer
+        std::atomic<std::uint32_t> consumerSleeping;
+
+        alignas(64) std::atomic<std::uint64_t> tail; // bytes read, by the consumer
+        std::atomic<std::uint32_t> popped;           // futex word of the producer
+        std::atomic<std::uint32_t> producerSleeping;
+    };
+
+private:
+    static const std::uint32_t Wrap = 0xffffffff;
+
+    Header*       header   = nullptr;
+    char*         data     = nullptr;
+    std::uint64_t capacity = 0; // this side's copy; the one in the header is only checked
+    bool          corrupt  = false;
+
+    static std::uint64_t RecordSize(std::size_t size) { return (4 + size + 7) & ~std::uint64_t(7); }
+
+    static void Futex(std::atomic<std::uint32_t>& word, int operation, std::uint32_t value,
+                      const timespec* timeout)
+    {
+        // the words are shared between processes: no FUTEX_PRIVATE_FLAG
+        ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), operation, value, timeout, nullptr,
+                  0);
+    }
+
+    static void Notify(std::atomic<std::uint32_t>& word, const std::atomic<std::uint32_t>& sleeping);
+
+    template <typename Ready>
+    static bool Wait(std::atomic<std::uint32_t>& word, std::atomic<std::uint32_t>& sleeping,
+                     Ready ready, const std::atomic<std::uint32_t>& closed,
+                     const SharedMemoryOptions& options);
+
+public:
+    static std::size_t RegionSize(std::size_t capacity) { return sizeof(Header) + capacity; }
+
+    SharedMemoryRing() = default;
+
+    // over region, of RegionSize(Capacity) bytes; initialize makes it an empty ring, otherwise it is one
+    SharedMemoryRing(void* region, std::size_t Capacity, bool initialize);
+
+    std::size_t maxMessageSize() const { return capacity / 2 - 8; }
+
+    bool empty() const
+    {
+        return header->head.load(std::memory_order_acquire) ==
+               header->tail.load(std::memory_order_relaxed);
+    }
+
+    // producer; false if the ring hasn't room for the message now
+    bool hasRoom(std::size_t size) const;
+    bool tryPush(const char* message, std::size_t size);
+
+    // consumer: hands up to maxMessages messages to onMessage(const char*, std::size_t), where they are
+    // in the ring, and frees each after onMessage returns; returns how many
+    template <typename OnMessage>
+    std::size_t consume(OnMessage&& onMessage, std::size_t maxMessages);
+
+    // consume() found a position or a length that the producer can't have written; it reads nothing
+    // more, and the channel should be closed
+    bool corrupted() const { return corrupt; }
+
+    // until a message can be consumed (or pushed); false if closed was set meanwhile
+    bool waitForMessage(const std::atomic<std::uint32_t>& closed, const SharedMemoryOptions& options);
+    bool waitForRoom(std::size_t size, const std::atomic<std::uint32_t>& closed,
+                     const SharedMemoryOptions& options);
+
+    // wakes both sides, to see that the channel was closed
+    void wakeAll();
+};
+
+inline SharedMemoryRing::SharedMemoryRing(void* region, std::size_t Capacity, bool initialize)
+    : header(static_cast<Header*>(region)), data(static_cast<char*>(region) + sizeof(Header)),
+      capacity(Capacity)
+{
+    if (capacity < 64 || (capacity & (capacity - 1)) != 0) {
+        throw std::runtime_error("SharedMemoryRing: the capacity must be a power of two, at least 64");
+    }
+    if (initialize) {
+        header->capacity = capacity;
+        header->head.store(0, std::memory_order_relaxed);
+        header->pushed.store(0, std::memory_order_relaxed);
+        header->consumerSleeping.store(0, std::memory_order_relaxed);
+        header->tail.store(0, std::memory_order_relaxed);
+        header->popped.store(0, std::memory_order_relaxed);
+        header->producerSleeping.store(0, std::memory_order_relaxed);
+    } else if (header->capacity != capacity) {
+        throw std::runtime_error("SharedMemoryRing: the capacity doesn't match");
+    }
+}
+
+inline void SharedMemoryRing::Notify(std::atomic<std::uint32_t>&       word,
+                                     const std::atomic<std::uint32_t>& sleeping)
+{
+    // seq_cst, like the sleeper's store of its flag: either it sees the bump, or this sees the flag
+    word.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_seq_cst)) {
+        Futex(word, FUTEX_WAKE, 1, nullptr);
+    }
+}
+
+template <typename Ready>
+bool SharedMemoryRing::Wait(std::atomic<std::uint32_t>& word, std::atomic<std::uint32_t>& sleeping,
+                            Ready ready, const std::atomic<std::uint32_t>& closed,
+                            const SharedMemoryOptions& options)
+{
+    // with a single cpu, the other side can't make progress while this one spins: it yields instead
+    static const bool singleCpu = (std::thread::hardware_concurrency() <= 1);
+
+    const std::uint32_t spinCount = (singleCpu ? 0 : options.spinCount);
+    for (std::uint32_t spin = 0; options.busyPoll || spin < spinCount; spin++) {
+        if (ready()) {
+            return true;
+        }
+        if (closed.load(std::memory_order_acquire)) {
+            return false;
+        }
+        if (singleCpu) {
+            std::this_thread::yield();
+        } else {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+    }
+    for (;;) {
+        const std::uint32_t seen = word.load(std::memory_order_seq_cst);
+        sleeping.store(1, std::memory_order_seq_cst);
+        if (ready()) {
+            sleeping.store(0, std::memory_order_relaxed);
+            return true;
+        }
+        if (closed.load(std::memory_order_acquire)) {
+            sleeping.store(0, std::memory_order_relaxed);
+            return false;
+        }
+        // a timeout: the other process can write anything in the header, and might not wake this side
+        // (it doesn't tell whether that process is still alive, see SharedMemoryChannel)
+        const timespec timeout = {0, 100 * 1000 * 1000};
+        Futex(word, FUTEX_WAIT, seen, &timeout);
+        sleeping.store(0, std::memory_order_relaxed);
+    }
+}
+
+inline bool SharedMemoryRing::hasRoom(std::size_t size) const
+{
+    const std::uint64_t record = RecordSize(size);
+    const std::uint64_t head   = header->head.load(std::memory_order_relaxed);
+    const std::uint64_t tail   = header->tail.load(std::memory_order_acquire);
+    const std::uint64_t offset = head & (capacity - 1);
+    // the message isn't split: if it doesn't fit before the end, the rest of the ring is skipped
+    const std::uint64_t skip = (offset + record > capacity ? capacity - offset : 0);
+    return size <= maxMessageSize() && head + skip + record - tail <= capacity;
+}
+
+inline bool SharedMemoryRing::tryPush(const char* message, std::size_t size)
+{
+    if (!hasRoom(size)) {
+        return false;
+    }
+    const std::uint64_t record = RecordSize(size);
+    std::uint64_t       head   = header->head.load(std::memory_order_relaxed);
+    std::uint64_t       offset = head & (capacity - 1);
+    if (offset + record > capacity) {
+        const std::uint32_t wrap = Wrap;
+        std::memcpy(data + offset, &wrap, 4);
+        head += capacity - offset;
+        offset = 0;
+    }
+    const std::uint32_t length = static_cast<std::uint32_t>(size);
+    std::memcpy(data + offset, &length, 4);
+    std::memcpy(data + offset + 4, message, size);
+    header->head.store(head + record, std::memory_order_release);
+    Notify(header->pushed, header->consumerSleeping);
+    return true;
+}
+
+template <typename OnMessage>
+std::size_t SharedMemoryRing::consume(OnMessage&& onMessage, std::size_t maxMessages)
+{
+    std::uint64_t       tail  = header->tail.load(std::memory_order_relaxed);
+    const std::uint64_t head  = header->head.load(std::memory_order_acquire);
+    std::size_t         count = 0;
+    if (corrupt || (tail & 7) != 0 || head - tail > capacity) {
+        corrupt = true;
+        return 0;
+    }
+    while (tail != head && count < maxMessages) {
+        const std::uint64_t offset = tail & (capacity - 1);
+        std::uint32_t       length;
+        std::memcpy(&length, data + offset, 4);
+        // what the record takes: up to the end of the ring, or the message
+        const bool          wrap   = (length == Wrap);
+        const std::uint64_t record = (wrap ? capacity - offset : RecordSize(length));
+        if ((!wrap && length > maxMessageSize()) || offset + record > capacity || record > head - tail) {
+            corrupt = true;
+            break;
+        }
+        if (wrap) {
+            tail += record;
+            continue;
+        }
+        onMessage(static_cast<const char*>(data + offset + 4), static_cast<std::size_t>(length));
+        tail += record;
+        count++;
+        header->tail.store(tail, std::memory_order_release);
+        Notify(header->popped, header->producerSleeping);
+    }
+    // a skipped end of the ring, after the last message
+    header->tail.store(tail, std::memory_order_release);
+    return count;
+}
+
+inline bool SharedMemoryRing::waitForMessage(const std::atomic<std::uint32_t>& closed,
+                                             const SharedMemoryOptions&        options)
+{
+    return Wait(
+        header->pushed, header->consumerSleeping, [this]() { return !empty(); }, closed, options);
+}
+
+inline bool SharedMemoryRing::waitForRoom(std::size_t size, const std::atomic<std::uint32_t>& closed,
+                                          const SharedMemoryOptions& options)
+{
+    return Wait(
+        header->popped, header->producerSleeping, [this, size]() { return hasRoom(size); }, closed,
+        options);
+}
+
+inline void SharedMemoryRing::wakeAll()
+{
+    header->pushed.fetch_add(1, std::memory_order_seq_cst);
+    header->popped.fetch_add(1, std::memory_order_seq_cst);
+    Futex(header->pushed, FUTEX_WAKE, 1, nullptr);
+    Futex(header->popped, FUTEX_WAKE, 1, nullptr);
+}
+
+// A shared memory segment (a memfd) holding the two rings between a client and the server: requests
+// and responses. The server creates it; the client process gets its fd over a Unix socket
+// (SCM_RIGHTS), and maps it with Map(). The segment is sealed to its size: a process that shrank it
+// would have the other one take SIGBUS on its next access, so Map() only takes a sealed one. Either
+// side can close() it: the other side's waits then return
+// false. A process that dies without closing it isn't noticed: the other side waits on, until it
+// closes the channel itself.
+class SharedMemoryChannel
+{
+    struct alignas(64) Header
+    {
+        std::uint64_t              magic;
+        std::uint64_t              ringCapacity;
+        std::atomic<std::uint32_t> closed;
+    };
+
+    static const std::uint64_t Magic = 0x414a525053484d31; // "AJRPSHM1"
+    static const int           Seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+    int              descriptor;
+    std::size_t      size;
+    void*            region;
+    Header*          header;
+    SharedMemoryRing requestRing;
+    SharedMemoryRing responseRing;
+
+    SharedMemoryChannel(int fd, std::size_t ringCapacity, bool initialize);
+
+    static std::size_t SegmentSize(std::size_t ringCapacity)
+    {
+        return sizeof(Header) + 2 * SharedMemoryRing::RegionSize(ringCapacity);
+    }
+
+    static std::runtime_error Error(const char* what)
+    {
+        return std::runtime_error(std::string("SharedMemoryChannel: ") + what + ": " +
+                                  std::strerror(errno));
+    }
+
+public:
+    // a new segment, with empty rings
+    static std::unique_ptr<SharedMemoryChannel> Create(std::size_t ringCapacity);
+
+    // the segment of fd, made by Create() (in this process or another); the channel owns fd
+    static std::unique_ptr<SharedMemoryChannel> Map(int fd);
+
+    SharedMemoryChannel(const SharedMemoryChannel&) = delete;
+    SharedMemoryChannel& operator=(const SharedMemoryChannel&) = delete;
+    ~SharedMemoryChannel();
+
+    int fd() const { return descriptor; }
+
+    SharedMemoryRing& requests() { return requestRing; }
+    SharedMemoryRing& responses() { return responseRing; }
+
+    void close();
+    bool closed() const { return header->closed.load(std::memory_order_acquire) != 0; }
+
+    const std::atomic<std::uint32_t>& closedFlag() const { return header->closed; }
+};
+
+inline SharedMemoryChannel::SharedMemoryChannel(int fd, std::size_t ringCapacity, bool initialize)
+    : descriptor(fd), size(SegmentSize(ringCapacity))
+{
+    region = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (region == MAP_FAILED) {
+        const std::runtime_error error = Error("mmap");
+        ::close(fd);
+        throw error;
+    }
+    header = static_cast<Header*>(region);
+    if (initialize) {
+        header->magic        = Magic;
+        header->ringCapacity = ringCapacity;
+        header->closed.store(0, std::memory_order_relaxed);
+    }
+    char* rings = static_cast<char*>(region) + sizeof(Header);
+    try {
+        requestRing  = SharedMemoryRing(rings, ringCapacity, initialize);
+        responseRing = SharedMemoryRing(rings + SharedMemoryRing::RegionSize(ringCapacity), ringCapacity,
+                                        initialize);
+    } catch (...) {
+        ::munmap(region, size);
+        ::close(fd);
+        throw;
+    }
+}
+
+inline std::unique_ptr<SharedMemoryChannel> SharedMemoryChannel::Create(std::size_t ringCapacity)
+{
+    if (ringCapacity < 64 || (ringCapacity & (ringCapacity - 1)) != 0) {
+        throw std::runtime_error("SharedMemoryChannel: the ring capacity must be a power of two, "
+                                 "at least 64");
+    }
+    const int fd = ::memfd_create("asyncjsonrpc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        throw Error("memfd_create");
+    }
+    if (::ftruncate(fd, static_cast<off_t>(SegmentSize(ringCapacity))) != 0) {
+        const std::runtime_error error = Error("ftruncate");
+        ::close(fd);
+        throw error;
+    }
+    if (::fcntl(fd, F_ADD_SEALS, Seals) != 0) {
+        const std::runtime_error error = Error("F_ADD_SEALS");
+        ::close(fd);
+        throw error;
+    }
+    return std::unique_ptr<SharedMemoryChannel>(new SharedMemoryChannel(fd, ringCapacity, true));
+}
+
+inline std::unique_ptr<SharedMemoryChannel> SharedMemoryChannel::Map(int fd)
+{
+    // unsealed, the other process could still shrink it under this one
+    const int seals = ::fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & Seals) != Seals) {
+        ::close(fd);
+        throw std::runtime_error("SharedMemoryChannel: the segment isn't sealed");
+    }
+    // the magic number and the ring capacity
+    std::uint64_t fields[2];
+    if (::pread(fd, fields, sizeof(fields), 0) != static_cast<ssize_t>(sizeof(fields)) ||
+        fields[0] != Magic) {
+        ::close(fd);
+        throw std::runtime_error("SharedMemoryChannel: not a channel");
+    }
+    // the capacity comes from the other process: it's checked before anything is sized with it
+    const std::uint64_t capacity = fields[1];
+    if (capacity < 64 || (capacity & (capacity - 1)) != 0) {
+        ::close(fd);
+        throw std::runtime_error("SharedMemoryChannel: bad ring capacity");
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || static_cast<std::uint64_t>(status.st_size) < capacity ||
+        static_cast<std::uint64_t>(status.st_size) < SegmentSize(capacity)) {
+        ::close(fd);
+        throw std::runtime_error("SharedMemoryChannel: truncated segment");
+    }
+    return std::unique_ptr<SharedMemoryChannel>(new SharedMemoryChannel(fd, capacity, false));
+}
+
+inline SharedMemoryChannel::~SharedMemoryChannel()
+{
+    ::munmap(region, size);
+    ::close(descriptor);
+}
+
+inline void SharedMemoryChannel::close()
+{
+    header->closed.store(1, std::memory_order_release);
+    requestRing.wakeAll();
+    responseRing.wakeAll();
+}
+
+// The client's side of a channel: requests are pushed on the request ring, responses come in order on
+// the response ring. send() several requests before receive()ing their responses to pipeline them.
+// Not thread-safe: one thread sends, and one (possibly the same) receives.
+class SharedMemoryClient
+{
+    std::shared_ptr<SharedMemoryChannel> channel;
+    SharedMemoryOptions                  options;
+
+public:
+    explicit SharedMemoryClient(std::shared_ptr<SharedMemoryChannel> Channel,
+                                const SharedMemoryOptions& Options = SharedMemoryOptions())
+        : channel(std::move(Channel)), options(Options)
+    {
+    }
+
+    SharedMemoryClient(const SharedMemoryClient&) = delete;
+    SharedMemoryClient& operator=(const SharedMemoryClient&) = delete;
+
+    // the server stops serving the channel
+    ~SharedMemoryClient() { channel->close(); }
+
+    // waits for room in the ring; false if the channel was closed
+    bool send(const char* request, std::size_t size);
+    bool send(const std::string& request) { return send(request.data(), request.size()); }
+
+    // waits for the next response, and hands it to onResponse(const char*, std::size_t) where it is, in
+    // the ring; false if the channel was closed
+    template <typename OnResponse>
+    bool receive(OnResponse&& onResponse);
+
+    // send(), then receive() into a string; throws std::runtime_error if the channel is closed
+    std::string call(const std::string& request);
+};
+
+inline bool SharedMemoryClient::send(const char* request, std::size_t size)
+{
+    SharedMemoryRing& requests = channel->requests();
+    if (size > requests.maxMessageSize()) {
+        throw std::runtime_error("SharedMemoryClient: the request is larger than half of the ring");
+    }
+    while (!requests.tryPush(request, size)) {
+        if (!requests.waitForRoom(size, channel->closedFlag(), options)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename OnResponse>
+bool SharedMemoryClient::receive(OnResponse&& onResponse)
+{
+    SharedMemoryRing& responses = channel->responses();
+    while (responses.consume(onResponse, 1) == 0) {
+        if (responses.corrupted()) {
+            channel->close();
+            return false;
+        }
+        if (!responses.waitForMessage(channel->closedFlag(), options)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline std::string SharedMemoryClient::call(const std::string& request)
+{
+    std::string response;
+    if (!send(request) ||
+        !receive([&response](const char* data, std::size_t size) { response.assign(data, size); })) {
+        throw std::runtime_error("SharedMemoryClient: the channel is closed");
+    }
+    return response;
+}
+
+#endif // SHAREDMEMORYCHANNEL_H
@@ -0,0 +1,124 @@
+#ifndef SHAREDMEMORYCLIENTTRANSPORT_H
+#define SHAREDMEMORYCLIENTTRANSPORT_H
+
+#include "SharedMemoryChannel.h"
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+// The connection of an AsyncJsonRPCClient to an AsyncJsonRPCSharedMemoryServer, over a channel it
+// accepted (or one mapped with SharedMemoryChannel::Map(), in another process). Requests are pushed on
+// the strand, waiting for room when the ring is full; a thread of the transport waits for the responses,
+// and posts a copy of each to the strand. A request larger than the ring takes closes the transport with
+// message_size. Used on its strand, as StreamClientTransport.
+class SharedMemoryClientTransport : public std::enable_shared_from_this<SharedMemoryClientTransport>
+{
+public:
+    using executor_type = boost::asio::strand<boost::asio::io_context::executor_type>;
+    using OnMessage     = std::function<void(const char* data, std::size_t size)>;
+    using OnClose       = std::function<void(boost::system::error_code ec)>;
+
+private:
+    executor_type                        strand;
+    std::shared_ptr<SharedMemoryChannel> channel;
+    SharedMemoryClient                   client;
+    std::thread                          reader;
+    OnMessage                            onMessage;
+    OnClose                              onClose;
+    bool                                 closed = false;
+
+    void receive(std::weak_ptr<SharedMemoryClientTransport> weak);
+    void fail(boost::system::error_code ec);
+
+public:
+    SharedMemoryClientTransport(boost::asio::io_context&             ioContext,
+                                std::shared_ptr<SharedMemoryChannel> Channel,
+                                const SharedMemoryOptions&           Options = SharedMemoryOptions())
+        : strand(boost::asio::make_strand(ioContext)), channel(std::move(Channel)),
+          client(channel, Options)
+    {
+    }
+
+    SharedMemoryClientTransport(const SharedMemoryClientTransport&) = delete;
+    SharedMemoryClientTransport& operator=(const SharedMemoryClientTransport&) = delete;
+
+    // closes the channel, and joins the thread
+    ~SharedMemoryClientTransport()
+    {
+        channel->close();
+        if (reader.joinable()) {
+            reader.join();
+        }
+    }
+
+    executor_type get_executor() const { return strand; }
+
+    void start(OnMessage onMessageRef, OnClose onCloseRef)
+    {
+        onMessage = std::move(onMessageRef);
+        onClose   = std::move(onCloseRef);
+        std::weak_ptr<SharedMemoryClientTransport> weak = shared_from_this();
+        reader = std::thread([this, weak]() { receive(weak); });
+    }
+
+    void send(const std::string& message)
+    {
+        if (closed) {
+            return;
+        }
+        if (message.size() > channel->requests().maxMessageSize()) {
+            fail(boost::asio::error::message_size);
+        } else if (!client.send(message)) {
+            fail(boost::asio::error::not_connected);
+        }
+    }
+
+    // the server stops serving the channel
+    void close()
+    {
+        closed    = true;
+        onMessage = nullptr;
+        onClose   = nullptr;
+        channel->close();
+    }
+};
+
+// the thread never owns the transport (the destructor joins it): what it posts holds a weak_ptr
+inline void SharedMemoryClientTransport::receive(std::weak_ptr<SharedMemoryClientTransport> weak)
+{
+    std::string response;
+    const auto copy = [&response](const char* data, std::size_t size) { response.assign(data, size); };
+    while (client.receive(copy)) {
+        boost::asio::post(strand, [weak, response = std::move(response)]() {
+            std::shared_ptr<SharedMemoryClientTransport> self = weak.lock();
+            if (self && self->onMessage) {
+                self->onMessage(response.data(), response.size());
+            }
+        });
+        response = std::string();
+    }
+    boost::asio::post(strand, [weak]() {
+        if (std::shared_ptr<SharedMemoryClientTransport> self = weak.lock()) {
+            self->fail(boost::asio::error::not_connected);
+        }
+    });
+}
+
+inline void SharedMemoryClientTransport::fail(boost::system::error_code ec)
+{
+    if (closed) {
+        return;
+    }
+    OnClose closing = std::move(onClose);
+    close();
+    if (closing) {
+        closing(ec);
+    }
+}
+
+#endif // SHAREDMEMORYCLIENTTRANSPORT_H
@@ -0,0 +1,222 @@
+#ifndef SLOWREQUESTLOG_H
+#define SLOWREQUESTLOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <jsoncpp/json/json.h>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct SlowRequestLogOptions
+{
+    // requests that take longer than this, end to end (from asyncPost(), or from post(), to the
+    // response), are logged
+    std::chrono::microseconds threshold{10000};
+
+    // the log keeps the last `capacity` slow requests
+    std::size_t capacity = 256;
+
+    // longer params are cut to this many bytes
+    std::size_t maxParamsSize = 256;
+};
+
+// A slow request and where its time went. For a batch, method and params are the ones of the slowest
+// call, and validate and invoke times are summed over all calls.
+struct SlowRequestRecord
+{
+    std::uint64_t sequence;    // 1 for the first slow request logged, 2 for the next, ...
+    std::uint64_t timestampNs; // when the response was ready, ns since the unix epoch
+    std::string   method;
+    std::string   params; // as in the request text, possibly truncated; empty without params
+    bool          paramsTruncated;
+    std::size_t   requestBytes;
+    std::size_t   batchSize; // 0 for a single call
+    int           errorCode; // of the request as a whole, like a parse error
+    std::uint64_t totalNs;
+    std::uint64_t queueWaitNs; // from asyncPost() to the start of processing; 0 for post()
+    std::uint64_t parseNs;
+    std::uint64_t validateNs;
+    std::uint64_t invokeNs;
+    std::uint64_t serializeNs;
+
+    Json::Value toJsonValue() const;
+
+    // one line: "#12 add total=15.210ms queue=10.002ms parse=0.004ms ... params={"p1": 1}"
+    std::string toString() const;
+};
+
+// A bounded ring of the last slow requests. Writers never wait: a writer claims a slot with one atomic
+// increment and fills it under the slot's try-lock; if the slot is busy (read by records(), or written
+// by a writer that was lapped), the record is dropped and counted instead.
+class SlowRequestLog
+{
+    struct Slot
+    {
+        std::atomic_flag  busy   = ATOMIC_FLAG_INIT;
+        SlowRequestRecord record = SlowRequestRecord(); // sequence 0: never written
+    };
+
+    SlowRequestLogOptions      options;
+    std::atomic<std::uint64_t> thresholdNs;
+    std::unique_ptr<Slot[]>    slots;
+    std::atomic<std::uint64_t> nextSequence{1};
+    std::atomic<std::uint64_t> dropped{0};
+
+public:
+    explicit SlowRequestLog(const SlowRequestLogOptions& Options = SlowRequestLogOptions());
+
+    const SlowRequestLogOptions& logOptions() const { return options; }
+
+    bool isSlow(std::uint64_t totalNs) const
+    {
+        return totalNs > thresholdNs.load(std::memory_order_relaxed);
+    }
+
+    // can be changed while requests are running
+    void setThreshold(std::chrono::nanoseconds threshold);
+
+    // fill(SlowRequestRecord&) sets every field but the sequence; the record it gets is reused, so its
+    // strings usually already have the capacity they need
+    template <typename Fill>
+    void record(Fill fill);
+
+    // the records in the ring, oldest first; a record being written at the time is skipped
+    std::vector<SlowRequestRecord> records() const;
+
+    // slow requests seen so far, including the ones that dropped out of the ring, or were dropped
+    std::uint64_t loggedCount() const { return nextSequence.load() - 1; }
+
+    std::uint64_t droppedCount() const { return dropped.load(); }
+
+    // records() as a json array, and as one line per record
+    Json::Value toJsonValue() const;
+    void        dump(std::ostream& out) const;
+
+    // copies [data, data + size) into out, cut to maxSize bytes; returns whether it was cut
+    static bool AssignTruncated(std::string& out, const char* data, std::size_t size,
+                                std::size_t maxSize);
+};
+
+inline Json::Value SlowRequestRecord::toJsonValue() const
+{
+    Json::Value value;
+    value["sequence"]        = Json::UInt64(sequence);
+    value["timestampNs"]     = Json::UInt64(timestampNs);
+    value["method"]          = method;
+    value["params"]          = params;
+    value["paramsTruncated"] = paramsTruncated;
+    value["requestBytes"]    = Json::UInt64(requestBytes);
+    value["batchSize"]       = Json::UInt64(batchSize);
+    value["errorCode"]       = errorCode;
+    value["totalNs"]         = Json::UInt64(totalNs);
+    value["queueWaitNs"]     = Json::UInt64(queueWaitNs);
+    value["parseNs"]         = Json::UInt64(parseNs);
+    value["validateNs"]      = Json::UInt64(validateNs);
+    value["invokeNs"]        = Json::UInt64(invokeNs);
+    value["serializeNs"]     = Json::UInt64(serializeNs);
+    return value;
+}
+
+inline std::string SlowRequestRecord::toString() const
+{
+    const auto ms = [](std::uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "#%llu %s total=%.3fms queue=%.3fms parse=%.3fms validate=%.3fms invoke=%.3fms "
+                  "serialize=%.3fms bytes=%zu batch=%zu error=%d",
+                  static_cast<unsigned long long>(sequence), method.empty() ? "-" : method.c_str(),
+                  ms(totalNs), ms(queueWaitNs), ms(parseNs), ms(validateNs), ms(invokeNs),
+                  ms(serializeNs), requestBytes, batchSize, errorCode);
+    std::string result = line;
+    if (!params.empty()) {
+        result += " params=" + params + (paramsTruncated ? "..." : "");
+    }
+    return result;
+}
+
+inline SlowRequestLog::SlowRequestLog(const SlowRequestLogOptions& Options)
+    : options(Options),
+      thresholdNs(static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(Options.threshold).count()))
+{
+    if (options.capacity == 0) {
+        throw std::runtime_error("The slow request log needs a capacity of at least 1");
+    }
+    slots.reset(new Slot[options.capacity]);
+}
+
+inline void SlowRequestLog::setThreshold(std::chrono::nanoseconds threshold)
+{
+    thresholdNs.store(static_cast<std::uint64_t>(threshold.count()), std::memory_order_relaxed);
+}
+
+template <typename Fill>
+void SlowRequestLog::record(Fill fill)
+{
+    const std::uint64_t sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+    Slot&               slot     = slots[(sequence - 1) % options.capacity];
+    if (slot.busy.test_and_set(std::memory_order_acquire)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // a writer lapped by a faster one doesn't overwrite the newer record
+    if (slot.record.sequence > sequence) {
+        slot.busy.clear(std::memory_order_release);
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    fill(slot.record);
+    slot.record.sequence = sequence;
+    slot.busy.clear(std::memory_order_release);
+}
+
+inline std::vector<SlowRequestRecord> SlowRequestLog::records() const
+{
+    std::vector<SlowRequestRecord> result;
+    for (std::size_t i = 0; i < options.capacity; i++) {
+        Slot& slot = slots[i];
+        if (slot.busy.test_and_set(std::memory_order_acquire)) {
+            continue;
+        }
+        if (slot.record.sequence != 0) {
+            result.push_back(slot.record);
+        }
+        slot.busy.clear(std::memory_order_release);
+    }
+    std::sort(result.begin(), result.end(), [](const SlowRequestRecord& a, const SlowRequestRecord& b) {
+        return a.sequence < b.sequence;
+    });
+    return result;
+}
+
+inline Json::Value SlowRequestLog::toJsonValue() const
+{
+    Json::Value array(Json::arrayValue);
+    for (const SlowRequestRecord& record : records()) {
+        array.append(record.toJsonValue());
+    }
+    return array;
+}
+
+inline void SlowRequestLog::dump(std::ostream& out) const
+{
+    for (const SlowRequestRecord& record : records()) {
+        out << record.toString() << "\n";
+    }
+}
+
+inline bool SlowRequestLog::AssignTruncated(std::string& out, const char* data, std::size_t size,
+                                            std::size_t maxSize)
+{
+    out.assign(data, std::min(size, maxSize));
+    return size > maxSize;
+}
+
+#endif // SLOWREQUESTLOG_H
@@ -0,0 +1,187 @@
+#ifndef STREAMCLIENTTRANSPORT_H
+#define STREAMCLIENTTRANSPORT_H
+
+#include "StreamFraming.h"
+#include <algorithm>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/system/error_code.hpp>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct StreamClientOptions
+{
+    // as the server's
+    Framing framing = Framing::Ndjson;
+
+    std::size_t readBufferSize = 64 * 1024;
+
+    // larger responses close the connection
+    std::size_t maxFrameSize = 1024 * 1024;
+};
+
+// The connection of an AsyncJsonRPCClient to an AsyncJsonRPCStreamServer (or AsyncJsonRPCUringServer):
+// Protocol is boost::asio::ip::tcp or boost::asio::local::stream_protocol. As in the server, requests
+// sent while a write is in progress are framed into one string, written with the next write, and the
+// responses are framed from the read buffer, where they are.
+//
+// A client transport is used on its strand, get_executor(): start(onMessage, onClose) begins reading,
+// onMessage(const char*, std::size_t) gets every message received, and onClose(error_code) is called
+// once, when the connection is lost (not after close()). send() takes one json-rpc message.
+template <typename Protocol = boost::asio::ip::tcp>
+class StreamClientTransport : public std::enable_shared_from_this<StreamClientTransport<Protocol>>
+{
+public:
+    using executor_type = boost::asio::strand<boost::asio::io_context::executor_type>;
+    using OnMessage     = std::function<void(const char* data, std::size_t size)>;
+    using OnClose       = std::function<void(boost::system::error_code ec)>;
+
+private:
+    const StreamClientOptions options;
+    executor_type             strand;
+    typename Protocol::socket socket;
+    StreamFramer              framer;
+    std::vector<char>         buffer;
+    std::size_t               begin = 0; // buffer[begin, end) is read, and not framed yet
+    std::size_t               end   = 0;
+    std::string               pending;
+    std::string               writing;
+    OnMessage                 onMessage;
+    OnClose                   onClose;
+    bool                      closed = false;
+
+    static void SetSocketOptions(boost::asio::ip::tcp::socket& socket)
+    {
+        socket.set_option(boost::asio::ip::tcp::no_delay(true));
+    }
+    template <typename Socket>
+    static void SetSocketOptions(Socket&)
+    {
+    }
+
+    void read();
+    void flush();
+    void fail(boost::system::error_code ec);
+
+public:
+    explicit StreamClientTransport(boost::asio::io_context&   ioContext,
+                                   const StreamClientOptions& Options = StreamClientOptions())
+        : options(Options), strand(boost::asio::make_strand(ioContext)), socket(strand),
+          framer(Options.framing, Options.maxFrameSize), buffer(Options.readBufferSize)
+    {
+    }
+
+    // blocks; throws boost::system::system_error
+    void connect(const typename Protocol::endpoint& endpoint)
+    {
+        socket.connect(endpoint);
+        SetSocketOptions(socket);
+    }
+
+    executor_type get_executor() const { return strand; }
+
+    void start(OnMessage onMessageRef, OnClose onCloseRef)
+    {
+        onMessage = std::move(onMessageRef);
+        onClose   = std::move(onCloseRef);
+        read();
+    }
+
+    void send(const std::string& message)
+    {
+        StreamFramer::Encode(options.framing, message.data(), message.size(), pending);
+        flush();
+    }
+
+    void close()
+    {
+        closed    = true;
+        onMessage = nullptr;
+        onClose   = nullptr;
+        boost::system::error_code ignored;
+        socket.close(ignored);
+    }
+};
+
+template <typename Protocol>
+void StreamClientTransport<Protocol>::read()
+{
+    if (end == buffer.size()) {
+        if (begin > 0) {
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        } else {
+            buffer.resize(buffer.size() * 2);
+        }
+    }
+    auto self = this->shared_from_this();
+    socket.async_read_some(
+        boost::asio::buffer(buffer.data() + end, buffer.size() - end),
+        [self](boost::system::error_code ec, std::size_t size) {
+            if (ec) {
+                self->fail(ec);
+                return;
+            }
+            self->end += size;
+            self->begin += self->framer.consume(
+                self->buffer.data() + self->begin, self->end - self->begin,
+                [&self](const char* frame, std::size_t frameSize) {
+                    if (self->onMessage) {
+                        self->onMessage(frame, frameSize);
+                    }
+                });
+            if (self->begin == self->end) {
+                self->begin = 0;
+                self->end   = 0;
+            }
+            if (self->framer.failed()) {
+                self->fail(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+                return;
+            }
+            if (!self->closed) {
+                self->read();
+            }
+        });
+}
+
+template <typename Protocol>
+void StreamClientTransport<Protocol>::flush()
+{
+    if (!writing.empty() || pending.empty() || closed) {
+        return;
+    }
+    writing.swap(pending);
+    auto self = this->shared_from_this();
+    boost::asio::async_write(socket, boost::asio::buffer(writing),
+                             [self](boost::system::error_code ec, std::size_t) {
+                                 self->writing.clear();
+                                 if (ec) {
+                                     self->fail(ec);
+                                     return;
+                                 }
+                                 self->flush();
+                             });
+}
+
+template <typename Protocol>
+void StreamClientTransport<Protocol>::fail(boost::system::error_code ec)
+{
+    if (closed) {
+        return;
+    }
+    OnClose closing = std::move(onClose);
+    close();
+    if (closing) {
+        closing(ec);
+    }
+}
+
+#endif // STREAMCLIENTTRANSPORT_H
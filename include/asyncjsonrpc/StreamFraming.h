@@ -0,0 +1,214 @@
+#ifndef STREAMFRAMING_H
+#define STREAMFRAMING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// how json-rpc messages are delimited on a byte stream
+enum class Framing
+{
+    Ndjson,       // one message per line; empty lines are skipped, a "\r" before the "\n" is dropped
+    LengthPrefix, // a 4-byte big-endian length, then the message
+    Netstring,    // "<decimal length>:<message>,"
+};
+
+inline const char* FramingName(Framing framing)
+{
+    static const char* names[] = {"ndjson", "length-prefix", "netstring"};
+    return names[static_cast<int>(framing)];
+}
+
+// Incremental framer: consume() is given the unconsumed bytes of a read buffer, hands every complete
+// frame in them to onFrame, as a pointer into the buffer and a size, and returns how many bytes it
+// consumed. The rest is the beginning of a frame, to be given again, with more bytes after it, once they
+// have been read. A frame larger than maxFrameSize, or a malformed prefix, makes the stream unusable:
+// failed() is then true and nothing more is consumed.
+class StreamFramer
+{
+    Framing     framing;
+    std::size_t maxFrameSize;
+    std::size_t scanned = 0; // ndjson: bytes of the incomplete line known to hold no "\n"
+    bool        error   = false;
+
+    template <typename OnFrame>
+    std::size_t consumeLines(const char* data, std::size_t size, OnFrame& onFrame);
+    template <typename OnFrame>
+    std::size_t consumeLengthPrefixed(const char* data, std::size_t size, OnFrame& onFrame);
+    template <typename OnFrame>
+    std::size_t consumeNetstrings(const char* data, std::size_t size, OnFrame& onFrame);
+
+public:
+    StreamFramer(Framing Framing, std::size_t MaxFrameSize)
+        : framing(Framing), maxFrameSize(MaxFrameSize)
+    {
+    }
+
+    template <typename OnFrame>
+    std::size_t consume(const char* data, std::size_t size, OnFrame&& onFrame);
+
+    bool failed() const { return error; }
+
+    // appends message, framed, to out; the "\n" that ends the library's responses is not part of the
+    // message
+    static void Encode(Framing framing, const char* data, std::size_t size, std::string& out);
+
+    // the same, around a message of size bytes that is written where it is (a shared notification):
+    // EncodePrefix() appends what goes before it to out, Suffix() is what goes after it
+    static void        EncodePrefix(Framing framing, std::size_t size, std::string& out);
+    static const char* Suffix(Framing framing);
+};
+
+template <typename OnFrame>
+std::size_t StreamFramer::consume(const char* data, std::size_t size, OnFrame&& onFrame)
+{
+    if (error) {
+        return 0;
+    }
+    switch (framing) {
+    case Framing::Ndjson:
+        return consumeLines(data, size, onFrame);
+    case Framing::LengthPrefix:
+        return consumeLengthPrefixed(data, size, onFrame);
+    case Framing::Netstring:
+        return consumeNetstrings(data, size, onFrame);
+    }
+    return 0;
+}
+
+template <typename OnFrame>
+std::size_t StreamFramer::consumeLines(const char* data, std::size_t size, OnFrame& onFrame)
+{
+    std::size_t consumed = 0;
+    // the incomplete line was scanned by the previous call already
+    std::size_t from = scanned;
+    while (from < size) {
+        const char* newline = static_cast<const char*>(std::memchr(data + from, '\n', size - from));
+        if (!newline) {
+            break;
+        }
+        std::size_t length = static_cast<std::size_t>(newline - (data + consumed));
+        if (length > 0 && data[consumed + length - 1] == '\r') {
+            length--;
+        }
+        if (length > maxFrameSize) {
+            error = true;
+            return consumed;
+        }
+        if (length > 0) {
+            onFrame(data + consumed, length);
+        }
+        consumed = static_cast<std::size_t>(newline - data) + 1;
+        from     = consumed;
+    }
+    scanned = size - consumed;
+    if (scanned > maxFrameSize + 1) {
+        error = true;
+    }
+    return consumed;
+}
+
+template <typename OnFrame>
+std::size_t StreamFramer::consumeLengthPrefixed(const char* data, std::size_t size, OnFrame& onFrame)
+{
+    std::size_t consumed = 0;
+    while (size - consumed >= 4) {
+        const unsigned char* prefix = reinterpret_cast<const unsigned char*>(data + consumed);
+        const std::size_t    length = (std::size_t(prefix[0]) << 24) | (std::size_t(prefix[1]) << 16) |
+                                   (std::size_t(prefix[2]) << 8) | std::size_t(prefix[3]);
+        if (length > maxFrameSize) {
+            error = true;
+            return consumed;
+        }
+        if (size - consumed - 4 < length) {
+            break;
+        }
+        onFrame(data + consumed + 4, length);
+        consumed += 4 + length;
+    }
+    return consumed;
+}
+
+template <typename OnFrame>
+std::size_t StreamFramer::consumeNetstrings(const char* data, std::size_t size, OnFrame& onFrame)
+{
+    std::size_t consumed = 0;
+    while (consumed < size) {
+        // the length: digits, then ":"
+        std::size_t length = 0;
+        std::size_t digits = 0;
+        std::size_t at     = consumed;
+        while (at < size && data[at] >= '0' && data[at] <= '9') {
+            length = length * 10 + static_cast<std::size_t>(data[at] - '0');
+            digits++;
+            at++;
+            if (length > maxFrameSize) {
+                error = true;
+                return consumed;
+            }
+        }
+        if (at == size) {
+            break;
+        }
+        if (digits == 0 || data[at] != ':') {
+            error = true;
+            return consumed;
+        }
+        at++;
+        if (size - at < length + 1) {
+            break;
+        }
+        if (data[at + length] != ',') {
+            error = true;
+            return consumed;
+        }
+        onFrame(data + at, length);
+        consumed = at + length + 1;
+    }
+    return consumed;
+}
+
+inline void StreamFramer::Encode(Framing framing, const char* data, std::size_t size, std::string& out)
+{
+    if (size > 0 && data[size - 1] == '\n') {
+        size--;
+    }
+    EncodePrefix(framing, size, out);
+    out.append(data, size);
+    out += Suffix(framing);
+}
+
+inline void StreamFramer::EncodePrefix(Framing framing, std::size_t size, std::string& out)
+{
+    switch (framing) {
+    case Framing::Ndjson:
+        break;
+    case Framing::LengthPrefix: {
+        const char prefix[4] = {static_cast<char>((size >> 24) & 0xff),
+                                static_cast<char>((size >> 16) & 0xff),
+                                static_cast<char>((size >> 8) & 0xff), static_cast<char>(size & 0xff)};
+        out.append(prefix, 4);
+        break;
+    }
+    case Framing::Netstring:
+        out += std::to_string(size);
+        out += ':';
+        break;
+    }
+}
+
+inline const char* StreamFramer::Suffix(Framing framing)
+{
+    switch (framing) {
+    case Framing::Ndjson:
+        return "\n";
+    case Framing::LengthPrefix:
+        return "";
+    case Framing::Netstring:
+        return ",";
+    }
+    return "";
+}
+
+#endif // STREAMFRAMING_H
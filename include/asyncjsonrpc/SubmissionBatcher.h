@@ -0,0 +1,304 @@
+#ifndef SUBMISSIONBATCHER_H
+#define SUBMISSIONBATCHER_H
+
+#include "RecyclingAllocator.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+struct SubmissionBatchingOptions
+{
+    // once this many calls are waiting while drains are busy, another drain is started (up to
+    // maxConcurrentDrains); a drain that lingers stops waiting when this many calls are staged
+    std::size_t maxBatchSize = 64;
+
+    // calls run in the order they were submitted only with a single drain: with more, the batches
+    // taken by different drains run concurrently, and a producer's calls can run out of order
+    std::size_t maxConcurrentDrains = 1;
+
+    // a drain keeps taking new calls for at most this long, then re-posts itself, so it doesn't hold
+    // a worker (and the calls queued behind it in the executor) indefinitely
+    std::chrono::microseconds maxDrainTime{500};
+
+    // how long a drain that found fewer than maxBatchSize calls waits for more before running them;
+    // zero (the default) means it never waits. Bounds the extra latency batching adds to a call. The
+    // drain waits by spinning (yielding) on its executor's worker: that worker burns a core for up to
+    // lingerTime per drain, so keep it to a few microseconds.
+    std::chrono::microseconds lingerTime{0};
+};
+
+struct SubmissionBatchingStats
+{
+    static const std::size_t HistogramBuckets = 16;
+
+    std::uint64_t submitted;
+    std::uint64_t batches;
+    std::uint64_t drainsStartedOnIdle;      // first call after the staging buffer went idle
+    std::uint64_t drainsStartedOnThreshold; // backlog reached maxBatchSize while drains were busy
+    std::uint64_t drainsRequeued;           // a drain ran for maxDrainTime and re-posted itself
+    std::uint64_t lingerTimeouts;           // a lingering drain ran a partial batch after lingerTime
+    std::uint64_t largestBatch;
+
+    // batchSizes[i] counts batches with size in [2^i, 2^(i+1)), the last bucket takes everything above
+    std::array<std::uint64_t, HistogramBuckets> batchSizes;
+};
+
+// Coalesces many small submissions into few executor tasks. submit() pushes onto a lock-free staging
+// list; a drain task, posted only when needed, takes the whole list at once and runs it in order on
+// one worker, so the executor's per-post cost (queue lock, wakeup, task allocation) is paid per batch.
+// Batches are only run one after the other with maxConcurrentDrains = 1.
+template <typename Executor, typename Task>
+class SubmissionBatcher
+{
+    struct Node
+    {
+        Node* next;
+        Task  task;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    enum DrainTrigger
+    {
+        OnIdle,
+        OnThreshold,
+        OnRequeue
+    };
+
+    Executor                  executor;
+    SubmissionBatchingOptions options;
+
+    std::atomic<Node*>       stagedHead{nullptr};
+    std::atomic<std::size_t> stagedCount{0};
+    std::atomic<std::size_t> activeDrains{0};
+
+    std::atomic<std::uint64_t>                submitted{0};
+    std::atomic<std::uint64_t>                batches{0};
+    std::array<std::atomic<std::uint64_t>, 3> drainsByTrigger;
+    std::atomic<std::uint64_t>                lingerTimeouts{0};
+    std::atomic<std::uint64_t>                largestBatch{0};
+
+    std::array<std::atomic<std::uint64_t>, SubmissionBatchingStats::HistogramBuckets> batchSizes;
+
+    void  scheduleDrain(DrainTrigger trigger);
+    void  drain();
+    Node* takeStaged();
+    void  restage(Node* batch);
+    bool  tryStartDrain(std::size_t limit);
+    void  recordBatch(std::uint64_t size);
+
+    static void destroyNode(Node* node);
+
+public:
+    SubmissionBatcher(const Executor& executorRef, const SubmissionBatchingOptions& Options);
+    ~SubmissionBatcher();
+
+    SubmissionBatcher(const SubmissionBatcher&) = delete;
+    SubmissionBatcher& operator=(const SubmissionBatcher&) = delete;
+
+    void submit(Task&& task);
+
+    SubmissionBatchingStats stats() const;
+};
+
+template <typename Executor, typename Task>
+SubmissionBatcher<Executor, Task>::SubmissionBatcher(const Executor&                  executorRef,
+                                                     const SubmissionBatchingOptions& Options)
+    : executor(executorRef), options(Options)
+{
+    if (options.maxBatchSize == 0) {
+        options.maxBatchSize = 1;
+    }
+    if (options.maxConcurrentDrains == 0) {
+        options.maxConcurrentDrains = 1;
+    }
+    for (auto& c : drainsByTrigger) {
+        c.store(0);
+    }
+    for (auto& c : batchSizes) {
+        c.store(0);
+    }
+}
+
+template <typename Executor, typename Task>
+SubmissionBatcher<Executor, Task>::~SubmissionBatcher()
+{
+    Node* node = stagedHead.exchange(nullptr);
+    while (node) {
+        Node* next = node->next;
+        destroyNode(node);
+        node = next;
+    }
+}
+
+template <typename Executor, typename Task>
+void SubmissionBatcher<Executor, Task>::destroyNode(Node* node)
+{
+    RecyclingAllocator<Node> alloc;
+    node->~Node();
+    alloc.deallocate(node, 1);
+}
+
+template <typename Executor, typename Task>
+void SubmissionBatcher<Executor, Task>::submit(Task&& task)
+{
+    RecyclingAllocator<Node> alloc;
+    Node*                    node = alloc.allocate(1);
+    new (node) Node{nullptr, std::move(task)};
+
+    // counted before it's published: a drain that takes it decrements the count after, so the count
+    // never drops below the calls actually staged
+    const std::size_t staged = stagedCount.fetch_add(1) + 1;
+    node->next               = stagedHead.load(std::memory_order_relaxed);
+    while (!stagedHead.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+    }
+    submitted.fetch_add(1, std::memory_order_relaxed);
+
+    if (tryStartDrain(0)) {
+        scheduleDrain(OnIdle);
+    } else if (staged >= options.maxBatchSize && tryStartDrain(options.maxConcurrentDrains - 1)) {
+        scheduleDrain(OnThreshold);
+    }
+}
+
+// starts a drain if fewer than (limit + 1) are active; limit 0 means "only if none is active"
+template <typename Executor, typename Task>
+bool SubmissionBatcher<Executor, Task>::tryStartDrain(std::size_t limit)
+{
+    std::size_t active = activeDrains.load();
+    while (active <= limit) {
+        if (activeDrains.compare_exchange_weak(active, active + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Executor, typename Task>
+void SubmissionBatcher<Executor, Task>::scheduleDrain(DrainTrigger trigger)
+{
+    drainsByTrigger[trigger].fetch_add(1, std::memory_order_relaxed);
+    executor.post([this]() { this->drain(); }, RecyclingAllocator<char>());
+}
+
+template <typename Executor, typename Task>
+typename SubmissionBatcher<Executor, Task>::Node* SubmissionBatcher<Executor, Task>::takeStaged()
+{
+    // the list is a stack; reverse it to run the calls in submission order
+    Node* node     = stagedHead.exchange(nullptr, std::memory_order_acquire);
+    Node* reversed = nullptr;
+    while (node) {
+        Node* next = node->next;
+        node->next = reversed;
+        reversed   = node;
+        node       = next;
+    }
+    return reversed;
+}
+
+// puts back calls taken but not run; they run after the ones staged in the meantime
+template <typename Executor, typename Task>
+void SubmissionBatcher<Executor, Task>::restage(Node* batch)
+{
+    while (batch) {
+        Node* next  = batch->next;
+        batch->next = stagedHead.load(std::memory_order_relaxed);
+        while (!stagedHead.compare_exchange_weak(batch->next, batch, std::memory_order_release,
+                                                 std::memory_order_relaxed)) {
+        }
+        batch = next;
+    }
+}
+
+template <typename Executor, typename Task>
+void SubmissionBatcher<Executor, Task>::drain()
+{
+    const Clock::time_point start = Clock::now();
+
+    if (options.lingerTime.count() > 0 && stagedCount.load() < options.maxBatchSize) {
+        const Clock::time_point lingerEnd = start + options.lingerTime;
+        while (stagedCount.load() < options.maxBatchSize && Clock::now() < lingerEnd) {
+            std::this_thread::yield();
+        }
+        if (stagedCount.load() < options.maxBatchSize) {
+            lingerTimeouts.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    while (true) {
+        Node* batch = takeStaged();
+        if (!batch) {
+            activeDrains.fetch_sub(1);
+            // a submitter may have seen this drain still active and relied on it; take over if so
+            if (stagedCount.load() == 0 || !tryStartDrain(0)) {
+                return;
+            }
+            continue;
+        }
+
+        std::uint64_t size = 0;
+        while (batch) {
+            Node* next = batch->next;
+            stagedCount.fetch_sub(1, std::memory_order_relaxed);
+            Task task(std::move(batch->task));
+            destroyNode(batch);
+            batch = next;
+            size++;
+            try {
+                task();
+            } catch (...) {
+                // hand the rest of the batch to another drain before letting the exception out
+                restage(batch);
+                activeDrains.fetch_sub(1);
+                if (stagedCount.load() > 0 && tryStartDrain(0)) {
+                    scheduleDrain(OnIdle);
+                }
+                throw;
+            }
+        }
+        recordBatch(size);
+
+        if (Clock::now() - start >= options.maxDrainTime && stagedCount.load() > 0) {
+            // let the executor run other work; this drain stays counted as active in the new task
+            scheduleDrain(OnRequeue);
+            return;
+        }
+    }
+}
+
+template <typename Executor, typename Task>
+void SubmissionBatcher<Executor, Task>::recordBatch(std::uint64_t size)
+{
+    batches.fetch_add(1, std::memory_order_relaxed);
+    std::uint64_t largest = largestBatch.load(std::memory_order_relaxed);
+    while (size > largest && !largestBatch.compare_exchange_weak(largest, size)) {
+    }
+    std::size_t bucket = 0;
+    while ((size >> (bucket + 1)) > 0 && bucket + 1 < batchSizes.size()) {
+        bucket++;
+    }
+    batchSizes[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Executor, typename Task>
+SubmissionBatchingStats SubmissionBatcher<Executor, Task>::stats() const
+{
+    SubmissionBatchingStats result;
+    result.submitted                = submitted.load();
+    result.batches                  = batches.load();
+    result.drainsStartedOnIdle      = drainsByTrigger[OnIdle].load();
+    result.drainsStartedOnThreshold = drainsByTrigger[OnThreshold].load();
+    result.drainsRequeued           = drainsByTrigger[OnRequeue].load();
+    result.lingerTimeouts           = lingerTimeouts.load();
+    result.largestBatch             = largestBatch.load();
+    for (std::size_t i = 0; i < batchSizes.size(); i++) {
+        result.batchSizes[i] = batchSizes[i].load();
+    }
+    return result;
+}
+
+#endif // SUBMISSIONBATCHER_H
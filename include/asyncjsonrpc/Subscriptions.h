@@ -0,0 +1,333 @@
+#ifndef SUBSCRIPTIONS_H
+#define SUBSCRIPTIONS_H
+
+#include "JsonErrorCode.h"
+#include <atomic>
+#include <boost/asio/post.hpp>
+#include <cstdint>
+#include <jsoncpp/json/json.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// a message serialized once, and written as it is to every connection it's sent to
+using SharedMessage = std::shared_ptr<const std::string>;
+
+// The end of a connection that notifications can be pushed to, made by the servers whose connections
+// stay open (AsyncJsonRPCStreamServer, AsyncJsonRPCWebSocketServer). deliver() can be called from any
+// thread; the message is queued on the connection's strand, after the responses already queued.
+class NotificationSink
+{
+    static const std::shared_ptr<NotificationSink>*& Current()
+    {
+        static thread_local const std::shared_ptr<NotificationSink>* current = nullptr;
+        return current;
+    }
+
+public:
+    virtual ~NotificationSink() = default;
+
+    virtual void deliver(const SharedMessage& message) = 0;
+
+    // the sink of the connection whose calls run on this thread, nullptr if none: as ResponseRouter
+    // does for responses, a server makes its connection's sink current while it posts the calls
+    static std::shared_ptr<NotificationSink> CurrentSink()
+    {
+        const std::shared_ptr<NotificationSink>* current = Current();
+        return current ? *current : nullptr;
+    }
+
+    class Scope
+    {
+        const std::shared_ptr<NotificationSink>* previous;
+
+    public:
+        explicit Scope(const std::shared_ptr<NotificationSink>& sink) : previous(Current())
+        {
+            Current() = &sink;
+        }
+        ~Scope() { Current() = previous; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+};
+
+// the sink of a server connection: Connection::notify(const SharedMessage&) is run on its strand, while
+// the connection is alive
+template <typename Connection, typename Executor>
+class ConnectionSink : public NotificationSink
+{
+    const std::weak_ptr<Connection> connection;
+    const Executor                  strand;
+
+public:
+    ConnectionSink(std::weak_ptr<Connection> connectionRef, Executor Strand)
+        : connection(std::move(connectionRef)), strand(std::move(Strand))
+    {
+    }
+
+    void deliver(const SharedMessage& message) override
+    {
+        boost::asio::post(strand, [connection = this->connection, message]() {
+            if (std::shared_ptr<Connection> alive = connection.lock()) {
+                alive->notify(message);
+            }
+        });
+    }
+};
+
+struct SubscriptionOptions
+{
+    // the methods install() adds, with params {"topic": string}: subscribe answers true, unsubscribe
+    // whether the connection was subscribed
+    std::string subscribeMethod   = "subscribe";
+    std::string unsubscribeMethod = "unsubscribe";
+
+    // publish() sends {"jsonrpc": "2.0", "method": notificationMethod, "params": {"topic": topic,
+    // "data": data}}
+    std::string notificationMethod = "notification";
+};
+
+struct SubscriptionStats
+{
+    std::uint64_t topics;        // with subscribers
+    std::uint64_t subscriptions; // over all topics, closed connections not pruned yet included
+    std::uint64_t published;     // publish() calls
+    std::uint64_t delivered;     // notifications handed to sinks
+};
+
+// Topics, and the connections subscribed to them. install(rpc) adds the subscribe and unsubscribe
+// methods, which (un)subscribe the connection the call came on; over a transport that can't push
+// (HTTP, ...), subscribe fails with a server error. publish() serializes its notification once, into a
+// SharedMessage that every subscriber's connection writes as it is.
+//
+// The subscriber sets are copy-on-write: (un)subscribing replaces the whole table under a mutex (it
+// copies the subscriber list of its topic), and publish() reads an immutable snapshot of it. Each
+// thread keeps the last snapshot it used, and only takes the mutex to refresh it after a change, so
+// publishing takes no lock in the steady state. Subscribers are held weakly: a closed connection stays
+// in its topics until the next change to them, or prune(), and is skipped by publish() meanwhile.
+//
+// publish() can be called from any thread. The rpc's handlers refer to the Subscriptions, which must
+// outlive them.
+class Subscriptions
+{
+    using Sinks  = std::vector<std::weak_ptr<NotificationSink>>;
+    using Topics = std::unordered_map<std::string, std::shared_ptr<const Sinks>>;
+
+    const SubscriptionOptions     options;
+    const std::uint64_t           id; // of this instance, in the threads' snapshots
+    mutable std::mutex            mutex; // guards topics; serializes the changes
+    std::shared_ptr<const Topics> topics;
+    std::atomic<std::uint64_t>    version{0};
+    std::atomic<std::uint64_t>    published{0};
+    std::atomic<std::uint64_t>    delivered{0};
+
+    static std::uint64_t NextId()
+    {
+        static std::atomic<std::uint64_t> next{1};
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline std::shared_ptr<const Topics> snapshot();
+
+    // with the lock held: topic's subscribers changed by change(Sinks&), closed connections dropped
+    template <typename Change>
+    bool update(const std::string& topic, Change change);
+
+public:
+    explicit Subscriptions(const SubscriptionOptions& Options = SubscriptionOptions())
+        : options(Options), id(NextId()), topics(std::make_shared<const Topics>())
+    {
+    }
+
+    Subscriptions(const Subscriptions&) = delete;
+    Subscriptions& operator=(const Subscriptions&) = delete;
+
+    template <typename Rpc>
+    void install(Rpc& rpc);
+
+    // false if sink was subscribed to topic already
+    inline bool subscribe(const std::string& topic, const std::shared_ptr<NotificationSink>& sink);
+
+    // false if sink wasn't subscribed to topic
+    inline bool unsubscribe(const std::string& topic, const std::shared_ptr<NotificationSink>& sink);
+
+    // the number of subscribers the notification was handed to; nothing is serialized if there's none
+    inline std::size_t publish(const std::string& topic, Json::Value data);
+
+    // drops the closed connections from every topic
+    inline void prune();
+
+    inline SubscriptionStats stats() const;
+};
+
+std::shared_ptr<const Subscriptions::Topics> Subscriptions::snapshot()
+{
+    struct Snapshot
+    {
+        std::uint64_t                 owner   = 0;
+        std::uint64_t                 version = 0;
+        std::shared_ptr<const Topics> topics;
+    };
+    static thread_local Snapshot cached;
+
+    const std::uint64_t current = version.load(std::memory_order_acquire);
+    if (cached.owner != id || cached.version != current || !cached.topics) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cached.owner   = id;
+        cached.version = version.load(std::memory_order_relaxed);
+        cached.topics  = topics;
+    }
+    return cached.topics;
+}
+
+template <typename Change>
+bool Subscriptions::update(const std::string& topic, Change change)
+{
+    auto       next  = std::make_shared<Topics>(*topics);
+    const auto found = next->find(topic);
+    Sinks      sinks;
+    if (found != next->end()) {
+        for (const std::weak_ptr<NotificationSink>& sink : *found->second) {
+            if (!sink.expired()) {
+                sinks.push_back(sink);
+            }
+        }
+    }
+    const bool changed = change(sinks);
+    if (sinks.empty()) {
+        next->erase(topic);
+    } else {
+        (*next)[topic] = std::make_shared<const Sinks>(std::move(sinks));
+    }
+    topics = std::move(next);
+    version.fetch_add(1, std::memory_order_release);
+    return changed;
+}
+
+template <typename Rpc>
+void Subscriptions::install(Rpc& rpc)
+{
+    rpc.addHandler(
+        [this](const Json::Value& request, Json::Value& response, auto&&...) {
+            const std::shared_ptr<NotificationSink> sink = NotificationSink::CurrentSink();
+            if (!sink) {
+                throw JsonErrorCode(-32000, "Subscriptions need a connection that stays open");
+            }
+            if (!request["topic"].isString()) {
+                throw JsonErrorCode::make_InvalidParams();
+            }
+            subscribe(request["topic"].asString(), sink);
+            response = true;
+        },
+        options.subscribeMethod, {{"topic", Json::ValueType::stringValue}});
+    rpc.addHandler(
+        [this](const Json::Value& request, Json::Value& response, auto&&...) {
+            const std::shared_ptr<NotificationSink> sink = NotificationSink::CurrentSink();
+            if (!request["topic"].isString()) {
+                throw JsonErrorCode::make_InvalidParams();
+            }
+            response = sink && unsubscribe(request["topic"].asString(), sink);
+        },
+        options.unsubscribeMethod, {{"topic", Json::ValueType::stringValue}});
+}
+
+bool Subscriptions::subscribe(const std::string& topic, const std::shared_ptr<NotificationSink>& sink)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return update(topic, [&sink](Sinks& sinks) {
+        for (const std::weak_ptr<NotificationSink>& subscribed : sinks) {
+            if (subscribed.lock() == sink) {
+                return false;
+            }
+        }
+        sinks.push_back(sink);
+        return true;
+    });
+}
+
+bool Subscriptions::unsubscribe(const std::string& topic, const std::shared_ptr<NotificationSink>& sink)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (topics->find(topic) == topics->end()) {
+        return false;
+    }
+    return update(topic, [&sink](Sinks& sinks) {
+        for (auto subscribed = sinks.begin(); subscribed != sinks.end(); ++subscribed) {
+            if (subscribed->lock() == sink) {
+                sinks.erase(subscribed);
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+std::size_t Subscriptions::publish(const std::string& topic, Json::Value data)
+{
+    published.fetch_add(1, std::memory_order_relaxed);
+    const std::shared_ptr<const Topics> current = snapshot();
+    const auto                          found   = current->find(topic);
+    if (found == current->end()) {
+        return 0;
+    }
+
+    Json::Value notification;
+    notification["jsonrpc"]         = "2.0";
+    notification["method"]          = options.notificationMethod;
+    notification["params"]["topic"] = topic;
+    notification["params"]["data"]  = std::move(data);
+    const SharedMessage message =
+        std::make_shared<const std::string>(JsonErrorCode::JsonValueToString(notification));
+
+    std::size_t count = 0;
+    for (const std::weak_ptr<NotificationSink>& subscribed : *found->second) {
+        if (std::shared_ptr<NotificationSink> sink = subscribed.lock()) {
+            sink->deliver(message);
+            count++;
+        }
+    }
+    delivered.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+
+void Subscriptions::prune()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto                        next = std::make_shared<Topics>();
+    for (const auto& topic : *topics) {
+        Sinks sinks;
+        for (const std::weak_ptr<NotificationSink>& sink : *topic.second) {
+            if (!sink.expired()) {
+                sinks.push_back(sink);
+            }
+        }
+        if (!sinks.empty()) {
+            next->emplace(topic.first, std::make_shared<const Sinks>(std::move(sinks)));
+        }
+    }
+    topics = std::move(next);
+    version.fetch_add(1, std::memory_order_release);
+}
+
+SubscriptionStats Subscriptions::stats() const
+{
+    SubscriptionStats result;
+    result.subscriptions = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.topics = topics->size();
+        for (const auto& topic : *topics) {
+            result.subscriptions += topic.second->size();
+        }
+    }
+    result.published = published.load(std::memory_order_relaxed);
+    result.delivered = delivered.load(std::memory_order_relaxed);
+    return result;
+}
+
+#endif // SUBSCRIPTIONS_H
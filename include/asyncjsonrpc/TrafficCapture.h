@@ -0,0 +1,333 @@
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Capture file format: the 8-byte magic "AJRPCAP1", then one record per request:
+//   uint32 request size, uint64 context key, uint64 arrival time (ns since the unix epoch),
+//   request bytes
+// Integers are in host byte order. The file is append-only; a record cut short by a crash is ignored by
+// the reader, and cut off by the next writer, before it appends.
+struct TrafficCaptureFormat
+{
+    static const std::size_t MagicSize  = 8;
+    static const std::size_t HeaderSize = 4 + 8 + 8;
+
+    static const char* Magic() { return "AJRPCAP1"; }
+};
+
+struct CapturedRequest
+{
+    std::uint64_t contextKey;
+    std::uint64_t timestampNs;
+    const char*   data; // points into the mapped file
+    std::size_t   size;
+
+    std::string toString() const { return std::string(data, size); }
+};
+
+// Appends requests to a capture file. Records go through a large stdio buffer under a lock, so a
+// request costs a memcpy, not a system call. The first failed write (a full disk...) closes the file,
+// which stays readable up to the record that failed; the requests after it are counted as dropped, as
+// are the ones too large for the 32-bit size of a record.
+class TrafficCaptureWriter
+{
+    mutable std::mutex mutex;
+    std::FILE*         file = nullptr;
+    std::string        fileName;
+    std::string        failure;
+    std::uint64_t      droppedCount = 0;
+
+    // with the lock held
+    void fail(const char* what);
+
+    // the length of the records of an existing capture file that are complete
+    static std::size_t CompleteLength(const std::string& fileName);
+
+public:
+    explicit TrafficCaptureWriter(const std::string& FileName, std::size_t bufferSize = 1 << 20);
+    ~TrafficCaptureWriter();
+
+    TrafficCaptureWriter(const TrafficCaptureWriter&) = delete;
+    TrafficCaptureWriter& operator=(const TrafficCaptureWriter&) = delete;
+
+    void append(const char* data, std::size_t size, std::uint64_t contextKey, std::uint64_t timestampNs);
+
+    void flush();
+
+    // flushes and closes the file; later appends are dropped
+    void close();
+
+    // empty while every write succeeded
+    std::string error() const;
+
+    // requests not written because the file failed, or too large for a record
+    std::uint64_t dropped() const;
+
+    static std::uint64_t Now();
+};
+
+inline TrafficCaptureWriter::TrafficCaptureWriter(const std::string& FileName, std::size_t bufferSize)
+    : fileName(FileName)
+{
+    // appending after a torn record would make the reader take the new bytes for its rest
+    const std::size_t complete = CompleteLength(fileName);
+    struct stat       st;
+    if (::stat(fileName.c_str(), &st) == 0 && static_cast<std::size_t>(st.st_size) > complete &&
+        ::truncate(fileName.c_str(), static_cast<off_t>(complete)) != 0) {
+        throw std::runtime_error("Failed to truncate capture file " + fileName + ": " +
+                                 std::strerror(errno));
+    }
+    file = std::fopen(fileName.c_str(), "ab");
+    if (!file) {
+        throw std::runtime_error("Failed to open capture file " + fileName + ": " +
+                                 std::strerror(errno));
+    }
+    std::setvbuf(file, nullptr, _IOFBF, bufferSize);
+    if (complete == 0 &&
+        (std::fwrite(TrafficCaptureFormat::Magic(), 1, TrafficCaptureFormat::MagicSize, file) !=
+             TrafficCaptureFormat::MagicSize ||
+         std::fflush(file) != 0)) {
+        const int writeErrno = errno;
+        std::fclose(file);
+        throw std::runtime_error("Failed to write capture file " + fileName + ": " +
+                                 std::strerror(writeErrno));
+    }
+}
+
+inline std::size_t TrafficCaptureWriter::CompleteLength(const std::string& fileName)
+{
+    std::FILE* existing = std::fopen(fileName.c_str(), "rb");
+    if (!existing) {
+        return 0;
+    }
+    struct stat st;
+    if (::fstat(::fileno(existing), &st) != 0) {
+        std::fclose(existing);
+        throw std::runtime_error("Failed to stat capture file " + fileName);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        std::fclose(existing);
+        return 0;
+    }
+    const std::size_t fileSize = static_cast<std::size_t>(st.st_size);
+    char              magic[TrafficCaptureFormat::MagicSize];
+    const std::size_t magicSize = std::fread(magic, 1, sizeof(magic), existing);
+    if (std::memcmp(magic, TrafficCaptureFormat::Magic(), magicSize) != 0) {
+        std::fclose(existing);
+        throw std::runtime_error(fileName + " is not a capture file");
+    }
+    if (magicSize < TrafficCaptureFormat::MagicSize) {
+        // torn in the magic: start over
+        std::fclose(existing);
+        return 0;
+    }
+
+    std::size_t complete = TrafficCaptureFormat::MagicSize;
+    char        header[TrafficCaptureFormat::HeaderSize];
+    while (std::fread(header, 1, sizeof(header), existing) == sizeof(header)) {
+        std::uint32_t size32;
+        std::memcpy(&size32, header, 4);
+        const std::size_t end = complete + TrafficCaptureFormat::HeaderSize + size32;
+        if (end > fileSize || std::fseek(existing, static_cast<long>(end), SEEK_SET) != 0) {
+            break;
+        }
+        complete = end;
+    }
+    std::fclose(existing);
+    return complete;
+}
+
+inline TrafficCaptureWriter::~TrafficCaptureWriter() { close(); }
+
+inline void TrafficCaptureWriter::append(const char* data, std::size_t size, std::uint64_t contextKey,
+                                         std::uint64_t timestampNs)
+{
+    if (size > UINT32_MAX) {
+        std::lock_guard<std::mutex> lock(mutex);
+        droppedCount++;
+        return;
+    }
+    char                header[TrafficCaptureFormat::HeaderSize];
+    const std::uint32_t size32 = static_cast<std::uint32_t>(size);
+    std::memcpy(header, &size32, 4);
+    std::memcpy(header + 4, &contextKey, 8);
+    std::memcpy(header + 12, &timestampNs, 8);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file) {
+        if (!failure.empty()) {
+            droppedCount++;
+        }
+        return;
+    }
+    if (std::fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+        std::fwrite(data, 1, size, file) != size) {
+        fail("Failed to write capture file ");
+        droppedCount++;
+    }
+}
+
+inline void TrafficCaptureWriter::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file && std::fflush(file) != 0) {
+        fail("Failed to write capture file ");
+    }
+}
+
+inline void TrafficCaptureWriter::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file) {
+        const int closed = std::fclose(file);
+        file             = nullptr;
+        if (closed != 0 && failure.empty()) {
+            failure = "Failed to write capture file " + fileName + ": " + std::strerror(errno);
+        }
+    }
+}
+
+inline void TrafficCaptureWriter::fail(const char* what)
+{
+    failure = what + fileName + ": " + std::strerror(errno);
+    std::fclose(file);
+    file = nullptr;
+}
+
+inline std::string TrafficCaptureWriter::error() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return failure;
+}
+
+inline std::uint64_t TrafficCaptureWriter::dropped() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return droppedCount;
+}
+
+inline std::uint64_t TrafficCaptureWriter::Now()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::system_clock::now().time_since_epoch())
+                                          .count());
+}
+
+// Reads a capture file through a read-only memory mapping; requests are returned in place, without
+// copying.
+class TrafficCaptureReader
+{
+    const char* begin    = nullptr;
+    std::size_t size     = 0;
+    std::size_t position = TrafficCaptureFormat::MagicSize;
+
+public:
+    explicit TrafficCaptureReader(const std::string& fileName);
+    ~TrafficCaptureReader();
+
+    TrafficCaptureReader(const TrafficCaptureReader&) = delete;
+    TrafficCaptureReader& operator=(const TrafficCaptureReader&) = delete;
+
+    // false at the end of the file, or at a truncated record
+    bool next(CapturedRequest& request);
+
+    void rewind() { position = TrafficCaptureFormat::MagicSize; }
+};
+
+inline TrafficCaptureReader::TrafficCaptureReader(const std::string& fileName)
+{
+    const int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open capture file " + fileName + ": " +
+                                 std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat capture file " + fileName);
+    }
+    size = static_cast<std::size_t>(st.st_size);
+    if (size < TrafficCaptureFormat::MagicSize) {
+        ::close(fd);
+        throw std::runtime_error(fileName + " is not a capture file");
+    }
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map capture file " + fileName);
+    }
+    begin = static_cast<const char*>(mapping);
+    if (std::memcmp(begin, TrafficCaptureFormat::Magic(), TrafficCaptureFormat::MagicSize) != 0) {
+        ::munmap(const_cast<char*>(begin), size);
+        throw std::runtime_error(fileName + " is not a capture file");
+    }
+    ::madvise(const_cast<char*>(begin), size, MADV_SEQUENTIAL);
+}
+
+inline TrafficCaptureReader::~TrafficCaptureReader() { ::munmap(const_cast<char*>(begin), size); }
+
+inline bool TrafficCaptureReader::next(CapturedRequest& request)
+{
+    if (size - position < TrafficCaptureFormat::HeaderSize) {
+        return false;
+    }
+    const char*   header = begin + position;
+    std::uint32_t size32;
+    std::memcpy(&size32, header, 4);
+    std::memcpy(&request.contextKey, header + 4, 8);
+    std::memcpy(&request.timestampNs, header + 12, 8);
+    if (size - position - TrafficCaptureFormat::HeaderSize < size32) {
+        return false;
+    }
+    request.data = header + TrafficCaptureFormat::HeaderSize;
+    request.size = size32;
+    position += TrafficCaptureFormat::HeaderSize + size32;
+    return true;
+}
+
+// Feeds every request of a capture file to submit(), which would usually call post() or asyncPost()
+// with a context rebuilt from the request's key. speed 1 keeps the original gaps between requests,
+// 2 halves them, 0 submits as fast as possible. Returns the number of requests submitted.
+inline std::size_t ReplayTrafficCapture(TrafficCaptureReader&                              reader,
+                                        const std::function<void(const CapturedRequest&)>& submit,
+                                        double                                              speed = 1)
+{
+    using Clock = std::chrono::steady_clock;
+
+    CapturedRequest   request;
+    std::size_t       count          = 0;
+    std::uint64_t     firstTimestamp = 0;
+    Clock::time_point start          = Clock::now();
+    while (reader.next(request)) {
+        if (count == 0) {
+            firstTimestamp = request.timestampNs;
+        } else if (speed > 0 && request.timestampNs > firstTimestamp) {
+            const std::chrono::duration<double, std::nano> offset(
+                static_cast<double>(request.timestampNs - firstTimestamp) / speed);
+            const Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(offset);
+            if (due > Clock::now()) {
+                std::this_thread::sleep_until(due);
+            }
+        }
+        submit(request);
+        count++;
+    }
+    return count;
+}
+
+#endif // TRAFFICCAPTURE_H
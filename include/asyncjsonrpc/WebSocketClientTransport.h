@@ -0,0 +1,142 @@
+#ifndef WEBSOCKETCLIENTTRANSPORT_H
+#define WEBSOCKETCLIENTTRANSPORT_H
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/websocket/rfc6455.hpp>
+#include <boost/beast/websocket/stream.hpp>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct WebSocketClientOptions
+{
+    // of the upgrade request
+    std::string host   = "localhost";
+    std::string target = "/";
+
+    // larger responses close the connection
+    std::size_t maxMessageSize = 1024 * 1024;
+};
+
+// The connection of an AsyncJsonRPCClient to an AsyncJsonRPCWebSocketServer: every request is a text
+// message; responses are messages too, arrays when the server coalesces them. Messages are written one
+// at a time, in order. Used on its strand, as StreamClientTransport.
+class WebSocketClientTransport : public std::enable_shared_from_this<WebSocketClientTransport>
+{
+public:
+    using executor_type = boost::asio::strand<boost::asio::io_context::executor_type>;
+    using OnMessage     = std::function<void(const char* data, std::size_t size)>;
+    using OnClose       = std::function<void(boost::system::error_code ec)>;
+
+private:
+    const WebSocketClientOptions                                  options;
+    executor_type                                                 strand;
+    boost::beast::websocket::stream<boost::asio::ip::tcp::socket> ws;
+    boost::beast::flat_buffer                                     buffer;
+    std::deque<std::string>                                       queued;
+    std::string                                                   writing;
+    OnMessage                                                     onMessage;
+    OnClose                                                       onClose;
+    bool                                                          closed = false;
+
+    void read();
+    void flush();
+    void fail(boost::system::error_code ec);
+
+public:
+    explicit WebSocketClientTransport(boost::asio::io_context&      ioContext,
+                                      const WebSocketClientOptions& Options = WebSocketClientOptions())
+        : options(Options), strand(boost::asio::make_strand(ioContext)), ws(strand)
+    {
+    }
+
+    // connects and upgrades; blocks, throws boost::system::system_error
+    void connect(const boost::asio::ip::tcp::endpoint& endpoint)
+    {
+        ws.next_layer().connect(endpoint);
+        ws.next_layer().set_option(boost::asio::ip::tcp::no_delay(true));
+        ws.handshake(options.host, options.target);
+        ws.read_message_max(options.maxMessageSize);
+        ws.text(true);
+    }
+
+    executor_type get_executor() const { return strand; }
+
+    void start(OnMessage onMessageRef, OnClose onCloseRef)
+    {
+        onMessage = std::move(onMessageRef);
+        onClose   = std::move(onCloseRef);
+        read();
+    }
+
+    void send(const std::string& message)
+    {
+        queued.push_back(message);
+        flush();
+    }
+
+    void close()
+    {
+        closed    = true;
+        onMessage = nullptr;
+        onClose   = nullptr;
+        boost::system::error_code ignored;
+        ws.next_layer().close(ignored);
+    }
+};
+
+inline void WebSocketClientTransport::read()
+{
+    auto self = shared_from_this();
+    ws.async_read(buffer, [self](boost::system::error_code ec, std::size_t) {
+        if (ec) {
+            self->fail(ec);
+            return;
+        }
+        const auto data = self->buffer.data();
+        if (self->onMessage) {
+            self->onMessage(static_cast<const char*>(data.data()), data.size());
+        }
+        self->buffer.consume(self->buffer.size());
+        if (!self->closed) {
+            self->read();
+        }
+    });
+}
+
+inline void WebSocketClientTransport::flush()
+{
+    if (!writing.empty() || queued.empty() || closed) {
+        return;
+    }
+    writing = std::move(queued.front());
+    queued.pop_front();
+    auto self = shared_from_this();
+    ws.async_write(boost::asio::buffer(writing), [self](boost::system::error_code ec, std::size_t) {
+        self->writing.clear();
+        if (ec) {
+            self->fail(ec);
+            return;
+        }
+        self->flush();
+    });
+}
+
+inline void WebSocketClientTransport::fail(boost::system::error_code ec)
+{
+    if (closed) {
+        return;
+    }
+    OnClose closing = std::move(onClose);
+    close();
+    if (closing) {
+        closing(ec);
+    }
+}
+
+#endif // WEBSOCKETCLIENTTRANSPORT_H
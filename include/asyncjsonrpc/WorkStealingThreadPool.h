@@ -0,0 +1,562 @@
+#ifndef WORKSTEALINGTHREADPOOL_H
+#define WORKSTEALINGTHREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// A thread pool with a lock-free work-stealing deque per worker, meant to be used as the executor of
+// AsyncJsonRPC. Submissions from a worker go to its own deque without locking; submissions from other
+// threads go to a shared injection queue. Idle workers steal from each other before going to sleep.
+class WorkStealingThreadPool
+{
+public:
+    enum class IdleStrategy
+    {
+        SpinThenPark, // spin for a while looking for work, then sleep until woken up
+        Park,         // sleep as soon as there's no work
+        Spin          // never sleep; lowest latency, burns a core per idle worker
+    };
+
+    struct Options
+    {
+        std::size_t  threadCount    = std::max(1u, std::thread::hardware_concurrency());
+        bool         pinThreads     = false; // pin worker i to cpu (i % cpu count); linux only
+        IdleStrategy idleStrategy   = IdleStrategy::SpinThenPark;
+        unsigned     spinIterations = 2000;
+        std::size_t  dequeCapacity  = 4096; // per worker, rounded up to a power of 2
+
+        // called on the worker with what a task threw; the worker then goes on with the next task.
+        // Without it, the exception is dropped (the rpc's handlers report their errors as responses)
+        std::function<void(std::exception_ptr)> onException;
+    };
+
+    class executor_type;
+
+private:
+    // type-erased unit of work; run() invokes the function and releases the task, discard() only
+    // releases it
+    struct Task
+    {
+        void (*completeFunction)(Task*, bool invoke);
+        Task* next = nullptr;
+
+        explicit Task(void (*CompleteFunction)(Task*, bool)) : completeFunction(CompleteFunction) {}
+        void run() { completeFunction(this, true); }
+        void discard() { completeFunction(this, false); }
+    };
+
+    template <typename Function, typename Allocator>
+    struct TaskImpl;
+
+    // Chase-Lev deque with a fixed capacity; the owner pushes and pops at the bottom, thieves steal
+    // from the top. When it's full, the pool falls back to the injection queue.
+    class WorkStealingDeque
+    {
+        std::atomic<std::int64_t>       top{0};
+        std::atomic<std::int64_t>       bottom{0};
+        std::vector<std::atomic<Task*>> buffer;
+        std::int64_t                    mask;
+
+    public:
+        explicit WorkStealingDeque(std::size_t capacity);
+        bool        push(Task* task);
+        Task*       pop();
+        Task*       steal();
+        std::size_t sizeEstimate() const;
+    };
+
+    struct Worker
+    {
+        WorkStealingDeque deque;
+        std::thread       thread;
+
+        explicit Worker(std::size_t dequeCapacity) : deque(dequeCapacity) {}
+    };
+
+    Options                              options;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::mutex               injectionMutex;
+    Task*                    injectionHead = nullptr;
+    Task*                    injectionTail = nullptr;
+    std::atomic<std::size_t> injectedCount{0}; // lets idle workers check without taking the lock
+
+    std::mutex              parkMutex;
+    std::condition_variable parkCondition;
+    std::atomic<unsigned>   parkedCount{0};
+
+    std::atomic<std::size_t> outstandingWork{0};
+    std::mutex               idleMutex;
+    std::condition_variable  idleCondition;
+    std::atomic<bool>        stopped{false};
+
+    struct ThreadState
+    {
+        WorkStealingThreadPool* pool;
+        std::size_t             workerIndex;
+    };
+    static ThreadState& currentThreadState()
+    {
+        static thread_local ThreadState state{nullptr, 0};
+        return state;
+    }
+
+    void  submit(Task* task);
+    void  pushInjected(Task* task);
+    Task* popInjected();
+    Task* findWork(std::size_t workerIndex, std::minstd_rand& random);
+    bool  hasVisibleWork();
+    void  wakeOne();
+    void  park();
+    void  workerLoop(std::size_t workerIndex);
+    void  onWorkFinished();
+
+    static std::size_t roundUpToPowerOf2(std::size_t value);
+
+public:
+    WorkStealingThreadPool();
+    explicit WorkStealingThreadPool(std::size_t threadCount);
+    explicit WorkStealingThreadPool(const Options& Opts);
+    // stops the workers; must not run on one of them (its thread can't be joined), see stop()
+    ~WorkStealingThreadPool();
+
+    WorkStealingThreadPool(const WorkStealingThreadPool&) = delete;
+    WorkStealingThreadPool& operator=(const WorkStealingThreadPool&) = delete;
+
+    executor_type get_executor() noexcept;
+
+    std::size_t threadCount() const;
+
+    bool runningInThisThread() const;
+
+    // blocks until there's no outstanding work, then stops the workers
+    void join();
+
+    // stops the workers as soon as they finish the task they're running; queued tasks are dropped.
+    // Throws std::logic_error when called from one of the workers, as join() does
+    void stop();
+};
+
+class WorkStealingThreadPool::executor_type
+{
+    WorkStealingThreadPool* pool;
+
+    friend class WorkStealingThreadPool;
+    explicit executor_type(WorkStealingThreadPool* Pool) : pool(Pool) {}
+
+public:
+    WorkStealingThreadPool& context() const noexcept { return *pool; }
+
+    void on_work_started() const noexcept { pool->outstandingWork++; }
+    void on_work_finished() const noexcept { pool->onWorkFinished(); }
+
+    bool running_in_this_thread() const noexcept { return pool->runningInThisThread(); }
+
+    template <typename Function, typename Allocator>
+    void post(Function&& f, const Allocator& a) const;
+
+    // runs f inline when called from one of the pool's workers, otherwise same as post()
+    template <typename Function, typename Allocator>
+    void dispatch(Function&& f, const Allocator& a) const;
+
+    template <typename Function, typename Allocator>
+    void defer(Function&& f, const Allocator& a) const
+    {
+        post(std::forward<Function>(f), a);
+    }
+
+    friend bool operator==(const executor_type& a, const executor_type& b) noexcept
+    {
+        return a.pool == b.pool;
+    }
+    friend bool operator!=(const executor_type& a, const executor_type& b) noexcept
+    {
+        return a.pool != b.pool;
+    }
+};
+
+template <typename Function, typename Allocator>
+struct WorkStealingThreadPool::TaskImpl : public Task
+{
+    using AllocatorType =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<TaskImpl<Function, Allocator>>;
+
+    Function      function;
+    AllocatorType allocator;
+
+    template <typename F>
+    TaskImpl(F&& f, const Allocator& a)
+        : Task(&TaskImpl::complete), function(std::forward<F>(f)), allocator(a)
+    {
+    }
+
+    static TaskImpl* create(Function&& f, const Allocator& a)
+    {
+        AllocatorType alloc(a);
+        TaskImpl*     memory = std::allocator_traits<AllocatorType>::allocate(alloc, 1);
+        try {
+            return new (memory) TaskImpl(std::move(f), a);
+        } catch (...) {
+            std::allocator_traits<AllocatorType>::deallocate(alloc, memory, 1);
+            throw;
+        }
+    }
+
+    static void complete(Task* base, bool invoke)
+    {
+        // the task's memory is released before invoking, so the function can reuse it for new tasks
+        TaskImpl*     self = static_cast<TaskImpl*>(base);
+        Function      f(std::move(self->function));
+        AllocatorType alloc(self->allocator);
+        self->~TaskImpl();
+        std::allocator_traits<AllocatorType>::deallocate(alloc, self, 1);
+        if (invoke) {
+            f();
+        }
+    }
+};
+
+template <typename Function, typename Allocator>
+void WorkStealingThreadPool::executor_type::post(Function&& f, const Allocator& a) const
+{
+    using FunctionType = typename std::decay<Function>::type;
+    FunctionType function(std::forward<Function>(f));
+    pool->submit(TaskImpl<FunctionType, Allocator>::create(std::move(function), a));
+}
+
+template <typename Function, typename Allocator>
+void WorkStealingThreadPool::executor_type::dispatch(Function&& f, const Allocator& a) const
+{
+    if (pool->runningInThisThread()) {
+        typename std::decay<Function>::type function(std::forward<Function>(f));
+        function();
+    } else {
+        post(std::forward<Function>(f), a);
+    }
+}
+
+inline WorkStealingThreadPool::WorkStealingDeque::WorkStealingDeque(std::size_t capacity)
+    : buffer(roundUpToPowerOf2(capacity)), mask(static_cast<std::int64_t>(buffer.size()) - 1)
+{
+}
+
+inline bool WorkStealingThreadPool::WorkStealingDeque::push(Task* task)
+{
+    std::int64_t b = bottom.load(std::memory_order_relaxed);
+    std::int64_t t = top.load(std::memory_order_acquire);
+    if (b - t > mask) {
+        return false;
+    }
+    buffer[b & mask].store(task, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+inline WorkStealingThreadPool::Task* WorkStealingThreadPool::WorkStealingDeque::pop()
+{
+    std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+        // empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Task* task = buffer[b & mask].load(std::memory_order_relaxed);
+    if (t == b) {
+        // last element; race against thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+inline WorkStealingThreadPool::Task* WorkStealingThreadPool::WorkStealingDeque::steal()
+{
+    std::int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+        return nullptr;
+    }
+    Task* task = buffer[t & mask].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return task;
+}
+
+inline std::size_t WorkStealingThreadPool::WorkStealingDeque::sizeEstimate() const
+{
+    std::int64_t b = bottom.load(std::memory_order_relaxed);
+    std::int64_t t = top.load(std::memory_order_relaxed);
+    return b > t ? static_cast<std::size_t>(b - t) : 0;
+}
+
+inline WorkStealingThreadPool::WorkStealingThreadPool() : WorkStealingThreadPool(Options()) {}
+
+inline WorkStealingThreadPool::WorkStealingThreadPool(std::size_t threadCount)
+    : WorkStealingThreadPool([threadCount]() {
+          Options opts;
+          opts.threadCount = threadCount;
+          return opts;
+      }())
+{
+}
+
+inline WorkStealingThreadPool::WorkStealingThreadPool(const Options& Opts) : options(Opts)
+{
+    if (options.threadCount == 0) {
+        throw std::invalid_argument("WorkStealingThreadPool needs at least one thread");
+    }
+    for (std::size_t i = 0; i < options.threadCount; i++) {
+        workers.emplace_back(new Worker(options.dequeCapacity));
+    }
+    // all deques must exist before any worker starts stealing
+    for (std::size_t i = 0; i < options.threadCount; i++) {
+        workers[i]->thread = std::thread([this, i]() { this->workerLoop(i); });
+#ifdef __linux__
+        if (options.pinThreads) {
+            unsigned  cpuCount = std::max(1u, std::thread::hardware_concurrency());
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(i % cpuCount, &cpuSet);
+            // pinning is best effort; a restricted cpuset just leaves the thread unpinned
+            pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(cpuSet), &cpuSet);
+        }
+#endif
+    }
+}
+
+inline WorkStealingThreadPool::~WorkStealingThreadPool()
+{
+    stop();
+    // release whatever was never run
+    for (auto& worker : workers) {
+        while (Task* task = worker->deque.pop()) {
+            task->discard();
+        }
+    }
+    while (Task* task = popInjected()) {
+        task->discard();
+    }
+}
+
+inline WorkStealingThreadPool::executor_type WorkStealingThreadPool::get_executor() noexcept
+{
+    return executor_type(this);
+}
+
+inline std::size_t WorkStealingThreadPool::threadCount() const { return workers.size(); }
+
+inline bool WorkStealingThreadPool::runningInThisThread() const
+{
+    return currentThreadState().pool == this;
+}
+
+inline void WorkStealingThreadPool::submit(Task* task)
+{
+    outstandingWork++;
+    ThreadState& state = currentThreadState();
+    // fast path: a worker submitting to its own pool pushes to its own deque without locking
+    if (state.pool != this || !workers[state.workerIndex]->deque.push(task)) {
+        pushInjected(task);
+    }
+    wakeOne();
+}
+
+inline void WorkStealingThreadPool::pushInjected(Task* task)
+{
+    std::lock_guard<std::mutex> lock(injectionMutex);
+    task->next = nullptr;
+    if (injectionTail) {
+        injectionTail->next = task;
+    } else {
+        injectionHead = task;
+    }
+    injectionTail = task;
+    injectedCount++;
+}
+
+inline WorkStealingThreadPool::Task* WorkStealingThreadPool::popInjected()
+{
+    if (injectedCount.load() == 0) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(injectionMutex);
+    Task*                       task = injectionHead;
+    if (task) {
+        injectionHead = task->next;
+        if (!injectionHead) {
+            injectionTail = nullptr;
+        }
+        injectedCount--;
+    }
+    return task;
+}
+
+inline WorkStealingThreadPool::Task* WorkStealingThreadPool::findWork(std::size_t workerIndex,
+                                                                      std::minstd_rand& random)
+{
+    if (Task* task = workers[workerIndex]->deque.pop()) {
+        return task;
+    }
+    if (Task* task = popInjected()) {
+        return task;
+    }
+    // start stealing at a random victim so thieves don't all hit the same deque
+    const std::size_t count = workers.size();
+    const std::size_t start = random() % count;
+    for (std::size_t i = 0; i < count; i++) {
+        std::size_t victim = (start + i) % count;
+        if (victim == workerIndex) {
+            continue;
+        }
+        if (Task* task = workers[victim]->deque.steal()) {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+inline bool WorkStealingThreadPool::hasVisibleWork()
+{
+    if (injectedCount.load() > 0) {
+        return true;
+    }
+    for (auto& worker : workers) {
+        if (worker->deque.sizeEstimate() > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void WorkStealingThreadPool::wakeOne()
+{
+    // pairs with the fence in park(): either the sleeper sees the new task or we see the sleeper
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parkedCount.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        parkCondition.notify_one();
+    }
+}
+
+inline void WorkStealingThreadPool::park()
+{
+    std::unique_lock<std::mutex> lock(parkMutex);
+    parkedCount++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!stopped.load() && !hasVisibleWork()) {
+        parkCondition.wait(lock);
+    }
+    parkedCount--;
+}
+
+inline void WorkStealingThreadPool::workerLoop(std::size_t workerIndex)
+{
+    currentThreadState() = ThreadState{this, workerIndex};
+    std::minstd_rand random(static_cast<std::minstd_rand::result_type>(workerIndex + 1));
+
+    unsigned idleRounds = 0;
+    while (!stopped.load(std::memory_order_relaxed)) {
+        if (Task* task = findWork(workerIndex, random)) {
+            idleRounds = 0;
+            try {
+                task->run();
+            } catch (...) {
+                if (options.onException) {
+                    options.onException(std::current_exception());
+                }
+            }
+            onWorkFinished();
+            continue;
+        }
+
+        switch (options.idleStrategy) {
+        case IdleStrategy::Spin:
+            std::this_thread::yield();
+            break;
+        case IdleStrategy::SpinThenPark:
+            if (++idleRounds < options.spinIterations) {
+                break;
+            }
+            idleRounds = 0;
+            park();
+            break;
+        case IdleStrategy::Park:
+            park();
+            break;
+        }
+    }
+
+    currentThreadState() = ThreadState{nullptr, 0};
+}
+
+inline void WorkStealingThreadPool::onWorkFinished()
+{
+    if (--outstandingWork == 0) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idleCondition.notify_all();
+    }
+}
+
+inline void WorkStealingThreadPool::join()
+{
+    if (runningInThisThread()) {
+        throw std::logic_error("WorkStealingThreadPool::join() called from one of its own workers");
+    }
+    {
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idleCondition.wait(lock, [this]() { return outstandingWork.load() == 0; });
+    }
+    stop();
+}
+
+inline void WorkStealingThreadPool::stop()
+{
+    if (runningInThisThread()) {
+        throw std::logic_error("WorkStealingThreadPool::stop() called from one of its own workers");
+    }
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        stopped.store(true);
+        parkCondition.notify_all();
+    }
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+inline std::size_t WorkStealingThreadPool::roundUpToPowerOf2(std::size_t value)
+{
+    std::size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+#endif // WORKSTEALINGTHREADPOOL_H
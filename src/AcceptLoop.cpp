@@ -0,0 +1 @@
+#include "asyncjsonrpc/AcceptLoop.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/AsyncJsonRPCClient.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/AsyncJsonRPCClientPool.h"
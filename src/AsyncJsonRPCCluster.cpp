@@ -0,0 +1 @@
+#include "asyncjsonrpc/AsyncJsonRPCCluster.h"
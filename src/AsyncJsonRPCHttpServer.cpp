@@ -0,0 +1 @@
+#include "asyncjsonrpc/AsyncJsonRPCHttpServer.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/AsyncJsonRPCSharedMemoryServer.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/AsyncJsonRPCStreamServer.h"
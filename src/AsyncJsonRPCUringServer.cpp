@@ -0,0 +1 @@
+#include "asyncjsonrpc/AsyncJsonRPCUringServer.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/AsyncJsonRPCWebSocketServer.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/CpuTimeAccounting.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/HttpClientTransport.h"
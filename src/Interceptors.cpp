@@ -0,0 +1 @@
+#include "asyncjsonrpc/Interceptors.h"
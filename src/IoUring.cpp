@@ -0,0 +1 @@
+#include "asyncjsonrpc/IoUring.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/KeyedStrand.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/PerThreadShards.h"
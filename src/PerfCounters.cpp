@@ -0,0 +1 @@
+#include "asyncjsonrpc/PerfCounters.h"
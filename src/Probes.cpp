@@ -0,0 +1,15 @@
+#include "asyncjsonrpc/Probes.h"
+
+#ifdef ASYNCJSONRPC_HAS_USDT
+
+#define ASYNCJSONRPC_DEFINE_SEMAPHORE(name)                                                             \
+    unsigned short asyncjsonrpc_##name##_semaphore __attribute__((section(".probes"))) = 0
+
+ASYNCJSONRPC_DEFINE_SEMAPHORE(request_received);
+ASYNCJSONRPC_DEFINE_SEMAPHORE(method_resolved);
+ASYNCJSONRPC_DEFINE_SEMAPHORE(handler_start);
+ASYNCJSONRPC_DEFINE_SEMAPHORE(handler_end);
+ASYNCJSONRPC_DEFINE_SEMAPHORE(error_emitted);
+ASYNCJSONRPC_DEFINE_SEMAPHORE(response_emitted);
+
+#endif
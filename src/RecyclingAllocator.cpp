@@ -0,0 +1 @@
+#include "asyncjsonrpc/RecyclingAllocator.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/ResponseRouter.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/RpcMetrics.h"
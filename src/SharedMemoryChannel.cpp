@@ -0,0 +1 @@
+#include "asyncjsonrpc/SharedMemoryChannel.h"
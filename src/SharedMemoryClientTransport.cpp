@@ -0,0 +1 @@
+#include "asyncjsonrpc/SharedMemoryClientTransport.h"
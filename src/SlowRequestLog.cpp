@@ -0,0 +1 @@
+#include "asyncjsonrpc/SlowRequestLog.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/StreamClientTransport.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/StreamFraming.h"
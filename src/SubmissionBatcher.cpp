@@ -0,0 +1 @@
+#include "asyncjsonrpc/SubmissionBatcher.h"
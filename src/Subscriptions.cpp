@@ -0,0 +1 @@
+#include "asyncjsonrpc/Subscriptions.h"
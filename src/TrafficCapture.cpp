@@ -0,0 +1 @@
+#include "asyncjsonrpc/TrafficCapture.h"
@@ -0,0 +1 @@
+#include "asyncjsonrpc/WebSocketClientTransport.h"
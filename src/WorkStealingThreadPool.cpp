@@ -0,0 +1 @@
+#include "asyncjsonrpc/WorkStealingThreadPool.h"
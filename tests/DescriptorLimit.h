@@ -0,0 +1,46 @@
+#ifndef DESCRIPTORLIMIT_H
+#define DESCRIPTORLIMIT_H
+
+#include "gtest/gtest.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+// While it lives, the soft limit of file descriptors is the lowest one free: no descriptor can be
+// opened, and a server can't accept a connection (EMFILE). Open the client's socket before.
+class DescriptorLimit
+{
+    struct rlimit original;
+    bool          lowered = false;
+
+    // in a function of its own: ASSERT_* can't be used in a constructor
+    void lower()
+    {
+        ASSERT_EQ(::getrlimit(RLIMIT_NOFILE, &original), 0);
+        const int lowestFree = ::dup(0);
+        ASSERT_GE(lowestFree, 0);
+        ::close(lowestFree);
+        struct rlimit limit = original;
+        limit.rlim_cur      = static_cast<rlim_t>(lowestFree);
+        ASSERT_EQ(::setrlimit(RLIMIT_NOFILE, &limit), 0);
+        lowered = true;
+    }
+
+public:
+    DescriptorLimit() { lower(); }
+
+    DescriptorLimit(const DescriptorLimit&) = delete;
+    DescriptorLimit& operator=(const DescriptorLimit&) = delete;
+
+    ~DescriptorLimit() { restore(); }
+
+    void restore()
+    {
+        if (lowered) {
+            EXPECT_EQ(::setrlimit(RLIMIT_NOFILE, &original), 0);
+            lowered = false;
+        }
+    }
+};
+
+#endif // DESCRIPTORLIMIT_H
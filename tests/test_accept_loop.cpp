@@ -0,0 +1,104 @@
+#include "gtest/gtest.h"
+
+#include "DescriptorLimit.h"
+#include "include/asyncjsonrpc/AcceptLoop.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+using tcp = boost::asio::ip::tcp;
+
+// an accept loop on an io_context run by threads of its own; the accepted sockets are kept
+struct AcceptFixture
+{
+    boost::asio::io_context  ioContext;
+    AcceptLoop<tcp>          loop;
+    std::mutex               socketsMutex;
+    std::vector<tcp::socket> sockets;
+    std::atomic<int>         accepted{0};
+    std::vector<std::thread> threads;
+
+    AcceptFixture(std::chrono::milliseconds retryDelay, int threadCount)
+        : loop(ioContext, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0), retryDelay)
+    {
+        loop.start([this](tcp::socket&& socket) {
+            std::lock_guard<std::mutex> lock(socketsMutex);
+            sockets.push_back(std::move(socket));
+            accepted++;
+        });
+        for (int i = 0; i < threadCount; i++) {
+            threads.emplace_back([this]() { ioContext.run(); });
+        }
+    }
+
+    ~AcceptFixture()
+    {
+        loop.stop();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void waitForAccepted(int count)
+    {
+        while (accepted.load() < count) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+};
+
+TEST(AcceptLoop, accept_errors_back_off)
+{
+    AcceptFixture           fixture(std::chrono::milliseconds(20), 1);
+    boost::asio::io_context clientContext;
+    tcp::socket             socket(clientContext);
+    socket.open(tcp::v4());
+
+    DescriptorLimit limit;
+    socket.connect(fixture.loop.localEndpoint());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const std::uint64_t errors = fixture.loop.acceptErrors();
+    limit.restore();
+
+    // one failed accept per retry delay, not a busy loop
+    EXPECT_GE(errors, 1u);
+    EXPECT_LE(errors, 10u);
+
+    // and the connection is accepted once descriptors are available again
+    fixture.waitForAccepted(1);
+    EXPECT_EQ(fixture.accepted.load(), 1);
+}
+
+// stop() from another thread, while accepts complete on several: connections are refused after it
+TEST(AcceptLoop, stop_while_threads_accept)
+{
+    AcceptFixture           fixture(std::chrono::milliseconds(20), 4);
+    const tcp::endpoint     endpoint = fixture.loop.localEndpoint();
+    boost::asio::io_context clientContext;
+
+    std::vector<tcp::socket> clients;
+    for (int i = 0; i < 50; i++) {
+        clients.emplace_back(clientContext);
+        clients.back().connect(endpoint);
+    }
+    fixture.waitForAccepted(50);
+    {
+        // each on a strand of its own
+        std::lock_guard<std::mutex> lock(fixture.socketsMutex);
+        EXPECT_NE(fixture.sockets[0].get_executor(), fixture.sockets[1].get_executor());
+    }
+
+    fixture.loop.stop();
+    boost::system::error_code ec;
+    for (int attempt = 0; attempt < 100 && !ec; attempt++) {
+        tcp::socket late(clientContext);
+        late.connect(endpoint, ec);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(ec, boost::asio::error::connection_refused);
+}
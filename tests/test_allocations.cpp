@@ -0,0 +1,133 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+
+// Allocation budgets of the call paths. operator new is replaced for the whole test binary and counts
+// the allocations of the calling thread; jsoncpp and the standard library allocate through it. (malloc
+// isn't interposed: nothing on these paths calls it directly.)
+//
+// The budgets are what the paths cost today, in steady state (after a warm-up call). When a change
+// removes allocations, lower the budget with it, so the gain can't quietly regress.
+
+static const std::uint64_t SuccessCallBudget       = 21; // 2 params by name
+static const std::uint64_t UnknownMethodCallBudget = 27;
+static const std::uint64_t BadParamsCallBudget     = 30;
+static const std::uint64_t ParseErrorBudget        = 26;
+static const std::uint64_t BatchBaseBudget         = 10;
+static const std::uint64_t BatchPerCallBudget      = 20;
+
+static thread_local std::uint64_t ThreadAllocationCount = 0;
+
+void* operator new(std::size_t size)
+{
+    ThreadAllocationCount++;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// not inlined, so the compiler doesn't see free() called on memory from operator new and warn about it
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+class AllocationBudget : public ::testing::Test
+{
+protected:
+    boost::asio::io_context                                   executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type, int> rpc;
+    std::size_t                                               responseCount = 0;
+
+    AllocationBudget() : rpc(executionContext.get_executor())
+    {
+        rpc.addHandler(
+            [](const Json::Value& request, Json::Value& response, int) {
+                response = request["p1"].asInt() + request["p2"].asInt();
+            },
+            "add", {{"p1", Json::ValueType::intValue}, {"p2", Json::ValueType::intValue}});
+        rpc.setResponseCallback([this](std::string&&) { responseCount++; });
+    }
+
+    // allocations of one post() of the call, after a warm-up post()
+    std::uint64_t allocationsOfPost(const std::string& call)
+    {
+        rpc.post(call, 0);
+        const std::uint64_t before = ThreadAllocationCount;
+        rpc.post(call, 0);
+        return ThreadAllocationCount - before;
+    }
+
+    static std::string batchOf(int size)
+    {
+        std::string call = "[";
+        for (int i = 0; i < size; i++) {
+            call += (i > 0 ? ", " : "");
+            call += R"({"jsonrpc": "2.0", "method": "add", "params": {"p1": 1, "p2": 2}, "id": )" +
+                    std::to_string(i) + "}";
+        }
+        return call + "]";
+    }
+};
+
+static const char* const SuccessCall =
+    R"({"jsonrpc": "2.0", "method": "add", "params": {"p1": 1, "p2": 2}, "id": 1})";
+
+TEST_F(AllocationBudget, single_successful_call)
+{
+    EXPECT_LE(allocationsOfPost(SuccessCall), SuccessCallBudget);
+    EXPECT_EQ(responseCount, 2u);
+}
+
+TEST_F(AllocationBudget, single_error_call)
+{
+    EXPECT_LE(allocationsOfPost(R"({"jsonrpc": "2.0", "method": "nosuchmethod", "id": 1})"),
+              UnknownMethodCallBudget);
+    EXPECT_LE(allocationsOfPost(
+                  R"({"jsonrpc": "2.0", "method": "add", "params": {"p1": 1, "p2": "x"}, "id": 1})"),
+              BadParamsCallBudget);
+    EXPECT_LE(allocationsOfPost(R"({"jsonrpc": "2.0", "meth)"), ParseErrorBudget);
+}
+
+TEST_F(AllocationBudget, batch)
+{
+    for (int size : {1, 10, 100}) {
+        EXPECT_LE(allocationsOfPost(batchOf(size)), BatchBaseBudget + size * BatchPerCallBudget)
+            << "batch of " << size;
+    }
+}
+
+TEST_F(AllocationBudget, async_post)
+{
+    const std::string call = SuccessCall;
+
+    // warm-up, fills the recycling allocator's cache
+    rpc.asyncPost(call, 0);
+    executionContext.run();
+    executionContext.restart();
+
+    std::string         moved  = call;
+    const std::uint64_t before = ThreadAllocationCount;
+    rpc.asyncPost(std::move(moved), 0);
+    const std::uint64_t posted = ThreadAllocationCount;
+    executionContext.run();
+
+    // posting itself doesn't allocate; running the call costs what post() costs
+    EXPECT_EQ(posted - before, 0u);
+    EXPECT_LE(ThreadAllocationCount - posted, SuccessCallBudget);
+    EXPECT_EQ(responseCount, 2u);
+}
+
+TEST_F(AllocationBudget, metrics_add_no_allocations)
+{
+    const std::uint64_t call  = allocationsOfPost(SuccessCall);
+    const std::uint64_t batch = allocationsOfPost(batchOf(10));
+    rpc.enableMetrics();
+    EXPECT_EQ(allocationsOfPost(SuccessCall), call);
+    EXPECT_EQ(allocationsOfPost(batchOf(10)), batch);
+}
@@ -0,0 +1,179 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/TrafficCapture.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <unistd.h>
+
+static std::string TemporaryCaptureFile(const std::string& name)
+{
+    const std::string fileName =
+        "/tmp/asyncjsonrpc_" + name + "_" + std::to_string(::getpid()) + ".cap";
+    std::remove(fileName.c_str());
+    return fileName;
+}
+
+TEST(TrafficCapture, round_trip_through_post)
+{
+    const std::string fileName = TemporaryCaptureFile("round_trip");
+
+    boost::asio::io_context                                   executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type, int> rpc(executionContext.get_executor());
+    rpc.addHandler([](const Json::Value&, Json::Value& response, int user) { response = user; },
+                   "whoami");
+    std::vector<std::string> responses;
+    rpc.setResponseCallback([&responses](std::string&& res) { responses.push_back(res); });
+
+    rpc.enableCapture(fileName, [](int user) { return static_cast<std::uint64_t>(user); });
+    const std::vector<std::string> calls = {R"({"jsonrpc": "2.0", "method": "whoami", "id": 1})",
+                                            "not json", R"([{"jsonrpc": "2.0", "method": "whoami"}])"};
+    for (std::size_t i = 0; i < calls.size(); i++) {
+        rpc.post(calls[i], static_cast<int>(i) + 10);
+    }
+    rpc.stopCapture();
+    // not captured
+    rpc.post(calls[0], 99);
+
+    TrafficCaptureReader reader(fileName);
+    CapturedRequest      request;
+    std::uint64_t        previousTimestamp = 0;
+    for (std::size_t i = 0; i < calls.size(); i++) {
+        ASSERT_TRUE(reader.next(request));
+        EXPECT_EQ(request.toString(), calls[i]);
+        EXPECT_EQ(request.contextKey, i + 10);
+        EXPECT_GE(request.timestampNs, previousTimestamp);
+        previousTimestamp = request.timestampNs;
+    }
+    EXPECT_FALSE(reader.next(request));
+
+    // replayed with contexts rebuilt from the keys, the requests get the responses they got originally
+    const std::vector<std::string> originalResponses(responses.begin(), responses.begin() + 3);
+    responses.clear();
+    reader.rewind();
+    const auto submit = [&rpc](const CapturedRequest& r) {
+        rpc.post(r.toString(), static_cast<int>(r.contextKey));
+    };
+    const std::size_t replayed = ReplayTrafficCapture(reader, submit, 0);
+    EXPECT_EQ(replayed, calls.size());
+    EXPECT_EQ(responses, originalResponses);
+    EXPECT_EQ(responses[0], "{\"id\":1,\"jsonrpc\":\"2.0\",\"result\":10}\n");
+
+    std::remove(fileName.c_str());
+}
+
+TEST(TrafficCapture, truncated_record_is_ignored)
+{
+    const std::string fileName = TemporaryCaptureFile("truncated");
+    {
+        TrafficCaptureWriter writer(fileName);
+        writer.append("first", 5, 1, 100);
+        writer.append("second", 6, 2, 200);
+    }
+    // a crash in the middle of the second record
+    ASSERT_EQ(::truncate(fileName.c_str(), TrafficCaptureFormat::MagicSize +
+                                               2 * TrafficCaptureFormat::HeaderSize + 5 + 3),
+              0);
+
+    TrafficCaptureReader reader(fileName);
+    CapturedRequest      request;
+    ASSERT_TRUE(reader.next(request));
+    EXPECT_EQ(request.toString(), "first");
+    EXPECT_EQ(request.timestampNs, 100u);
+    EXPECT_FALSE(reader.next(request));
+
+    // appending after a restart keeps the magic once, and the file readable up to the truncated record
+    {
+        TrafficCaptureWriter writer(fileName);
+        writer.append("third", 5, 3, 300);
+    }
+    // the torn record was cut off first, so the appended one reads back intact
+    TrafficCaptureReader reopened(fileName);
+    ASSERT_TRUE(reopened.next(request));
+    EXPECT_EQ(request.toString(), "first");
+    ASSERT_TRUE(reopened.next(request));
+    EXPECT_EQ(request.toString(), "third");
+    EXPECT_EQ(request.contextKey, 3u);
+    EXPECT_EQ(request.timestampNs, 300u);
+    EXPECT_FALSE(reopened.next(request));
+
+    // a file cut in its magic starts over
+    ASSERT_EQ(::truncate(fileName.c_str(), 3), 0);
+    {
+        TrafficCaptureWriter writer(fileName);
+        writer.append("fourth", 6, 4, 400);
+    }
+    TrafficCaptureReader restarted(fileName);
+    ASSERT_TRUE(restarted.next(request));
+    EXPECT_EQ(request.toString(), "fourth");
+    EXPECT_FALSE(restarted.next(request));
+
+    EXPECT_THROW(TrafficCaptureReader("/nonexistent/capture"), std::runtime_error);
+    std::remove(fileName.c_str());
+}
+
+TEST(TrafficCapture, write_failures_are_reported)
+{
+    // not a capture file: appending to it would make it unreadable
+    const std::string fileName = TemporaryCaptureFile("foreign");
+    {
+        std::FILE* file = std::fopen(fileName.c_str(), "wb");
+        std::fputs("some other file", file);
+        std::fclose(file);
+    }
+    EXPECT_THROW(TrafficCaptureWriter writer(fileName), std::runtime_error);
+    std::remove(fileName.c_str());
+
+    // every write fails with ENOSPC
+    EXPECT_THROW(TrafficCaptureWriter writer("/dev/full"), std::runtime_error);
+}
+
+// the size of a record is 32 bits: a larger request is dropped, and the ones around it are written
+TEST(TrafficCapture, oversized_requests_are_dropped)
+{
+    const std::string fileName = TemporaryCaptureFile("oversized");
+    {
+        TrafficCaptureWriter writer(fileName);
+        writer.append("first", 5, 1, 100);
+        // never read: the size alone drops it
+        writer.append("huge", std::size_t(UINT32_MAX) + 1, 2, 200);
+        writer.append("third", 5, 3, 300);
+        EXPECT_EQ(writer.dropped(), 1u);
+        EXPECT_EQ(writer.error(), "");
+    }
+    TrafficCaptureReader reader(fileName);
+    CapturedRequest      request;
+    ASSERT_TRUE(reader.next(request));
+    EXPECT_EQ(request.toString(), "first");
+    ASSERT_TRUE(reader.next(request));
+    EXPECT_EQ(request.toString(), "third");
+    EXPECT_FALSE(reader.next(request));
+    std::remove(fileName.c_str());
+}
+
+TEST(TrafficCapture, replay_keeps_the_pace)
+{
+    const std::string fileName = TemporaryCaptureFile("pace");
+    {
+        TrafficCaptureWriter writer(fileName);
+        for (std::uint64_t i = 0; i < 5; i++) {
+            writer.append("x", 1, 0, i * 10000000); // every 10 ms
+        }
+    }
+    TrafficCaptureReader reader(fileName);
+    const auto           ignore = [](const CapturedRequest&) {};
+
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(ReplayTrafficCapture(reader, ignore, 2), 5u);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    // 40 ms of traffic at twice the speed
+    EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+
+    reader.rewind();
+    EXPECT_EQ(ReplayTrafficCapture(reader, ignore, 0), 5u);
+    std::remove(fileName.c_str());
+}
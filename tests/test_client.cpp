@@ -0,0 +1,426 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCClient.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCHttpServer.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCSharedMemoryServer.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCStreamServer.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCWebSocketServer.h"
+#include "include/asyncjsonrpc/HttpClientTransport.h"
+#include "include/asyncjsonrpc/SharedMemoryClientTransport.h"
+#include "include/asyncjsonrpc/StreamClientTransport.h"
+#include "include/asyncjsonrpc/WebSocketClientTransport.h"
+#include <atomic>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/spawn.hpp>
+#include <boost/asio/use_future.hpp>
+#include <boost/asio/write.hpp>
+
+using Rpc = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+using tcp = boost::asio::ip::tcp;
+
+static const tcp::endpoint Loopback(boost::asio::ip::address_v4::loopback(), 0);
+
+// a server of every transport, for one rpc; one thread runs the servers and the clients
+struct ClientFixture
+{
+    boost::asio::io_context                                                  ioContext;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    Rpc                                                                      rpc;
+    AsyncJsonRPCStreamServer<Rpc>                                            streamServer;
+    AsyncJsonRPCHttpServer<Rpc>                                              httpServer;
+    AsyncJsonRPCWebSocketServer<Rpc>                                         webSocketServer;
+    AsyncJsonRPCSharedMemoryServer<Rpc>                                      sharedMemoryServer;
+    std::thread                                                              thread;
+
+    static WebSocketServerOptions Coalescing()
+    {
+        WebSocketServerOptions options;
+        options.coalesceResponses = true;
+        return options;
+    }
+
+    ClientFixture()
+        : work(ioContext.get_executor()), rpc(ioContext.get_executor()),
+          streamServer(rpc, ioContext, Loopback), httpServer(rpc, ioContext, Loopback),
+          webSocketServer(rpc, ioContext, Loopback,
+                          AsyncJsonRPCWebSocketServer<Rpc>::DefaultContextFactory(), Coalescing()),
+          sharedMemoryServer(rpc)
+    {
+        rpc.addHandler(
+            [](const Json::Value& request, Json::Value& response) {
+                response = request["p0"].asInt() + request["p1"].asInt();
+            },
+            "sum", {{"p0", Json::ValueType::intValue}, {"p1", Json::ValueType::intValue}});
+        streamServer.start();
+        httpServer.start();
+        webSocketServer.start();
+        thread = std::thread([this]() { ioContext.run(); });
+    }
+
+    ~ClientFixture()
+    {
+        streamServer.stop();
+        httpServer.stop();
+        webSocketServer.stop();
+        sharedMemoryServer.stop();
+        work.reset();
+        ioContext.stop();
+        thread.join();
+    }
+
+    template <typename Transport, typename Endpoint, typename... Options>
+    std::shared_ptr<Transport> connect(const Endpoint& endpoint, const Options&... options)
+    {
+        auto transport = std::make_shared<Transport>(ioContext, options...);
+        transport->connect(endpoint);
+        return transport;
+    }
+};
+
+static Json::Value SumParams(int p0, int p1)
+{
+    Json::Value params;
+    params["p0"] = p0;
+    params["p1"] = p1;
+    return params;
+}
+
+template <typename Transport>
+static void ExpectCalls(AsyncJsonRPCClient<Transport>& client)
+{
+    // a callback, and a future
+    std::promise<Json::Value> promise;
+    client.asyncCall("sum", SumParams(1, 2),
+                     [&promise](boost::system::error_code ec, Json::Value result) {
+                         EXPECT_FALSE(ec);
+                         promise.set_value(result);
+                     });
+    EXPECT_EQ(promise.get_future().get().asInt(), 3);
+    EXPECT_EQ(client.asyncCall("sum", SumParams(20, 22), boost::asio::use_future).get().asInt(), 42);
+
+    // pipelined
+    std::vector<std::future<Json::Value>> results;
+    for (int i = 0; i < 100; i++) {
+        results.push_back(client.asyncCall("sum", SumParams(i, 1000), boost::asio::use_future));
+    }
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(results[i].get().asInt(), i + 1000);
+    }
+    const ClientStats stats = client.stats();
+    EXPECT_EQ(stats.calls, 102u);
+    EXPECT_EQ(stats.completed, 102u);
+    EXPECT_EQ(stats.unmatched, 0u);
+}
+
+TEST(Client, calls_over_every_transport)
+{
+    ClientFixture fixture;
+    {
+        AsyncJsonRPCClient<StreamClientTransport<tcp>> client(
+            fixture.connect<StreamClientTransport<tcp>>(fixture.streamServer.localEndpoint()));
+        ExpectCalls(client);
+    }
+    {
+        AsyncJsonRPCClient<HttpClientTransport> client(
+            fixture.connect<HttpClientTransport>(fixture.httpServer.localEndpoint()));
+        ExpectCalls(client);
+    }
+    {
+        AsyncJsonRPCClient<WebSocketClientTransport> client(
+            fixture.connect<WebSocketClientTransport>(fixture.webSocketServer.localEndpoint()));
+        ExpectCalls(client);
+    }
+    {
+        AsyncJsonRPCClient<SharedMemoryClientTransport> client(
+            std::make_shared<SharedMemoryClientTransport>(fixture.ioContext,
+                                                          fixture.sharedMemoryServer.accept()));
+        ExpectCalls(client);
+    }
+}
+
+// from a coroutine: a call returns its result, and an error response is thrown, or set in yield[ec]
+TEST(Client, calls_from_a_coroutine)
+{
+    ClientFixture                                  fixture;
+    AsyncJsonRPCClient<StreamClientTransport<tcp>> client(
+        fixture.connect<StreamClientTransport<tcp>>(fixture.streamServer.localEndpoint()));
+
+    std::promise<void> done;
+    boost::asio::spawn(fixture.ioContext, [&client, &done](boost::asio::yield_context yield) {
+        int sum = 0;
+        for (int i = 0; i < 10; i++) {
+            sum += client.asyncCall("sum", SumParams(i, 1), yield).asInt();
+        }
+        EXPECT_EQ(sum, 55);
+
+        boost::system::error_code ec;
+        const Json::Value         error = client.asyncCall("nope", Json::Value(), yield[ec]);
+        EXPECT_EQ(ec.value(), -32601);
+        EXPECT_EQ(error["code"].asInt(), -32601);
+        EXPECT_THROW(client.asyncCall("nope", Json::Value(), yield), boost::system::system_error);
+        done.set_value();
+    });
+    done.get_future().get();
+    EXPECT_EQ(client.stats().completed, 12u);
+}
+
+TEST(Client, error_responses)
+{
+    ClientFixture                                  fixture;
+    AsyncJsonRPCClient<StreamClientTransport<tcp>> client(
+        fixture.connect<StreamClientTransport<tcp>>(fixture.streamServer.localEndpoint()));
+
+    // a missing param, and a method that doesn't exist
+    Json::Value missing;
+    missing["p0"] = 1;
+    for (const std::string& method : {std::string("sum"), std::string("nope")}) {
+        std::promise<std::pair<boost::system::error_code, Json::Value>> promise;
+        client.asyncCall(method, method == "sum" ? missing : Json::Value(),
+                         [&promise](boost::system::error_code ec, Json::Value result) {
+                             promise.set_value({ec, result});
+                         });
+        const auto completion = promise.get_future().get();
+        EXPECT_EQ(&completion.first.category(), &JsonRpcCategory());
+        EXPECT_EQ(completion.first.value(), method == "sum" ? -32602 : -32601);
+        EXPECT_EQ(completion.second["code"].asInt(), completion.first.value());
+        EXPECT_TRUE(completion.second["message"].isString());
+    }
+    // use_future throws them
+    EXPECT_THROW(client.asyncCall("nope", Json::Value(), boost::asio::use_future).get(),
+                 boost::system::system_error);
+    EXPECT_EQ(client.stats().errors, 3u);
+}
+
+// a server that accepts one connection, and answers as the test says
+struct ScriptedServer
+{
+    boost::asio::io_context ioContext;
+    tcp::acceptor           acceptor{ioContext, Loopback};
+    tcp::socket             socket{ioContext};
+    std::string             buffer;
+
+    void accept() { acceptor.accept(socket); }
+
+    Json::Value readRequest()
+    {
+        const std::size_t size =
+            boost::asio::read_until(socket, boost::asio::dynamic_buffer(buffer), '\n');
+        Json::Value request;
+        EXPECT_TRUE(Json::Reader().parse(buffer.substr(0, size), request));
+        buffer.erase(0, size);
+        return request;
+    }
+
+    void write(const std::string& bytes) { boost::asio::write(socket, boost::asio::buffer(bytes)); }
+};
+
+static std::string Response(const Json::Value& id, int result)
+{
+    return R"({"jsonrpc":"2.0","result":)" + std::to_string(result) + R"(,"id":)" +
+           std::to_string(id.asUInt()) + "}";
+}
+
+TEST(Client, responses_in_any_order_and_batched)
+{
+    ClientFixture  fixture;
+    ScriptedServer server;
+    auto           transport = std::make_shared<StreamClientTransport<tcp>>(fixture.ioContext);
+    transport->connect(server.acceptor.local_endpoint());
+    server.accept();
+    AsyncJsonRPCClient<StreamClientTransport<tcp>> client(transport);
+
+    std::vector<std::future<Json::Value>> results;
+    std::vector<Json::Value>              ids;
+    for (int i = 0; i < 4; i++) {
+        results.push_back(client.asyncCall("any", Json::Value(), boost::asio::use_future));
+        ids.push_back(server.readRequest()["id"]);
+    }
+    // distinct ids
+    for (int i = 0; i < 4; i++) {
+        for (int j = i + 1; j < 4; j++) {
+            EXPECT_NE(ids[i], ids[j]);
+        }
+    }
+
+    // the last first; then an array of two, with a response of no call; then a malformed message
+    server.write(Response(ids[3], 3) + "\n[" + Response(ids[1], 1) + "," + Response(ids[0], 0) + "," +
+                 Response(12345, 9) + "]\nnot json\n");
+    EXPECT_EQ(results[3].get().asInt(), 3);
+    EXPECT_EQ(results[1].get().asInt(), 1);
+    EXPECT_EQ(results[0].get().asInt(), 0);
+
+    // the connection is lost: the call in flight fails, and calls after it fail at once
+    server.socket.close();
+    EXPECT_THROW(results[2].get(), boost::system::system_error);
+    try {
+        client.asyncCall("any", Json::Value(), boost::asio::use_future).get();
+        ADD_FAILURE();
+    } catch (const boost::system::system_error& error) {
+        EXPECT_EQ(error.code(), boost::asio::error::not_connected);
+    }
+    const ClientStats stats = client.stats();
+    EXPECT_EQ(stats.calls, 4u);
+    EXPECT_EQ(stats.completed, 5u);
+    EXPECT_EQ(stats.unmatched, 2u);
+}
+
+// a message that isn't an object, in a batch or not, or an error that isn't: the read loop goes on
+TEST(Client, messages_that_are_not_objects)
+{
+    ClientFixture  fixture;
+    ScriptedServer server;
+    auto           transport = std::make_shared<StreamClientTransport<tcp>>(fixture.ioContext);
+    transport->connect(server.acceptor.local_endpoint());
+    server.accept();
+    AsyncJsonRPCClient<StreamClientTransport<tcp>> client(transport);
+
+    std::future<Json::Value> first    = client.asyncCall("any", Json::Value(), boost::asio::use_future);
+    const Json::Value        firstId  = server.readRequest()["id"];
+    std::future<Json::Value> second   = client.asyncCall("any", Json::Value(), boost::asio::use_future);
+    const Json::Value        secondId = server.readRequest()["id"];
+
+    server.write("5\n[\"x\"," + Response(firstId, 1) + "]\n" + R"({"jsonrpc":"2.0","error":3,"id":)" +
+                 std::to_string(secondId.asUInt()) + "}\n");
+    EXPECT_EQ(first.get().asInt(), 1);
+    try {
+        second.get();
+        ADD_FAILURE();
+    } catch (const boost::system::system_error& error) {
+        EXPECT_EQ(error.code().value(), -32603);
+    }
+    EXPECT_EQ(client.stats().unmatched, 2u);
+}
+
+TEST(Client, slots_are_reused_and_bounded)
+{
+    ClientFixture  fixture;
+    ScriptedServer server;
+    auto           transport = std::make_shared<StreamClientTransport<tcp>>(fixture.ioContext);
+    transport->connect(server.acceptor.local_endpoint());
+    server.accept();
+    ClientOptions options;
+    options.maxPending = 3; // 4 slots
+    AsyncJsonRPCClient<StreamClientTransport<tcp>> client(transport, options);
+
+    // many more calls than slots, one at a time: every id is new
+    std::vector<Json::Value> ids;
+    for (int i = 0; i < 20; i++) {
+        std::future<Json::Value> result =
+            client.asyncCall("any", Json::Value(), boost::asio::use_future);
+        ids.push_back(server.readRequest()["id"]);
+        server.write(Response(ids.back(), i) + "\n");
+        EXPECT_EQ(result.get().asInt(), i);
+        for (std::size_t before = 0; before + 1 < ids.size(); before++) {
+            EXPECT_NE(ids[before], ids.back());
+        }
+    }
+
+    // a late response for a call whose slot was reused is dropped
+    std::future<Json::Value> pending = client.asyncCall("any", Json::Value(), boost::asio::use_future);
+    const Json::Value        id      = server.readRequest()["id"];
+    server.write(Response(ids[0], -1) + "\n" + Response(id, 7) + "\n");
+    EXPECT_EQ(pending.get().asInt(), 7);
+
+    // every slot in flight: the next call fails at once
+    std::vector<std::future<Json::Value>> inFlight;
+    for (int i = 0; i < 4; i++) {
+        inFlight.push_back(client.asyncCall("any", Json::Value(), boost::asio::use_future));
+    }
+    try {
+        client.asyncCall("any", Json::Value(), boost::asio::use_future).get();
+        ADD_FAILURE();
+    } catch (const boost::system::system_error& error) {
+        EXPECT_EQ(error.code(), boost::asio::error::no_buffer_space);
+    }
+
+    // closing fails them
+    client.close();
+    for (auto& result : inFlight) {
+        try {
+            result.get();
+            ADD_FAILURE();
+        } catch (const boost::system::system_error& error) {
+            EXPECT_EQ(error.code(), boost::asio::error::operation_aborted);
+        }
+    }
+    EXPECT_EQ(client.stats().unmatched, 1u);
+}
+
+TEST(Client, auto_batching_within_a_window)
+{
+    ClientFixture  fixture;
+    ScriptedServer server;
+    auto           transport = std::make_shared<StreamClientTransport<tcp>>(fixture.ioContext);
+    transport->connect(server.acceptor.local_endpoint());
+    server.accept();
+    ClientOptions options;
+    options.maxBatch    = 4;
+    options.batchWindow = std::chrono::milliseconds(50);
+    AsyncJsonRPCClient<StreamClientTransport<tcp>> client(transport, options);
+
+    // 4 calls fill a batch; 2 more wait for the window; 1 alone is sent as it is
+    for (std::size_t calls : {4, 2, 1}) {
+        std::vector<std::future<Json::Value>> results;
+        for (std::size_t i = 0; i < calls; i++) {
+            results.push_back(client.asyncCall("any", Json::Value(), boost::asio::use_future));
+        }
+        const Json::Value request = server.readRequest();
+        if (calls == 1) {
+            ASSERT_TRUE(request.isObject());
+            server.write(Response(request["id"], 0) + "\n");
+        } else {
+            ASSERT_TRUE(request.isArray());
+            ASSERT_EQ(request.size(), calls);
+            // answered in reverse
+            std::string response = "[";
+            for (std::size_t i = calls; i > 0; i--) {
+                response += Response(request[Json::ArrayIndex(i - 1)]["id"], static_cast<int>(i - 1));
+                response += (i > 1 ? "," : "]\n");
+            }
+            server.write(response);
+        }
+        for (std::size_t i = 0; i < calls; i++) {
+            EXPECT_EQ(results[i].get().asUInt(), i);
+        }
+    }
+    const ClientStats stats = client.stats();
+    EXPECT_EQ(stats.calls, 7u);
+    EXPECT_EQ(stats.batches, 2u);
+}
+
+TEST(Client, auto_batching_against_the_server)
+{
+    ClientFixture fixture;
+    ClientOptions options;
+    options.maxBatch = 16;
+    AsyncJsonRPCClient<StreamClientTransport<tcp>> client(
+        fixture.connect<StreamClientTransport<tcp>>(fixture.streamServer.localEndpoint()), options);
+
+    // made on the client's strand, before it runs anything else: the batches are full but the last
+    std::promise<void> done;
+    int                remaining = 200;
+    boost::asio::dispatch(client.get_executor(), [&]() {
+        for (int i = 0; i < 200; i++) {
+            client.asyncCall("sum", SumParams(i, 1),
+                             [&, i](boost::system::error_code ec, Json::Value result) {
+                                 EXPECT_FALSE(ec);
+                                 EXPECT_EQ(result.asInt(), i + 1);
+                                 if (--remaining == 0) {
+                                     done.set_value();
+                                 }
+                             });
+        }
+    });
+    done.get_future().wait();
+    const ClientStats stats = client.stats();
+    EXPECT_EQ(stats.completed, 200u);
+    EXPECT_EQ(stats.batches, 13u);
+    EXPECT_EQ(fixture.streamServer.stats().requests, 13u);
+}
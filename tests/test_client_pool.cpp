@@ -0,0 +1,455 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCClientPool.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCStreamServer.h"
+#include "include/asyncjsonrpc/StreamClientTransport.h"
+#include <chrono>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/use_future.hpp>
+
+using Rpc       = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+using tcp       = boost::asio::ip::tcp;
+using Transport = StreamClientTransport<tcp>;
+using Pool      = AsyncJsonRPCClientPool<Transport>;
+
+// a server on a thread of its own: "which" answers with its number, after delay (and, given a gate,
+// not before the gate is opened: the server stalls until then)
+struct PoolServer
+{
+    boost::asio::io_context                                                  ioContext;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    Rpc                                                                      rpc;
+    AsyncJsonRPCStreamServer<Rpc>                                            server;
+    std::thread                                                              thread;
+
+    PoolServer(int number, std::chrono::microseconds delay, unsigned short port = 0,
+               std::shared_future<void> gate = std::shared_future<void>())
+        : work(ioContext.get_executor()), rpc(ioContext.get_executor()),
+          server(rpc, ioContext, tcp::endpoint(boost::asio::ip::address_v4::loopback(), port))
+    {
+        rpc.addHandler(
+            [number, delay, gate](const Json::Value&, Json::Value& response) {
+                std::this_thread::sleep_for(delay);
+                if (gate.valid()) {
+                    gate.wait();
+                }
+                response = number;
+            },
+            "which");
+        server.start();
+        thread = std::thread([this]() { ioContext.run(); });
+    }
+
+    // the connections are closed too
+    ~PoolServer()
+    {
+        server.stop();
+        work.reset();
+        ioContext.stop();
+        thread.join();
+    }
+
+    unsigned short port() const { return server.localEndpoint().port(); }
+};
+
+// the io_context of the clients' transports
+struct PoolClients
+{
+    boost::asio::io_context                                                  ioContext;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    std::thread                                                              thread;
+
+    PoolClients() : work(ioContext.get_executor())
+    {
+        thread = std::thread([this]() { ioContext.run(); });
+    }
+
+    ~PoolClients()
+    {
+        work.reset();
+        ioContext.stop();
+        thread.join();
+    }
+
+    Pool::Connector connector(unsigned short port)
+    {
+        return [this, port]() {
+            auto transport = std::make_shared<Transport>(ioContext);
+            transport->connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+            return transport;
+        };
+    }
+};
+
+// a port nothing listens on
+static unsigned short ClosedPort()
+{
+    boost::asio::io_context ioContext;
+    tcp::acceptor           acceptor(ioContext, tcp::endpoint(tcp::v4(), 0));
+    return acceptor.local_endpoint().port();
+}
+
+// total calls, concurrency of them in flight at any time; every completion makes the next call
+static void ClosedLoop(Pool& pool, int total, int concurrency)
+{
+    std::promise<void>                                          done;
+    std::atomic<int>                                            started{0};
+    std::atomic<int>                                            completed{0};
+    std::function<void()>                                       next;
+    std::function<void(boost::system::error_code, Json::Value)> onCompletion;
+    next = [&]() {
+        if (started.fetch_add(1) < total) {
+            pool.asyncCall("which", Json::Value(), onCompletion);
+        }
+    };
+    onCompletion = [&](boost::system::error_code ec, Json::Value) {
+        EXPECT_FALSE(ec);
+        if (completed.fetch_add(1) + 1 == total) {
+            done.set_value();
+        } else {
+            next();
+        }
+    };
+    for (int c = 0; c < concurrency; c++) {
+        next();
+    }
+    done.get_future().wait();
+}
+
+// the stats of the endpoints once no call is outstanding on any (the losers of hedged calls are
+// answered, and dropped), waiting up to 5 s for it
+static std::vector<PoolEndpointStats> StatsWhenIdle(Pool& pool)
+{
+    const auto                     deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    std::vector<PoolEndpointStats> stats    = pool.stats();
+    auto                           busy     = [&stats]() {
+        for (const PoolEndpointStats& endpoint : stats) {
+            if (endpoint.outstanding > 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+    while (busy() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        stats = pool.stats();
+    }
+    return stats;
+}
+
+TEST(ClientPool, calls_are_spread_over_the_endpoints)
+{
+    for (PoolBalancing balancing : {PoolBalancing::LeastOutstanding, PoolBalancing::PowerOfTwoChoices}) {
+        std::vector<std::unique_ptr<PoolServer>> servers;
+        PoolClients                              clients;
+        std::vector<Pool::Connector>             connectors;
+        for (int s = 0; s < 3; s++) {
+            servers.emplace_back(new PoolServer(s, std::chrono::microseconds(0)));
+            connectors.push_back(clients.connector(servers.back()->port()));
+        }
+        PoolOptions options;
+        options.balancing = balancing;
+        Pool pool(connectors, options);
+
+        std::vector<std::future<Json::Value>> results;
+        for (int i = 0; i < 300; i++) {
+            results.push_back(pool.asyncCall("which", Json::Value(), boost::asio::use_future));
+        }
+        std::vector<int> answered(3, 0);
+        for (auto& result : results) {
+            answered[result.get().asInt()]++;
+        }
+        const std::vector<PoolEndpointStats> stats = pool.stats();
+        for (int s = 0; s < 3; s++) {
+            EXPECT_EQ(stats[s].calls, static_cast<std::uint64_t>(answered[s]));
+            EXPECT_GT(answered[s], 50) << static_cast<int>(balancing);
+            EXPECT_EQ(stats[s].connects, 1u);
+            EXPECT_EQ(stats[s].outstanding, 0u);
+            EXPECT_TRUE(stats[s].healthy);
+        }
+    }
+}
+
+TEST(ClientPool, slow_endpoints_get_fewer_calls)
+{
+    for (PoolBalancing balancing : {PoolBalancing::LeastOutstanding, PoolBalancing::PowerOfTwoChoices}) {
+        std::vector<std::unique_ptr<PoolServer>> servers;
+        PoolClients                              clients;
+        std::vector<Pool::Connector>             connectors;
+        for (int s = 0; s < 3; s++) {
+            // the last one takes 5 ms a call
+            servers.emplace_back(new PoolServer(s, std::chrono::microseconds(s == 2 ? 5000 : 0)));
+            connectors.push_back(clients.connector(servers.back()->port()));
+        }
+        PoolOptions options;
+        options.balancing = balancing;
+        Pool pool(connectors, options);
+
+        ClosedLoop(pool, 600, 6);
+        const std::vector<PoolEndpointStats> stats = pool.stats();
+        EXPECT_LT(stats[2].calls * 4, stats[0].calls) << static_cast<int>(balancing);
+        EXPECT_LT(stats[2].calls * 4, stats[1].calls) << static_cast<int>(balancing);
+        EXPECT_GT(stats[2].latencyEwmaUs, stats[0].latencyEwmaUs);
+        EXPECT_GT(stats[2].latencyEwmaUs, 4000);
+    }
+}
+
+TEST(ClientPool, warmup_connects_and_seeds_the_latencies)
+{
+    std::vector<std::unique_ptr<PoolServer>> servers;
+    PoolClients                              clients;
+    std::vector<Pool::Connector>             connectors;
+    for (int s = 0; s < 2; s++) {
+        servers.emplace_back(new PoolServer(s, std::chrono::microseconds(s == 1 ? 2000 : 0)));
+        connectors.push_back(clients.connector(servers.back()->port()));
+    }
+    PoolOptions options;
+    options.warmupCalls  = 3;
+    options.warmupMethod = "which";
+    Pool pool(connectors, options);
+
+    for (const PoolEndpointStats& stats : pool.stats()) {
+        EXPECT_EQ(stats.connects, 0u);
+        EXPECT_FALSE(stats.healthy);
+    }
+    pool.warmup();
+    const std::vector<PoolEndpointStats> stats = pool.stats();
+    for (int s = 0; s < 2; s++) {
+        EXPECT_EQ(stats[s].connects, 1u);
+        EXPECT_EQ(stats[s].calls, 3u);
+        EXPECT_TRUE(stats[s].healthy);
+        EXPECT_GT(stats[s].latencyEwmaUs, 0);
+    }
+    EXPECT_GT(stats[1].latencyEwmaUs, stats[0].latencyEwmaUs);
+
+    // with no calls in flight, the first call goes to the faster one
+    EXPECT_EQ(pool.asyncCall("which", Json::Value(), boost::asio::use_future).get().asInt(), 0);
+}
+
+TEST(ClientPool, failed_endpoints_are_skipped_and_retried)
+{
+    PoolClients                              clients;
+    std::vector<std::unique_ptr<PoolServer>> servers;
+    servers.emplace_back(new PoolServer(0, std::chrono::microseconds(0)));
+    servers.emplace_back(new PoolServer(1, std::chrono::microseconds(0)));
+    const unsigned short port = servers[1]->port();
+    PoolOptions          options;
+    options.retryAfter = std::chrono::milliseconds(100);
+    Pool pool({clients.connector(servers[0]->port()), clients.connector(port),
+               clients.connector(ClosedPort())},
+              options);
+
+    // the endpoint that can't be connected is skipped
+    for (int i = 0; i < 20; i++) {
+        EXPECT_NO_THROW(pool.asyncCall("which", Json::Value(), boost::asio::use_future).get());
+    }
+    std::vector<PoolEndpointStats> stats = pool.stats();
+    EXPECT_EQ(stats[2].connects, 0u);
+    EXPECT_EQ(stats[2].calls, 0u);
+    EXPECT_FALSE(stats[2].healthy);
+    EXPECT_GT(stats[1].calls, 0u);
+
+    // a lost connection fails the call made on it, and its endpoint is skipped from then on (two calls
+    // at a time: both endpoints are picked)
+    servers[1].reset();
+    int failed = 0;
+    for (int i = 0; i < 10; i++) {
+        auto first  = pool.asyncCall("which", Json::Value(), boost::asio::use_future);
+        auto second = pool.asyncCall("which", Json::Value(), boost::asio::use_future);
+        for (std::future<Json::Value>* result : {&first, &second}) {
+            try {
+                EXPECT_EQ(result->get().asInt(), 0);
+            } catch (const boost::system::system_error&) {
+                failed++;
+            }
+        }
+    }
+    EXPECT_EQ(failed, 1);
+    stats = pool.stats();
+    EXPECT_FALSE(stats[1].healthy);
+    EXPECT_EQ(stats[1].failures, 1u);
+
+    // back on the same port: connected again once retryAfter is over
+    servers[1].reset(new PoolServer(1, std::chrono::microseconds(0), port));
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    std::vector<std::future<Json::Value>> results;
+    for (int i = 0; i < 20; i++) {
+        results.push_back(pool.asyncCall("which", Json::Value(), boost::asio::use_future));
+    }
+    for (auto& result : results) {
+        EXPECT_NO_THROW(result.get());
+    }
+    stats = pool.stats();
+    EXPECT_TRUE(stats[1].healthy);
+    EXPECT_EQ(stats[1].connects, 2u);
+}
+
+// the two endpoints sampled include the one that can't be connected about half the time: the others
+// are scanned then
+TEST(ClientPool, power_of_two_choices_around_a_failed_endpoint)
+{
+    PoolClients                              clients;
+    std::vector<std::unique_ptr<PoolServer>> servers;
+    std::vector<Pool::Connector>             connectors;
+    for (int s = 0; s < 3; s++) {
+        servers.emplace_back(new PoolServer(s, std::chrono::microseconds(0)));
+        connectors.push_back(clients.connector(servers.back()->port()));
+    }
+    connectors.push_back(clients.connector(ClosedPort()));
+    PoolOptions options;
+    options.balancing = PoolBalancing::PowerOfTwoChoices;
+    Pool pool(connectors, options);
+
+    for (int i = 0; i < 100; i++) {
+        EXPECT_LE(pool.asyncCall("which", Json::Value(), boost::asio::use_future).get().asInt(), 2);
+    }
+    const std::vector<PoolEndpointStats> stats = pool.stats();
+    EXPECT_EQ(stats[3].calls, 0u);
+    EXPECT_EQ(stats[0].calls + stats[1].calls + stats[2].calls, 100u);
+}
+
+TEST(ClientPool, no_endpoint_to_call)
+{
+    PoolClients clients;
+    Pool        pool({clients.connector(ClosedPort()), clients.connector(ClosedPort())});
+    try {
+        pool.asyncCall("which", Json::Value(), boost::asio::use_future).get();
+        ADD_FAILURE();
+    } catch (const boost::system::system_error& error) {
+        EXPECT_EQ(error.code(), boost::asio::error::host_unreachable);
+    }
+    EXPECT_THROW(Pool(std::vector<Pool::Connector>()), std::runtime_error);
+}
+
+TEST(ClientPool, hedging_answers_the_calls_of_a_stalled_endpoint)
+{
+    // endpoint 0 stalls until the end of the test: only a hedge can answer a call sent to it
+    std::promise<void> open;
+    PoolClients        clients;
+    PoolServer         stalled(0, std::chrono::microseconds(0), 0, open.get_future().share());
+    PoolServer         fast(1, std::chrono::microseconds(0));
+    PoolOptions        options;
+    options.hedging.delay        = std::chrono::microseconds(1000);
+    options.hedging.maxExtraLoad = 1.0;
+    const std::vector<Pool::Connector> connectors = {clients.connector(stalled.port()),
+                                                     clients.connector(fast.port())};
+
+    // with nothing in flight and no latency known yet, the first call of a pool goes to the first
+    // endpoint: the stalled one; hedges only go to connected endpoints
+    Pool plainPool(connectors, options);
+    auto plain = plainPool.asyncCall("which", Json::Value(), boost::asio::use_future);
+    Pool pool(connectors, options);
+    pool.warmup();
+    for (int i = 0; i < 10; i++) {
+        auto result = pool.asyncHedgedCall("which", Json::Value(), boost::asio::use_future);
+        EXPECT_EQ(result.get().asInt(), 1);
+    }
+    // the calls that followed went to the other endpoint (and a late one of them may have been hedged
+    // too); without a hedge, the first call is still waiting
+    EXPECT_EQ(plain.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+    PoolHedgingStats stats = pool.hedgingStats();
+    EXPECT_EQ(stats.calls, 10u);
+    EXPECT_GE(stats.wins, 1u);
+    EXPECT_LE(stats.wins, stats.hedges);
+    EXPECT_EQ(stats.delayUs, 1000u);
+
+    open.set_value();
+    EXPECT_EQ(plain.get().asInt(), 0);
+    std::uint64_t calls = 0;
+    for (const PoolEndpointStats& endpoint : StatsWhenIdle(pool)) {
+        EXPECT_EQ(endpoint.outstanding, 0u);
+        calls += endpoint.calls;
+    }
+    stats = pool.hedgingStats();
+    EXPECT_EQ(calls, stats.calls + stats.hedges);
+}
+
+// a hedge is sent from the strand of the first attempt's transport: no connector is called there
+TEST(ClientPool, hedges_only_go_to_connected_endpoints)
+{
+    std::promise<void> open;
+    PoolClients        clients;
+    PoolServer         stalled(0, std::chrono::microseconds(0), 0, open.get_future().share());
+    PoolServer         fast(1, std::chrono::microseconds(0));
+    PoolOptions        options;
+    options.hedging.delay        = std::chrono::microseconds(1000);
+    options.hedging.maxExtraLoad = 1.0;
+    std::atomic<int>             connects{0};
+    const Pool::Connector        connector  = clients.connector(fast.port());
+    std::vector<Pool::Connector> connectors = {clients.connector(stalled.port()),
+                                               [&connects, connector]() {
+                                                   connects++;
+                                                   return connector();
+                                               }};
+    Pool                         pool(connectors, options);
+
+    auto result = pool.asyncHedgedCall("which", Json::Value(), boost::asio::use_future);
+    EXPECT_EQ(result.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+    EXPECT_EQ(connects.load(), 0);
+    EXPECT_EQ(pool.hedgingStats().hedges, 0u);
+
+    open.set_value();
+    EXPECT_EQ(result.get().asInt(), 0);
+}
+
+TEST(ClientPool, the_hedge_delay_is_a_quantile_once_known)
+{
+    PoolClients clients;
+    PoolServer  first(0, std::chrono::microseconds(100));
+    PoolServer  second(1, std::chrono::microseconds(100));
+    PoolOptions options;
+    options.hedging.minSamples = 32; // (the delay is computed again every 16 latencies)
+    Pool pool({clients.connector(first.port()), clients.connector(second.port())}, options);
+
+    for (int i = 0; i < 32; i++) {
+        EXPECT_EQ(pool.hedgingStats().delayUs, 0u);
+        pool.asyncHedgedCall("which", Json::Value(), boost::asio::use_future).get();
+    }
+    // no hedge before then; the delay is at least what the servers take
+    const PoolHedgingStats stats = pool.hedgingStats();
+    EXPECT_EQ(stats.hedges, 0u);
+    EXPECT_GE(stats.delayUs, 100u);
+}
+
+TEST(ClientPool, hedges_are_within_the_budget)
+{
+    for (double maxExtraLoad : {0.0, 0.1}) {
+        PoolClients                              clients;
+        std::vector<std::unique_ptr<PoolServer>> servers;
+        std::vector<Pool::Connector>             connectors;
+        for (int s = 0; s < 2; s++) {
+            servers.emplace_back(new PoolServer(s, std::chrono::microseconds(3000)));
+            connectors.push_back(clients.connector(servers.back()->port()));
+        }
+        // every call is late for the hedge
+        PoolOptions options;
+        options.hedging.delay        = std::chrono::microseconds(500);
+        options.hedging.maxExtraLoad = maxExtraLoad;
+        options.hedging.maxBurst     = 1;
+        Pool pool(connectors, options);
+
+        for (int i = 0; i < 100; i++) {
+            auto result = pool.asyncHedgedCall("which", Json::Value(), boost::asio::use_future);
+            EXPECT_LE(result.get().asInt(), 1);
+        }
+        const PoolHedgingStats stats = pool.hedgingStats();
+        EXPECT_EQ(stats.calls, 100u);
+        EXPECT_EQ(stats.delayUs, 500u);
+        EXPECT_LE(stats.hedges, static_cast<std::uint64_t>(100 * maxExtraLoad));
+        EXPECT_GE(stats.hedges + 1, static_cast<std::uint64_t>(100 * maxExtraLoad));
+
+        std::uint64_t calls = 0;
+        for (const PoolEndpointStats& endpoint : StatsWhenIdle(pool)) {
+            EXPECT_EQ(endpoint.outstanding, 0u);
+            calls += endpoint.calls;
+        }
+        EXPECT_EQ(calls, stats.calls + stats.hedges);
+    }
+}
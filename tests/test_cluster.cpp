@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPCCluster.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+TEST(AsyncJsonRPCCluster, same_key_same_shard_in_order)
+{
+    AsyncJsonRPCCluster<int>::Options options;
+    options.shardCount = 4;
+    AsyncJsonRPCCluster<int> cluster([](const int& connectionId) { return std::size_t(connectionId); },
+                                     options);
+
+    std::mutex                               seenMutex;
+    std::map<int, std::vector<int>>          seenPerKey;
+    std::map<int, std::set<std::thread::id>> threadsPerKey;
+
+    cluster.addHandler(
+        [&](const Json::Value& request, Json::Value& response, int connectionId) {
+            std::lock_guard<std::mutex> lg(seenMutex);
+            seenPerKey[connectionId].push_back(request["seq"].asInt());
+            threadsPerKey[connectionId].insert(std::this_thread::get_id());
+            response = Json::Value(true);
+        },
+        "testmethod1", {{"seq", Json::ValueType::intValue}});
+
+    std::atomic<int> responseCount{0};
+    cluster.setResponseCallback([&responseCount](std::string&&) { responseCount++; });
+
+    const int keyCount    = 10;
+    const int callsPerKey = 50;
+    for (int i = 0; i < callsPerKey; i++) {
+        for (int key = 0; key < keyCount; key++) {
+            cluster.asyncPost(R"({"jsonrpc": "2.0", "method": "testmethod1", "params": {"seq": )" +
+                                  std::to_string(i) + R"(}, "id": 1})",
+                              key);
+        }
+    }
+    cluster.join();
+
+    EXPECT_EQ(responseCount.load(), keyCount * callsPerKey);
+    for (int key = 0; key < keyCount; key++) {
+        EXPECT_EQ(threadsPerKey[key].size(), 1u);
+        ASSERT_EQ(seenPerKey[key].size(), static_cast<std::size_t>(callsPerKey));
+        for (int i = 0; i < callsPerKey; i++) {
+            EXPECT_EQ(seenPerKey[key][i], i);
+        }
+    }
+
+    std::uint64_t totalCompleted = 0;
+    auto          stats          = cluster.shardStats();
+    ASSERT_EQ(stats.size(), 4u);
+    for (std::size_t i = 0; i < stats.size(); i++) {
+        EXPECT_EQ(stats[i].posted, stats[i].completed);
+        totalCompleted += stats[i].completed;
+    }
+    EXPECT_EQ(totalCompleted, static_cast<std::uint64_t>(keyCount * callsPerKey));
+}
+
+TEST(AsyncJsonRPCCluster, method_table_frozen_after_first_call)
+{
+    AsyncJsonRPCCluster<int>::Options options;
+    options.shardCount = 2;
+    AsyncJsonRPCCluster<int> cluster([](const int& key) { return std::size_t(key); }, options);
+
+    EXPECT_NO_THROW(cluster.addHandler(
+        [](const Json::Value& /*request*/, Json::Value& /*response*/, int) {}, "testmethod1"));
+    EXPECT_TRUE(cluster.handlerExists("testmethod1"));
+    EXPECT_EQ(cluster.handlerCount(), 1u);
+
+    cluster.asyncPost(R"({"jsonrpc": "2.0", "method": "testmethod1", "id": 1})", 7);
+
+    EXPECT_ANY_THROW(cluster.addHandler(
+        [](const Json::Value& /*request*/, Json::Value& /*response*/, int) {}, "testmethod2"));
+    EXPECT_ANY_THROW(cluster.removeHandler("testmethod1"));
+    cluster.join();
+}
+
+TEST(AsyncJsonRPCCluster, destroyed_while_busy)
+{
+    std::atomic<int> responseCount{0};
+    {
+        AsyncJsonRPCCluster<int>::Options options;
+        options.shardCount = 4;
+        AsyncJsonRPCCluster<int> cluster([](const int& key) { return std::size_t(key); }, options);
+        cluster.addHandler(
+            [](const Json::Value&, Json::Value& response, int) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                response = Json::Value(true);
+            },
+            "slow");
+        cluster.setResponseCallback([&responseCount](std::string&&) { responseCount++; });
+
+        for (int i = 0; i < 4000; i++) {
+            cluster.asyncPost(R"({"jsonrpc": "2.0", "method": "slow", "id": 1})", i);
+        }
+        // no join(): the shards are still running calls, with more queued
+        while (responseCount.load() == 0) {
+            std::this_thread::yield();
+        }
+    }
+    // no call runs once the cluster is gone
+    const int afterDestruction = responseCount.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(responseCount.load(), afterDestruction);
+    EXPECT_LT(afterDestruction, 4000);
+}
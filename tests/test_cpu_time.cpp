@@ -0,0 +1,130 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/CpuTimeAccounting.h"
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <boost/asio/io_context.hpp>
+
+using TenantRpc = AsyncJsonRPC<boost::asio::io_context::executor_type, int>;
+
+static const std::uint64_t Millisecond = 1000000;
+
+static void AddHandlers(TenantRpc& rpc)
+{
+    // burns cpu for 5 ms
+    rpc.addHandler(
+        [](const Json::Value&, Json::Value& response, int) {
+            const std::uint64_t start = ThreadCpuNow();
+            std::uint64_t       spins = 0;
+            while (ThreadCpuNow() - start < 5 * Millisecond) {
+                spins++;
+            }
+            response = Json::UInt64(spins);
+        },
+        "spin");
+    // waits 5 ms without using the cpu
+    rpc.addHandler(
+        [](const Json::Value&, Json::Value& response, int) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            response = true;
+        },
+        "sleep");
+    rpc.setResponseCallback([](std::string&&) {});
+}
+
+static std::string Call(const std::string& method)
+{
+    return R"({"jsonrpc": "2.0", "method": ")" + method + R"(", "id": 1})";
+}
+
+TEST(CpuTimeAccounting, separates_cpu_from_wall_time)
+{
+    boost::asio::io_context executionContext;
+    TenantRpc               rpc(executionContext.get_executor());
+    AddHandlers(rpc);
+    rpc.enableCpuTimeAccounting(CpuTimeAccountingOptions(),
+                                [](int tenant) { return static_cast<std::uint64_t>(tenant); });
+
+    for (int i = 0; i < 2; i++) {
+        rpc.post(Call("spin"), 1);
+        rpc.post(Call("sleep"), 2);
+    }
+    rpc.post("[" + Call("spin") + ", " + Call("sleep") + "]", 2);
+
+    const CpuTimeSnapshot snapshot = rpc.cpuTimeSnapshot();
+    ASSERT_EQ(snapshot.methods.count("spin"), 1u);
+    ASSERT_EQ(snapshot.methods.count("sleep"), 1u);
+    EXPECT_EQ(snapshot.methods.at("spin").count, 3u);
+    EXPECT_GE(snapshot.methods.at("spin").cpuNs, 3 * 5 * Millisecond);
+    EXPECT_EQ(snapshot.methods.at("sleep").count, 3u);
+    EXPECT_LT(snapshot.methods.at("sleep").cpuNs, 3 * Millisecond);
+
+    EXPECT_EQ(snapshot.parse.count, 5u);
+    EXPECT_EQ(snapshot.serialize.count, 5u);
+    EXPECT_GT(snapshot.parse.cpuNs, 0u);
+
+    // tenant 2 made the batch, so it owns one of the spins
+    ASSERT_EQ(snapshot.contextKeys.size(), 2u);
+    EXPECT_EQ(snapshot.contextKeys.at(1).count, 2u);
+    EXPECT_EQ(snapshot.contextKeys.at(2).count, 3u);
+    EXPECT_GE(snapshot.contextKeys.at(1).cpuNs, 2 * 5 * Millisecond);
+    EXPECT_GE(snapshot.contextKeys.at(2).cpuNs, 5 * Millisecond);
+    EXPECT_LT(snapshot.contextKeys.at(2).cpuNs, snapshot.contextKeys.at(1).cpuNs);
+
+    const Json::Value json = snapshot.toJsonValue();
+    EXPECT_EQ(json["methods"]["spin"]["count"].asUInt64(), 3u);
+    EXPECT_EQ(json["contextKeys"]["2"]["count"].asUInt64(), 3u);
+}
+
+TEST(CpuTimeAccounting, sampling_scales_the_counts)
+{
+    boost::asio::io_context executionContext;
+    TenantRpc               rpc(executionContext.get_executor());
+    AddHandlers(rpc);
+    rpc.addHandler([](const Json::Value&, Json::Value& response, int) { response = 1; }, "fast");
+
+    CpuTimeAccountingOptions options;
+    options.sampleInterval = 4;
+    options.maxContextKeys = 2;
+    rpc.enableCpuTimeAccounting(options, [](int tenant) { return static_cast<std::uint64_t>(tenant); });
+
+    // the 1st, 5th and 9th request of the thread are measured
+    for (int tenant = 0; tenant < 8; tenant++) {
+        rpc.post(Call("fast"), tenant);
+    }
+    rpc.post(Call("spin"), 0);
+
+    const CpuTimeSnapshot snapshot = rpc.cpuTimeSnapshot();
+    EXPECT_EQ(snapshot.methods.at("fast").count, 8u);
+    EXPECT_EQ(snapshot.methods.at("spin").count, 4u);
+    EXPECT_GE(snapshot.methods.at("spin").cpuNs, 4 * 5 * Millisecond);
+    EXPECT_EQ(snapshot.parse.count, 12u);
+
+    EXPECT_EQ(snapshot.contextKeys.size(), 2u);
+    EXPECT_EQ(snapshot.contextKeys.at(0).count, 8u);
+    EXPECT_EQ(snapshot.contextKeys.at(4).count, 4u);
+
+    // the 13th is measured, and its key is one too many
+    rpc.post(Call("fast"), 1);
+    rpc.post(Call("fast"), 1);
+    rpc.post(Call("fast"), 1);
+    rpc.post(Call("fast"), 9);
+    const std::uint64_t other = CpuTimeSnapshot::OtherContextKeys; // not odr-used, no definition needed
+    EXPECT_EQ(rpc.cpuTimeSnapshot().contextKeys.at(other).count, 4u);
+}
+
+TEST(CpuTimeAccounting, disabled_by_default)
+{
+    boost::asio::io_context executionContext;
+    TenantRpc               rpc(executionContext.get_executor());
+    AddHandlers(rpc);
+    rpc.post(Call("sleep"), 1);
+
+    const CpuTimeSnapshot snapshot = rpc.cpuTimeSnapshot();
+    EXPECT_TRUE(snapshot.methods.empty());
+    EXPECT_TRUE(snapshot.contextKeys.empty());
+    EXPECT_EQ(snapshot.parse.count, 0u);
+}
@@ -3,8 +3,13 @@
 #include "include/asyncjsonrpc/AsyncJsonRPC.h"
 #include <atomic>
 #include <future>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include <boost/asio/executor_work_guard.hpp>
 #include <boost/asio/io_context.hpp>
 
 std::string GenerateRandomString__test(const int len)
@@ -133,7 +138,10 @@ TEST(AsyncJsonRPC, async_many_single_rpc_calls_successful)
     std::atomic<unsigned> currCount{0};
     currCount.store(0); // ensure atomicity as constructor is not atomic
 
-    rpc.setResponseCallback([&promise, &currCount](std::string&& res) {
+    // keeps run() from returning before the detached threads below got to post their calls
+    auto work = boost::asio::make_work_guard(executionContext);
+
+    rpc.setResponseCallback([&promise, &currCount, &work](std::string&& res) {
         Json::Reader reader;
         Json::Value  val;
         reader.parse(res, val);
@@ -143,6 +151,7 @@ TEST(AsyncJsonRPC, async_many_single_rpc_calls_successful)
 
         if (currCount >= postCount) {
             promise.set_value();
+            work.reset();
         }
     });
 
@@ -161,6 +170,140 @@ TEST(AsyncJsonRPC, async_many_single_rpc_calls_successful)
     future.get();
 }
 
+TEST(AsyncJsonRPC, async_ordered_rpc_calls_keep_per_key_order)
+{
+    boost::asio::io_context                                   executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type, int> rpc(executionContext.get_executor());
+
+    const int keyCount      = 8;
+    const int callsPerKey   = 100;
+    const int totalRequests = keyCount * callsPerKey;
+
+    std::mutex                      seenMutex;
+    std::map<int, std::vector<int>> seenPerKey;
+
+    rpc.addHandler(
+        [&](const Json::Value& request, Json::Value& response, int connectionId) {
+            // random delay to give other threads a chance to overtake, if ordering were broken
+            std::this_thread::sleep_for(std::chrono::microseconds(rand() % 50));
+            std::lock_guard<std::mutex> lg(seenMutex);
+            seenPerKey[connectionId].push_back(request["seq"].asInt());
+            response = Json::Value(true);
+        },
+        "testmethod1", {{"seq", Json::ValueType::intValue}});
+
+    std::atomic<int> responseCount{0};
+    rpc.setResponseCallback([&responseCount](std::string&&) { responseCount++; });
+
+    for (int i = 0; i < callsPerKey; i++) {
+        for (int key = 0; key < keyCount; key++) {
+            rpc.asyncPostOrdered(key,
+                                 R"({"jsonrpc": "2.0", "method": "testmethod1", "params": {"seq": )" +
+                                     std::to_string(i) + R"(}, "id": 1})",
+                                 key);
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&executionContext]() { executionContext.run(); });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(responseCount.load(), totalRequests);
+    ASSERT_EQ(seenPerKey.size(), static_cast<std::size_t>(keyCount));
+    for (const auto& p : seenPerKey) {
+        ASSERT_EQ(p.second.size(), static_cast<std::size_t>(callsPerKey));
+        for (int i = 0; i < callsPerKey; i++) {
+            EXPECT_EQ(p.second[i], i);
+        }
+    }
+
+    // queues are released once drained
+    EXPECT_EQ(rpc.activeOrderingKeyCount(), 0u);
+}
+
+TEST(AsyncJsonRPC, async_batched_submissions)
+{
+    boost::asio::io_context                                           executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type, std::string> rpc(
+        executionContext.get_executor());
+
+    SubmissionBatchingOptions options;
+    options.maxBatchSize = 1000;
+    rpc.enableSubmissionBatching(options);
+
+    std::vector<int> seen;
+    rpc.addHandler(
+        [&seen](const Json::Value& request, Json::Value& response, std::string str) {
+            EXPECT_EQ(str, "TheString");
+            seen.push_back(request["seq"].asInt());
+            response = Json::Value(true);
+        },
+        "testmethod1", {{"seq", Json::ValueType::intValue}});
+
+    int responseCount = 0;
+    rpc.setResponseCallback([&responseCount](std::string&&) { responseCount++; });
+
+    // nothing runs until run(), so all the calls pile up behind the single drain posted by the first
+    const int postCount = 200;
+    for (int i = 0; i < postCount; i++) {
+        rpc.asyncPost(R"({"jsonrpc": "2.0", "method": "testmethod1", "params": {"seq": )" +
+                          std::to_string(i) + R"(}, "id": 1})",
+                      "TheString");
+    }
+    executionContext.run();
+
+    EXPECT_EQ(responseCount, postCount);
+    ASSERT_EQ(seen.size(), static_cast<std::size_t>(postCount));
+    for (int i = 0; i < postCount; i++) {
+        EXPECT_EQ(seen[i], i);
+    }
+
+    SubmissionBatchingStats stats = rpc.submissionBatchingStats();
+    EXPECT_EQ(stats.submitted, static_cast<std::uint64_t>(postCount));
+    EXPECT_EQ(stats.drainsStartedOnIdle, 1u);
+    EXPECT_EQ(stats.batches, 1u);
+    EXPECT_EQ(stats.largestBatch, static_cast<std::uint64_t>(postCount));
+    EXPECT_EQ(stats.batchSizes[7], 1u); // 128 <= 200 < 256
+}
+
+TEST(AsyncJsonRPC, async_batched_submissions_threshold_starts_more_drains)
+{
+    boost::asio::io_context                                   executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type, int> rpc(executionContext.get_executor());
+
+    SubmissionBatchingOptions options;
+    options.maxBatchSize        = 10;
+    options.maxConcurrentDrains = 4;
+    rpc.enableSubmissionBatching(options);
+
+    rpc.addHandler([](const Json::Value& /*request*/, Json::Value& response, int) { response = 1; },
+                   "testmethod1");
+
+    std::atomic<int> responseCount{0};
+    rpc.setResponseCallback([&responseCount](std::string&&) { responseCount++; });
+
+    const int postCount = 100;
+    for (int i = 0; i < postCount; i++) {
+        rpc.asyncPost(R"({"jsonrpc": "2.0", "method": "testmethod1", "id": 1})", i);
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&executionContext]() { executionContext.run(); });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(responseCount.load(), postCount);
+    SubmissionBatchingStats stats = rpc.submissionBatchingStats();
+    EXPECT_EQ(stats.drainsStartedOnIdle, 1u);
+    EXPECT_EQ(stats.drainsStartedOnThreshold, 3u);
+}
+
 TEST(AsyncJsonRPC, single_rpc_calls_wrong_parameter_type)
 {
     boost::asio::io_context                                           executionContext;
@@ -189,6 +332,35 @@ TEST(AsyncJsonRPC, single_rpc_calls_wrong_parameter_type)
              "TheString");
 }
 
+TEST(AsyncJsonRPC, single_rpc_calls_by_position)
+{
+    boost::asio::io_context                              executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type> rpc(executionContext.get_executor());
+
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response) {
+            response = request[0].asInt() - request[1].asInt();
+        },
+        "subtract", std::vector<Json::ValueType>{Json::ValueType::intValue, Json::ValueType::intValue});
+
+    Json::Value lastResponse;
+    rpc.setResponseCallback([&lastResponse](std::string&& res) {
+        Json::Reader reader;
+        reader.parse(res, lastResponse);
+    });
+
+    rpc.post(R"({"jsonrpc": "2.0", "method": "subtract", "params": [42, 23], "id": 4})");
+    EXPECT_EQ(lastResponse["result"].asInt(), 19);
+
+    // wrong type in the second position
+    rpc.post(R"({"jsonrpc": "2.0", "method": "subtract", "params": [42, "23"], "id": 5})");
+    EXPECT_EQ(lastResponse["error"]["code"].asInt(), -32602);
+
+    // named parameters for a method declared by position
+    rpc.post(R"({"jsonrpc": "2.0", "method": "subtract", "params": {"a": 42, "b": 23}, "id": 6})");
+    EXPECT_EQ(lastResponse["error"]["code"].asInt(), -32602);
+}
+
 TEST(AsyncJsonRPC, single_rpc_calls_one_less_parameter)
 {
     boost::asio::io_context                                           executionContext;
@@ -0,0 +1,181 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCHttpServer.h"
+#include <atomic>
+#include <future>
+#include <string>
+#include <thread>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/string_body.hpp>
+
+using Rpc        = AsyncJsonRPC<boost::asio::io_context::executor_type, int>;
+using HttpServer = AsyncJsonRPCHttpServer<Rpc>;
+using tcp        = boost::asio::ip::tcp;
+namespace http   = boost::beast::http;
+
+// an rpc and its http server, on a thread of their own
+struct HttpFixture
+{
+    boost::asio::io_context ioContext;
+    Rpc                     rpc;
+    std::atomic<int>        connections{0};
+    HttpServer              server;
+    std::thread             thread;
+
+    explicit HttpFixture(const HttpServerOptions& options = HttpServerOptions())
+        : rpc(ioContext.get_executor()),
+          server(rpc, ioContext, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+                 [this](const tcp::endpoint&) { return std::make_tuple(++connections); }, options)
+    {
+        rpc.addHandler(
+            [](const Json::Value& request, Json::Value& response, int connection) {
+                response = request["x"].asInt() * 1000 + connection;
+            },
+            "tag", {{"x", Json::ValueType::intValue}});
+        server.start();
+        thread = std::thread([this]() { ioContext.run(); });
+    }
+
+    ~HttpFixture()
+    {
+        server.stop();
+        thread.join();
+    }
+};
+
+struct HttpClient
+{
+    boost::asio::io_context   ioContext;
+    tcp::socket               socket{ioContext};
+    boost::beast::flat_buffer buffer;
+
+    explicit HttpClient(const tcp::endpoint& server) { socket.connect(server); }
+
+    void send(const std::string& text) { boost::asio::write(socket, boost::asio::buffer(text)); }
+
+    http::response<http::string_body> receive()
+    {
+        http::response<http::string_body> response;
+        http::read(socket, buffer, response);
+        return response;
+    }
+
+    bool closedByServer()
+    {
+        char                      byte;
+        boost::system::error_code ec;
+        socket.read_some(boost::asio::buffer(&byte, 1), ec);
+        return ec == boost::asio::error::eof;
+    }
+};
+
+static std::string Request(int x, const std::string& extraHeaders = "", const std::string& target = "/")
+{
+    const std::string body =
+        R"({"jsonrpc": "2.0", "method": "tag", "params": {"x": )" + std::to_string(x) + R"(}, "id": 1})";
+    return "POST " + target + " HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\n" +
+           extraHeaders + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+static int Result(const http::response<http::string_body>& response)
+{
+    Json::Value  value;
+    Json::Reader reader;
+    EXPECT_TRUE(reader.parse(response.body(), value)) << response.body();
+    return value["result"].asInt();
+}
+
+TEST(HttpServer, keep_alive_and_pipelining_in_order)
+{
+    HttpFixture fixture;
+    HttpClient  client(fixture.server.localEndpoint());
+
+    client.send(Request(1));
+    http::response<http::string_body> first = client.receive();
+    EXPECT_EQ(first.result(), http::status::ok);
+    EXPECT_EQ(first[http::field::content_type], "application/json");
+    EXPECT_TRUE(first.keep_alive());
+    EXPECT_EQ(Result(first), 1001);
+
+    // 50 requests in one write, without waiting for responses
+    std::string pipelined;
+    for (int i = 2; i <= 51; i++) {
+        pipelined += Request(i);
+    }
+    client.send(pipelined);
+    for (int i = 2; i <= 51; i++) {
+        EXPECT_EQ(Result(client.receive()), i * 1000 + 1);
+    }
+
+    const HttpServerStats stats = fixture.server.stats();
+    EXPECT_EQ(stats.accepted, 1u);
+    EXPECT_EQ(stats.requests, 51u);
+    EXPECT_LE(stats.writes, stats.requests);
+}
+
+TEST(HttpServer, context_per_connection)
+{
+    HttpFixture fixture;
+    HttpClient  a(fixture.server.localEndpoint());
+    a.send(Request(1));
+    EXPECT_EQ(Result(a.receive()), 1001);
+
+    HttpClient b(fixture.server.localEndpoint());
+    b.send(Request(2));
+    EXPECT_EQ(Result(b.receive()), 2002);
+
+    a.send(Request(3));
+    EXPECT_EQ(Result(a.receive()), 3001);
+}
+
+TEST(HttpServer, errors_and_connection_close)
+{
+    HttpServerOptions options;
+    options.target      = "/rpc";
+    options.maxBodySize = 100;
+    HttpFixture fixture(options);
+
+    HttpClient client(fixture.server.localEndpoint());
+    client.send(Request(1, "", "/other"));
+    EXPECT_EQ(client.receive().result(), http::status::not_found);
+    client.send("GET /rpc HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    EXPECT_EQ(client.receive().result(), http::status::method_not_allowed);
+
+    // the last request of the connection
+    client.send(Request(2, "Connection: close\r\n", "/rpc"));
+    http::response<http::string_body> last = client.receive();
+    EXPECT_EQ(Result(last), 2001);
+    EXPECT_FALSE(last.keep_alive());
+    EXPECT_TRUE(client.closedByServer());
+
+    HttpClient large(fixture.server.localEndpoint());
+    large.send("POST /rpc HTTP/1.1\r\nHost: localhost\r\nContent-Length: 1000\r\n\r\n" +
+               std::string(1000, ' '));
+    EXPECT_EQ(large.receive().result(), http::status::payload_too_large);
+    EXPECT_TRUE(large.closedByServer());
+
+    HttpClient malformed(fixture.server.localEndpoint());
+    malformed.send("NOT HTTP\r\n\r\n");
+    EXPECT_EQ(malformed.receive().result(), http::status::bad_request);
+}
+
+// asyncPost() on the rpc: its response isn't a connection's
+TEST(HttpServer, other_responses_go_to_the_fallback)
+{
+    std::promise<std::string> fallback;
+    HttpServerOptions         options;
+    options.responseFallback = [&fallback](std::string&& response) { fallback.set_value(response); };
+    HttpFixture fixture(options);
+
+    fixture.rpc.asyncPost(R"({"jsonrpc": "2.0", "method": "tag", "params": {"x": 7}, "id": 1})", 0);
+    EXPECT_NE(fallback.get_future().get().find("\"result\":7000"), std::string::npos);
+
+    HttpClient client(fixture.server.localEndpoint());
+    client.send(Request(1));
+    EXPECT_EQ(Result(client.receive()), 1001);
+}
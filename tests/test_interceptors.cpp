@@ -0,0 +1,171 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/Interceptors.h"
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+// records the hooks it sees, as "hook:detail"
+struct RecordingInterceptor : public RpcInterceptor
+{
+    std::vector<std::string>* log = nullptr;
+
+    void onReceive(const std::string&, const std::string& user) { log->push_back("receive:" + user); }
+
+    void afterParse(const Json::Value& root, const std::string&)
+    {
+        log->push_back(std::string("parse:") + (root.isArray() ? "batch" : "single"));
+    }
+
+    void beforeInvoke(const std::string& methodName, const Json::Value&, std::string&)
+    {
+        log->push_back("before:" + methodName);
+    }
+
+    void afterInvoke(const std::string& methodName, const Json::Value&, const std::exception* error,
+                     const std::string&)
+    {
+        log->push_back("after:" + methodName + (error ? ":" + std::string(error->what()) : ""));
+    }
+
+    void beforeSerialize(Json::Value&, const std::string&) { log->push_back("serialize"); }
+
+    void onSend(std::string&, const std::string&) { log->push_back("send"); }
+};
+
+// rejects calls from anonymous users and rewrites the user name the handler gets
+struct AuthInterceptor : public RpcInterceptor
+{
+    void beforeInvoke(const std::string&, const Json::Value&, std::string& user)
+    {
+        if (user.empty()) {
+            throw JsonErrorCode::make_ServerError(-32001);
+        }
+        user = "authenticated:" + user;
+    }
+};
+
+// only hides one hook; the others are the no-ops of RpcInterceptor
+struct TaggingInterceptor : public RpcInterceptor
+{
+    template <typename... Ctx>
+    void beforeSerialize(Json::Value& response, const Ctx&...)
+    {
+        if (response.isObject()) {
+            response["tag"] = "tagged";
+        }
+    }
+};
+
+using InterceptedRpc =
+    AsyncJsonRPC<boost::asio::io_context::executor_type,
+                 Interceptors<AuthInterceptor, RecordingInterceptor, TaggingInterceptor>, std::string>;
+
+TEST(Interceptors, hooks_run_in_order_around_calls)
+{
+    boost::asio::io_context executionContext;
+    InterceptedRpc          rpc(executionContext.get_executor());
+
+    std::vector<std::string> log;
+    rpc.interceptors().get<RecordingInterceptor>().log = &log;
+
+    std::vector<std::string> users;
+    rpc.addHandler(
+        [&users](const Json::Value&, Json::Value& response, std::string user) {
+            users.push_back(user);
+            response = 1;
+        },
+        "ok");
+    rpc.addHandler(
+        [](const Json::Value&, Json::Value&, std::string) { throw std::runtime_error("boom"); },
+        "fails");
+
+    std::vector<Json::Value> responses;
+    rpc.setResponseCallback([&responses](std::string&& res) {
+        Json::Reader reader;
+        Json::Value  val;
+        reader.parse(res, val);
+        responses.push_back(val);
+    });
+
+    rpc.post(R"({"jsonrpc": "2.0", "method": "ok", "id": 1})", "alice");
+    ASSERT_EQ(responses.size(), 1u);
+    EXPECT_EQ(responses.back()["result"].asInt(), 1);
+    EXPECT_EQ(responses.back()["tag"].asString(), "tagged");
+    ASSERT_EQ(users.size(), 1u);
+    EXPECT_EQ(users.back(), "authenticated:alice");
+    EXPECT_EQ(log, (std::vector<std::string>{"receive:alice", "parse:single", "before:ok", "after:ok",
+                                             "serialize", "send"}));
+
+    log.clear();
+    rpc.post(R"({"jsonrpc": "2.0", "method": "fails", "id": 2})", "bob");
+    EXPECT_EQ(responses.back()["error"]["code"].asInt(), -32603);
+    EXPECT_EQ(log, (std::vector<std::string>{"receive:bob", "parse:single", "before:fails",
+                                             "after:fails:boom", "serialize", "send"}));
+
+    // rejected by the first interceptor: the others never see the call
+    log.clear();
+    rpc.post(R"({"jsonrpc": "2.0", "method": "ok", "id": 3})", "");
+    EXPECT_EQ(responses.back()["error"]["code"].asInt(), -32001);
+    EXPECT_EQ(users.size(), 1u);
+    EXPECT_EQ(log, (std::vector<std::string>{"receive:", "parse:single", "serialize", "send"}));
+
+    // the context of every call of a batch starts from the original
+    log.clear();
+    rpc.post(R"([{"jsonrpc": "2.0", "method": "ok", "id": 4},
+                 {"jsonrpc": "2.0", "method": "ok", "id": 5}])",
+             "carol");
+    ASSERT_EQ(users.size(), 3u);
+    EXPECT_EQ(users[1], "authenticated:carol");
+    EXPECT_EQ(users[2], "authenticated:carol");
+    EXPECT_EQ(log, (std::vector<std::string>{"receive:carol", "parse:batch", "before:ok", "after:ok",
+                                             "before:ok", "after:ok", "serialize", "send"}));
+
+    log.clear();
+    rpc.post("not json", "dave");
+    EXPECT_EQ(responses.back()["error"]["code"].asInt(), -32700);
+    EXPECT_EQ(log, (std::vector<std::string>{"receive:dave", "serialize", "send"}));
+}
+
+TEST(Interceptors, chain_can_be_constructed_with_state)
+{
+    std::vector<std::string> log;
+    RecordingInterceptor     recorder;
+    recorder.log = &log;
+
+    boost::asio::io_context executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type, Interceptors<RecordingInterceptor>, std::string>
+        rpc(executionContext.get_executor(), Interceptors<RecordingInterceptor>(recorder));
+
+    rpc.addHandler([](const Json::Value&, Json::Value&, std::string) {}, "noop");
+    rpc.asyncPost(R"({"jsonrpc": "2.0", "method": "noop", "id": 1})", "erin");
+    executionContext.run();
+
+    EXPECT_EQ(log, (std::vector<std::string>{"receive:erin", "parse:single", "before:noop",
+                                             "after:noop", "serialize", "send"}));
+}
+
+TEST(Interceptors, request_posted_from_raw_memory)
+{
+    std::vector<std::string> log;
+    RecordingInterceptor     recorder;
+    recorder.log = &log;
+
+    boost::asio::io_context executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type, Interceptors<RecordingInterceptor>, std::string>
+        rpc(executionContext.get_executor(), Interceptors<RecordingInterceptor>(recorder));
+
+    std::string response;
+    rpc.setResponseCallback([&response](std::string&& res) { response = std::move(res); });
+    rpc.addHandler([](const Json::Value&, Json::Value& result, std::string) { result = 7; }, "seven");
+
+    // only the first call of the buffer is posted
+    const std::string buffer = R"({"jsonrpc": "2.0", "method": "seven", "id": 1}{"unrelated": 1})";
+    rpc.post(buffer.data(), buffer.find('}') + 1, "frank");
+
+    EXPECT_EQ(response, "{\"id\":1,\"jsonrpc\":\"2.0\",\"result\":7}\n");
+    EXPECT_EQ(log, (std::vector<std::string>{"receive:frank", "parse:single", "before:seven",
+                                             "after:seven", "serialize", "send"}));
+}
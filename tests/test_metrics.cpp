@@ -0,0 +1,149 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/RpcMetrics.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+TEST(LatencyHistogram, buckets_and_percentiles)
+{
+    // small values are exact, larger ones are bucketed within 12.5%
+    for (std::uint64_t v = 0; v < 8; v++) {
+        EXPECT_EQ(LatencyHistogram::bucketUpperBound(LatencyHistogram::bucketIndex(v)), v);
+    }
+    for (std::uint64_t v : {9ull, 100ull, 12345ull, 1000000007ull, ~0ull}) {
+        const std::uint64_t upper = LatencyHistogram::bucketUpperBound(LatencyHistogram::bucketIndex(v));
+        EXPECT_GE(upper, v);
+        EXPECT_LE(upper - v, v / 8);
+    }
+    // a copy: BucketCount is not odr-used, so it needs no out-of-line definition in C++14
+    EXPECT_LT(LatencyHistogram::bucketIndex(~0ull), std::size_t(LatencyHistogram::BucketCount));
+
+    LatencyHistogram h;
+    EXPECT_EQ(h.percentile(0.5), 0u);
+    for (std::uint64_t v = 1; v <= 1000; v++) {
+        h.record(v);
+    }
+    EXPECT_EQ(h.count(), 1000u);
+    EXPECT_EQ(h.maxValue(), 1000u);
+    EXPECT_EQ(h.sumOfValues(), 500500u);
+    EXPECT_NEAR(static_cast<double>(h.percentile(0.5)), 500, 500 / 8);
+    EXPECT_NEAR(static_cast<double>(h.percentile(0.99)), 990, 990 / 8);
+    EXPECT_EQ(h.percentile(1), 1000u);
+    EXPECT_EQ(h.countAtOrBelow(7), 7u);
+
+    LatencyHistogram other;
+    other.record(5000);
+    h.merge(other);
+    EXPECT_EQ(h.count(), 1001u);
+    EXPECT_EQ(h.maxValue(), 5000u);
+}
+
+TEST(RpcMetrics, counts_calls_errors_and_sizes)
+{
+    boost::asio::io_context                              executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type> rpc(executionContext.get_executor());
+
+    rpc.addHandler([](const Json::Value& request, Json::Value& response) { response = request["p1"]; },
+                   "echo", {{"p1", Json::ValueType::intValue}});
+    rpc.addHandler([](const Json::Value&, Json::Value&) { throw std::runtime_error("failed"); },
+                   "fails");
+
+    EXPECT_FALSE(rpc.metricsEnabled());
+    rpc.enableMetrics();
+    EXPECT_TRUE(rpc.metricsEnabled());
+    EXPECT_ANY_THROW(rpc.enableMetrics());
+
+    std::vector<std::string> responses;
+    rpc.setResponseCallback([&responses](std::string&& res) { responses.push_back(std::move(res)); });
+
+    const std::string call = R"({"jsonrpc": "2.0", "method": "echo", "params": {"p1": 5}, "id": 1})";
+    rpc.post(call);
+    rpc.post(R"({"jsonrpc": "2.0", "method": "echo", "params": {"p1": "x"}, "id": 2})");
+    rpc.post(R"({"jsonrpc": "2.0", "method": "fails", "id": 3})");
+    rpc.post(R"({"jsonrpc": "2.0", "method": "unknown", "id": 4})");
+    rpc.post(R"([{"jsonrpc": "2.0", "method": "echo", "params": {"p1": 1}, "id": 5},
+                 {"jsonrpc": "2.0", "method": "echo", "params": {"p1": 2}, "id": 6}])");
+    rpc.post("{ not json");
+
+    // calls made on other threads land in other shards
+    std::thread t([&]() { rpc.post(call); });
+    t.join();
+
+    ASSERT_EQ(responses.size(), 7u);
+
+    RpcMetricsSnapshot snapshot = rpc.metricsSnapshot();
+    EXPECT_EQ(snapshot.requests, 7u);
+
+    ASSERT_EQ(snapshot.methods.count("echo"), 1u);
+    const MethodMetrics& echo = snapshot.methods["echo"];
+    EXPECT_EQ(echo.calls, 5u);
+    EXPECT_EQ(echo.errorsByCode.size(), 1u);
+    EXPECT_EQ(echo.errorsByCode.at(-32602), 1u); // invalid params
+    EXPECT_EQ(echo.invokeNs.count(), 4u);
+    EXPECT_EQ(echo.validateNs.count(), 5u);
+
+    EXPECT_EQ(snapshot.methods["fails"].errorsByCode.at(-32603), 1u); // internal error
+    EXPECT_EQ(snapshot.methods["fails"].invokeNs.count(), 1u);
+
+    // unknown methods are counted as errors, but don't get a series of their own
+    EXPECT_EQ(snapshot.methods.count("unknown"), 0u);
+    EXPECT_EQ(snapshot.errorsByCode.at(-32601), 1u);
+    EXPECT_EQ(snapshot.errorsByCode.at(-32700), 1u);
+
+    EXPECT_EQ(snapshot.batchSizes.count(), 1u);
+    EXPECT_EQ(snapshot.batchSizes.maxValue(), 2u);
+    EXPECT_EQ(snapshot.requestBytes.count(), 7u);
+    EXPECT_EQ(snapshot.responseBytes.count(), 7u);
+    EXPECT_EQ(snapshot.parseNs.count(), 7u);
+
+    const std::string text = snapshot.toPrometheusText();
+    EXPECT_NE(text.find("asyncjsonrpc_requests_total 7\n"), std::string::npos);
+    EXPECT_NE(text.find("asyncjsonrpc_calls_total{method=\"echo\"} 5\n"), std::string::npos);
+    EXPECT_NE(text.find("asyncjsonrpc_method_errors_total{method=\"echo\",code=\"-32602\"} 1\n"),
+              std::string::npos);
+    EXPECT_NE(text.find("asyncjsonrpc_batch_size_bucket{le=\"2\"} 1\n"), std::string::npos);
+    EXPECT_NE(
+        text.find("asyncjsonrpc_stage_duration_seconds_count{stage=\"invoke\",method=\"echo\"} 4\n"),
+        std::string::npos);
+}
+
+TEST(RpcMetrics, stats_method)
+{
+    boost::asio::io_context                                   executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type, int> rpc(executionContext.get_executor());
+
+    rpc.addHandler([](const Json::Value&, Json::Value& response, int) { response = 1; }, "one");
+    rpc.enableMetrics(true);
+    EXPECT_TRUE(rpc.handlerExists("rpc.stats"));
+
+    Json::Value stats;
+    rpc.setResponseCallback([&stats](std::string&& res) {
+        Json::Reader reader;
+        Json::Value  val;
+        reader.parse(res, val);
+        stats = val["result"];
+    });
+
+    rpc.post(R"({"jsonrpc": "2.0", "method": "one", "id": 1})", 0);
+    rpc.post(R"({"jsonrpc": "2.0", "method": "rpc.stats", "id": 2})", 0);
+
+    EXPECT_EQ(stats["requests"].asUInt64(), 1u);
+    EXPECT_EQ(stats["methods"]["one"]["calls"].asUInt64(), 1u);
+    EXPECT_EQ(stats["methods"]["one"]["invokeNs"]["count"].asUInt64(), 1u);
+}
+
+TEST(RpcMetrics, disabled_by_default)
+{
+    boost::asio::io_context                              executionContext;
+    AsyncJsonRPC<boost::asio::io_context::executor_type> rpc(executionContext.get_executor());
+
+    rpc.addHandler([](const Json::Value&, Json::Value&) {}, "noop");
+    rpc.post(R"({"jsonrpc": "2.0", "method": "noop", "id": 1})");
+
+    EXPECT_EQ(rpc.metricsSnapshot().requests, 0u);
+    EXPECT_TRUE(rpc.metricsSnapshot().methods.empty());
+}
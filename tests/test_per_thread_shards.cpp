@@ -0,0 +1,61 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/PerThreadShards.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+struct CountingShard
+{
+    int count = 0;
+};
+
+TEST(PerThreadShards, one_shard_per_thread)
+{
+    PerThreadShards<CountingShard> shards;
+    std::vector<std::thread>       threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&shards, t]() {
+            for (int i = 0; i <= t; i++) {
+                shards.local().count++;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    shards.local().count += 10;
+
+    int total = 0;
+    for (const auto& shard : shards.all()) {
+        total += shard->count;
+    }
+    EXPECT_EQ(shards.all().size(), 5u);
+    EXPECT_EQ(total, 1 + 2 + 3 + 4 + 10);
+}
+
+TEST(PerThreadShards, destroyed_instances_leave_no_entries)
+{
+    const std::size_t              before = PerThreadShards<CountingShard>::CountOnThisThread();
+    std::shared_ptr<CountingShard> kept;
+    for (int i = 0; i < 1000; i++) {
+        PerThreadShards<CountingShard> shards;
+        shards.local().count++;
+        // two instances at once, so the last-used cache isn't enough
+        PerThreadShards<CountingShard> other;
+        other.local().count++;
+        shards.local().count++;
+        EXPECT_EQ(PerThreadShards<CountingShard>::CountOnThisThread(), before + 2);
+        kept = shards.all().front();
+    }
+    EXPECT_EQ(PerThreadShards<CountingShard>::CountOnThisThread(), before);
+    // the shards outlive their instance
+    EXPECT_EQ(kept->count, 2);
+
+    // from a thread that has exited as well
+    {
+        PerThreadShards<CountingShard> shards;
+        std::thread([&shards]() { shards.local().count++; }).join();
+        EXPECT_EQ(shards.all().size(), 1u);
+    }
+}
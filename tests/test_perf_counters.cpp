@@ -0,0 +1,151 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/CpuTimeAccounting.h"
+#include "include/asyncjsonrpc/PerfCounters.h"
+#include <iostream>
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+
+using Rpc = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+
+static const std::uint64_t Millisecond = 1000000;
+
+static std::size_t Index(PerfCounter counter) { return static_cast<std::size_t>(counter); }
+
+static void AddSpinHandler(Rpc& rpc)
+{
+    // burns cpu for 2 ms
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response) {
+            const std::uint64_t start = ThreadCpuNow();
+            std::uint64_t       spins = 0;
+            while (ThreadCpuNow() - start < 2 * Millisecond) {
+                spins++;
+            }
+            response = Json::UInt64(spins) + request["x"].asUInt64();
+        },
+        "spin", {{"x", Json::ValueType::intValue}});
+    rpc.setResponseCallback([](std::string&&) {});
+}
+
+static const char* const SpinCall =
+    R"({"jsonrpc": "2.0", "method": "spin", "params": {"x": 1}, "id": 1})";
+
+TEST(PerfCounters, group_reads_are_monotonic)
+{
+    PerfCounterGroup  group;
+    PerfCounterValues first;
+    PerfCounterValues second;
+    group.read(first);
+    volatile std::uint64_t sum = 0;
+    for (int i = 0; i < 100000; i++) {
+        sum += i;
+    }
+    group.read(second);
+
+    for (std::size_t c = 0; c < PerfCounterCount; c++) {
+        if (group.available(static_cast<PerfCounter>(c))) {
+            EXPECT_GE(second[c], first[c]);
+        } else {
+            EXPECT_EQ(first[c], 0u);
+            EXPECT_EQ(second[c], 0u);
+        }
+    }
+    EXPECT_EQ(group.anyAvailable(), PerfCounters::Supported());
+}
+
+TEST(PerfCounters, degrades_gracefully)
+{
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+    AddSpinHandler(rpc);
+
+    const bool enabled = rpc.enablePerfCounters();
+    EXPECT_EQ(enabled, PerfCounters::Supported());
+    if (enabled) {
+        EXPECT_THROW(rpc.enablePerfCounters(), std::runtime_error);
+    } else {
+        // nothing is counted, and requests work as usual
+        EXPECT_FALSE(rpc.enablePerfCounters());
+    }
+
+    rpc.post(SpinCall);
+    const PerfCountersSnapshot snapshot = rpc.perfCountersSnapshot();
+    EXPECT_EQ(snapshot.requests, enabled ? 1u : 0u);
+    if (!snapshot.available[Index(PerfCounter::Instructions)]) {
+        EXPECT_EQ(snapshot.ipc(PerfStage::Invoke), 0.0);
+    }
+    const Json::Value json = snapshot.toJsonValue();
+    EXPECT_EQ(json["available"].empty(), !enabled);
+    EXPECT_TRUE(json["stages"].isMember("serialize"));
+}
+
+TEST(PerfCounters, attributes_counts_to_stages)
+{
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+    AddSpinHandler(rpc);
+    if (!rpc.enablePerfCounters()) {
+        std::cout << "no perf counters on this machine, skipped" << std::endl;
+        return;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        rpc.post(SpinCall);
+    }
+    rpc.post(std::string("[") + SpinCall + ", " + SpinCall + "]");
+    rpc.post(R"({"jsonrpc": "2.0", "method": "nosuchmethod", "id": 1})");
+
+    const PerfCountersSnapshot snapshot = rpc.perfCountersSnapshot();
+    EXPECT_EQ(snapshot.requests, 5u);
+
+    // the handler dominates whatever the counter
+    for (std::size_t c = 0; c < PerfCounterCount; c++) {
+        if (!snapshot.available[c] || c == Index(PerfCounter::CacheMisses)) {
+            continue;
+        }
+        const PerfCounter counter = static_cast<PerfCounter>(c);
+        EXPECT_GT(snapshot.perRequest(PerfStage::Invoke, counter),
+                  snapshot.perRequest(PerfStage::Parse, counter))
+            << PerfCounterName(counter);
+        EXPECT_GT(snapshot.perRequest(PerfStage::Invoke, counter),
+                  snapshot.perRequest(PerfStage::Serialize, counter))
+            << PerfCounterName(counter);
+    }
+    if (snapshot.available[Index(PerfCounter::TaskClock)]) {
+        const PerfCounterValues& invoke = snapshot.totals[static_cast<std::size_t>(PerfStage::Invoke)];
+        EXPECT_GE(invoke[Index(PerfCounter::TaskClock)], 5 * 2 * Millisecond);
+    }
+    if (snapshot.available[Index(PerfCounter::Instructions)] &&
+        snapshot.available[Index(PerfCounter::Cycles)]) {
+        EXPECT_GT(snapshot.ipc(PerfStage::Invoke), 0.0);
+    }
+
+    const Json::Value json = snapshot.toJsonValue();
+    EXPECT_EQ(json["requests"].asUInt64(), 5u);
+    EXPECT_TRUE(json["stages"]["invoke"].isMember("ipc"));
+    EXPECT_NE(snapshot.toString().find("invoke"), std::string::npos);
+}
+
+TEST(PerfCounters, nested_posts_count_for_the_outer_request)
+{
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+    AddSpinHandler(rpc);
+    rpc.addHandler(
+        [&rpc](const Json::Value&, Json::Value& response) {
+            rpc.post(SpinCall);
+            response = true;
+        },
+        "outer");
+    if (!rpc.enablePerfCounters()) {
+        std::cout << "no perf counters on this machine, skipped" << std::endl;
+        return;
+    }
+
+    rpc.post(R"({"jsonrpc": "2.0", "method": "outer", "id": 1})");
+    rpc.post(SpinCall);
+    EXPECT_EQ(rpc.perfCountersSnapshot().requests, 2u);
+}
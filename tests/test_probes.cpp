@@ -0,0 +1,44 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/Probes.h"
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+using Rpc = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+
+TEST(Probes, request_ids_as_probe_arguments)
+{
+    EXPECT_EQ(ProbeRequestId(Json::Value(7)), "7");
+    EXPECT_EQ(ProbeRequestId(Json::Value("abc")), "\"abc\"");
+    EXPECT_EQ(ProbeRequestId(Json::Value()), "null");
+    EXPECT_EQ(ProbeRequestId(Json::Value(-1.5)), "-1.5");
+}
+
+TEST(Probes, not_attached_by_default)
+{
+    // compiled out, or compiled in with no tracer attached in a test run
+    EXPECT_FALSE(ASYNCJSONRPC_PROBE_ENABLED(request_received));
+    EXPECT_FALSE(ASYNCJSONRPC_PROBE_ENABLED(error_emitted));
+
+    boost::asio::io_context  executionContext;
+    Rpc                      rpc(executionContext.get_executor());
+    std::vector<std::string> responses;
+    rpc.setResponseCallback([&responses](std::string&& res) { responses.push_back(res); });
+    rpc.addHandler([](const Json::Value&, Json::Value& response) { response = 1; }, "one");
+    rpc.addHandler([](const Json::Value&, Json::Value&) { throw std::runtime_error("fails"); }, "fails");
+
+    // every probe site: success, handler error, unknown method, parse error
+    rpc.post(R"({"jsonrpc": "2.0", "method": "one", "id": 1})");
+    rpc.post(R"({"jsonrpc": "2.0", "method": "fails", "id": 2})");
+    rpc.post(R"({"jsonrpc": "2.0", "method": "nosuchmethod", "id": 3})");
+    rpc.post("not json");
+
+    ASSERT_EQ(responses.size(), 4u);
+    EXPECT_NE(responses[0].find(R"("result":1)"), std::string::npos);
+    EXPECT_NE(responses[1].find("-32603"), std::string::npos);
+    EXPECT_NE(responses[2].find("-32601"), std::string::npos);
+    EXPECT_NE(responses[3].find("-32700"), std::string::npos);
+}
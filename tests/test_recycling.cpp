@@ -0,0 +1,87 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/RecyclingAllocator.h"
+#include "include/asyncjsonrpc/WorkStealingThreadPool.h"
+#include <future>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(RecyclingAllocator, reuses_freed_blocks)
+{
+    RecyclingAllocator<char> alloc;
+
+    char* p1 = alloc.allocate(100);
+    alloc.deallocate(p1, 100);
+    // same size class (65 to 128 bytes), so the block just freed comes back
+    char* p2 = alloc.allocate(120);
+    EXPECT_EQ(p1, p2);
+    alloc.deallocate(p2, 120);
+
+    // too big to be pooled
+    char* big = alloc.allocate(10000);
+    alloc.deallocate(big, 10000);
+}
+
+TEST(RecyclingAllocator, blocks_freed_on_another_thread_come_back)
+{
+    const std::size_t blockCount = RecyclingMemoryPool::LocalCacheLimit * 4;
+
+    std::vector<char*>       blocks;
+    RecyclingAllocator<char> alloc;
+    for (std::size_t i = 0; i < blockCount; i++) {
+        blocks.push_back(alloc.allocate(500));
+    }
+    std::set<char*> allocated(blocks.begin(), blocks.end());
+
+    // the consumer thread frees everything; what it can't keep goes to the depot, and the rest goes
+    // there when the thread exits
+    std::thread consumer([&blocks]() {
+        RecyclingAllocator<char> consumerAlloc;
+        for (char* p : blocks) {
+            consumerAlloc.deallocate(p, 500);
+        }
+    });
+    consumer.join();
+
+    std::size_t reused = 0;
+    blocks.clear();
+    for (std::size_t i = 0; i < blockCount; i++) {
+        char* p = alloc.allocate(500);
+        blocks.push_back(p);
+        reused += allocated.count(p);
+    }
+    EXPECT_EQ(reused, blockCount);
+    for (char* p : blocks) {
+        alloc.deallocate(p, 500);
+    }
+}
+
+TEST(AsyncJsonRPC, async_dispatch_runs_inline_on_executor)
+{
+    WorkStealingThreadPool                                           pool(2);
+    AsyncJsonRPC<WorkStealingThreadPool::executor_type, std::string> rpc(pool.get_executor());
+
+    std::thread::id handlerThread;
+    rpc.addHandler(
+        [&handlerThread](const Json::Value& /*request*/, Json::Value& response, std::string str) {
+            EXPECT_EQ(str, "TheString");
+            handlerThread = std::this_thread::get_id();
+            response      = Json::Value(1);
+        },
+        "testmethod1");
+
+    std::promise<bool> sameThread;
+    pool.get_executor().post(
+        [&]() {
+            rpc.asyncDispatch(R"({"jsonrpc": "2.0", "method": "testmethod1", "id": 4})", "TheString");
+            // dispatched from a worker, so the handler already ran, on this thread
+            sameThread.set_value(handlerThread == std::this_thread::get_id());
+        },
+        std::allocator<char>());
+
+    EXPECT_TRUE(sameThread.get_future().get());
+    pool.join();
+}
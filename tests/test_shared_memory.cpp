@@ -0,0 +1,318 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCSharedMemoryServer.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+using Rpc                = AsyncJsonRPC<boost::asio::io_context::executor_type, int>;
+using SharedMemoryServer = AsyncJsonRPCSharedMemoryServer<Rpc>;
+
+static std::string Request(int x)
+{
+    return R"({"jsonrpc": "2.0", "method": "tag", "params": {"x": )" + std::to_string(x) +
+           R"(}, "id": 1})";
+}
+
+static int Result(const char* response, std::size_t size)
+{
+    Json::Value  value;
+    Json::Reader reader;
+    EXPECT_TRUE(reader.parse(response, response + size, value));
+    return value["result"].asInt();
+}
+
+// the context of a call is the number given to accept()
+static void AddTagHandler(Rpc& rpc)
+{
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response, int client) {
+            response = request["x"].asInt() * 1000 + client;
+        },
+        "tag", {{"x", Json::ValueType::intValue}});
+}
+
+TEST(SharedMemoryRing, wraps_around_in_order)
+{
+    std::unique_ptr<SharedMemoryChannel> channel = SharedMemoryChannel::Create(256);
+    SharedMemoryRing&                    ring    = channel->requests();
+    EXPECT_EQ(ring.maxMessageSize(), 120u);
+    EXPECT_FALSE(ring.tryPush(std::string(121, 'x').data(), 121));
+
+    // messages of every size, many times around the ring without a split one
+    std::size_t pushed   = 0;
+    std::size_t consumed = 0;
+    for (int round = 0; round < 50; round++) {
+        while (ring.tryPush(std::string(pushed % 121, char('a' + pushed % 26)).data(), pushed % 121)) {
+            pushed++;
+        }
+        ring.consume(
+            [&](const char* message, std::size_t size) {
+                const std::string expected(consumed % 121, char('a' + consumed % 26));
+                EXPECT_EQ(std::string(message, size), expected);
+                consumed++;
+            },
+            3);
+    }
+    ring.consume([&](const char*, std::size_t) { consumed++; }, 1000);
+    EXPECT_EQ(consumed, pushed);
+    EXPECT_GT(pushed, 100u);
+    EXPECT_TRUE(ring.empty());
+}
+
+// a ring of 256 bytes over memory of the test, that the test can corrupt as the other process could
+struct RingRegion
+{
+    alignas(64) char region[sizeof(SharedMemoryRing::Header) + 256];
+    SharedMemoryRing ring{region, 256, true};
+
+    SharedMemoryRing::Header& header() { return *reinterpret_cast<SharedMemoryRing::Header*>(region); }
+
+    void setLength(std::uint64_t position, std::uint32_t length)
+    {
+        std::memcpy(region + sizeof(SharedMemoryRing::Header) + (position & (header().capacity - 1)),
+                    &length, 4);
+    }
+};
+
+TEST(SharedMemoryRing, corrupt_positions_and_lengths_are_not_read)
+{
+    const auto consumeAll = [](SharedMemoryRing& ring) {
+        return ring.consume([](const char*, std::size_t) { ADD_FAILURE() << "read a corrupt message"; },
+                            1000);
+    };
+
+    // a length larger than a message can be
+    {
+        RingRegion memory;
+        ASSERT_TRUE(memory.ring.tryPush("hello", 5));
+        memory.setLength(0, 1000);
+        EXPECT_EQ(consumeAll(memory.ring), 0u);
+        EXPECT_TRUE(memory.ring.corrupted());
+    }
+    // a message past the end of the ring, and one past the head: (length, head)
+    const std::pair<std::uint32_t, std::uint64_t> corruptions[] = {{100, 560}, {20, 464}};
+    for (const auto& corrupt : corruptions) {
+        RingRegion memory;
+        for (std::size_t size : {116u, 76u, 116u, 76u}) {
+            ASSERT_TRUE(memory.ring.tryPush(std::string(size, 'x').data(), size));
+            const std::size_t consumed = memory.ring.consume([](const char*, std::size_t) {}, 1);
+            EXPECT_EQ(consumed, 1u);
+        }
+        ASSERT_TRUE(memory.ring.tryPush("abcd", 4)); // at offset 200
+        memory.setLength(256 + 200, corrupt.first);
+        memory.header().head.store(corrupt.second);
+        EXPECT_EQ(consumeAll(memory.ring), 0u);
+        EXPECT_TRUE(memory.ring.corrupted());
+    }
+    // a head more than the ring ahead of the tail, and a misaligned tail
+    {
+        RingRegion memory;
+        memory.header().head.store(264);
+        EXPECT_EQ(consumeAll(memory.ring), 0u);
+        EXPECT_TRUE(memory.ring.corrupted());
+    }
+    {
+        RingRegion memory;
+        memory.header().tail.store(3);
+        memory.header().head.store(11);
+        EXPECT_EQ(consumeAll(memory.ring), 0u);
+        EXPECT_TRUE(memory.ring.corrupted());
+    }
+}
+
+// the capacity in the segment is the other process's: Map() checks it
+TEST(SharedMemoryChannel, map_checks_the_capacity)
+{
+    std::unique_ptr<SharedMemoryChannel> channel = SharedMemoryChannel::Create(256);
+    for (std::uint64_t capacity : {std::uint64_t(100), std::uint64_t(32), std::uint64_t(1) << 62}) {
+        ASSERT_EQ(::pwrite(channel->fd(), &capacity, sizeof(capacity), 8), 8);
+        EXPECT_THROW(SharedMemoryChannel::Map(::dup(channel->fd())), std::runtime_error) << capacity;
+    }
+    const std::uint64_t capacity = 256;
+    ASSERT_EQ(::pwrite(channel->fd(), &capacity, sizeof(capacity), 8), 8);
+    EXPECT_NO_THROW(SharedMemoryChannel::Map(::dup(channel->fd())));
+}
+
+// the client side can't resize the segment under the server, and Map() refuses one it could
+TEST(SharedMemoryChannel, the_segment_is_sealed)
+{
+    std::unique_ptr<SharedMemoryChannel> channel = SharedMemoryChannel::Create(256);
+    std::unique_ptr<SharedMemoryChannel> client  = SharedMemoryChannel::Map(::dup(channel->fd()));
+
+    struct stat status;
+    ASSERT_EQ(::fstat(client->fd(), &status), 0);
+    EXPECT_EQ(::ftruncate(client->fd(), 0), -1);
+    EXPECT_EQ(errno, EPERM);
+    EXPECT_EQ(::ftruncate(client->fd(), status.st_size * 2), -1);
+    EXPECT_EQ(::fcntl(client->fd(), F_ADD_SEALS, F_SEAL_WRITE), -1);
+    ASSERT_TRUE(client->requests().tryPush("still mapped", 12));
+
+    const int unsealed = ::memfd_create("unsealed", MFD_CLOEXEC);
+    ASSERT_GE(unsealed, 0);
+    ASSERT_EQ(::ftruncate(unsealed, status.st_size), 0);
+    std::vector<char> segment(static_cast<std::size_t>(status.st_size));
+    ASSERT_EQ(::pread(channel->fd(), segment.data(), segment.size(), 0), status.st_size);
+    ASSERT_EQ(::pwrite(unsealed, segment.data(), segment.size(), 0), status.st_size);
+    EXPECT_THROW(SharedMemoryChannel::Map(unsealed), std::runtime_error);
+}
+
+TEST(SharedMemoryServer, calls_and_pipelining)
+{
+    boost::asio::io_context ioContext;
+    Rpc                     rpc(ioContext.get_executor());
+    AddTagHandler(rpc);
+    SharedMemoryServer server(rpc);
+
+    SharedMemoryClient a(server.accept(std::make_tuple(1)));
+    SharedMemoryClient b(server.accept(std::make_tuple(2)));
+    const std::string  response = a.call(Request(5));
+    EXPECT_EQ(Result(response.data(), response.size()), 5001);
+
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(b.send(Request(i)));
+    }
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(b.receive([i](const char* data, std::size_t size) {
+            EXPECT_EQ(Result(data, size), i * 1000 + 2);
+        }));
+    }
+    EXPECT_EQ(server.stats().channels, 2u);
+    EXPECT_EQ(server.stats().requests, 101u);
+}
+
+TEST(SharedMemoryServer, stop_closes_the_channels)
+{
+    boost::asio::io_context ioContext;
+    Rpc                     rpc(ioContext.get_executor());
+    AddTagHandler(rpc);
+    SharedMemoryServer server(rpc);
+
+    SharedMemoryClient client(server.accept(std::make_tuple(1)));
+    std::thread        stopper([&server]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        server.stop();
+    });
+    // sleeps on the futex until the channel is closed
+    EXPECT_FALSE(client.receive([](const char*, std::size_t) {}));
+    stopper.join();
+    EXPECT_THROW(client.call(Request(1)), std::runtime_error);
+}
+
+// a call of a method that returns size bytes
+static std::string BigRequest(unsigned size, int id)
+{
+    return R"({"jsonrpc": "2.0", "method": "big", "params": {"size": )" + std::to_string(size) +
+           R"(}, "id": )" + std::to_string(id) + "}";
+}
+
+TEST(SharedMemoryServer, a_response_too_large_is_an_error_with_its_id)
+{
+    boost::asio::io_context ioContext;
+    Rpc                     rpc(ioContext.get_executor());
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response, int) {
+            response = std::string(request["size"].asUInt(), 'x');
+        },
+        "big", {{"size", Json::ValueType::intValue}});
+    SharedMemoryOptions options;
+    options.ringCapacity = 4096;
+    SharedMemoryServer server(rpc, options);
+    SharedMemoryClient client(server.accept(std::make_tuple(1)), options);
+
+    Json::Value  response;
+    Json::Reader reader;
+    ASSERT_TRUE(reader.parse(client.call(BigRequest(5000, 7)), response));
+    EXPECT_EQ(response["error"]["code"].asInt(), -32603);
+    EXPECT_EQ(response["id"].asInt(), 7);
+
+    // a batch gets an error for each of its calls, with their ids
+    ASSERT_TRUE(
+        reader.parse(client.call("[" + BigRequest(10, 8) + "," + BigRequest(3000, 9) + "]"), response));
+    ASSERT_EQ(response.size(), 2u);
+    for (int i = 0; i < 2; i++) {
+        EXPECT_EQ(response[i]["error"]["code"].asInt(), -32603);
+        EXPECT_EQ(response[i]["id"].asInt(), 8 + i);
+    }
+
+    // and the channel still works
+    ASSERT_TRUE(reader.parse(client.call(BigRequest(3, 10)), response));
+    EXPECT_EQ(response["result"].asString(), "xxx");
+    EXPECT_EQ(response["id"].asInt(), 10);
+}
+
+// the channel's fd is sent to another process, over a Unix socket
+TEST(SharedMemoryServer, client_in_another_process)
+{
+    int sockets[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+
+    // forked before the server has threads
+    const pid_t child = ::fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        char   byte;
+        iovec  io = {&byte, 1};
+        char   control[CMSG_SPACE(sizeof(int))];
+        msghdr message         = {};
+        message.msg_iov        = &io;
+        message.msg_iovlen     = 1;
+        message.msg_control    = control;
+        message.msg_controllen = sizeof(control);
+        if (::recvmsg(sockets[1], &message, 0) != 1) {
+            ::_exit(2);
+        }
+        int fd;
+        std::memcpy(&fd, CMSG_DATA(CMSG_FIRSTHDR(&message)), sizeof(int));
+
+        int failures = 0;
+        {
+            SharedMemoryClient client(SharedMemoryChannel::Map(fd));
+            for (int i = 0; i < 1000; i++) {
+                const std::string response = client.call(Request(i));
+                Json::Value       value;
+                Json::Reader().parse(response, value);
+                failures += (value["result"].asInt() != i * 1000 + 7);
+            }
+        }
+        ::_exit(failures == 0 ? 0 : 1);
+    }
+
+    boost::asio::io_context ioContext;
+    Rpc                     rpc(ioContext.get_executor());
+    AddTagHandler(rpc);
+    SharedMemoryServer                   server(rpc);
+    std::shared_ptr<SharedMemoryChannel> channel = server.accept(std::make_tuple(7));
+
+    char   byte                             = 0;
+    iovec  io                               = {&byte, 1};
+    char   control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message                          = {};
+    message.msg_iov        = &io;
+    message.msg_iovlen     = 1;
+    message.msg_control    = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header        = CMSG_FIRSTHDR(&message);
+    header->cmsg_level     = SOL_SOCKET;
+    header->cmsg_type      = SCM_RIGHTS;
+    header->cmsg_len       = CMSG_LEN(sizeof(int));
+    const int fd           = channel->fd();
+    std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    ASSERT_EQ(::sendmsg(sockets[0], &message, 0), 1);
+
+    int status = 0;
+    ASSERT_EQ(::waitpid(child, &status, 0), child);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    EXPECT_EQ(server.stats().requests, 1000u);
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+}
@@ -0,0 +1,170 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/SlowRequestLog.h"
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+using Rpc = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+
+static const std::uint64_t Millisecond = 1000000;
+
+static SlowRequestLogOptions Threshold(std::chrono::microseconds threshold, std::size_t capacity = 16)
+{
+    SlowRequestLogOptions options;
+    options.threshold     = threshold;
+    options.capacity      = capacity;
+    options.maxParamsSize = 16;
+    return options;
+}
+
+static void AddSleepHandler(Rpc& rpc)
+{
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(request["ms"].asInt()));
+            response = true;
+        },
+        "sleep", {{"ms", Json::ValueType::intValue}, {"padding", Json::ValueType::stringValue}});
+}
+
+static std::string SleepCall(int ms, int id = 1)
+{
+    return R"({"jsonrpc": "2.0", "method": "sleep", "params": {"ms": )" + std::to_string(ms) +
+           R"(, "padding": "xxxxxxxxxxxxxxxx"}, "id": )" + std::to_string(id) + "}";
+}
+
+TEST(SlowRequestLog, records_slow_calls_with_stage_breakdown)
+{
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+    AddSleepHandler(rpc);
+    rpc.setResponseCallback([](std::string&&) {});
+    EXPECT_EQ(rpc.slowRequestLog(), nullptr);
+    rpc.enableSlowRequestLog(Threshold(std::chrono::milliseconds(5)));
+    ASSERT_NE(rpc.slowRequestLog(), nullptr);
+
+    rpc.post(SleepCall(0));
+    rpc.post(SleepCall(10));
+    rpc.post(R"([{"jsonrpc": "2.0", "method": "nosuchmethod", "id": 1},)" + SleepCall(10, 2) + "]");
+
+    const std::vector<SlowRequestRecord> records = rpc.slowRequestLog()->records();
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(rpc.slowRequestLog()->loggedCount(), 2u);
+
+    const SlowRequestRecord& single = records[0];
+    EXPECT_EQ(single.sequence, 1u);
+    EXPECT_EQ(single.method, "sleep");
+    EXPECT_EQ(single.params, R"({"ms": 10, "padd)");
+    EXPECT_TRUE(single.paramsTruncated);
+    EXPECT_EQ(single.requestBytes, SleepCall(10).size());
+    EXPECT_EQ(single.batchSize, 0u);
+    EXPECT_EQ(single.queueWaitNs, 0u);
+    EXPECT_GE(single.invokeNs, 10 * Millisecond);
+    EXPECT_GE(single.totalNs, single.parseNs + single.validateNs + single.invokeNs + single.serializeNs);
+    EXPECT_GT(single.timestampNs, 0u);
+
+    // in a batch, the slowest call is the one shown
+    const SlowRequestRecord& batch = records[1];
+    EXPECT_EQ(batch.method, "sleep");
+    EXPECT_EQ(batch.batchSize, 2u);
+    EXPECT_GE(batch.invokeNs, 10 * Millisecond);
+}
+
+TEST(SlowRequestLog, measures_queue_wait)
+{
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+    AddSleepHandler(rpc);
+    rpc.setResponseCallback([](std::string&&) {});
+    rpc.enableSlowRequestLog(Threshold(std::chrono::milliseconds(5)));
+
+    // a fast call stuck behind a slow task in the executor's queue
+    boost::asio::post(executionContext,
+                      []() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); });
+    rpc.asyncPost(SleepCall(0));
+    executionContext.run();
+
+    const std::vector<SlowRequestRecord> records = rpc.slowRequestLog()->records();
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_GE(records[0].queueWaitNs, 10 * Millisecond);
+    EXPECT_LT(records[0].invokeNs, 5 * Millisecond);
+    EXPECT_GE(records[0].totalNs, records[0].queueWaitNs);
+}
+
+TEST(SlowRequestLog, ring_keeps_the_last_records)
+{
+    boost::asio::io_context executionContext;
+    Rpc                     rpc(executionContext.get_executor());
+    rpc.addHandler([](const Json::Value&, Json::Value& response) { response = 1; }, "fast");
+    std::vector<std::string> responses;
+    rpc.setResponseCallback([&responses](std::string&& res) { responses.push_back(res); });
+    // every request is slow
+    rpc.enableSlowRequestLog(Threshold(std::chrono::microseconds(0), 4), true);
+
+    for (int i = 0; i < 10; i++) {
+        rpc.post(R"({"jsonrpc": "2.0", "method": "fast", "id": 1})");
+    }
+    rpc.post("not json");
+
+    const std::vector<SlowRequestRecord> records = rpc.slowRequestLog()->records();
+    ASSERT_EQ(records.size(), 4u);
+    EXPECT_EQ(records.front().sequence, 8u);
+    EXPECT_EQ(records.back().sequence, 11u);
+    EXPECT_EQ(records.back().method, "");
+    EXPECT_EQ(records.back().errorCode, -32700);
+    EXPECT_EQ(rpc.slowRequestLog()->droppedCount(), 0u);
+
+    std::ostringstream dump;
+    rpc.slowRequestLog()->dump(dump);
+    EXPECT_EQ(dump.str().find("#8 fast total="), 0u);
+    EXPECT_NE(dump.str().find("#11 - total="), std::string::npos);
+
+    rpc.post(R"({"jsonrpc": "2.0", "method": "rpc.slowRequests", "id": 2})");
+    Json::Value  response;
+    Json::Reader reader;
+    ASSERT_TRUE(reader.parse(responses.back(), response));
+    ASSERT_EQ(response["result"].size(), 4u);
+    EXPECT_EQ(response["result"][3]["sequence"].asUInt64(), 11u);
+}
+
+TEST(SlowRequestLog, concurrent_writers_and_readers)
+{
+    SlowRequestLog    log(Threshold(std::chrono::microseconds(0), 8));
+    std::atomic<bool> done{false};
+
+    std::thread reader([&]() {
+        while (!done.load()) {
+            for (const SlowRequestRecord& record : log.records()) {
+                EXPECT_EQ(record.method, "m" + std::to_string(record.requestBytes));
+            }
+        }
+    });
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++) {
+        writers.emplace_back([&log]() {
+            for (std::size_t i = 0; i < 1000; i++) {
+                log.record([i](SlowRequestRecord& record) {
+                    record.method       = "m" + std::to_string(i);
+                    record.requestBytes = i;
+                });
+            }
+        });
+    }
+    for (auto& t : writers) {
+        t.join();
+    }
+    done.store(true);
+    reader.join();
+
+    EXPECT_EQ(log.loggedCount(), 4000u);
+    EXPECT_LE(log.records().size(), 8u);
+    EXPECT_LE(log.droppedCount(), 4000u);
+}
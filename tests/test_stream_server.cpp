@@ -0,0 +1,246 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCStreamServer.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/write.hpp>
+
+using Rpc   = AsyncJsonRPC<boost::asio::io_context::executor_type, int>;
+using tcp   = boost::asio::ip::tcp;
+using local = boost::asio::local::stream_protocol;
+
+static std::vector<std::string> FrameAll(Framing framing, const std::string& bytes, std::size_t chunk,
+                                         bool* failed = nullptr)
+{
+    StreamFramer             framer(framing, 100);
+    std::vector<std::string> frames;
+    std::string              buffer;
+    for (std::size_t at = 0; at < bytes.size(); at += chunk) {
+        buffer.append(bytes, at, chunk);
+        const std::size_t consumed = framer.consume(
+            buffer.data(), buffer.size(),
+            [&](const char* frame, std::size_t size) { frames.emplace_back(frame, size); });
+        buffer.erase(0, consumed);
+    }
+    if (failed) {
+        *failed = framer.failed();
+    }
+    return frames;
+}
+
+TEST(StreamFramer, frames_split_anywhere)
+{
+    const std::vector<std::string> messages = {R"({"a": 1})", "", std::string(100, 'x'), "[1,\n2]"};
+    for (Framing framing : {Framing::LengthPrefix, Framing::Netstring}) {
+        std::string bytes;
+        for (const std::string& message : messages) {
+            StreamFramer::Encode(framing, message.data(), message.size(), bytes);
+        }
+        for (std::size_t chunk : {1, 3, 7, 1000}) {
+            EXPECT_EQ(FrameAll(framing, bytes, chunk), messages) << FramingName(framing) << " " << chunk;
+        }
+    }
+
+    // lines can't hold "\n"; empty lines are skipped
+    const std::string lines = "{\"a\": 1}\r\n\n" + std::string(100, 'x') + "\nlast";
+    for (std::size_t chunk : {1, 3, 1000}) {
+        const std::vector<std::string> frames = FrameAll(Framing::Ndjson, lines, chunk);
+        ASSERT_EQ(frames.size(), 2u);
+        EXPECT_EQ(frames[0], R"({"a": 1})");
+        EXPECT_EQ(frames[1], std::string(100, 'x'));
+    }
+}
+
+TEST(StreamFramer, malformed_and_oversized)
+{
+    bool failed = false;
+    EXPECT_EQ(FrameAll(Framing::Netstring, "2:ab,x:", 1000, &failed).size(), 1u);
+    EXPECT_TRUE(failed);
+    FrameAll(Framing::Netstring, "2:abc", 1000, &failed);
+    EXPECT_TRUE(failed);
+    FrameAll(Framing::Netstring, "101:", 1000, &failed);
+    EXPECT_TRUE(failed);
+    FrameAll(Framing::LengthPrefix, std::string("\0\0\0\x65", 4), 1000, &failed);
+    EXPECT_TRUE(failed);
+    FrameAll(Framing::Ndjson, std::string(102, 'x'), 10, &failed);
+    EXPECT_TRUE(failed);
+
+    // exactly the limit
+    FrameAll(Framing::LengthPrefix, std::string("\0\0\0\x64", 4), 1000, &failed);
+    EXPECT_FALSE(failed);
+    FrameAll(Framing::Ndjson, std::string(100, 'x'), 1000, &failed);
+    EXPECT_FALSE(failed);
+}
+
+// an rpc and its stream server, on a thread of their own; the context of a call is the number of its
+// connection
+template <typename Protocol>
+struct StreamFixture
+{
+    boost::asio::io_context                 ioContext;
+    Rpc                                     rpc;
+    std::atomic<int>                        connections{0};
+    AsyncJsonRPCStreamServer<Rpc, Protocol> server;
+    std::thread                             thread;
+
+    StreamFixture(const typename Protocol::endpoint& endpoint, const StreamServerOptions& options)
+        : rpc(ioContext.get_executor()),
+          server(rpc, ioContext, endpoint,
+                 [this](const typename Protocol::endpoint&) { return std::make_tuple(++connections); },
+                 options)
+    {
+        rpc.addHandler(
+            [](const Json::Value& request, Json::Value& response, int connection) {
+                response = request["x"].asInt() * 1000 + connection;
+            },
+            "tag", {{"x", Json::ValueType::intValue}});
+        server.start();
+        thread = std::thread([this]() { ioContext.run(); });
+    }
+
+    ~StreamFixture()
+    {
+        server.stop();
+        thread.join();
+    }
+};
+
+template <typename Protocol>
+struct StreamClient
+{
+    boost::asio::io_context   ioContext;
+    typename Protocol::socket socket{ioContext};
+    StreamFramer              framer;
+    Framing                   framing;
+    std::string               buffer;
+
+    StreamClient(const typename Protocol::endpoint& server, Framing Framing)
+        : framer(Framing, 1024 * 1024), framing(Framing)
+    {
+        socket.connect(server);
+    }
+
+    void send(const std::string& bytes) { boost::asio::write(socket, boost::asio::buffer(bytes)); }
+
+    void sendFramed(const std::string& message)
+    {
+        std::string bytes;
+        StreamFramer::Encode(framing, message.data(), message.size(), bytes);
+        send(bytes);
+    }
+
+    // the results of the next count responses
+    std::vector<int> receive(std::size_t count)
+    {
+        std::vector<int> results;
+        char             chunk[4096];
+        while (results.size() < count) {
+            const std::size_t consumed =
+                framer.consume(buffer.data(), buffer.size(), [&](const char* frame, std::size_t size) {
+                    Json::Value  value;
+                    Json::Reader reader;
+                    EXPECT_TRUE(reader.parse(frame, frame + size, value));
+                    results.push_back(value["result"].asInt());
+                });
+            buffer.erase(0, consumed);
+            if (results.size() < count) {
+                buffer.append(chunk, socket.read_some(boost::asio::buffer(chunk)));
+            }
+        }
+        return results;
+    }
+
+    bool closedByServer()
+    {
+        char                      byte;
+        boost::system::error_code ec;
+        socket.read_some(boost::asio::buffer(&byte, 1), ec);
+        return ec == boost::asio::error::eof;
+    }
+};
+
+static std::string Request(int x, std::size_t padding = 0)
+{
+    return R"({"jsonrpc": "2.0", "method": "tag", "params": {"x": )" + std::to_string(x) +
+           R"(}, "id": 1)" + std::string(padding, ' ') + "}";
+}
+
+TEST(StreamServer, tcp_ndjson_many_requests_per_read)
+{
+    StreamFixture<tcp> fixture(tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+                               StreamServerOptions());
+    StreamClient<tcp>  a(fixture.server.localEndpoint(), Framing::Ndjson);
+
+    // 200 requests in one write
+    std::string requests;
+    for (int i = 1; i <= 200; i++) {
+        requests += Request(i) + "\n";
+    }
+    a.send(requests);
+    const std::vector<int> results = a.receive(200);
+    for (int i = 1; i <= 200; i++) {
+        EXPECT_EQ(results[i - 1], i * 1000 + 1);
+    }
+
+    StreamClient<tcp> b(fixture.server.localEndpoint(), Framing::Ndjson);
+    b.sendFramed(Request(7));
+    EXPECT_EQ(b.receive(1), std::vector<int>{7002});
+
+    const StreamServerStats stats = fixture.server.stats();
+    EXPECT_EQ(stats.accepted, 2u);
+    EXPECT_EQ(stats.requests, 201u);
+    EXPECT_LT(stats.reads, stats.requests / 4);
+    EXPECT_LT(stats.writes, stats.requests);
+}
+
+TEST(StreamServer, unix_socket_length_prefix_and_netstring)
+{
+    for (Framing framing : {Framing::LengthPrefix, Framing::Netstring}) {
+        const std::string path = "/tmp/asyncjsonrpc_test_" + std::to_string(getpid()) + ".sock";
+        ::unlink(path.c_str());
+        StreamServerOptions options;
+        options.framing        = framing;
+        options.readBufferSize = 64; // frames straddle reads, and the buffer grows for a large one
+        {
+            StreamFixture<local> fixture(local::endpoint(path), options);
+            StreamClient<local>  client(fixture.server.localEndpoint(), framing);
+
+            std::string bytes;
+            for (int i = 1; i <= 20; i++) {
+                const std::string request = Request(i);
+                StreamFramer::Encode(framing, request.data(), request.size(), bytes);
+            }
+            const std::string large = Request(21, 1000);
+            StreamFramer::Encode(framing, large.data(), large.size(), bytes);
+            client.send(bytes);
+
+            const std::vector<int> results = client.receive(21);
+            for (int i = 1; i <= 21; i++) {
+                EXPECT_EQ(results[i - 1], i * 1000 + 1) << FramingName(framing);
+            }
+        }
+        ::unlink(path.c_str());
+    }
+}
+
+TEST(StreamServer, malformed_framing_closes_the_connection)
+{
+    StreamServerOptions options;
+    options.framing = Framing::Netstring;
+    StreamFixture<tcp> fixture(tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0), options);
+    StreamClient<tcp>  client(fixture.server.localEndpoint(), Framing::Netstring);
+
+    // the frame before the malformed one is answered
+    std::string       bytes;
+    const std::string request = Request(3);
+    StreamFramer::Encode(Framing::Netstring, request.data(), request.size(), bytes);
+    client.send(bytes + "not a netstring");
+    EXPECT_EQ(client.receive(1), std::vector<int>{3001});
+    EXPECT_TRUE(client.closedByServer());
+}
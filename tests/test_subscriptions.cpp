@@ -0,0 +1,287 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCClient.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCStreamServer.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCWebSocketServer.h"
+#include "include/asyncjsonrpc/StreamClientTransport.h"
+#include "include/asyncjsonrpc/Subscriptions.h"
+#include "include/asyncjsonrpc/WebSocketClientTransport.h"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/use_future.hpp>
+
+using Rpc = AsyncJsonRPC<boost::asio::io_context::executor_type>;
+using tcp = boost::asio::ip::tcp;
+
+static const tcp::endpoint Loopback(boost::asio::ip::address_v4::loopback(), 0);
+
+static StreamServerOptions WithFraming(Framing framing)
+{
+    StreamServerOptions options;
+    options.framing = framing;
+    return options;
+}
+
+// the stream and WebSocket servers of one rpc, with subscriptions; one thread runs the servers and the
+// clients
+struct SubscriptionFixture
+{
+    boost::asio::io_context                                                  ioContext;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    Rpc                                                                      rpc;
+    Subscriptions                                                            subscriptions;
+    AsyncJsonRPCStreamServer<Rpc>                                            streamServer;
+    AsyncJsonRPCWebSocketServer<Rpc>                                         webSocketServer;
+    std::thread                                                              thread;
+
+    explicit SubscriptionFixture(Framing framing = Framing::Ndjson)
+        : work(ioContext.get_executor()), rpc(ioContext.get_executor()),
+          streamServer(rpc, ioContext, Loopback, AsyncJsonRPCStreamServer<Rpc>::DefaultContextFactory(),
+                       WithFraming(framing)),
+          webSocketServer(rpc, ioContext, Loopback)
+    {
+        subscriptions.install(rpc);
+        streamServer.start();
+        webSocketServer.start();
+        thread = std::thread([this]() { ioContext.run(); });
+    }
+
+    ~SubscriptionFixture()
+    {
+        streamServer.stop();
+        webSocketServer.stop();
+        work.reset();
+        ioContext.stop();
+        thread.join();
+    }
+};
+
+// the result of subscribe or unsubscribe
+template <typename Transport>
+static bool Call(AsyncJsonRPCClient<Transport>& client, const std::string& method,
+                 const std::string& topic)
+{
+    Json::Value params;
+    params["topic"] = topic;
+    return client.asyncCall(method, params, boost::asio::use_future).get().asBool();
+}
+
+// the notifications a client received
+struct Received
+{
+    std::mutex               mutex;
+    std::vector<Json::Value> notifications;
+
+    template <typename Transport>
+    void listen(AsyncJsonRPCClient<Transport>& client)
+    {
+        client.setNotificationHandler([this](const std::string& method, const Json::Value& params) {
+            EXPECT_EQ(method, "notification");
+            std::lock_guard<std::mutex> lock(mutex);
+            notifications.push_back(params);
+        });
+    }
+
+    // waits for count of them
+    std::vector<Json::Value> wait(std::size_t count)
+    {
+        for (int i = 0; i < 500; i++) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (notifications.size() >= count) {
+                    return notifications;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        return notifications;
+    }
+};
+
+// records what it's given
+struct RecordingSink : NotificationSink
+{
+    std::vector<SharedMessage> messages;
+
+    void deliver(const SharedMessage& message) override { messages.push_back(message); }
+};
+
+TEST(Subscriptions, notifications_reach_the_subscribers)
+{
+    for (Framing framing : {Framing::Ndjson, Framing::LengthPrefix, Framing::Netstring}) {
+        SubscriptionFixture fixture(framing);
+        StreamClientOptions streamOptions;
+        streamOptions.framing = framing;
+        auto                streamTransport =
+            std::make_shared<StreamClientTransport<tcp>>(fixture.ioContext, streamOptions);
+        streamTransport->connect(fixture.streamServer.localEndpoint());
+        auto webSocketTransport = std::make_shared<WebSocketClientTransport>(fixture.ioContext);
+        webSocketTransport->connect(fixture.webSocketServer.localEndpoint());
+        AsyncJsonRPCClient<StreamClientTransport<tcp>> streamClient(streamTransport);
+        AsyncJsonRPCClient<WebSocketClientTransport>   webSocketClient(webSocketTransport);
+        Received                                       streamReceived;
+        Received                                       webSocketReceived;
+        streamReceived.listen(streamClient);
+        webSocketReceived.listen(webSocketClient);
+
+        EXPECT_TRUE(Call(streamClient, "subscribe", "ticks"));
+        EXPECT_TRUE(Call(webSocketClient, "subscribe", "ticks"));
+        EXPECT_TRUE(Call(webSocketClient, "subscribe", "news"));
+
+        for (int i = 0; i < 100; i++) {
+            Json::Value tick;
+            tick["price"] = 100 + i;
+            EXPECT_EQ(fixture.subscriptions.publish("ticks", tick), 2u);
+        }
+        EXPECT_EQ(fixture.subscriptions.publish("news", "hello"), 1u);
+        EXPECT_EQ(fixture.subscriptions.publish("weather", "rain"), 0u);
+
+        // in the order they were published, on both connections
+        const std::vector<Json::Value> streamNotifications = streamReceived.wait(100);
+        ASSERT_EQ(streamNotifications.size(), 100u) << FramingName(framing);
+        for (int i = 0; i < 100; i++) {
+            EXPECT_EQ(streamNotifications[i]["topic"].asString(), "ticks");
+            EXPECT_EQ(streamNotifications[i]["data"]["price"].asInt(), 100 + i);
+        }
+        const std::vector<Json::Value> webSocketNotifications = webSocketReceived.wait(101);
+        ASSERT_EQ(webSocketNotifications.size(), 101u);
+        EXPECT_EQ(webSocketNotifications[99]["data"]["price"].asInt(), 199);
+        EXPECT_EQ(webSocketNotifications[100]["topic"].asString(), "news");
+        EXPECT_EQ(webSocketNotifications[100]["data"].asString(), "hello");
+
+        // calls still work, between the notifications
+        EXPECT_FALSE(Call(streamClient, "unsubscribe", "news"));
+        EXPECT_TRUE(Call(streamClient, "unsubscribe", "ticks"));
+        EXPECT_EQ(fixture.subscriptions.publish("ticks", 0), 1u);
+        EXPECT_EQ(webSocketReceived.wait(102).size(), 102u);
+
+        EXPECT_EQ(fixture.streamServer.stats().notified, 100u);
+        EXPECT_EQ(fixture.webSocketServer.stats().notified, 102u);
+        EXPECT_EQ(streamClient.stats().notifications, 100u);
+        EXPECT_EQ(streamClient.stats().unmatched, 0u);
+        const SubscriptionStats stats = fixture.subscriptions.stats();
+        EXPECT_EQ(stats.topics, 2u);
+        EXPECT_EQ(stats.subscriptions, 2u);
+        EXPECT_EQ(stats.published, 103u);
+        EXPECT_EQ(stats.delivered, 202u);
+    }
+}
+
+TEST(Subscriptions, a_notification_is_serialized_once)
+{
+    Subscriptions                               subscriptions;
+    std::vector<std::shared_ptr<RecordingSink>> sinks;
+    for (int s = 0; s < 3; s++) {
+        sinks.push_back(std::make_shared<RecordingSink>());
+        EXPECT_TRUE(subscriptions.subscribe("ticks", sinks.back()));
+    }
+    EXPECT_FALSE(subscriptions.subscribe("ticks", sinks[0]));
+
+    EXPECT_EQ(subscriptions.publish("ticks", 42), 3u);
+    const SharedMessage& message = sinks[0]->messages.at(0);
+    for (const auto& sink : sinks) {
+        ASSERT_EQ(sink->messages.size(), 1u);
+        EXPECT_EQ(sink->messages[0].get(), message.get());
+    }
+    Json::Value  notification;
+    Json::Reader reader;
+    ASSERT_TRUE(reader.parse(*message, notification));
+    EXPECT_EQ(notification["jsonrpc"].asString(), "2.0");
+    EXPECT_EQ(notification["method"].asString(), "notification");
+    EXPECT_FALSE(notification.isMember("id"));
+    EXPECT_EQ(notification["params"]["topic"].asString(), "ticks");
+    EXPECT_EQ(notification["params"]["data"].asInt(), 42);
+
+    // a sink that's gone is skipped, then pruned
+    sinks.pop_back();
+    EXPECT_EQ(subscriptions.publish("ticks", 43), 2u);
+    EXPECT_EQ(subscriptions.stats().subscriptions, 3u);
+    subscriptions.prune();
+    EXPECT_EQ(subscriptions.stats().subscriptions, 2u);
+    EXPECT_TRUE(subscriptions.unsubscribe("ticks", sinks[0]));
+    EXPECT_TRUE(subscriptions.unsubscribe("ticks", sinks[1]));
+    EXPECT_FALSE(subscriptions.unsubscribe("ticks", sinks[1]));
+    EXPECT_EQ(subscriptions.stats().topics, 0u);
+    EXPECT_EQ(subscriptions.publish("ticks", 44), 0u);
+}
+
+TEST(Subscriptions, publishing_while_subscribing)
+{
+    Subscriptions                               subscriptions;
+    std::vector<std::shared_ptr<RecordingSink>> sinks;
+    for (int s = 0; s < 100; s++) {
+        sinks.push_back(std::make_shared<RecordingSink>());
+    }
+    // the sinks are only given messages by one thread at a time: the publisher, then this one
+    std::atomic<bool> done{false};
+    std::thread       publisher([&]() {
+        while (!done) {
+            subscriptions.publish("ticks", 1);
+        }
+    });
+    for (const auto& sink : sinks) {
+        subscriptions.subscribe("ticks", sink);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    done = true;
+    publisher.join();
+    EXPECT_EQ(subscriptions.publish("ticks", 2), 100u);
+    // every sink got what was published after it subscribed, the first one the most
+    EXPECT_GE(sinks.front()->messages.size(), sinks.back()->messages.size());
+    EXPECT_FALSE(sinks.back()->messages.empty());
+    std::size_t received = 0;
+    for (const auto& sink : sinks) {
+        received += sink->messages.size();
+    }
+    EXPECT_EQ(subscriptions.stats().delivered, received);
+}
+
+TEST(Subscriptions, subscribing_needs_a_connection_that_stays_open)
+{
+    boost::asio::io_context ioContext;
+    Rpc                     rpc(ioContext.get_executor());
+    Subscriptions           subscriptions;
+    subscriptions.install(rpc);
+    std::string response;
+    rpc.setResponseCallback([&response](std::string&& value) { response = std::move(value); });
+
+    rpc.post(R"({"jsonrpc":"2.0","method":"subscribe","params":{"topic":"ticks"},"id":1})");
+    Json::Value  error;
+    Json::Reader reader;
+    ASSERT_TRUE(reader.parse(response, error));
+    EXPECT_EQ(error["error"]["code"].asInt(), -32000);
+
+    rpc.post(R"({"jsonrpc":"2.0","method":"subscribe","params":{"topic":1},"id":2})");
+    ASSERT_TRUE(reader.parse(response, error));
+    EXPECT_EQ(error["error"]["code"].asInt(), -32602);
+}
+
+TEST(Subscriptions, closed_connections_are_skipped)
+{
+    SubscriptionFixture fixture;
+    {
+        auto transport = std::make_shared<StreamClientTransport<tcp>>(fixture.ioContext);
+        transport->connect(fixture.streamServer.localEndpoint());
+        AsyncJsonRPCClient<StreamClientTransport<tcp>> client(transport);
+        EXPECT_TRUE(Call(client, "subscribe", "ticks"));
+        EXPECT_EQ(fixture.subscriptions.publish("ticks", 1), 1u);
+    }
+    // the connection is gone once the server has seen it closed
+    std::size_t delivered = 1;
+    for (int i = 0; i < 500 && delivered > 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        delivered = fixture.subscriptions.publish("ticks", 2);
+    }
+    EXPECT_EQ(delivered, 0u);
+    fixture.subscriptions.prune();
+    EXPECT_EQ(fixture.subscriptions.stats().subscriptions, 0u);
+}
@@ -0,0 +1,233 @@
+#include "gtest/gtest.h"
+
+#include "DescriptorLimit.h"
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCUringServer.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+
+using Rpc         = AsyncJsonRPC<boost::asio::io_context::executor_type, int>;
+using UringServer = AsyncJsonRPCUringServer<Rpc>;
+using tcp         = boost::asio::ip::tcp;
+
+// an rpc and its server; the io_context's thread only runs the fallback. The context of a call is the
+// number of its connection
+struct UringFixture
+{
+    boost::asio::io_context                                                  ioContext;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    Rpc                                                                      rpc;
+    std::atomic<int>                                                         connections{0};
+    UringServer                                                              server;
+    std::thread                                                              thread;
+
+    explicit UringFixture(const UringServerOptions& options)
+        : work(ioContext.get_executor()), rpc(ioContext.get_executor()),
+          server(rpc, ioContext, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+                 [this](const tcp::endpoint&) { return std::make_tuple(++connections); }, options)
+    {
+        rpc.addHandler(
+            [](const Json::Value& request, Json::Value& response, int connection) {
+                response = request["x"].asInt() * 1000 + connection;
+            },
+            "tag", {{"x", Json::ValueType::intValue}});
+        server.start();
+        thread = std::thread([this]() { ioContext.run(); });
+    }
+
+    ~UringFixture()
+    {
+        server.stop();
+        work.reset();
+        ioContext.stop();
+        thread.join();
+    }
+};
+
+struct UringClient
+{
+    boost::asio::io_context ioContext;
+    tcp::socket             socket{ioContext};
+    StreamFramer            framer;
+    Framing                 framing;
+    std::string             buffer;
+
+    UringClient(const tcp::endpoint& server, Framing Framing)
+        : framer(Framing, 1024 * 1024), framing(Framing)
+    {
+        socket.connect(server);
+    }
+
+    void send(const std::string& bytes) { boost::asio::write(socket, boost::asio::buffer(bytes)); }
+
+    std::vector<int> receive(std::size_t count)
+    {
+        std::vector<int> results;
+        char             chunk[4096];
+        while (results.size() < count) {
+            const std::size_t consumed =
+                framer.consume(buffer.data(), buffer.size(), [&](const char* frame, std::size_t size) {
+                    Json::Value  value;
+                    Json::Reader reader;
+                    EXPECT_TRUE(reader.parse(frame, frame + size, value));
+                    results.push_back(value["result"].asInt());
+                });
+            buffer.erase(0, consumed);
+            if (results.size() < count) {
+                buffer.append(chunk, socket.read_some(boost::asio::buffer(chunk)));
+            }
+        }
+        return results;
+    }
+
+    bool closedByServer()
+    {
+        char                      byte;
+        boost::system::error_code ec;
+        socket.read_some(boost::asio::buffer(&byte, 1), ec);
+        return ec == boost::asio::error::eof;
+    }
+};
+
+static std::string Requests(Framing framing, int from, int to, std::size_t padding = 0)
+{
+    std::string bytes;
+    for (int x = from; x <= to; x++) {
+        const std::string request = R"({"jsonrpc": "2.0", "method": "tag", "params": {"x": )" +
+                                    std::to_string(x) + R"(}, "id": 1)" + std::string(padding, ' ') +
+                                    "}";
+        StreamFramer::Encode(framing, request.data(), request.size(), bytes);
+    }
+    return bytes;
+}
+
+// with io_uring where the kernel has it, and with the fallback
+TEST(UringServer, calls_on_many_connections)
+{
+    for (bool forceFallback : {false, true}) {
+        UringServerOptions options;
+        options.forceFallback = forceFallback;
+        UringFixture fixture(options);
+        EXPECT_EQ(fixture.server.usesUring(), !forceFallback && IoUring::Create(8) != nullptr);
+
+        std::vector<std::unique_ptr<UringClient>> clients;
+        for (int c = 0; c < 20; c++) {
+            clients.emplace_back(new UringClient(fixture.server.localEndpoint(), Framing::Ndjson));
+            clients.back()->send(Requests(Framing::Ndjson, 1, 50));
+        }
+        // every connection has a context of its own
+        std::vector<bool> seen(21, false);
+        for (auto& client : clients) {
+            const std::vector<int> results    = client->receive(50);
+            const int              connection = results[0] % 1000;
+            ASSERT_GE(connection, 1);
+            ASSERT_LE(connection, 20);
+            EXPECT_FALSE(seen[connection]);
+            seen[connection] = true;
+            for (int x = 1; x <= 50; x++) {
+                EXPECT_EQ(results[x - 1], x * 1000 + connection);
+            }
+        }
+
+        const UringServerStats stats = fixture.server.stats();
+        EXPECT_EQ(stats.accepted, 20u);
+        EXPECT_EQ(stats.requests, 1000u);
+        EXPECT_LT(stats.reads, stats.requests);
+        if (fixture.server.usesUring()) {
+            // many receives and sends per system call
+            EXPECT_LT(stats.submits, stats.reads + stats.writes);
+        }
+    }
+}
+
+TEST(UringServer, frames_split_between_buffers)
+{
+    for (Framing framing : {Framing::LengthPrefix, Framing::Netstring, Framing::Ndjson}) {
+        UringServerOptions options;
+        options.stream.framing = framing;
+        options.bufferCount    = 4; // fewer than needed: receives end with ENOBUFS, and are rearmed
+        options.bufferSize     = 64;
+        UringFixture fixture(options);
+        UringClient  client(fixture.server.localEndpoint(), framing);
+
+        client.send(Requests(framing, 1, 100) + Requests(framing, 101, 101, 5000));
+        const std::vector<int> results = client.receive(101);
+        for (int x = 1; x <= 101; x++) {
+            EXPECT_EQ(results[x - 1], x * 1000 + 1) << FramingName(framing);
+        }
+    }
+}
+
+TEST(UringServer, responses_not_read_pause_the_receives)
+{
+    UringServerOptions options;
+    options.stream.maxPendingBytes = 1024;
+    UringFixture fixture(options);
+    UringClient  client(fixture.server.localEndpoint(), Framing::Ndjson);
+
+    // more responses than the socket buffers hold, before any is read
+    std::thread writer([&client]() { client.send(Requests(Framing::Ndjson, 1, 20000)); });
+    const std::vector<int> results = client.receive(20000);
+    writer.join();
+    for (int x = 1; x <= 20000; x++) {
+        ASSERT_EQ(results[x - 1], x * 1000 + 1);
+    }
+}
+
+TEST(UringServer, malformed_framing_and_stop_close_the_connections)
+{
+    UringServerOptions options;
+    options.stream.framing = Framing::Netstring;
+    UringFixture fixture(options);
+
+    UringClient malformed(fixture.server.localEndpoint(), Framing::Netstring);
+    malformed.send(Requests(Framing::Netstring, 3, 3) + "not a netstring");
+    EXPECT_EQ(malformed.receive(1), std::vector<int>{3001});
+    EXPECT_TRUE(malformed.closedByServer());
+
+    if (fixture.server.usesUring()) {
+        UringClient idle(fixture.server.localEndpoint(), Framing::Netstring);
+        idle.send(Requests(Framing::Netstring, 4, 4));
+        EXPECT_EQ(idle.receive(1), std::vector<int>{4002});
+        fixture.server.stop();
+        EXPECT_TRUE(idle.closedByServer());
+    }
+}
+
+// the ring's accept is rearmed after a timeout, not at once (see AcceptLoop.accept_errors_back_off)
+TEST(UringServer, accept_errors_back_off)
+{
+    for (bool forceFallback : {false, true}) {
+        UringServerOptions options;
+        options.forceFallback           = forceFallback;
+        options.stream.acceptRetryDelay = std::chrono::milliseconds(20);
+        UringFixture            fixture(options);
+        boost::asio::io_context clientContext;
+        tcp::socket             socket(clientContext);
+        socket.open(tcp::v4());
+
+        DescriptorLimit limit;
+        socket.connect(fixture.server.localEndpoint());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const UringServerStats stats = fixture.server.stats();
+        limit.restore();
+
+        EXPECT_GE(stats.acceptErrors, 1u);
+        EXPECT_LE(stats.acceptErrors, 10u);
+        EXPECT_LE(stats.submits, 20u);
+
+        // and the connection is accepted once descriptors are available again
+        boost::asio::write(socket, boost::asio::buffer(Requests(Framing::Ndjson, 5, 5)));
+        std::string response;
+        boost::asio::read_until(socket, boost::asio::dynamic_buffer(response), '\n');
+        EXPECT_NE(response.find("\"result\":5001"), std::string::npos) << response;
+        EXPECT_EQ(fixture.server.stats().accepted, 1u);
+    }
+}
@@ -0,0 +1,161 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/AsyncJsonRPCWebSocketServer.h"
+#include <set>
+#include <string>
+#include <thread>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core/buffers_to_string.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/websocket/stream.hpp>
+
+using Rpc             = AsyncJsonRPC<boost::asio::io_context::executor_type, std::string>;
+using WebSocketServer = AsyncJsonRPCWebSocketServer<Rpc>;
+using tcp             = boost::asio::ip::tcp;
+namespace http        = boost::beast::http;
+namespace websocket   = boost::beast::websocket;
+
+// an rpc and its websocket server, on a thread of their own; the context of a connection is the user
+// named by the X-User header of its upgrade request
+struct WebSocketFixture
+{
+    boost::asio::io_context ioContext;
+    Rpc                     rpc;
+    WebSocketServer         server;
+    std::thread             thread;
+
+    explicit WebSocketFixture(const WebSocketServerOptions& options = WebSocketServerOptions())
+        : rpc(ioContext.get_executor()),
+          server(rpc, ioContext, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+                 [](const WebSocketServer::UpgradeRequest& upgrade, const tcp::endpoint&) {
+                     return std::make_tuple(std::string(upgrade["X-User"]));
+                 },
+                 options)
+    {
+        rpc.addHandler(
+            [](const Json::Value&, Json::Value& response, std::string user) { response = user; },
+            "whoami");
+        server.start();
+        thread = std::thread([this]() { ioContext.run(); });
+    }
+
+    ~WebSocketFixture()
+    {
+        server.stop();
+        thread.join();
+    }
+};
+
+struct WebSocketClient
+{
+    boost::asio::io_context        ioContext;
+    websocket::stream<tcp::socket> ws{ioContext};
+    boost::beast::flat_buffer      buffer;
+
+    WebSocketClient(const tcp::endpoint& server, const std::string& user)
+    {
+        ws.next_layer().connect(server);
+        ws.set_option(websocket::stream_base::decorator(
+            [user](websocket::request_type& request) { request.set("X-User", user); }));
+        ws.handshake("localhost", "/");
+        ws.text(true);
+    }
+
+    void send(const std::string& text) { ws.write(boost::asio::buffer(text)); }
+
+    Json::Value receive()
+    {
+        buffer.consume(buffer.size());
+        ws.read(buffer);
+        Json::Value  value;
+        Json::Reader reader;
+        EXPECT_TRUE(reader.parse(boost::beast::buffers_to_string(buffer.data()), value));
+        return value;
+    }
+};
+
+static std::string WhoAmI(int id)
+{
+    return R"({"jsonrpc": "2.0", "method": "whoami", "id": )" + std::to_string(id) + "}";
+}
+
+TEST(WebSocketServer, context_from_the_upgrade_request)
+{
+    WebSocketFixture fixture;
+    WebSocketClient  alice(fixture.server.localEndpoint(), "alice");
+    WebSocketClient  bob(fixture.server.localEndpoint(), "bob");
+
+    for (int i = 0; i < 3; i++) {
+        alice.send(WhoAmI(i));
+        bob.send(WhoAmI(i));
+    }
+    for (int i = 0; i < 3; i++) {
+        const Json::Value a = alice.receive();
+        EXPECT_EQ(a["result"].asString(), "alice");
+        EXPECT_EQ(a["id"].asInt(), i);
+        const Json::Value b = bob.receive();
+        EXPECT_EQ(b["result"].asString(), "bob");
+        EXPECT_EQ(b["id"].asInt(), i);
+    }
+
+    const WebSocketServerStats stats = fixture.server.stats();
+    EXPECT_EQ(stats.accepted, 2u);
+    EXPECT_EQ(stats.messages, 6u);
+    EXPECT_EQ(stats.frames, 6u); // no coalescing by default
+}
+
+TEST(WebSocketServer, coalesces_queued_responses)
+{
+    WebSocketServerOptions options;
+    options.coalesceResponses = true;
+
+    WebSocketFixture fixture(options);
+    WebSocketClient  client(fixture.server.localEndpoint(), "carol");
+
+    const int         calls = 200;
+    const std::string batch = "[" + WhoAmI(-1) + "," + WhoAmI(-2) + "]";
+    client.send(batch);
+    for (int i = 0; i < calls; i++) {
+        client.send(WhoAmI(i));
+    }
+
+    // every response arrives once, alone or in an array
+    std::set<int> ids;
+    while (ids.size() < calls + 2u) {
+        const Json::Value value = client.receive();
+        if (value.isArray()) {
+            for (const Json::Value& response : value) {
+                EXPECT_EQ(response["result"].asString(), "carol");
+                EXPECT_TRUE(ids.insert(response["id"].asInt()).second);
+            }
+        } else {
+            EXPECT_EQ(value["result"].asString(), "carol");
+            EXPECT_TRUE(ids.insert(value["id"].asInt()).second);
+        }
+    }
+    EXPECT_EQ(ids.count(-1), 1u);
+    EXPECT_EQ(ids.count(calls - 1), 1u);
+
+    const WebSocketServerStats stats = fixture.server.stats();
+    EXPECT_EQ(stats.messages, calls + 1u);
+    EXPECT_LE(stats.frames, stats.messages);
+}
+
+TEST(WebSocketServer, refuses_plain_http)
+{
+    WebSocketFixture        fixture;
+    boost::asio::io_context clientContext;
+    tcp::socket             socket(clientContext);
+    socket.connect(fixture.server.localEndpoint());
+    const std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    boost::asio::write(socket, boost::asio::buffer(request));
+
+    boost::beast::flat_buffer         buffer;
+    http::response<http::string_body> response;
+    http::read(socket, buffer, response);
+    EXPECT_EQ(response.result(), http::status::upgrade_required);
+    EXPECT_EQ(fixture.server.stats().accepted, 0u);
+}
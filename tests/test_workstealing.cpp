@@ -0,0 +1,156 @@
+#include "gtest/gtest.h"
+
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/WorkStealingThreadPool.h"
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+TEST(WorkStealingThreadPool, runs_posted_tasks)
+{
+    WorkStealingThreadPool pool(4);
+    std::atomic<int>       count{0};
+
+    const int taskCount = 10000;
+    for (int i = 0; i < taskCount; i++) {
+        pool.get_executor().post([&count]() { count++; }, std::allocator<char>());
+    }
+    pool.join();
+
+    EXPECT_EQ(count.load(), taskCount);
+}
+
+TEST(WorkStealingThreadPool, tasks_posted_from_workers_get_stolen)
+{
+    WorkStealingThreadPool::Options options;
+    options.threadCount   = 4;
+    options.dequeCapacity = 16; // small, to exercise the overflow into the injection queue
+    WorkStealingThreadPool pool(options);
+
+    std::mutex                            idsMutex;
+    std::set<std::thread::id>             threadIds;
+    std::atomic<int>                      count{0};
+    WorkStealingThreadPool::executor_type executor = pool.get_executor();
+
+    // a single task fans out many others into its worker's deque, so the other workers can only get
+    // them by stealing (or from the injection queue, once the deque overflows)
+    const int fanOut = 2000;
+    executor.post(
+        [&]() {
+            for (int i = 0; i < fanOut; i++) {
+                executor.post(
+                    [&]() {
+                        std::this_thread::sleep_for(std::chrono::microseconds(10));
+                        std::lock_guard<std::mutex> lg(idsMutex);
+                        threadIds.insert(std::this_thread::get_id());
+                        count++;
+                    },
+                    std::allocator<char>());
+            }
+        },
+        std::allocator<char>());
+    pool.join();
+
+    EXPECT_EQ(count.load(), fanOut);
+    EXPECT_GT(threadIds.size(), 1u);
+}
+
+TEST(WorkStealingThreadPool, a_throwing_task_does_not_stop_its_worker)
+{
+    WorkStealingThreadPool::Options options;
+    options.threadCount = 1;
+    std::atomic<int> exceptions{0};
+    options.onException = [&exceptions](std::exception_ptr e) {
+        EXPECT_THROW(std::rethrow_exception(e), std::runtime_error);
+        exceptions++;
+    };
+    WorkStealingThreadPool pool(options);
+    std::atomic<int>       count{0};
+
+    for (int i = 0; i < 100; i++) {
+        pool.get_executor().post(
+            [&count, i]() {
+                if (i % 10 == 0) {
+                    throw std::runtime_error("task failed");
+                }
+                count++;
+            },
+            std::allocator<char>());
+    }
+    pool.join();
+
+    EXPECT_EQ(exceptions.load(), 10);
+    EXPECT_EQ(count.load(), 90);
+}
+
+// a worker can't join its own thread
+TEST(WorkStealingThreadPool, stop_from_a_worker_throws)
+{
+    WorkStealingThreadPool pool(2);
+    std::promise<bool>     threw;
+    pool.get_executor().post(
+        [&pool, &threw]() {
+            try {
+                pool.stop();
+                threw.set_value(false);
+            } catch (const std::logic_error&) {
+                threw.set_value(true);
+            }
+        },
+        std::allocator<char>());
+    EXPECT_TRUE(threw.get_future().get());
+    pool.join();
+}
+
+TEST(WorkStealingThreadPool, dispatch_runs_inline_on_workers)
+{
+    WorkStealingThreadPool                pool(2);
+    WorkStealingThreadPool::executor_type executor = pool.get_executor();
+
+    std::promise<bool> ranInline;
+    executor.post(
+        [&]() {
+            bool done = false;
+            executor.dispatch([&done]() { done = true; }, std::allocator<char>());
+            ranInline.set_value(done);
+        },
+        std::allocator<char>());
+
+    EXPECT_TRUE(ranInline.get_future().get());
+    EXPECT_FALSE(executor.running_in_this_thread());
+    pool.join();
+}
+
+TEST(WorkStealingThreadPool, as_rpc_executor)
+{
+    WorkStealingThreadPool                                           pool(4);
+    AsyncJsonRPC<WorkStealingThreadPool::executor_type, std::string> rpc(pool.get_executor());
+
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response, std::string str) {
+            EXPECT_EQ(str, "TheString");
+            response = Json::Value(request["p1"].asInt() * 3);
+        },
+        "testmethod1", {{"p1", Json::ValueType::intValue}});
+
+    std::atomic<int> sum{0};
+    rpc.setResponseCallback([&sum](std::string&& res) {
+        Json::Reader reader;
+        Json::Value  val;
+        reader.parse(res, val);
+        sum += val["result"].asInt();
+    });
+
+    const int callCount = 500;
+    for (int i = 0; i < callCount; i++) {
+        rpc.asyncPost(R"({"jsonrpc": "2.0", "method": "testmethod1", "params": {"p1": 1}, "id": 4})",
+                      "TheString");
+    }
+    pool.join();
+
+    EXPECT_EQ(sum.load(), 3 * callCount);
+}
@@ -0,0 +1,507 @@
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/Interceptors.h"
+#include "include/asyncjsonrpc/RpcMetrics.h"
+#include "include/asyncjsonrpc/WorkStealingThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+// Drives an in-process AsyncJsonRPC with a mix of requests from N producer threads and reports the
+// latency distribution and throughput.
+//
+// open loop:   every producer sends at a constant rate, whether earlier requests completed or not.
+//              Latency is measured from the time a request was scheduled to be sent, not from the time
+//              it actually was, so a stalled system is charged for the requests it delayed
+//              (coordinated-omission correction).
+// closed loop: every producer keeps a fixed number of requests outstanding. With
+//              --expected-interval-us, latencies longer than the interval are corrected by adding the
+//              samples a constant-rate client would have seen while waiting.
+
+using Clock = std::chrono::steady_clock;
+
+static std::uint64_t ToNanoseconds(Clock::duration d)
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+struct LoadOptions
+{
+    std::string mode                   = "open";
+    double      rate                   = 10000; // requests per second, all producers (open loop)
+    std::size_t concurrency            = 1;     // outstanding requests per producer (closed loop)
+    std::size_t producers              = 1;
+    std::size_t workers                = std::max(1u, std::thread::hardware_concurrency());
+    std::string executor               = "io_context";
+    double      duration               = 10;
+    double      warmup                 = 1;
+    std::string requestsFile           = "";
+    std::string mix                    = "echo=70,sum=20,spin=5,invalid=5";
+    std::size_t payloadSize            = 64;
+    std::size_t spinMicros             = 20;
+    double      expectedIntervalMicros = 0;
+    unsigned    seed                   = 1;
+};
+
+static void PrintUsage()
+{
+    std::cout
+        << "usage: asyncjsonrpc_loadgen [options]\n"
+           "  --mode=open|closed            constant rate, or a fixed number of outstanding requests\n"
+           "  --rate=R                      open loop: total requests per second\n"
+           "  --concurrency=C               closed loop: outstanding requests per producer\n"
+           "  --producers=N                 producer threads\n"
+           "  --workers=N                   executor threads\n"
+           "  --executor=io_context|work-stealing\n"
+           "  --duration=S --warmup=S       measured seconds, and seconds discarded before that\n"
+           "  --requests=FILE               requests to send, one json request per line (cycled)\n"
+           "  --mix=echo=70,sum=20,...      generated requests, by weight: echo (payload-size bytes),\n"
+           "                                sum (20 ints by position), spin (busy handler), invalid\n"
+           "                                (unknown method), malformed (parse error)\n"
+           "  --payload-size=B --spin-us=U  size of echo payloads, time spent in spin handlers\n"
+           "  --expected-interval-us=U      closed loop: coordinated-omission correction interval\n"
+           "  --seed=S                      seed of the generated mix\n";
+}
+
+static LoadOptions ParseOptions(int argc, char** argv)
+{
+    LoadOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            std::exit(0);
+        }
+        const std::size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            throw std::invalid_argument("Invalid argument: " + arg);
+        }
+        const std::string key   = arg.substr(2, eq - 2);
+        const std::string value = arg.substr(eq + 1);
+        if (key == "mode") {
+            options.mode = value;
+        } else if (key == "rate") {
+            options.rate = std::stod(value);
+        } else if (key == "concurrency") {
+            options.concurrency = std::stoul(value);
+        } else if (key == "producers") {
+            options.producers = std::stoul(value);
+        } else if (key == "workers") {
+            options.workers = std::stoul(value);
+        } else if (key == "executor") {
+            options.executor = value;
+        } else if (key == "duration") {
+            options.duration = std::stod(value);
+        } else if (key == "warmup") {
+            options.warmup = std::stod(value);
+        } else if (key == "requests") {
+            options.requestsFile = value;
+        } else if (key == "mix") {
+            options.mix = value;
+        } else if (key == "payload-size") {
+            options.payloadSize = std::stoul(value);
+        } else if (key == "spin-us") {
+            options.spinMicros = std::stoul(value);
+        } else if (key == "expected-interval-us") {
+            options.expectedIntervalMicros = std::stod(value);
+        } else if (key == "seed") {
+            options.seed = static_cast<unsigned>(std::stoul(value));
+        } else {
+            throw std::invalid_argument("Unknown option: --" + key);
+        }
+    }
+    if (options.mode != "open" && options.mode != "closed") {
+        throw std::invalid_argument("--mode must be open or closed");
+    }
+    if (options.producers == 0 || options.workers == 0 || options.concurrency == 0 ||
+        options.rate <= 0) {
+        throw std::invalid_argument("--producers, --workers, --concurrency and --rate must be positive");
+    }
+    return options;
+}
+
+static std::vector<std::string> ReadRequests(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + fileName);
+    }
+    std::vector<std::string> requests;
+    std::string              line;
+    while (std::getline(file, line)) {
+        if (line.find_first_not_of(" \t\r") != std::string::npos) {
+            requests.push_back(line);
+        }
+    }
+    if (requests.empty()) {
+        throw std::runtime_error(fileName + " has no requests");
+    }
+    return requests;
+}
+
+static std::vector<std::string> GenerateRequests(const LoadOptions& options)
+{
+    std::vector<std::pair<std::string, double>> weights;
+    std::stringstream                           mix(options.mix);
+    std::string                                 entry;
+    while (std::getline(mix, entry, ',')) {
+        const std::size_t eq = entry.find('=');
+        if (eq == std::string::npos) {
+            throw std::invalid_argument("Invalid --mix entry: " + entry);
+        }
+        weights.emplace_back(entry.substr(0, eq), std::stod(entry.substr(eq + 1)));
+    }
+
+    std::vector<double> weightValues;
+    for (const auto& w : weights) {
+        weightValues.push_back(w.second);
+    }
+    std::mt19937                    random(options.seed);
+    std::discrete_distribution<int> pick(weightValues.begin(), weightValues.end());
+
+    const std::string payload(options.payloadSize, 'x');
+    std::string       sumParams = "[";
+    for (int i = 0; i < 20; i++) {
+        sumParams += (i > 0 ? ", " : "") + std::to_string(i);
+    }
+    sumParams += "]";
+
+    std::vector<std::string> requests;
+    for (int id = 1; id <= 1000; id++) {
+        const std::string& kind = weights[static_cast<std::size_t>(pick(random))].first;
+        const std::string  head = R"({"jsonrpc": "2.0", "id": )" + std::to_string(id) + ", ";
+        if (kind == "echo") {
+            requests.push_back(head + R"("method": "echo", "params": {"data": ")" + payload + "\"}}");
+        } else if (kind == "sum") {
+            requests.push_back(head + R"("method": "sum", "params": )" + sumParams + "}");
+        } else if (kind == "spin") {
+            requests.push_back(head + R"("method": "spin"})");
+        } else if (kind == "invalid") {
+            requests.push_back(head + R"("method": "nosuchmethod"})");
+        } else if (kind == "malformed") {
+            requests.push_back(head + R"("method": "ec)");
+        } else {
+            throw std::invalid_argument("Unknown request kind in --mix: " + kind);
+        }
+    }
+    return requests;
+}
+
+// travels with every request as its context
+struct RequestStamp
+{
+    std::size_t       producer;
+    Clock::time_point intendedStart; // when the request was scheduled to be sent
+    Clock::time_point actualStart;
+};
+
+struct LatencyRecorder
+{
+    LatencyHistogram corrected;
+    LatencyHistogram service; // from the actual send time; what a naive client would measure
+    std::uint64_t    completed = 0;
+    std::uint64_t    errors    = 0;
+};
+
+class LoadState
+{
+    // padded, so producers don't share cache lines
+    struct ProducerState
+    {
+        std::atomic<std::size_t> outstanding{0};
+        char                     padding[64 - sizeof(std::atomic<std::size_t>)];
+    };
+
+    std::vector<std::unique_ptr<ProducerState>>   producerStates;
+    std::mutex                                    recordersMutex;
+    std::vector<std::unique_ptr<LatencyRecorder>> recorders;
+    std::uint64_t                                 expectedIntervalNs;
+
+    LatencyRecorder& localRecorder()
+    {
+        // a recorder per completing thread, so recording takes no lock; merged after the run
+        static thread_local std::map<const LoadState*, LatencyRecorder*> recorderOfThread;
+        LatencyRecorder*& recorder = recorderOfThread[this];
+        if (!recorder) {
+            std::lock_guard<std::mutex> lock(recordersMutex);
+            recorders.emplace_back(new LatencyRecorder);
+            recorder = recorders.back().get();
+        }
+        return *recorder;
+    }
+
+public:
+    Clock::time_point measureStart;
+    Clock::time_point measureEnd;
+
+    LoadState(std::size_t producerCount, double expectedIntervalMicros)
+        : expectedIntervalNs(static_cast<std::uint64_t>(expectedIntervalMicros * 1000))
+    {
+        for (std::size_t i = 0; i < producerCount; i++) {
+            producerStates.emplace_back(new ProducerState);
+        }
+    }
+
+    std::size_t outstanding(std::size_t producer) const
+    {
+        return producerStates[producer]->outstanding.load(std::memory_order_acquire);
+    }
+
+    void sent(std::size_t producer) { producerStates[producer]->outstanding.fetch_add(1); }
+
+    void completed(const RequestStamp& stamp, const std::string& response)
+    {
+        const Clock::time_point now = Clock::now();
+        if (stamp.intendedStart >= measureStart && stamp.intendedStart < measureEnd) {
+            LatencyRecorder&    recorder = localRecorder();
+            const std::uint64_t latency  = ToNanoseconds(now - stamp.intendedStart);
+            recorder.corrected.record(latency);
+            // the samples a constant-rate client would have recorded while this one was stuck
+            if (expectedIntervalNs > 0) {
+                for (std::uint64_t missed = expectedIntervalNs; missed < latency;
+                     missed += expectedIntervalNs) {
+                    recorder.corrected.record(latency - missed);
+                }
+            }
+            recorder.service.record(ToNanoseconds(now - stamp.actualStart));
+            recorder.completed++;
+            if (response.find("\"error\"") != std::string::npos) {
+                recorder.errors++;
+            }
+        }
+        producerStates[stamp.producer]->outstanding.fetch_sub(1, std::memory_order_release);
+    }
+
+    // call once every completion ran
+    LatencyRecorder merged()
+    {
+        LatencyRecorder             result;
+        std::lock_guard<std::mutex> lock(recordersMutex);
+        for (const auto& r : recorders) {
+            result.corrected.merge(r->corrected);
+            result.service.merge(r->service);
+            result.completed += r->completed;
+            result.errors += r->errors;
+        }
+        return result;
+    }
+};
+
+struct LatencyInterceptor : public RpcInterceptor
+{
+    LoadState* state;
+
+    explicit LatencyInterceptor(LoadState* State) : state(State) {}
+
+    void onSend(std::string& response, const RequestStamp& stamp) { state->completed(stamp, response); }
+};
+
+template <typename Executor>
+using LoadRpc = AsyncJsonRPC<Executor, Interceptors<LatencyInterceptor>, RequestStamp>;
+
+template <typename Executor>
+static void AddHandlers(LoadRpc<Executor>& rpc, const LoadOptions& options)
+{
+    rpc.addHandler([](const Json::Value& request, Json::Value& response,
+                      RequestStamp) { response = request["data"]; },
+                   "echo", {{"data", Json::ValueType::stringValue}});
+    rpc.addHandler(
+        [](const Json::Value& request, Json::Value& response, RequestStamp) {
+            int sum = 0;
+            for (const Json::Value& v : request) {
+                sum += v.asInt();
+            }
+            response = sum;
+        },
+        "sum", std::vector<Json::ValueType>(20, Json::ValueType::intValue));
+    const std::chrono::microseconds spinTime(options.spinMicros);
+    rpc.addHandler(
+        [spinTime](const Json::Value&, Json::Value& response, RequestStamp) {
+            const Clock::time_point end = Clock::now() + spinTime;
+            while (Clock::now() < end) {
+            }
+            response = true;
+        },
+        "spin");
+}
+
+static void WaitUntil(Clock::time_point t)
+{
+    // sleeping is too coarse for short intervals; spin for the last stretch
+    const Clock::duration spinThreshold = std::chrono::microseconds(100);
+    Clock::time_point     now           = Clock::now();
+    if (t - now > spinThreshold) {
+        std::this_thread::sleep_until(t - spinThreshold);
+    }
+    while (Clock::now() < t) {
+        std::this_thread::yield();
+    }
+}
+
+template <typename Executor>
+static void Produce(LoadRpc<Executor>& rpc, LoadState& state, const LoadOptions& options,
+                    const std::vector<std::string>& requests, std::size_t producer,
+                    Clock::time_point start, Clock::time_point end)
+{
+    std::size_t next = producer * requests.size() / options.producers;
+
+    if (options.mode == "open") {
+        const Clock::duration interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(static_cast<double>(options.producers) / options.rate));
+        // producers are staggered within one interval
+        Clock::time_point intended = start + interval * static_cast<Clock::rep>(producer) /
+                                                 static_cast<Clock::rep>(options.producers);
+        for (; intended < end; intended += interval) {
+            WaitUntil(intended);
+            state.sent(producer);
+            rpc.asyncPost(requests[next], RequestStamp{producer, intended, Clock::now()});
+            next = (next + 1) % requests.size();
+        }
+    } else {
+        for (Clock::time_point now = Clock::now(); now < end; now = Clock::now()) {
+            if (state.outstanding(producer) >= options.concurrency) {
+                std::this_thread::yield();
+                continue;
+            }
+            state.sent(producer);
+            rpc.asyncPost(requests[next], RequestStamp{producer, now, now});
+            next = (next + 1) % requests.size();
+        }
+    }
+}
+
+static void PrintLatencies(const char* name, const LatencyHistogram& histogram)
+{
+    std::printf("%-30s p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us\n", name,
+                static_cast<double>(histogram.percentile(0.5)) / 1000,
+                static_cast<double>(histogram.percentile(0.9)) / 1000,
+                static_cast<double>(histogram.percentile(0.99)) / 1000,
+                static_cast<double>(histogram.percentile(0.999)) / 1000,
+                static_cast<double>(histogram.maxValue()) / 1000);
+}
+
+template <typename Runner>
+static void RunLoad(Runner& runner, const LoadOptions& options, const std::vector<std::string>& requests)
+{
+    using Executor = typename Runner::executor_type;
+
+    LoadState         state(options.producers, options.expectedIntervalMicros);
+    LoadRpc<Executor> rpc(runner.get_executor(),
+                          Interceptors<LatencyInterceptor>(LatencyInterceptor(&state)));
+    AddHandlers(rpc, options);
+
+    const Clock::time_point start = Clock::now() + std::chrono::milliseconds(10);
+    state.measureStart = start + std::chrono::duration_cast<Clock::duration>(
+                                     std::chrono::duration<double>(options.warmup));
+    state.measureEnd   = state.measureStart + std::chrono::duration_cast<Clock::duration>(
+                                              std::chrono::duration<double>(options.duration));
+
+    std::vector<std::thread> producers;
+    for (std::size_t p = 0; p < options.producers; p++) {
+        producers.emplace_back([&, p]() {
+            Produce(rpc, state, options, requests, p, start, state.measureEnd);
+        });
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    runner.join();
+
+    const LatencyRecorder result = state.merged();
+    std::printf("%s loop, %zu producers, %zu %s workers, %.1f s measured after %.1f s warm-up\n",
+                options.mode.c_str(), options.producers, options.workers, options.executor.c_str(),
+                options.duration, options.warmup);
+    if (options.mode == "open") {
+        std::printf("target rate %.0f/s\n", options.rate);
+    } else {
+        std::printf("%zu outstanding per producer\n", options.concurrency);
+    }
+    std::printf("completed %llu, errors %llu, throughput %.0f/s\n",
+                static_cast<unsigned long long>(result.completed),
+                static_cast<unsigned long long>(result.errors),
+                static_cast<double>(result.completed) / options.duration);
+    PrintLatencies("latency (corrected)", result.corrected);
+    PrintLatencies("latency (from actual send)", result.service);
+}
+
+class IoContextRunner
+{
+    boost::asio::io_context                                                  context;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    std::vector<std::thread>                                                 threads;
+
+public:
+    using executor_type = boost::asio::io_context::executor_type;
+
+    explicit IoContextRunner(std::size_t threadCount)
+        : context(static_cast<int>(threadCount)), work(boost::asio::make_work_guard(context))
+    {
+        for (std::size_t i = 0; i < threadCount; i++) {
+            threads.emplace_back([this]() { context.run(); });
+        }
+    }
+    ~IoContextRunner() { join(); }
+    executor_type get_executor() { return context.get_executor(); }
+
+    // runs what's queued, then stops the threads
+    void join()
+    {
+        work.reset();
+        for (auto& t : threads) {
+            t.join();
+        }
+        threads.clear();
+    }
+};
+
+class WorkStealingRunner
+{
+    WorkStealingThreadPool pool;
+
+public:
+    using executor_type = WorkStealingThreadPool::executor_type;
+
+    explicit WorkStealingRunner(std::size_t threadCount) : pool(threadCount) {}
+    executor_type get_executor() { return pool.get_executor(); }
+    void          join() { pool.join(); }
+};
+
+int main(int argc, char** argv)
+{
+    try {
+        const LoadOptions              options = ParseOptions(argc, argv);
+        const std::vector<std::string> requests = options.requestsFile.empty()
+                                                      ? GenerateRequests(options)
+                                                      : ReadRequests(options.requestsFile);
+
+        if (options.executor == "io_context") {
+            IoContextRunner runner(options.workers);
+            RunLoad(runner, options, requests);
+        } else if (options.executor == "work-stealing") {
+            WorkStealingRunner runner(options.workers);
+            RunLoad(runner, options, requests);
+        } else {
+            throw std::invalid_argument("--executor must be io_context or work-stealing");
+        }
+    } catch (std::exception& ex) {
+        std::cerr << ex.what() << "\n";
+        PrintUsage();
+        return 1;
+    }
+    return 0;
+}
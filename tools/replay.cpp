@@ -0,0 +1,228 @@
+#include "include/asyncjsonrpc/AsyncJsonRPC.h"
+#include "include/asyncjsonrpc/TrafficCapture.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+// Replays a capture file written by AsyncJsonRPC::enableCapture() against an in-process AsyncJsonRPC,
+// at the original pace or faster, and reports the throughput. The handlers are stand-ins that echo
+// their params: one is registered for every method of the capture, with the names (or positions) and
+// types of its params there, so the replay exercises parsing, validation, dispatch and serialization
+// with the production request shapes, not the production handlers. A method called with params of
+// several shapes can't be declared with all of them: it's registered without params, and its
+// stand-in, which gets none, answers null. The context of every call is the context key of its record.
+
+using Clock = std::chrono::steady_clock;
+
+using ReplayRpc = AsyncJsonRPC<boost::asio::io_context::executor_type, std::uint64_t>;
+
+struct ReplayOptions
+{
+    std::string fileName;
+    double      speed   = 1; // 0: as fast as possible
+    std::size_t workers = 0; // 0: post() on the replaying thread
+    std::size_t repeat  = 1;
+};
+
+static void PrintUsage()
+{
+    std::cout << "usage: asyncjsonrpc_replay [options] FILE\n"
+                 "  --speed=X    1 keeps the original pace, 2 is twice as fast, 0 as fast as possible\n"
+                 "  --workers=N  asyncPost() on N executor threads; 0 (default) post() synchronously\n"
+                 "  --repeat=N   replay the capture N times\n";
+}
+
+static ReplayOptions ParseOptions(int argc, char** argv)
+{
+    ReplayOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            PrintUsage();
+            std::exit(0);
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            options.fileName = arg;
+            continue;
+        }
+        const std::size_t eq = arg.find('=');
+        if (eq == std::string::npos) {
+            throw std::invalid_argument("Invalid argument: " + arg);
+        }
+        const std::string key   = arg.substr(2, eq - 2);
+        const std::string value = arg.substr(eq + 1);
+        if (key == "speed") {
+            options.speed = std::stod(value);
+        } else if (key == "workers") {
+            options.workers = std::stoul(value);
+        } else if (key == "repeat") {
+            options.repeat = std::stoul(value);
+        } else {
+            throw std::invalid_argument("Unknown option: --" + key);
+        }
+    }
+    if (options.fileName.empty()) {
+        throw std::invalid_argument("No capture file given");
+    }
+    return options;
+}
+
+// the params of a call: by name or by position, with their types
+struct ParamsShape
+{
+    bool                                   byPosition = false;
+    std::map<std::string, Json::ValueType> names;
+    std::vector<Json::ValueType>           positions;
+
+    bool operator==(const ParamsShape& other) const
+    {
+        return byPosition == other.byPosition && names == other.names && positions == other.positions;
+    }
+};
+
+struct MethodShape
+{
+    ParamsShape params;
+    bool        varies = false; // calls with params of several shapes, or neither an object nor an array
+};
+
+static bool ShapeOf(const Json::Value& call, ParamsShape& shape)
+{
+    if (!call.isMember("params")) {
+        return true;
+    }
+    const Json::Value& params = call["params"];
+    if (params.isObject()) {
+        for (Json::Value::const_iterator it = params.begin(); it != params.end(); it++) {
+            shape.names[it.key().asString()] = it->type();
+        }
+        return true;
+    }
+    if (params.isArray()) {
+        shape.byPosition = true;
+        for (const Json::Value& param : params) {
+            shape.positions.push_back(param.type());
+        }
+        return true;
+    }
+    return false;
+}
+
+// the methods called in the capture, including the calls of batches, with the shape of their params
+static std::map<std::string, MethodShape> CollectMethods(TrafficCaptureReader& reader)
+{
+    std::map<std::string, MethodShape> methods;
+    CapturedRequest                    request;
+    Json::Reader                       jsonReader;
+    while (reader.next(request)) {
+        Json::Value root;
+        if (!jsonReader.parse(request.data, request.data + request.size, root, false)) {
+            continue;
+        }
+        Json::Value calls = root;
+        if (!root.isArray()) {
+            calls = Json::Value(Json::arrayValue);
+            calls.append(root);
+        }
+        for (const Json::Value& call : calls) {
+            if (!call.isObject() || !call["method"].isString()) {
+                continue;
+            }
+            ParamsShape  shape;
+            const bool   valid  = ShapeOf(call, shape);
+            const auto   found  = methods.emplace(call["method"].asString(), MethodShape());
+            MethodShape& method = found.first->second;
+            if (found.second) {
+                method.params = std::move(shape);
+                method.varies = !valid;
+            } else if (!valid || !(method.params == shape)) {
+                method.varies = true;
+            }
+        }
+    }
+    reader.rewind();
+    return methods;
+}
+
+int main(int argc, char** argv)
+{
+    try {
+        const ReplayOptions     options = ParseOptions(argc, argv);
+        TrafficCaptureReader    reader(options.fileName);
+        boost::asio::io_context executionContext(std::max(1, static_cast<int>(options.workers)));
+        ReplayRpc               rpc(executionContext.get_executor());
+
+        const std::map<std::string, MethodShape> methods = CollectMethods(reader);
+        std::size_t                              varying = 0;
+        for (const auto& method : methods) {
+            auto echo = [](const Json::Value& params, Json::Value& response, std::uint64_t) {
+                response = params;
+            };
+            const ParamsShape& params = method.second.params;
+            if (method.second.varies) {
+                rpc.addHandler(echo, method.first);
+                varying++;
+            } else if (params.byPosition) {
+                rpc.addHandler(echo, method.first, params.positions);
+            } else {
+                rpc.addHandler(echo, method.first, params.names);
+            }
+        }
+        std::atomic<std::size_t> responseBytes{0};
+        rpc.setResponseCallback([&](std::string&& response) {
+            responseBytes.fetch_add(response.size(), std::memory_order_relaxed);
+        });
+
+        auto                     work = boost::asio::make_work_guard(executionContext);
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < options.workers; i++) {
+            threads.emplace_back([&executionContext]() { executionContext.run(); });
+        }
+
+        std::size_t       submitted = 0;
+        std::size_t       bytes     = 0;
+        Clock::time_point start     = Clock::now();
+        for (std::size_t i = 0; i < options.repeat; i++) {
+            submitted += ReplayTrafficCapture(
+                reader,
+                [&](const CapturedRequest& request) {
+                    bytes += request.size;
+                    if (options.workers == 0) {
+                        rpc.post(request.toString(), request.contextKey);
+                    } else {
+                        rpc.asyncPost(request.toString(), request.contextKey);
+                    }
+                },
+                options.speed);
+            reader.rewind();
+        }
+        work.reset();
+        for (auto& t : threads) {
+            t.join();
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::printf("methods:   %zu (%zu with params of several shapes, answered null)\n", methods.size(),
+                    varying);
+        std::printf("requests:  %zu\n", submitted);
+        std::printf("bytes:     %zu in, %zu out\n", bytes, responseBytes.load());
+        std::printf("duration:  %.3f s\n", seconds);
+        std::printf("rate:      %.0f req/s, %.1f MB/s\n", submitted / seconds, bytes / seconds / 1e6);
+    } catch (std::exception& ex) {
+        std::cerr << ex.what() << "\n";
+        PrintUsage();
+        return 1;
+    }
+    return 0;
+}